@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Frustum.h"
+
+/**
+ * @brief An axis-aligned box, given by its corners.
+ */
+struct Aabb {
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+/**
+ * @brief The distance along the ray origin + t * direction at which it enters the box, given
+ * 1 / direction; or infinity if it misses the box within 0 <= t <= maxDistance.
+ */
+float rayEntry(const Aabb& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance);
+
+/**
+ * @brief A dynamic bounding volume hierarchy: a binary tree of axis-aligned boxes whose leaves
+ * ("proxies") each hold one user value, such as an object's index.
+ *
+ * Leaves are inserted next to the sibling that grows the tree's surface area the least, and the
+ * tree is kept balanced by rotations, so queries stay logarithmic as proxies come and go. Each
+ * leaf's box is enlarged by a margin around the bounds it was given, so a proxy that moves a
+ * little stays where it is; only one that leaves its enlarged box is removed and reinserted.
+ */
+class AabbTree {
+public:
+	static constexpr int32_t NULL_NODE = -1;
+
+	/**
+	 * @brief Adds a proxy with the given bounds, and returns its id.
+	 */
+	int32_t createProxy(const Aabb& bounds, uint32_t userData);
+	void destroyProxy(int32_t proxy);
+
+	/**
+	 * @brief Gives a proxy new bounds. Returns true if it had to be reinserted, or false if
+	 * the bounds still fit in its enlarged box.
+	 */
+	bool moveProxy(int32_t proxy, const Aabb& bounds);
+
+	uint32_t getUserData(int32_t proxy) const;
+	// The enlarged box the tree keeps for a proxy, which contains its bounds.
+	const Aabb& getFatBounds(int32_t proxy) const;
+
+	/**
+	 * @brief Appends the user data of every proxy whose enlarged box may be in the frustum.
+	 */
+	void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& results) const;
+	/**
+	 * @brief Appends the user data of every proxy whose enlarged box overlaps the given box.
+	 */
+	void queryBox(const Aabb& box, std::vector<uint32_t>& results) const;
+	/**
+	 * @brief Visits the proxies whose enlarged boxes the ray origin + t * direction hits with
+	 * 0 <= t <= maxDistance, roughly nearest first. The visitor returns the new maxDistance,
+	 * e.g. the distance to an exact hit it found, to skip everything farther away.
+	 */
+	void raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+		const std::function<float(uint32_t userData, float maxDistance)>& visitor) const;
+
+	size_t getProxyCount() const;
+	// The number of levels below the root; 0 for a tree of one proxy.
+	int32_t getHeight() const;
+
+private:
+	struct Node {
+		Aabb bounds;
+		// Also links the free list, for unused nodes.
+		int32_t parent;
+		int32_t child1;
+		int32_t child2;
+		// 0 for leaves; -1 for unused nodes.
+		int32_t height;
+		uint32_t userData;
+
+		bool isLeaf() const { return child1 == NULL_NODE; }
+	};
+
+	std::vector<Node> m_nodes;
+	int32_t m_root = NULL_NODE;
+	int32_t m_freeList = NULL_NODE;
+	size_t m_proxyCount = 0;
+
+	int32_t allocateNode();
+	void freeNode(int32_t node);
+	void insertLeaf(int32_t leaf);
+	void removeLeaf(int32_t leaf);
+	// Rotates the subtree at the given node if its children's heights differ by more than one,
+	// and returns the subtree's new root.
+	int32_t balance(int32_t node);
+	// Recomputes the bounds and heights of the given node and its ancestors, balancing each.
+	void refitUpwards(int32_t node);
+};
@@ -0,0 +1,131 @@
+#pragma once
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include "AssimpImport.h"
+#include "Mesh3D.h"
+#include "StreamBuffer.h"
+#include "Texture.h"
+#include "TextureManager.h"
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
+
+/**
+ * @brief A handle to an asset that is loading in the background.
+ *
+ * The asset can be used right away: until its data arrives it renders as a placeholder (an
+ * empty mesh, or a 1x1 grey texture), and is then filled in place, so everything holding the
+ * pointer sees the finished asset. The future becomes ready once the asset is on the GPU, and
+ * rethrows the error if loading failed, or a std::runtime_error if the loader was destroyed
+ * before the asset finished loading.
+ */
+template <typename T>
+struct AssetHandle {
+	std::shared_ptr<T> asset;
+	std::shared_future<void> ready;
+
+	bool isReady() const {
+		return ready.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}
+};
+
+/**
+ * @brief Loads models and textures concurrently on a pool of worker threads.
+ *
+ * Workers do everything that doesn't need OpenGL: reading the mesh cache or running the Assimp
+ * import, and decoding images. Finished CPU-side data is queued for upload, which happens on
+ * the thread that owns the OpenGL context when it calls processUploads(). Every method other
+ * than the constructor must be called on that thread.
+ *
+ * With texture streaming enabled, textures arrive with only their small mipmap levels, and
+ * their finer levels are read and decoded on the workers as a TextureStreamer asks for them.
+ *
+ * Asset files are memory-mapped and decoded straight from the mapping, and textures are
+ * uploaded through a pixel unpack buffer that each processUploads() call fills, so the driver
+ * copies them to the GPU asynchronously and the decoded pixels are freed as soon as they are
+ * staged.
+ */
+class AssetLoader {
+private:
+	TextureManager& m_textures;
+	// Uploads waiting for the context thread.
+	std::queue<std::function<void()>> m_uploads;
+	std::mutex m_uploadMutex;
+	// Textures whose placeholders are still waiting for their image; only touched on the context thread.
+	std::unordered_map<const Texture*, std::shared_future<void>> m_inFlightTextures;
+	// Assets requested but not yet uploaded; only touched on the context thread.
+	size_t m_pending;
+	ModelImporter m_importer;
+	// Null unless texture streaming is enabled.
+	std::unique_ptr<TextureStreamer> m_streamer;
+	// The pixel unpack buffer that texture uploads are staged in, one region per frame.
+	std::unique_ptr<StreamBuffer> m_staging;
+	// Declared last, so the workers are joined before the queue they post to is destroyed.
+	ThreadPool m_workers;
+
+	void queueUpload(std::function<void()> upload);
+
+public:
+	/**
+	 * @brief Creates a loader that shares textures through the given manager, with the given
+	 * number of worker threads (0 for one per hardware thread). Must be created on the thread
+	 * that owns the OpenGL context.
+	 */
+	explicit AssetLoader(TextureManager& textures, size_t threadCount = 0);
+
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator=(const AssetLoader&) = delete;
+
+	/**
+	 * @brief Starts loading the model at the given path, like assimpLoad, and returns its
+	 * placeholder mesh. The model's textures are loaded through loadTexture once it is parsed.
+	 */
+	AssetHandle<Mesh3D> loadModel(const std::string& path, bool flipTextureCoords);
+
+	/**
+	 * @brief Chooses the parser for the models requested from now on; ModelImporter::Auto by
+	 * default.
+	 */
+	void setModelImporter(ModelImporter importer);
+
+	/**
+	 * @brief Starts loading the texture at the given path, unless the texture manager already
+	 * has it, and returns its placeholder.
+	 */
+	AssetHandle<Texture> loadTexture(const std::string& path);
+
+	/**
+	 * @brief Loads the textures requested from now on with only the mipmap levels that are at
+	 * most initialSize on either side, and streams in their finer levels under the given budget
+	 * of GPU memory, in bytes. Textures that are already loaded are not streamed.
+	 */
+	void enableTextureStreaming(size_t budget, int initialSize = 64);
+
+	/**
+	 * @brief The streamer to report the frame's texture uses to, or null if streaming is off.
+	 */
+	TextureStreamer* getTextureStreamer();
+
+	/**
+	 * @brief Starts loading the texture levels the streamer asks for, once the frame's texture
+	 * uses have been reported. Does nothing if streaming is off.
+	 */
+	void streamTextures();
+
+	/**
+	 * @brief Uploads finished assets to the GPU. Stops early once the time budget is spent, so
+	 * a burst of finished assets doesn't stall a frame; the rest wait for the next call. The
+	 * default budget uploads everything that has finished.
+	 */
+	void processUploads(std::chrono::microseconds budget = std::chrono::microseconds::max());
+
+	/**
+	 * @brief The number of requested assets that have not been uploaded yet.
+	 */
+	size_t getPendingCount() const;
+};
@@ -1,6 +1,76 @@
 #pragma once
 #include "Mesh3D.h"
+#include "MeshCache.h"
 #include "Object3D.h"
+#include "TextureManager.h"
 #include <assimp/scene.h>
+#include <filesystem>
+#include <string>
+#include <vector>
 
-Object3D assimpLoad(const std::string& path, bool flipTextureCoords);
+/**
+ * @brief The CPU-side result of importing a model: its packed vertex and face buffers and its
+ * per-material sub-mesh table, ready to be uploaded by createMesh.
+ *
+ * The views point either into a memory-mapped MeshCache or into buffers freshly built by
+ * the importer; either way they are owned by this object and stay valid as it is moved around.
+ */
+struct ModelData {
+	std::filesystem::path path;
+
+	std::span<const Vertex3D> vertices;
+	std::span<const uint32_t> faces;
+	// The full-detail sub-meshes, followed by those of each simplified level of detail.
+	std::span<const MeshCacheSubMesh> subMeshes;
+
+	// Storage behind the views, for whichever of the two sources was used.
+	MeshCache cache;
+	std::vector<Vertex3D> importedVertices;
+	std::vector<uint32_t> importedFaces;
+	std::vector<std::string> importedTextures;
+	std::vector<MeshCacheSubMesh> importedSubMeshes;
+
+	/**
+	 * @brief The path of a sub-mesh's diffuse texture image, or an empty path if it has none.
+	 */
+	std::filesystem::path texturePath(const MeshCacheSubMesh& subMesh) const;
+
+	/**
+	 * @brief The simplified levels of detail in the sub-mesh table, for Mesh3D::setLods.
+	 */
+	std::vector<MeshLod> getLods() const;
+};
+
+/**
+ * @brief Which parser reads model files.
+ */
+enum class ModelImporter {
+	// parseObj for .obj files, falling back to Assimp for those it can't parse, and Assimp for
+	// everything else.
+	Auto,
+	// Assimp for every file.
+	Assimp,
+};
+
+/**
+ * @brief Reads the model at the given path into CPU memory, from its mesh cache if the cache is
+ * up to date, or else through the given importer (refreshing the cache). Freshly imported models are run
+ * through optimizeMesh and given levels of detail by generateLods before caching. Makes no OpenGL calls, so it can run on any thread.
+ */
+ModelData importModel(const std::string& path, bool flipTextureCoords, ModelImporter importer = ModelImporter::Auto);
+
+/**
+ * @brief Uploads an imported model to the GPU, loading each material's texture through the
+ * given manager.
+ */
+Mesh3D createMesh(const ModelData& model, TextureManager& textures,
+	PositionFormat positionFormat = PositionFormat::Float);
+
+/**
+ * @brief Loads every mesh in the model at the given path into a single Object3D, along with
+ * the diffuse texture of each material. The meshes are packed into one vertex and index
+ * buffer, with one sub-mesh per material. Textures are requested from the given manager, so
+ * models sharing an image share one GPU texture.
+ */
+Object3D assimpLoad(const std::string& path, bool flipTextureCoords, TextureManager& textures,
+	ModelImporter importer = ModelImporter::Auto);
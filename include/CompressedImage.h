@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+/**
+ * @brief A block-compressed image with a precomputed mipmap chain, read from a KTX (version 1)
+ * or DDS file, in a format the GPU can sample directly (BCn, ETC2 or ASTC).
+ *
+ * The file is memory-mapped, and the mipmap levels are views into the mapping, so they can be
+ * handed to glCompressedTexImage2D without any decoding or copying.
+ */
+class CompressedImage {
+public:
+	struct Level {
+		int width;
+		int height;
+		const unsigned char* data;
+		size_t size;
+	};
+
+private:
+	MappedFile m_file;
+	// The OpenGL internal format of the image, e.g. GL_COMPRESSED_RGBA_BPTC_UNORM.
+	uint32_t m_format;
+	std::vector<Level> m_levels;
+
+	void loadKtx(const std::string& filepath);
+	void loadDds(const std::string& filepath);
+
+public:
+	CompressedImage();
+
+	/**
+	 * @brief Loads a .ktx or .dds file, throwing std::runtime_error if it is malformed or uses
+	 * an unsupported layout (cube maps, arrays, 3D textures, or uncompressed pixels).
+	 */
+	void loadFromFile(const std::string& filepath);
+
+	/**
+	 * @brief Looks for a pre-compressed version of an image file: the same name with a .ktx or
+	 * .dds extension. Loads it and returns true if one exists, loads, and is in a format the GPU
+	 * supports; otherwise returns false, so the caller can fall back to decoding the original
+	 * image. A compressed file that fails to load is skipped with a warning.
+	 */
+	bool loadCompressedVersionOf(const std::string& imagePath);
+
+	/**
+	 * @brief Whether the current OpenGL context can sample the given compressed format.
+	 */
+	static bool isFormatSupported(uint32_t format);
+
+	uint32_t getFormat() const;
+	int getWidth() const;
+	int getHeight() const;
+	const std::vector<Level>& getLevels() const;
+	// The total size of every level, as it will be stored on the GPU.
+	size_t getSize() const;
+};
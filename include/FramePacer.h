@@ -0,0 +1,74 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include "GlFence.h"
+
+/**
+ * @brief When buffer swaps wait for the display's vertical blank.
+ */
+enum class VsyncMode {
+	// Never: frames are presented as soon as they are done, and may tear.
+	Off,
+	// Always: frames are presented at the refresh rate, or at a fraction of it when they miss.
+	On,
+	// While frames keep up with the refresh rate; a frame that misses turns syncing off until
+	// frames are comfortably fast again, rather than waiting a whole extra refresh.
+	Adaptive
+};
+
+/**
+ * @brief Keeps the CPU at most a few frames ahead of the GPU, and decides when buffer swaps
+ * should wait for vertical blank.
+ *
+ * endFrame() places a fence after each frame's commands, and beginFrame() waits for the fence
+ * of the frame that many frames back before the next one is recorded. Without the limit the
+ * driver queues frames as fast as the CPU records them, and input shows up on screen as many
+ * frames late as it has queued.
+ *
+ * The pacer doesn't own the window: swap waiting is set through the windowing library, e.g.
+ * sf::Window::setVerticalSyncEnabled(), whenever wantsVsync() changes. Adaptive mode emulates
+ * adaptive vsync (late swaps tear instead of waiting) from the frame times, since the
+ * windowing library doesn't expose the swap interval that would do it in the driver.
+ */
+class FramePacer {
+public:
+	explicit FramePacer(size_t framesInFlight = 2);
+	~FramePacer();
+
+	FramePacer(const FramePacer&) = delete;
+	FramePacer& operator=(const FramePacer&) = delete;
+
+	/**
+	 * @brief Waits until the GPU has finished all but framesInFlight - 1 of the frames before this one.
+	 */
+	void beginFrame();
+	/**
+	 * @brief Marks the end of the frame's commands, after its swap, and measures the time
+	 * since the previous frame's end for adaptive vsync.
+	 */
+	void endFrame();
+
+	void setVsyncMode(VsyncMode mode);
+	VsyncMode getVsyncMode() const;
+	/**
+	 * @brief Sets the display's refresh interval, in seconds, that adaptive mode measures
+	 * frames against.
+	 */
+	void setRefreshInterval(double seconds);
+	/**
+	 * @brief Whether the next swap should wait for vertical blank.
+	 */
+	bool wantsVsync() const;
+
+private:
+	size_t m_framesInFlight;
+	std::deque<GLsync> m_fences;
+	VsyncMode m_mode;
+	double m_refreshInterval;
+	bool m_vsync;
+	// Consecutive frames that took comfortably less than a refresh interval, with vsync off.
+	size_t m_fastFrames;
+	bool m_timed;
+	std::chrono::steady_clock::time_point m_lastFrameEnd;
+};
@@ -0,0 +1,93 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Object3D.h"
+
+/**
+ * @brief The state of the simulated world at one step: every object's position, orientation
+ * and scale, in the order of a Scene's objects.
+ */
+struct FrameSnapshot {
+	struct Transform {
+		glm::vec3 position;
+		glm::vec3 orientation;
+		glm::vec3 scale;
+	};
+
+	// The number of steps simulated, and the simulated time, in seconds.
+	uint64_t step;
+	double time;
+	std::vector<Transform> objects;
+
+	static FrameSnapshot from(std::span<const Object3D> objects);
+
+	/**
+	 * @brief Gives the objects their transformations from the snapshot, only touching those
+	 * that differ, so objects that didn't move keep their transformation versions. Objects
+	 * beyond the end of the snapshot are left alone.
+	 */
+	void applyTo(std::span<Object3D> objects) const;
+};
+
+/**
+ * @brief Runs the simulation on a thread of its own, one fixed step at a time, and hands the
+ * render thread the most recent step's snapshot, so simulating the next frame overlaps
+ * rendering this one.
+ *
+ * The simulation steps its own copy of the world, never the objects the render thread draws,
+ * and publishes a copy after each step. A published snapshot is never written again while
+ * the render thread holds it: there are three, one being written, the newest published one,
+ * and the one being rendered, which is swapped for the newest when acquire() finds one. A
+ * render thread that falls behind skips steps rather than queueing them, so it always draws
+ * the latest state; one that runs ahead draws the same snapshot again.
+ */
+class FramePipeline {
+public:
+	/**
+	 * @brief Advances the world by the given number of seconds.
+	 */
+	using Step = std::function<void(FrameSnapshot& world, double seconds)>;
+
+	/**
+	 * @brief Starts simulating from the given world, stepping it every stepSeconds of real time.
+	 */
+	FramePipeline(FrameSnapshot world, Step step, double stepSeconds);
+	/**
+	 * @brief Stops the simulation after the step it is taking, and joins its thread.
+	 */
+	~FramePipeline();
+
+	FramePipeline(const FramePipeline&) = delete;
+	FramePipeline& operator=(const FramePipeline&) = delete;
+
+	/**
+	 * @brief The most recently published snapshot, which stays unchanged until the next call.
+	 * Never waits for the simulation, apart from the brief hand-over of a new snapshot.
+	 */
+	const FrameSnapshot& acquire();
+
+private:
+	Step m_simulate;
+	double m_stepSeconds;
+	// Only touched by the simulation thread.
+	FrameSnapshot m_world;
+	// The snapshot being written, the newest published one, and the one being rendered.
+	FrameSnapshot m_snapshots[3];
+	FrameSnapshot* m_writing;
+	FrameSnapshot* m_published;
+	FrameSnapshot* m_rendering;
+	// Whether m_published is newer than m_rendering.
+	bool m_fresh;
+	bool m_stopping;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::thread m_thread;
+
+	void simulationLoop();
+};
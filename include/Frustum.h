@@ -0,0 +1,30 @@
+#pragma once
+#include <array>
+#include <glm/glm.hpp>
+
+/**
+ * @brief The six planes of a view frustum, in world space.
+ */
+struct Frustum {
+	// Each plane is (a, b, c, d) with a unit normal (a, b, c), and ax + by + cz + d >= 0 on
+	// the inside: left, right, bottom, top, near, far.
+	std::array<glm::vec4, 6> planes;
+
+	enum class Containment {
+		Outside,
+		Intersects,
+		Inside
+	};
+
+	/**
+	 * @brief Extracts the frustum of a projection * view matrix.
+	 */
+	static Frustum fromMatrix(const glm::mat4& viewProjection);
+
+	/**
+	 * @brief Classifies an axis-aligned box, given by its center and half-extents. Conservative
+	 * near the frustum's edges: a box outside but close to a corner may be reported as
+	 * intersecting.
+	 */
+	Containment classify(const glm::vec3& center, const glm::vec3& extent) const;
+};
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Object3D.h"
+
+/**
+ * @brief Finds which of a list of objects may be inside the view frustum.
+ *
+ * The world-space bounds of every object are kept in a structure of arrays, one array of floats
+ * per component, so the test against the six frustum planes runs over contiguous memory and
+ * the compiler can vectorize it. An object's bounds are only recomputed when its transformation
+ * or its mesh's bounds change.
+ *
+ * The test is conservative: an object outside the frustum but near one of its corners may be
+ * reported visible, but a visible object is never culled.
+ */
+class FrustumCuller {
+private:
+	// The objects' world-space bounds: box centers, box half-extents and sphere radii.
+	std::vector<float> m_centerX, m_centerY, m_centerZ;
+	std::vector<float> m_extentX, m_extentY, m_extentZ;
+	std::vector<float> m_radius;
+	// What each object's bounds were computed from.
+	std::vector<uint64_t> m_transformVersions;
+	std::vector<BoundingVolume> m_meshBounds;
+
+	std::vector<uint8_t> m_inside;
+	std::vector<uint32_t> m_visible;
+
+	void updateObject(const Object3D& object, size_t index);
+
+public:
+	/**
+	 * @brief Brings the bounds up to date with the objects. Call whenever objects have moved,
+	 * before cull(); the objects must be the same list, in the same order, as passed to cull().
+	 */
+	void update(std::span<const Object3D> objects);
+
+	/**
+	 * @brief Tests every object against the frustum of the given projection * view matrix,
+	 * counts the visible and culled objects towards the profiler, and returns the indices of
+	 * the visible objects, in order. The span is valid until the next call.
+	 */
+	std::span<const uint32_t> cull(const glm::mat4& viewProjection);
+};
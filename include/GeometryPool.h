@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "Mesh3D.h"
+
+/**
+ * @brief One vertex buffer and one index buffer, with one vertex array over them, that many
+ * meshes' geometry is sub-allocated from, so they can be drawn without switching vertex
+ * arrays, or all at once with a multi-draw call.
+ *
+ * Every mesh in a pool shares its vertex layout and index type. Meshes are copied in from
+ * their own buffers on the GPU; each keeps its own indices, which the draws offset by the
+ * mesh's base vertex. The buffers double in size when they run out of room.
+ */
+class GeometryPool {
+public:
+	/**
+	 * @brief Where a mesh's geometry lives in the pool. The mesh's index ranges are offset by
+	 * firstIndex, and its indices by baseVertex.
+	 */
+	struct Allocation {
+		uint32_t baseVertex;
+		uint32_t vertexCount;
+		uint32_t firstIndex;
+		uint32_t indexCount;
+	};
+
+	GeometryPool(const Mesh3D::VertexLayout& layout, uint32_t indexType);
+	~GeometryPool();
+
+	GeometryPool(const GeometryPool&) = delete;
+	GeometryPool& operator=(const GeometryPool&) = delete;
+
+	/**
+	 * @brief Whether the mesh's layout and index type match the pool's.
+	 */
+	bool accepts(const Mesh3D& mesh) const;
+
+	/**
+	 * @brief Copies the mesh's vertices and indices into the pool.
+	 */
+	Allocation add(const Mesh3D& mesh);
+
+	/**
+	 * @brief Frees a mesh's geometry, for other meshes to reuse once the GPU has finished the
+	 * frames that may still draw it (see GpuResources::endFrame), so copying another mesh over
+	 * it never makes the driver wait for those draws.
+	 */
+	void remove(const Allocation& allocation);
+
+	uint32_t getVertexArray() const;
+	uint32_t getIndexType() const;
+	size_t getIndexSize() const;
+
+private:
+	// First-fit allocation of ranges of elements, from a list of free ranges sorted by offset.
+	class RangeAllocator {
+	private:
+		struct Range {
+			uint32_t offset;
+			uint32_t size;
+		};
+		std::vector<Range> m_free;
+		uint32_t m_capacity = 0;
+
+	public:
+		// Returns false if no free range is big enough.
+		bool allocate(uint32_t size, uint32_t& offset);
+		void free(uint32_t offset, uint32_t size);
+		// Adds room at the end, up to the new capacity.
+		void grow(uint32_t capacity);
+		uint32_t getCapacity() const;
+	};
+
+	Mesh3D::VertexLayout m_layout;
+	uint32_t m_indexType;
+	uint32_t m_vao;
+	uint32_t m_vbo;
+	uint32_t m_ebo;
+	RangeAllocator m_vertices;
+	RangeAllocator m_indices;
+	// Removed geometry not freed yet, with the frames it was removed in, oldest first.
+	std::vector<std::pair<uint64_t, Allocation>> m_removed;
+
+	// Replaces one of the buffers with a bigger one holding the same data.
+	void growBuffer(uint32_t& buffer, size_t oldBytes, size_t newBytes);
+	void bindBuffers();
+	// Frees the removed geometry that no frame in flight can draw anymore.
+	void reclaim();
+};
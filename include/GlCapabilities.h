@@ -0,0 +1,22 @@
+#pragma once
+#include <string_view>
+
+/**
+ * @brief Whether the current OpenGL context supports an extension, such as
+ * "GL_EXT_texture_compression_s3tc".
+ *
+ * The context's extension list, version and limits are read the first time either function is called,
+ * which must happen on a thread with a current context. After that they may be called from any
+ * thread, including asset loading workers.
+ */
+bool hasGlExtension(std::string_view name);
+
+/**
+ * @brief Whether the current OpenGL context's version is at least major.minor.
+ */
+bool hasGlVersion(int major, int minor);
+
+/**
+ * @brief The largest width or height of a 2D texture the current OpenGL context accepts.
+ */
+int getGlMaxTextureSize();
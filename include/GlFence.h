@@ -0,0 +1,10 @@
+#pragma once
+
+// An opaque OpenGL fence, from glFenceSync.
+typedef struct __GLsync* GLsync;
+
+/**
+ * @brief Blocks until the GPU has passed the fence, or the wait has failed, e.g. because the
+ * context was lost. The fence is left for the caller to delete.
+ */
+void waitForFence(GLsync fence);
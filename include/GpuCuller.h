@@ -0,0 +1,129 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <glm/glm.hpp>
+#include "ShaderProgram.h"
+
+/**
+ * @brief Culls objects and picks their levels of detail on the GPU, with a compute shader
+ * that writes the indirect draw commands of the visible ones directly, so neither culling nor
+ * command building goes through the CPU. Needs OpenGL 4.3.
+ *
+ * Each object is tested against the view frustum and, with occlusion culling enabled, against
+ * a depth pyramid (a "hierarchical Z" buffer) built from the previous frame's depth buffer by
+ * updateDepthPyramid(). An object that was hidden last frame but is uncovered this frame is
+ * drawn a frame late.
+ *
+ * The commands themselves live in a buffer owned by the caller, such as a MultiDrawRenderer,
+ * which describes each object's sub-meshes with draw and range records. The culler only
+ * rewrites each command's index range and instance count: one instance if the object is
+ * visible, none if not.
+ */
+class GpuCuller {
+public:
+	/**
+	 * @brief An object's world-space bounds: the center of its box, the radius of its sphere,
+	 * the box's half-extents and the model matrix's largest scale, as selectLod uses them; and
+	 * its draws.
+	 */
+	struct ObjectRecord {
+		glm::vec4 sphere;
+		glm::vec4 extent;
+		uint32_t firstDraw;
+		uint32_t drawCount;
+		uint32_t lodCount;
+		uint32_t padding;
+	};
+
+	/**
+	 * @brief One of an object's sub-meshes: the command it writes, and the first of its index
+	 * ranges, one per level of detail.
+	 */
+	struct DrawRecord {
+		uint32_t command;
+		uint32_t firstRange;
+	};
+
+	/**
+	 * @brief A sub-mesh's indices at a level of detail, and the level's error.
+	 */
+	struct RangeRecord {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		float error;
+		uint32_t padding;
+	};
+
+	/**
+	 * @brief Whether the context has compute shaders, storage buffers and indirect multi-draws.
+	 */
+	static bool isSupported();
+
+	/**
+	 * @brief Loads the culling and depth pyramid compute shaders. Throws std::runtime_error if
+	 * they can't be built.
+	 */
+	GpuCuller();
+	~GpuCuller();
+
+	GpuCuller(const GpuCuller&) = delete;
+	GpuCuller& operator=(const GpuCuller&) = delete;
+
+	/**
+	 * @brief Replaces the draws and ranges of every object, and makes room for the given number
+	 * of objects, whose records must then be set with setObjects(). Resets every object's level
+	 * of detail to its lodLevels entry.
+	 */
+	void setDraws(std::span<const DrawRecord> draws, std::span<const RangeRecord> ranges,
+		std::span<const uint32_t> lodLevels);
+
+	/**
+	 * @brief Overwrites the records of the objects starting at the given index.
+	 */
+	void setObjects(size_t firstObject, std::span<const ObjectRecord> objects);
+
+	/**
+	 * @brief Writes the commands of every object for the given camera, with the same level of
+	 * detail selection as Object3D::selectLod. The commands are ready to draw from afterwards.
+	 */
+	void cull(uint32_t commandBuffer, const glm::mat4& view, const glm::mat4& projection,
+		float viewportHeight, float pixelError = 1.0f);
+
+	/**
+	 * @brief Turns testing objects against the depth pyramid on or off.
+	 */
+	void setOcclusionCulling(bool occlusionCulling);
+	bool getOcclusionCulling() const;
+
+	/**
+	 * @brief Builds the depth pyramid from the depth buffer of the bound framebuffer, which must
+	 * have a 24-bit depth and 8-bit stencil format, once a frame has been drawn into it with the
+	 * given projection * view matrix. Does nothing while occlusion culling is off.
+	 */
+	void updateDepthPyramid(const glm::mat4& viewProjection, uint32_t width, uint32_t height);
+
+private:
+	ShaderProgram m_cullProgram;
+	ShaderProgram m_pyramidProgram;
+
+	uint32_t m_objectBuffer;
+	uint32_t m_drawBuffer;
+	uint32_t m_rangeBuffer;
+	uint32_t m_lodBuffer;
+	size_t m_objectCount;
+
+	bool m_occlusionCulling;
+	// A single-sampled copy of the depth buffer, and the pyramid built from it. The pyramid is
+	// invalid until the first update, and after a resize until the next.
+	uint32_t m_depthTexture;
+	uint32_t m_depthFramebuffer;
+	uint32_t m_pyramidTexture;
+	uint32_t m_pyramidWidth;
+	uint32_t m_pyramidHeight;
+	int32_t m_pyramidLevels;
+	bool m_pyramidValid;
+	glm::mat4 m_pyramidViewProjection;
+
+	void resizePyramid(uint32_t width, uint32_t height);
+	void deletePyramid();
+};
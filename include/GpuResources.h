@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "GlFence.h"
+
+/**
+ * @brief Hands out OpenGL buffer, vertex array and texture names, and takes them back when the
+ * objects that own them are destroyed.
+ *
+ * Names are generated in batches, so creating a mesh or texture doesn't cost a driver call per
+ * object. Destroying one only queues its names: the GPU may still be drawing from them in a
+ * frame that is in flight, and deleting an object in use makes some drivers wait for the GPU,
+ * or hold on to its memory anyway. Instead, endFrame() places a fence after each frame's
+ * commands, and the names released while recording that frame are deleted once a later
+ * endFrame() finds the fence signaled, which never waits. The same frame numbers let other
+ * allocators, such as GeometryPool's ranges, hold freed memory back until the GPU is done with it.
+ *
+ * Names must be created on the thread with the context, but may be released from any thread,
+ * e.g. by an asset loading worker dropping the last reference to a mesh.
+ */
+class GpuResources {
+public:
+	/**
+	 * @brief The pool every mesh and texture takes its names from.
+	 */
+	static GpuResources& shared();
+
+	GpuResources(const GpuResources&) = delete;
+	GpuResources& operator=(const GpuResources&) = delete;
+
+	uint32_t createBuffer();
+	uint32_t createVertexArray();
+	uint32_t createTexture();
+
+	/**
+	 * @brief Deletes the object once the GPU has finished the frame being recorded. Zero, the
+	 * name of no object, is ignored.
+	 */
+	void destroyBuffer(uint32_t buffer);
+	void destroyVertexArray(uint32_t vertexArray);
+	void destroyTexture(uint32_t texture);
+
+	/**
+	 * @brief Marks the end of the frame's commands, and deletes the objects released during
+	 * frames the GPU has since finished. Call once per frame, after its last draw.
+	 */
+	void endFrame();
+
+	/**
+	 * @brief The number of the frame being recorded, counting from 1; endFrame() moves on to
+	 * the next one.
+	 */
+	uint64_t getFrame() const;
+
+	/**
+	 * @brief Whether the GPU has finished the given frame's commands, and every earlier frame's,
+	 * as of the last endFrame().
+	 */
+	bool isFrameComplete(uint64_t frame) const;
+
+	/**
+	 * @brief The number of released objects not deleted yet.
+	 */
+	size_t getPendingCount() const;
+
+private:
+	enum Kind { BUFFER, VERTEX_ARRAY, TEXTURE, KIND_COUNT };
+
+	// The names released while recording one frame, by kind.
+	struct Retired {
+		uint64_t frame;
+		std::vector<uint32_t> names[KIND_COUNT];
+	};
+
+	// Generated names not handed out yet, by kind.
+	std::vector<uint32_t> m_free[KIND_COUNT];
+	// Released names, oldest frame first, and the fences after the frames not known to be finished.
+	std::deque<Retired> m_retired;
+	std::deque<std::pair<uint64_t, GLsync>> m_fences;
+	uint64_t m_frame;
+	uint64_t m_completedFrame;
+	size_t m_pendingCount;
+	mutable std::mutex m_mutex;
+
+	GpuResources();
+
+	uint32_t create(Kind kind);
+	void destroy(Kind kind, uint32_t name);
+};
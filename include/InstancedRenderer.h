@@ -0,0 +1,92 @@
+#pragma once
+#include <span>
+#include <map>
+#include <utility>
+#include <vector>
+#include "Object3D.h"
+#include "StreamBuffer.h"
+
+/**
+ * @brief Draws objects that share a Mesh3D with one instanced draw call per mesh, instead of
+ * one uniform upload and one draw call per object.
+ *
+ * The objects are grouped by mesh and level of detail, and their model matrices are kept in a per-instance vertex
+ * buffer. As long as the same objects are rendered with the same meshes and levels, only the matrices of
+ * objects whose transformation changed are re-uploaded. Use with a shader that reads the model
+ * matrix from attributes 2 through 5, such as texture_perspective_instanced.vert.
+ *
+ * When most objects move every frame, tracking changes buys nothing; give the renderer a
+ * StreamBuffer and it writes every matrix into that instead, each frame.
+ */
+class InstancedRenderer {
+private:
+	// One mesh's range of the instance buffer, at one level of detail.
+	struct Batch {
+		Mesh3D* mesh;
+		size_t lod;
+		size_t firstInstance;
+		size_t instanceCount;
+		// The mesh's position transform when the batch's matrices were uploaded. A mesh that
+		// finishes loading in place may change it.
+		glm::mat4 positionTransform;
+	};
+
+	uint32_t m_instanceBuffer;
+	// The instance buffer's size, in matrices.
+	size_t m_capacity;
+
+	// The layout of the instance buffer, as built for the last list of objects rendered.
+	const Object3D* m_objects;
+	// Each object's mesh and level of detail.
+	std::vector<std::pair<const Mesh3D*, size_t>> m_objectMeshes;
+	std::vector<Batch> m_batches;
+	// Each object's slot in the instance buffer, and the transformation version uploaded there.
+	std::vector<size_t> m_slots;
+	std::vector<size_t> m_objectBatches;
+	std::vector<uint64_t> m_uploadedVersions;
+	// CPU copy of the instance buffer, and which slots of it need uploading.
+	std::vector<glm::mat4> m_matrices;
+	std::vector<bool> m_dirtySlots;
+	// If not null, every frame's matrices are written here instead of the instance buffer.
+	StreamBuffer* m_stream;
+	// Holds the visible objects' matrices when rendering a culled list without a StreamBuffer.
+	uint32_t m_visibleBuffer;
+	std::vector<glm::mat4> m_visibleMatrices;
+	std::vector<size_t> m_visibleCounts;
+	std::vector<size_t> m_visibleStarts;
+
+	bool layoutMatches(std::span<const Object3D> objects) const;
+	void buildLayout(std::span<const Object3D> objects);
+	void uploadDirtySlots();
+	// Draws through the stream, or returns false without drawing if this frame's matrices don't
+	// fit or the stream fails to map.
+	bool streamMatrices(std::span<const Object3D> objects);
+	glm::mat4 instanceMatrix(const Object3D& object, size_t objectIndex) const;
+
+public:
+	InstancedRenderer();
+	~InstancedRenderer();
+
+	InstancedRenderer(const InstancedRenderer&) = delete;
+	InstancedRenderer& operator=(const InstancedRenderer&) = delete;
+
+	/**
+	 * @brief Writes every frame's matrices through the given buffer, whose frames are begun
+	 * and ended by the caller, or goes back to the change-tracked instance buffer if null. A
+	 * frame whose matrices don't fit in what is left of the stream's region, or that fails to
+	 * map it, draws from the instance buffers instead.
+	 */
+	void setStreamBuffer(StreamBuffer* stream);
+
+	/**
+	 * @brief Renders the objects with the currently active shader program.
+	 */
+	void render(std::span<const Object3D> objects);
+
+	/**
+	 * @brief Renders only the objects at the given indices, e.g. those that survived culling.
+	 * The visible objects' matrices are written anew each frame, so this suits lists of which
+	 * only a small part is visible.
+	 */
+	void render(std::span<const Object3D> objects, std::span<const uint32_t> visible);
+};
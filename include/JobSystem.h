@@ -0,0 +1,89 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Splits a frame's CPU work across cores, with one work-stealing queue per thread.
+ *
+ * parallelFor() cuts a range of items into chunks and deals them out over the threads' queues.
+ * Each thread runs the chunks in its own queue, newest first, and when that is empty steals
+ * the oldest chunk from another thread's. The calling thread takes part as worker 0 and
+ * returns once every chunk has run, so everything the chunks wrote is visible to it then.
+ *
+ * Jobs are told which worker runs them, an index below getWorkerCount() that no other thread
+ * uses at the same time, so they can write to per-thread lists without locking and merge
+ * them afterwards. Jobs may call parallelFor() themselves: while waiting, a worker only runs
+ * chunks of that nested call, never another chunk of the job it is in the middle of, but the
+ * nested chunks it runs get its index too, so they need lists of their own. Jobs must not
+ * throw, and must not make OpenGL calls: only the thread that owns the context may.
+ *
+ * Unlike a ThreadPool, which runs long tasks in the background, parallelFor() is meant for
+ * short bursts the caller waits on; idle workers sleep between them.
+ */
+class JobSystem {
+public:
+	/**
+	 * @brief A job over the items [begin, end), run by the given worker.
+	 */
+	using RangeJob = std::function<void(size_t begin, size_t end, size_t worker)>;
+
+	/**
+	 * @brief Creates a system with the given number of workers, counting the thread that calls
+	 * parallelFor(); 0 means one per hardware thread.
+	 */
+	explicit JobSystem(size_t workerCount = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	/**
+	 * @brief Runs the job over the items [0, count), in chunks of about grainSize items, and
+	 * waits for all of them. Outside of a job, only one thread may call this at a time.
+	 */
+	void parallelFor(size_t count, size_t grainSize, const RangeJob& job);
+
+	/**
+	 * @brief The number of workers, including the calling thread: one more than the highest
+	 * worker index a job can be given.
+	 */
+	size_t getWorkerCount() const;
+
+private:
+	struct Chunk {
+		const RangeJob* job;
+		size_t begin;
+		size_t end;
+		// The chunks of the job's parallelFor() that have not finished yet.
+		std::atomic<size_t>* remaining;
+	};
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Chunk> chunks;
+	};
+
+	// One per worker; the calling thread's is the first.
+	std::vector<std::unique_ptr<Queue>> m_queues;
+	std::vector<std::thread> m_threads;
+	// The chunks waiting in any queue, which idle workers sleep until there are some of.
+	std::atomic<size_t> m_queued;
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wake;
+	bool m_stopping;
+
+	// The calling thread's worker index: its own if it is one of the workers, or 0.
+	size_t currentWorker() const;
+	// Runs one chunk from the worker's own queue, or one stolen from another's, only taking
+	// the chunks of the given call's parallelFor() if there is one. Returns false if no queue
+	// had a chunk to take.
+	bool runChunk(size_t worker, const std::atomic<size_t>* call = nullptr);
+	void workerLoop(size_t worker);
+};
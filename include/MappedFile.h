@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief A read-only memory mapping of an entire file. The file's contents stay
+ * mapped until the object is destroyed or another file is opened.
+ */
+class MappedFile {
+private:
+	const unsigned char* m_data;
+	size_t m_size;
+#ifdef _WIN32
+	void* m_file;
+	void* m_mapping;
+#else
+	int m_file;
+#endif
+
+	void close();
+
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	/**
+	 * @brief Maps the file at the given path, throwing std::runtime_error if it cannot be opened.
+	 */
+	void open(const std::string& filepath);
+
+	bool isOpen() const;
+	const unsigned char* getData() const;
+	size_t getSize() const;
+};
@@ -1,8 +1,10 @@
 #pragma once
 #include <glm/glm.hpp>
 #include <glad/glad.h>
+#include <memory>
+#include <span>
 #include <vector>
-#include "StbImage.h"
+#include "Texture.h"
 
 struct Vertex3D {
 	float x;
@@ -13,39 +15,234 @@ struct Vertex3D {
 	float v;
 };
 
+/**
+ * @brief An axis-aligned box and a sphere, sharing a center, that both contain a set of points.
+ * Culling tests against whichever of the two is tighter.
+ */
+struct BoundingVolume {
+	glm::vec3 center;
+	// Half the size of the box along each axis.
+	glm::vec3 extent;
+	float radius;
+
+	bool operator==(const BoundingVolume& other) const {
+		return center == other.center && extent == other.extent && radius == other.radius;
+	}
+	bool operator!=(const BoundingVolume& other) const { return !(*this == other); }
+};
+
+/**
+ * @brief A contiguous range of a mesh's index buffer that is drawn with a single material.
+ */
+struct SubMesh {
+	// The first index of the range, and the number of indices in it.
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	// The range's diffuse texture; may be shared with other meshes, or null.
+	std::shared_ptr<Texture> texture;
+};
+
+/**
+ * @brief A contiguous range of a mesh's index buffer.
+ */
+struct IndexRange {
+	uint32_t indexOffset;
+	uint32_t indexCount;
+};
+
+/**
+ * @brief A simplified version of a whole mesh, drawn from the same vertices with its own faces.
+ */
+struct MeshLod {
+	// Roughly how far, in model units, the simplified surface is from the full-detail one.
+	float error;
+	// Each sub-mesh's faces at this level, in the same order as the mesh's sub-meshes.
+	std::vector<IndexRange> ranges;
+};
+
+/**
+ * @brief How a Mesh3D stores vertex positions on the GPU.
+ */
+enum class PositionFormat {
+	// Three 32-bit floats.
+	Float,
+	// Three 16-bit normalized integers spanning the mesh's bounding box, undone by the mesh's
+	// position transform. Half the size, at 1/65535 of the box's extent in precision.
+	Unorm16
+};
+
 class Mesh3D {
+public:
+	/**
+	 * @brief Where a vertex buffer's attributes are, and in what types.
+	 */
+	struct VertexLayout {
+		// GL_FLOAT, or GL_UNSIGNED_SHORT (normalized).
+		uint32_t positionType;
+		// GL_FLOAT, GL_HALF_FLOAT, or GL_UNSIGNED_SHORT (normalized).
+		uint32_t texCoordType;
+		uint32_t texCoordOffset;
+		uint32_t stride;
+
+		bool operator==(const VertexLayout& other) const {
+			return positionType == other.positionType && texCoordType == other.texCoordType
+				&& texCoordOffset == other.texCoordOffset && stride == other.stride;
+		}
+	};
+
+	/**
+	 * @brief Points attributes 0 and 1 of the bound vertex array at vertices in the given buffer.
+	 */
+	static void setVertexAttributes(const VertexLayout& layout, uint32_t buffer, size_t bufferOffset);
+
 private:
 	uint32_t m_vao;
-	uint32_t m_texture;
+	uint32_t m_vbo;
+	uint32_t m_ebo;
+	std::vector<SubMesh> m_subMeshes;
+	std::vector<MeshLod> m_lods;
 	size_t m_vertexCount;
 	size_t m_faceCount;
+	VertexLayout m_layout;
+	// GL_UNSIGNED_SHORT if every index fits in 16 bits, or else GL_UNSIGNED_INT.
+	uint32_t m_indexType;
+	// Maps the stored positions back to model space, if they are quantized.
+	glm::mat4 m_positionTransform;
+	bool m_quantizedPositions;
+	// The box and sphere around every vertex, in model space.
+	BoundingVolume m_bounds;
 
 public:
 	Mesh3D() = delete;
+	~Mesh3D();
 
+	// A mesh owns its vertex array and buffers, and releases them when destroyed: it can be
+	// moved, which leaves the source an empty mesh that owns nothing, but not copied.
+	Mesh3D(const Mesh3D&) = delete;
+	Mesh3D& operator=(const Mesh3D&) = delete;
+	Mesh3D(Mesh3D&& other) noexcept;
+	Mesh3D& operator=(Mesh3D&& other) noexcept;
 
 	/**
 	 * @brief Construcst a Mesh3D using existing vectors of vertices and faces.
+	 * The texture may be shared with other meshes, or null for an untextured mesh.
 	*/
 	Mesh3D(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& faces,
-		const StbImage& texture);
+		std::shared_ptr<Texture> texture);
+
+	/**
+	 * @brief Constructs a Mesh3D from views of vertex and face buffers, such as a memory-mapped
+	 * MeshCache. The buffers only need to live until the constructor returns.
+	*/
+	Mesh3D(std::span<const Vertex3D> vertices, std::span<const uint32_t> faces,
+		std::shared_ptr<Texture> texture);
 
+	/**
+	 * @brief Constructs a Mesh3D whose packed vertex and face buffers are split into sub-meshes,
+	 * each drawn with its own texture. All sub-meshes share one vertex array, so drawing them
+	 * only rebinds textures. Face indices refer to the whole vertex buffer.
+	 *
+	 * The GPU copy is stored compactly: texture coordinates as 16-bit normalized integers
+	 * (or as half floats, if any fall outside [0, 1]), positions in the given format, and
+	 * indices in 16 bits when there are fewer than 65536 vertices.
+	*/
+	Mesh3D(std::span<const Vertex3D> vertices, std::span<const uint32_t> faces,
+		std::vector<SubMesh> subMeshes, PositionFormat positionFormat = PositionFormat::Float);
+
+	/**
+	 * @brief Constructs a mesh with no faces, which renders nothing. Stands in for a model
+	 * that is still loading.
+	*/
+	static Mesh3D empty();
 	/**
 	 * @brief Constructs a 1x1 square centered at the origin in world space.
 	*/
-	static Mesh3D square(const StbImage& texture);
+	static Mesh3D square(std::shared_ptr<Texture> texture);
 	/**
 	 * @brief Constructs a 1x1x1 cube centered at the origin in world space.
 	*/
-	static Mesh3D cube(const StbImage& texture);
+	static Mesh3D cube(std::shared_ptr<Texture> texture);
 	/**
 	 * @brief Constructs the upper-left half of the 1x1 square centered at the origin.
 	*/
-	static Mesh3D triangle(const StbImage& texture);
+	static Mesh3D triangle(std::shared_ptr<Texture> texture);
+
+	/**
+	 * @brief Renders the mesh to the given context, at the given level of detail (0 being the
+	 * full-detail mesh).
+	 */
+	void render(size_t lod = 0);
+
+	/**
+	 * @brief Renders several copies of the mesh in one draw call per sub-mesh. Each copy's
+	 * model matrix is read from the given buffer, starting at the given byte offset, into the
+	 * per-instance attributes 2 through 5 (see texture_perspective_instanced.vert).
+	 */
+	void renderInstanced(uint32_t instanceBuffer, size_t bufferOffset, size_t instanceCount, size_t lod = 0);
+
+	/**
+	 * @brief Gives the mesh simplified levels of detail, from least to most simplified. Each
+	 * level must have one range per sub-mesh.
+	 */
+	void setLods(std::vector<MeshLod> lods);
+
+	/**
+	 * @brief The number of levels of detail, including the full-detail level 0.
+	 */
+	size_t getLodCount() const;
+
+	/**
+	 * @brief The error of the given level of detail, in model units; 0 for level 0.
+	 */
+	float getLodError(size_t lod) const;
+
+	/**
+	 * @brief Reads the mesh's vertices from another buffer, starting at the given byte offset,
+	 * instead of the mesh's own. Used for vertices that are rewritten every frame, such as
+	 * animated ones written through a StreamBuffer. The new vertices are full-precision
+	 * Vertex3Ds in the same order as the originals, so the mesh's faces still index them; if
+	 * the mesh's positions are quantized, they are in the quantized space.
+	 */
+	void setVertexSource(uint32_t vertexBuffer, size_t bufferOffset);
+
+	/**
+	 * @brief Goes back to reading the mesh's vertices from its own buffer.
+	 */
+	void resetVertexSource();
+
+	const std::vector<SubMesh>& getSubMeshes() const;
+	size_t getVertexCount() const;
+
+	/**
+	 * @brief The pieces needed to issue the mesh's draws elsewhere, such as in a RenderQueue:
+	 * its vertex array, the type and size of its indices, and the index range of a sub-mesh
+	 * at a level of detail.
+	 */
+	uint32_t getVertexArray() const;
+	uint32_t getIndexType() const;
+	size_t getIndexSize() const;
+	IndexRange getRange(size_t subMesh, size_t lod) const;
+
+	/**
+	 * @brief The mesh's own buffers and their layout, e.g. to copy them into a GeometryPool.
+	 * The index buffer holds getIndexCount() indices of getIndexType(), covering every level
+	 * of detail.
+	 */
+	uint32_t getVertexBuffer() const;
+	uint32_t getIndexBuffer() const;
+	const VertexLayout& getLayout() const;
+	size_t getIndexCount() const;
+
+	/**
+	 * @brief The transformation from the positions stored on the GPU to model space, to be
+	 * applied before the model matrix. The identity unless the positions are quantized.
+	 */
+	const glm::mat4& getPositionTransform() const;
+	bool hasQuantizedPositions() const;
 
 	/**
-	 * @brief Renders the mesh to the given context.
+	 * @brief The bounds of every vertex, in model space.
 	 */
-	void render();
+	const BoundingVolume& getBounds() const;
 
 };
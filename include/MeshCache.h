@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "MappedFile.h"
+#include "Mesh3D.h"
+
+// The highest level of detail a cache entry may have, the most generateLods makes by default.
+const uint32_t MESH_CACHE_MAX_LOD = 3;
+
+/**
+ * @brief A sub-mesh's range of the index buffer, and the name of its diffuse texture
+ * relative to the model file (empty if it has none).
+ *
+ * Simplified levels of detail of the sub-meshes are entries of their own, with a level above
+ * 0 and the level's error in model units (see generateLods).
+ */
+struct MeshCacheSubMesh {
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	std::string_view diffuseTexture;
+	uint32_t lod = 0;
+	float lodError = 0;
+};
+
+/**
+ * @brief A memory-mapped binary cache of an imported model: the final packed vertex and index
+ * buffers and the per-material sub-mesh table, exactly as they are uploaded to the GPU.
+ *
+ * Each cache file records a hash of the source model file and the import options used to
+ * produce it, so a cache left over from an older model or different options is rejected.
+ */
+class MeshCache {
+private:
+	MappedFile m_file;
+	std::span<const Vertex3D> m_vertices;
+	std::span<const uint32_t> m_faces;
+	std::vector<MeshCacheSubMesh> m_subMeshes;
+
+public:
+	/**
+	 * @brief Maps the cache file at the given path. Returns false if the file is missing,
+	 * malformed (including indices of vertices it doesn't have), or was built from a different
+	 * source file or with different import options.
+	 */
+	bool open(const std::filesystem::path& cachePath, uint64_t sourceHash, uint32_t importOptions);
+
+	/**
+	 * @brief Writes a cache file for the given mesh buffers, replacing any existing one.
+	 */
+	static void write(const std::filesystem::path& cachePath, uint64_t sourceHash, uint32_t importOptions,
+		std::span<const Vertex3D> vertices, std::span<const uint32_t> faces,
+		std::span<const MeshCacheSubMesh> subMeshes);
+
+	/**
+	 * @brief Returns the path of the cache file that belongs to a model file.
+	 */
+	static std::filesystem::path pathFor(const std::filesystem::path& modelPath);
+
+	/**
+	 * @brief Hashes the contents of a file, for detecting stale caches.
+	 */
+	static uint64_t hash(const unsigned char* data, size_t size);
+
+	// Views into the mapped file; valid until the cache is destroyed.
+	std::span<const Vertex3D> getVertices() const;
+	std::span<const uint32_t> getFaces() const;
+	std::span<const MeshCacheSubMesh> getSubMeshes() const;
+};
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "Mesh3D.h"
+#include "MeshCache.h"
+
+/**
+ * @brief Reorders a face list so the GPU's post-transform vertex cache hits more often, and then
+ * so faces on the outside of the mesh tend to be drawn before the faces they hide.
+ *
+ * The first pass is Tipsify (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex
+ * Locality and Reduced Overdraw"), which fans around vertices still in a cache of the given
+ * size. Its output is cut into clusters, at the points where it had to jump to a new area of
+ * the mesh and every few hundred faces, and the second pass sorts those clusters so the ones
+ * facing most directly away from the mesh's center come first.
+ */
+void optimizeFaceOrder(std::span<uint32_t> faces, std::span<const Vertex3D> vertices, size_t cacheSize = 16);
+
+/**
+ * @brief Renumbers vertices in the order the faces first use them, so the vertex fetches of
+ * consecutive faces are close together in memory, and drops vertices no face uses.
+ */
+void optimizeVertexFetch(std::vector<Vertex3D>& vertices, std::span<uint32_t> faces);
+
+/**
+ * @brief Optimizes the faces of each sub-mesh range with optimizeFaceOrder, then the vertices of
+ * the whole mesh with optimizeVertexFetch. The sub-mesh ranges keep their offsets and counts.
+ */
+void optimizeMesh(std::vector<Vertex3D>& vertices, std::span<uint32_t> faces,
+	std::span<const MeshCacheSubMesh> subMeshes);
+
+/**
+ * @brief Converts a float to the nearest IEEE half-precision float, as stored by GL_HALF_FLOAT.
+ */
+uint16_t toHalfFloat(float value);
+
+/**
+ * @brief Converts a float in [0, 1] to the nearest 16-bit normalized integer.
+ */
+uint16_t toUnorm16(float value);
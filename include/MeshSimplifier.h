@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "Mesh3D.h"
+#include "MeshCache.h"
+
+/**
+ * @brief Simplifies a face list by vertex clustering: the mesh's bounding box is divided into a
+ * grid of cubic cells, every vertex in a cell is replaced by the one vertex of that cell that
+ * best fits the surface (by the summed plane quadrics of the cell's faces), and faces that
+ * collapse are dropped. The grid is made as fine as possible while keeping at most
+ * targetFaceCount faces.
+ *
+ * The result indexes the same vertices as the original, so it can share its vertex buffer.
+ * The error is set to the size of a cell: roughly how far, in model units, the simplified
+ * surface can be from the original one.
+ */
+std::vector<uint32_t> simplifyByClustering(std::span<const uint32_t> faces, std::span<const Vertex3D> vertices,
+	size_t targetFaceCount, float& error);
+
+/**
+ * @brief Appends simplified levels of detail of each sub-mesh to the face list, halving the
+ * face count from one level to the next, for up to maxLevels levels or until the mesh stops
+ * getting simpler. Every level has one entry per sub-mesh of level 0, in the same order,
+ * appended to the sub-mesh table with its level and error.
+ */
+void generateLods(std::span<const Vertex3D> vertices, std::vector<uint32_t>& faces,
+	std::vector<MeshCacheSubMesh>& subMeshes, size_t maxLevels = MESH_CACHE_MAX_LOD);
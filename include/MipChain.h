@@ -0,0 +1,52 @@
+#pragma once
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "CompressedImage.h"
+#include "StbImage.h"
+
+/**
+ * @brief A texture image's mipmap chain, read from its file on any thread for
+ * Texture::upload(). Only the levels from getFirstLevel() on are kept in memory, so streaming
+ * in a low resolution of a large image doesn't keep its full-size pixels around.
+ *
+ * A pre-compressed version of the image (see CompressedImage::loadCompressedVersionOf) is read
+ * in its place if there is one, with its own mipmaps. Otherwise the image is decoded and its
+ * mipmaps are generated with a box filter, as glGenerateMipmap would.
+ */
+class MipChain {
+public:
+	using Level = CompressedImage::Level;
+
+private:
+	// GL_RGBA8 for decoded images, or the compressed image's format.
+	uint32_t m_format;
+	int m_firstLevel;
+	// Every level, with null data for those before the first.
+	std::vector<Level> m_levels;
+	CompressedImage m_compressed;
+	StbImage m_image;
+	// The generated levels after level 0, which stays in the decoded image.
+	std::vector<std::vector<unsigned char>> m_pixels;
+
+public:
+	MipChain();
+
+	/**
+	 * @brief Reads the levels from firstLevel on, and also skips those larger than maxSize on
+	 * either side, though the last level is always read. Throws std::runtime_error if the
+	 * image can't be read.
+	 */
+	void load(const std::string& imagePath, int firstLevel, int maxSize = INT_MAX);
+
+	uint32_t getFormat() const;
+	bool isCompressed() const;
+	int getFirstLevel() const;
+	const std::vector<Level>& getLevels() const;
+
+	/**
+	 * @brief The first level of a chain that is at most maxSize on either side, or its last level.
+	 */
+	static int levelForSize(const std::vector<Level>& levels, int maxSize);
+};
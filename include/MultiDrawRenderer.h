@@ -0,0 +1,176 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
+#include "GeometryPool.h"
+#include "GpuCuller.h"
+#include "Object3D.h"
+#include "ShaderProgram.h"
+#include "TexturePacker.h"
+
+/**
+ * @brief Draws a list of objects with a handful of multi-draw calls: their meshes' geometry is
+ * copied into shared GeometryPools, and every draw of a pool that uses the same texture is
+ * issued by one glMultiDrawElementsIndirect call.
+ *
+ * Each draw's model matrix is written to a per-instance buffer, and the draw starts its
+ * instances at that matrix's index (its "base instance"), so a shader that reads the model
+ * matrix from attributes 2 through 5, such as texture_perspective_instanced.vert, picks up the
+ * right one for every draw. Without OpenGL 4.3's indirect multi-draws, the same commands are
+ * issued one by one, still without switching vertex arrays between meshes.
+ *
+ * With texture packing on, the textures are copied into texture arrays by a TexturePacker, and
+ * every draw whose texture was packed into the same array joins one multi-draw. Its layer and
+ * region of the layer follow the model matrix, in attributes 6 and 7; a program that reads
+ * them, such as texture_perspective_layered.vert with texturing_layered.frag, must sample the
+ * array from texture unit LAYERED_TEXTURE_UNIT. Textures are packed a frame after they are
+ * first drawn or change, and drawn from their own bindings until then.
+ *
+ * With a GpuCuller, every object's commands are built once and kept on the GPU, where the
+ * culler rewrites them each frame; they are only rebuilt when the objects' meshes change, and
+ * only the records of objects that moved are uploaded again.
+ */
+class MultiDrawRenderer {
+public:
+	MultiDrawRenderer();
+	~MultiDrawRenderer();
+
+	MultiDrawRenderer(const MultiDrawRenderer&) = delete;
+	MultiDrawRenderer& operator=(const MultiDrawRenderer&) = delete;
+
+	// The texture unit packed textures are bound to.
+	static constexpr int LAYERED_TEXTURE_UNIT = 1;
+
+	/**
+	 * @brief Whether the context can issue a pool's draws with one indirect multi-draw call.
+	 */
+	static bool isIndirectSupported();
+
+	/**
+	 * @brief Turns packing the objects' textures into texture arrays on or off. Turning it off
+	 * frees the arrays.
+	 */
+	void setTexturePacking(bool packing);
+	bool getTexturePacking() const;
+	/**
+	 * @brief The packer, while texture packing is on, or null.
+	 */
+	const TexturePacker* getTexturePacker() const;
+
+	/**
+	 * @brief Renders the objects at the given indices with the currently active shader program.
+	 */
+	void render(std::span<const Object3D> objects, std::span<const uint32_t> visible);
+
+	/**
+	 * @brief Renders every object the culler finds visible from the given camera, at the levels
+	 * of detail it picks, with the given shader program. The culler must be supported, and be
+	 * used with one renderer only.
+	 */
+	void render(std::span<const Object3D> objects, GpuCuller& culler, ShaderProgram& program,
+		const glm::mat4& view, const glm::mat4& projection, float viewportHeight);
+
+private:
+	// The layout of GL's DrawElementsIndirectCommand.
+	struct DrawCommand {
+		uint32_t count;
+		uint32_t instanceCount;
+		uint32_t firstIndex;
+		int32_t baseVertex;
+		uint32_t baseInstance;
+	};
+
+	// What each draw's instance reads: its model matrix, and where its texture was packed, with
+	// a layer of -1 if it wasn't.
+	struct InstanceData {
+		glm::mat4 model;
+		glm::vec4 textureRegion;
+		float textureLayer;
+		float padding[3];
+	};
+
+	// A texture that draws are sorted by: a GL_TEXTURE_2D, or a packer's GL_TEXTURE_2D_ARRAY.
+	struct TextureBinding {
+		uint32_t texture;
+		bool layered;
+	};
+
+	// A draw before it is sorted into its pool and texture's run of commands.
+	struct PendingDraw {
+		uint64_t key;
+		DrawCommand command;
+	};
+
+	// Where a mesh's geometry was copied to. A mesh that was replaced in place, such as one
+	// that finished loading, has a new vertex buffer and is copied again.
+	struct PooledMesh {
+		std::weak_ptr<Mesh3D> mesh;
+		uint32_t vertexBuffer;
+		size_t pool;
+		GeometryPool::Allocation allocation;
+	};
+
+	std::vector<std::unique_ptr<GeometryPool>> m_pools;
+	std::unordered_map<const Mesh3D*, PooledMesh> m_meshes;
+	// The textures referred to by the draw keys.
+	std::vector<TextureBinding> m_textures;
+	std::unordered_map<uint64_t, uint32_t> m_textureIndices;
+	std::unique_ptr<TexturePacker> m_packer;
+
+	uint32_t m_instanceBuffer;
+	uint32_t m_indirectBuffer;
+	std::vector<InstanceData> m_instances;
+	std::vector<PendingDraw> m_draws;
+	std::vector<DrawCommand> m_commands;
+
+	// What the GPU-culled commands were built from, per object. The transformation and bounds
+	// are those of the object's last uploaded record.
+	struct CulledObject {
+		const Mesh3D* mesh;
+		uint32_t vertexBuffer;
+		uint64_t transformVersion;
+		BoundingVolume bounds;
+	};
+
+	// A range of the GPU-culled commands that draws from one pool with one texture.
+	struct CommandRun {
+		size_t pool;
+		uint32_t textureIndex;
+		size_t firstCommand;
+		size_t commandCount;
+	};
+
+	const GpuCuller* m_culler = nullptr;
+	std::vector<CulledObject> m_culledObjects;
+	std::vector<CommandRun> m_culledRuns;
+	std::vector<GpuCuller::ObjectRecord> m_objectRecords;
+	std::vector<InstanceData> m_culledInstances;
+	// The textures the culled commands draw with, and the packer's generation and the latest
+	// texture version when they were built.
+	std::vector<std::weak_ptr<Texture>> m_culledTextures;
+	uint64_t m_culledPackGeneration = 0;
+	uint64_t m_culledTextureVersion = 0;
+	uint32_t m_culledCommandBuffer;
+	uint32_t m_culledInstanceBuffer;
+
+	const PooledMesh& poolMesh(const std::shared_ptr<Mesh3D>& mesh);
+	void forgetDeadMeshes();
+	uint32_t textureIndex(uint32_t texture, bool layered);
+	// The index of the binding to draw with the texture, which may be null, filling in where
+	// the instance finds it in the binding.
+	uint32_t bindingFor(const std::shared_ptr<Texture>& texture, InstanceData& instance);
+	void bindTexture(uint32_t textureIndex);
+	void unbindTextures();
+	// Points the per-instance attributes 2 through 7 of the bound vertex array at the given
+	// buffer of InstanceData, starting at the given instance.
+	static void setInstanceAttributes(uint32_t instanceBuffer, size_t firstInstance);
+
+	// Packs the textures queued since the last frame, and those of the culled commands that
+	// changed since.
+	void refreshPacking();
+	bool culledCommandsOutdated(std::span<const Object3D> objects, const GpuCuller& culler) const;
+	void buildCulledCommands(std::span<const Object3D> objects, GpuCuller& culler);
+	void uploadMovedObjects(std::span<const Object3D> objects, GpuCuller& culler);
+};
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Mesh3D.h"
+
+/**
+ * @brief One material's faces in an ObjModel, and the material's diffuse texture as named in
+ * its MTL file (empty if it has none).
+ */
+struct ObjGroup {
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	std::string diffuseTexture;
+};
+
+/**
+ * @brief A Wavefront OBJ model as packed buffers: one vertex per distinct pair of position and
+ * texture coordinate the faces use, and the triangles of each material in one contiguous range.
+ */
+struct ObjModel {
+	std::vector<Vertex3D> vertices;
+	std::vector<uint32_t> faces;
+	std::vector<ObjGroup> groups;
+};
+
+/**
+ * @brief Parses the contents of an OBJ file without Assimp, reading the material libraries it
+ * names from the given directory.
+ *
+ * The file is cut into chunks at line boundaries and the chunks are parsed on the given number
+ * of threads (0 for one per hardware thread, though small files use fewer), then the corners of
+ * the faces are merged into vertices. Polygons are split into triangle fans, and triangles
+ * that repeat a position are dropped, as Assimp's import would. Only positions, texture
+ * coordinates, faces and materials' diffuse maps are read; normals, groups, lines and points
+ * are ignored. A missing material library is reported and its materials left untextured.
+ *
+ * Throws std::runtime_error if the file is malformed, e.g. a face refers to a vertex that
+ * doesn't exist.
+ */
+ObjModel parseObj(std::string_view source, const std::filesystem::path& directory, bool flipTextureCoords,
+	size_t threadCount = 0);
@@ -1,43 +1,89 @@
 #pragma once
+#include <cstdint>
 #include <memory>
 #include "ShaderProgram.h"
 #include "Mesh3D.h"
+#include "TransformStorage.h"
+
+/**
+ * @brief A mesh placed in the world. The object's transformation lives in a slot of the shared
+ * TransformStorage, which the object owns: copies get slots of their own, and destroying the
+ * object releases its slot.
+ */
 class Object3D {
 private:
 	// The object's mesh.
 	std::shared_ptr<Mesh3D> m_mesh;
+	// The object's position, orientation, and scale, relative to its parent transformation if it
+	// has one and in world space otherwise, and its cached local->world transformation matrix,
+	// rebuilt on demand after any change to them.
+	uint32_t m_transform;
+	// The mesh's level of detail to render, as picked by selectLod().
+	size_t m_lod;
 
-	// The object's position, orientation, and scale in world space.
-	glm::vec3 m_position;
-	glm::vec3 m_orientation;
-	glm::vec3 m_scale;
-
-	// The object's cached local->world transformation matrix.
-	// Recomputes the local->world transformation matrix.
-	glm::mat4 buildModelMatrix() const;
-
+	// The slot of an object that was moved from.
+	static constexpr uint32_t NO_TRANSFORM = UINT32_MAX;
 
 public:
 	// No default constructor; you must have a mesh to initialize an object.
 	Object3D() = delete;
 
 	Object3D(std::shared_ptr<Mesh3D>&& mesh);
+	~Object3D();
+
+	Object3D(const Object3D& other);
+	Object3D(Object3D&& other) noexcept;
+	Object3D& operator=(const Object3D& other);
+	Object3D& operator=(Object3D&& other) noexcept;
 
 	// Simple accessors.
-	const glm::vec3& getPosition() const;
-	const glm::vec3& getOrientation() const;
-	const glm::vec3& getScale() const;
+	const std::shared_ptr<Mesh3D>& getMesh() const;
+	glm::vec3 getPosition() const;
+	glm::vec3 getOrientation() const;
+	glm::vec3 getScale() const;
 
 	// Simple mutators.
 	void setPosition(const glm::vec3& position);
 	void setOrientation(const glm::vec3& orientation);
 	void setScale(const glm::vec3& scale);
 
+	// Places the object relative to a parent's local->world transformation, e.g. a SceneGraph
+	// node's world transformation; its position, orientation, and scale are then in the parent's
+	// space. Scene does this for the objects attached to its graph's nodes.
+	void setParentTransform(const glm::mat4& parentTransform);
+	void clearParentTransform();
+
 	// Transformations.
 	void move(const glm::vec3& offset);
 	void rotate(const glm::vec3& rotation);
 	void grow(const glm::vec3& growth);
 
+	// The local->world transformation matrix, as uploaded by render(). Only rebuilt when the
+	// transformation has changed since the last call, or since TransformStorage rebuilt every
+	// changed matrix at once.
+	const glm::mat4& getModelMatrix() const;
+	// A number that changes whenever the object's transformation does, and is never reused by
+	// another transformation. Remember it to find out later whether the object has moved,
+	// e.g. to skip re-uploading the model matrix of a static object.
+	uint64_t getTransformVersion() const;
+	// The largest factor by which the local->world transformation, parent included, scales
+	// lengths along the model axes.
+	float getWorldScale() const;
+	// The mesh's bounds, transformed to world space: the box is the smallest axis-aligned one
+	// around the transformed model-space box, and the sphere is scaled by the largest scale.
+	BoundingVolume getWorldBounds() const;
+
+	// Picks the mesh's level of detail for the coming frame: the simplest one whose error
+	// would cover at most pixelError pixels on screen, given the view and projection matrices
+	// and the viewport's height in pixels. A simpler level is only taken once its error is
+	// comfortably below the limit, so objects near a threshold don't flicker between levels.
+	// "Comfortably" is LOD_HYSTERESIS times the limit.
+	static constexpr float LOD_HYSTERESIS = 0.75f;
+	void selectLod(const glm::mat4& view, const glm::mat4& projection, float viewportHeight, float pixelError = 1.0f);
+	size_t getLod() const;
+
 	// Rendering.
 	void render(ShaderProgram& shaderProgram) const;
+	// Renders using a pre-resolved handle to the program's "model" uniform.
+	void render(ShaderProgram& shaderProgram, UniformHandle modelUniform) const;
 };
\ No newline at end of file
@@ -0,0 +1,174 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Measures frames, and named sections of them (e.g. "update", "render"), on the CPU
+ * and on the GPU, and counts rendering events per frame.
+ *
+ * GPU times come from GL_TIME_ELAPSED queries kept in a small ring per section, so a result
+ * is read a few frames after it was issued, once it is available, and never stalls the
+ * pipeline. Nothing is printed or written while frames run: reports and exports are produced
+ * on request, from the frames the profiler has kept.
+ *
+ * All methods must be called on the thread that owns the OpenGL context.
+ */
+class Profiler {
+public:
+	enum class Counter {
+		DrawCalls,
+		StateChanges,
+		UniformUploads,
+		ObjectsVisible,
+		ObjectsCulled,
+		Count
+	};
+
+	/**
+	 * @brief A summary of a measurement over the recent frames, in milliseconds.
+	 */
+	struct Stats {
+		size_t samples = 0;
+		double mean = 0;
+		double p50 = 0;
+		double p99 = 0;
+		double max = 0;
+	};
+
+	/**
+	 * @brief Times a section from construction to destruction.
+	 */
+	class Scope {
+	private:
+		Profiler& m_profiler;
+
+	public:
+		/**
+		 * @brief Starts the named section. GPU sections cannot overlap, so a GPU section opened
+		 * inside another is only timed on the CPU.
+		 */
+		Scope(Profiler& profiler, const char* name, bool gpu = true);
+		~Scope();
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	};
+
+	/**
+	 * @brief Creates a profiler whose reports cover up to the given number of recent frames.
+	 */
+	explicit Profiler(size_t historyFrames = 1024);
+	~Profiler();
+
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	void beginFrame();
+	void endFrame();
+
+	void beginSection(const char* name, bool gpu = true);
+	void endSection();
+
+	/**
+	 * @brief Counts an event towards the current frame. Cheap enough to call for every draw.
+	 */
+	static void count(Counter counter, uint32_t amount = 1) {
+		s_counters[static_cast<size_t>(counter)] += amount;
+	}
+
+	/**
+	 * @brief Reads the GPU results that have become available. endFrame() does this already;
+	 * call it directly after glFinish() to pick up the last frames' results.
+	 */
+	void collectGpuResults();
+
+	Stats getFrameTimeStats() const;
+	/**
+	 * @brief The named section's CPU or GPU times, over the recent frames it ran in.
+	 */
+	Stats getSectionStats(const std::string& section, bool gpu) const;
+	/**
+	 * @brief The counter's average per frame, over the recent frames.
+	 */
+	double getCounterAverage(Counter counter) const;
+
+	/**
+	 * @brief Keeps every frame from now on, instead of only the recent history, so the whole
+	 * run can be exported.
+	 */
+	void setRecording(bool recording);
+
+	/**
+	 * @brief Writes a summary of the recent frames: frame-time percentiles and histogram, and
+	 * each section's CPU and GPU times and the counters, averaged per frame.
+	 */
+	void writeReport(std::ostream& out) const;
+
+	/**
+	 * @brief Writes one line per kept frame, with its frame time, section times and counters.
+	 */
+	void writeCsv(const std::string& path) const;
+
+	/**
+	 * @brief Writes the kept frames in the Chrome trace event format, for chrome://tracing or
+	 * Perfetto. GPU sections are drawn on their own track, starting where the CPU issued them.
+	 */
+	void writeChromeTrace(const std::string& path) const;
+
+private:
+	// The number of frames a GPU query has to become available before its slot is reused.
+	static constexpr size_t QueryLatency = 4;
+
+	struct Section {
+		std::string name;
+		bool gpu;
+		std::array<uint32_t, QueryLatency> queries;
+		// The frame each query was issued in, or -1 for a query with no pending result.
+		std::array<int64_t, QueryLatency> queryFrames;
+	};
+
+	struct SectionTiming {
+		size_t section;
+		double cpuStart;
+		double cpuTime;
+		// Negative until the GPU result is read.
+		double gpuTime;
+		bool gpuTimed;
+	};
+
+	struct FrameRecord {
+		int64_t frame;
+		double start;
+		// Negative while the frame is running.
+		double frameTime;
+		std::array<uint32_t, static_cast<size_t>(Counter::Count)> counters;
+		std::vector<SectionTiming> sections;
+	};
+
+	inline static std::array<uint32_t, static_cast<size_t>(Counter::Count)> s_counters{};
+
+	std::chrono::steady_clock::time_point m_epoch;
+	size_t m_historyFrames;
+	bool m_recording;
+
+	std::vector<Section> m_sections;
+	std::deque<FrameRecord> m_frames;
+	int64_t m_frame;
+	// The open sections, as indices into the current frame's timings, and whether each one
+	// holds the GPU query.
+	std::vector<std::pair<size_t, bool>> m_openSections;
+	bool m_gpuQueryOpen;
+
+	// Milliseconds since the profiler was created.
+	double now() const;
+	size_t sectionIndex(const char* name, bool gpu);
+	// The index of the first frame the statistics cover.
+	size_t firstRecentFrame() const;
+	static Stats statsOf(std::vector<double> values);
+};
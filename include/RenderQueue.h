@@ -0,0 +1,151 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <glm/glm.hpp>
+#include "JobSystem.h"
+#include "Object3D.h"
+#include "ShaderProgram.h"
+#include "StreamBuffer.h"
+
+/**
+ * @brief Collects a frame's draws as keyed packets, sorts them, and issues them with as few
+ * state changes as possible.
+ *
+ * Each sub-mesh of a submitted object becomes one packet, with a 64-bit key made of its
+ * program, texture, vertex array and view depth. The packets are radix-sorted by key, so
+ * draws that share state end up next to each other, and the backend only binds a program,
+ * vertex array or texture when it differs from the previous draw's.
+ *
+ * By default state comes first in the key and depth last, so draws with the same state are
+ * drawn front to back. With depth first, every draw is front to back, for the most early-Z
+ * rejection at the cost of more state changes; that is the better order when fragment
+ * shading dominates.
+ *
+ * With a depth pre-pass, flush() first draws the packets of programs that have a depth
+ * program (see setDepthProgram()) into the depth buffer alone, then shades them with a
+ * GL_EQUAL depth test and depth writes off, so each pixel runs the expensive fragment shader
+ * once, for the surface left in front. That costs a second pass over the geometry, so it
+ * pays off when the scene is fill-rate bound with a lot of overdraw; front to back order gets
+ * most of the rejection without one.
+ *
+ * Packets can also be built on a JobSystem's workers, each into its own list; the lists are
+ * merged into the queue before the call returns, so only sorting and drawing happen on the
+ * thread that owns the OpenGL context.
+ *
+ * Programs that declare an "Object" uniform block (see ObjectUniforms), such as
+ * texture_perspective_object.vert, read each draw's model matrix from a slot of one large
+ * uniform buffer instead of a "model" uniform: flush() writes every slot in one go, and each
+ * draw only binds its range of the buffer.
+ */
+class RenderQueue {
+public:
+	RenderQueue() = default;
+	~RenderQueue();
+
+	RenderQueue(const RenderQueue&) = delete;
+	RenderQueue& operator=(const RenderQueue&) = delete;
+
+	/**
+	 * @brief Starts a new frame of packets, whose depths are measured with the given view matrix.
+	 */
+	void begin(const glm::mat4& view);
+
+	/**
+	 * @brief Queues the object's draws, at its current level of detail, with the given program,
+	 * which must have a "model" matrix uniform. The program must outlive the call to flush().
+	 */
+	void submit(ShaderProgram& program, const Object3D& object);
+	/**
+	 * @brief Queues the draws of the objects at the given indices like submit(), building their
+	 * packets on the job system's workers. No object may appear twice.
+	 */
+	void submit(JobSystem& jobs, ShaderProgram& program, std::span<const Object3D> objects,
+		std::span<const uint32_t> indices);
+
+	/**
+	 * @brief Sorts and draws every packet submitted since begin().
+	 */
+	void flush();
+
+	void setDepthFirst(bool depthFirst);
+	/**
+	 * @brief Gives a program the position-only program its packets' depth pre-pass is drawn
+	 * with, or null for none. The depth program must compute gl_Position exactly as the
+	 * program does, from the same "model" uniform or "Object" block, and both must declare it
+	 * invariant, so the shading pass's GL_EQUAL test passes on the surfaces the pre-pass left.
+	 */
+	void setDepthProgram(ShaderProgram& program, ShaderProgram* depthProgram);
+	/**
+	 * @brief Turns the depth pre-pass on or off. Expects GL_DEPTH_TEST on with GL_LESS, and
+	 * leaves it that way.
+	 */
+	void setDepthPrepass(bool depthPrepass);
+	/**
+	 * @brief Sets the GL_UNIFORM_BUFFER stream buffer that programs with an "Object" block read
+	 * their draws' data from, which needs a slot of UniformBuffer::getOffsetAlignment() bytes
+	 * (rounded up to a whole ObjectUniforms) per such draw; a frame with more of those draws
+	 * than its region has slots for grows the buffer, and one whose region fails to map
+	 * uploads its slots to a buffer of the queue's own. Must be set before flushing draws of
+	 * those programs.
+	 */
+	void setObjectBuffer(StreamBuffer* objectBuffer);
+	size_t getPacketCount() const;
+
+private:
+	struct Packet {
+		uint32_t program;
+		uint32_t vertexArray;
+		uint32_t texture;
+		uint32_t indexType;
+		uint32_t indexCount;
+		size_t indexByteOffset;
+		glm::mat4 model;
+	};
+
+	struct SortEntry {
+		uint64_t key;
+		uint32_t packet;
+	};
+
+	// The programs submitted to the queue, which packets refer to by index, so a program's
+	// index fits in the key.
+	struct ProgramEntry {
+		ShaderProgram* program;
+		UniformHandle modelUniform;
+		bool objectBlock;
+		// The program the pre-pass draws the packets with, or null to shade them without one.
+		ShaderProgram* depthProgram;
+		UniformHandle depthModelUniform;
+	};
+
+	glm::mat4 m_view = glm::mat4(1);
+	bool m_depthFirst = false;
+	bool m_depthPrepass = false;
+	StreamBuffer* m_objectBuffer = nullptr;
+	// Holds the slots instead when the object buffer fails to map, created on first use.
+	uint32_t m_fallbackObjectBuffer = 0;
+	std::vector<unsigned char> m_fallbackSlots;
+	std::vector<ProgramEntry> m_programs;
+	std::vector<Packet> m_packets;
+	std::vector<SortEntry> m_entries;
+	std::vector<SortEntry> m_scratch;
+
+	// A worker's packets, whose entries refer to them by their index in this list until they
+	// are merged into the queue's.
+	struct PacketList {
+		std::vector<Packet> packets;
+		std::vector<SortEntry> entries;
+	};
+	std::vector<PacketList> m_workerLists;
+
+	uint32_t programIndex(ShaderProgram& program);
+	// Draws the sorted packets that have a depth program into the depth buffer only. Their
+	// object block slots start at the given offset in slotBuffer, one slot per packet whose
+	// program has a block, or there are none if slotBuffer is 0.
+	void drawDepthPrepass(uint32_t slotBuffer, size_t firstSlotOffset, size_t slotSize);
+	uint64_t makeKey(const Packet& packet, float depth) const;
+	// Appends the object's packets and their entries to the given lists. Only reads the queue.
+	void buildPackets(uint32_t programId, const Object3D& object, std::vector<Packet>& packets,
+		std::vector<SortEntry>& entries) const;
+};
@@ -0,0 +1,119 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+#include <glm/glm.hpp>
+#include "AabbTree.h"
+#include "JobSystem.h"
+#include "Object3D.h"
+#include "SceneGraph.h"
+#include "ShaderProgram.h"
+
+/**
+ * @brief A list of objects drawn with one shader program, with a bounding volume hierarchy
+ * over the objects' world-space bounds for frustum, box and ray queries.
+ *
+ * The objects may be added to, removed from the end of, and transformed freely; update()
+ * brings the hierarchy up to date with them, refitting only the objects whose transformation
+ * or mesh bounds changed since the last update. Objects are identified by their index in the
+ * list.
+ *
+ * Objects can also be attached to nodes of the scene's graph, to be placed relative to the
+ * node's world transformation: moving a node moves every object attached to it or below it,
+ * at the next update.
+ */
+class Scene {
+public:
+	std::vector<Object3D> objects;
+	ShaderProgram program;
+	SceneGraph graph;
+
+	/**
+	 * @brief The nearest object whose bounds a ray hits.
+	 */
+	struct RayHit {
+		uint32_t object;
+		float distance;
+	};
+
+	Scene(std::vector<Object3D> objects, ShaderProgram program);
+
+	/**
+	 * @brief Adds an object to the end of the list, and returns its index.
+	 */
+	size_t addObject(Object3D object);
+
+	/**
+	 * @brief Places an object relative to a node of the graph from the next update on, or back in
+	 * world space if the node is SceneGraph::NO_NODE. Objects attached to a node that is
+	 * destroyed go back to world space too, unless a new node reuses its id first.
+	 */
+	void attach(size_t object, SceneGraph::NodeId node);
+	SceneGraph::NodeId getNode(size_t object) const;
+
+	/**
+	 * @brief Brings the hierarchy up to date with the objects, after updating the graph, handing
+	 * the attached objects their nodes' new world transformations, and rebuilding every changed
+	 * model matrix in TransformStorage's batches. Queries only see the objects as they were at
+	 * the last update.
+	 */
+	void update();
+	/**
+	 * @brief Brings the hierarchy up to date like update(), rebuilding the model matrices and
+	 * recomputing the moved objects' bounds on the job system's workers. Only the tree itself is
+	 * updated on the calling thread.
+	 */
+	void update(JobSystem& jobs);
+
+	/**
+	 * @brief Finds the objects whose bounds are in the frustum of the given projection * view
+	 * matrix, in no particular order, and counts them (and the others) towards the profiler.
+	 */
+	void queryFrustum(const glm::mat4& viewProjection, std::vector<uint32_t>& visible) const;
+	/**
+	 * @brief Finds the objects in the frustum like queryFrustum(), testing the candidates the
+	 * hierarchy finds against their own bounds on the job system's workers.
+	 */
+	void queryFrustum(const glm::mat4& viewProjection, std::vector<uint32_t>& visible, JobSystem& jobs) const;
+	/**
+	 * @brief Finds the objects whose bounding boxes overlap the given box.
+	 */
+	void queryBox(const Aabb& box, std::vector<uint32_t>& results) const;
+	/**
+	 * @brief Finds the object whose bounding box the ray origin + t * direction enters first,
+	 * within maxDistance (in units of the direction's length).
+	 */
+	std::optional<RayHit> raycast(const glm::vec3& origin, const glm::vec3& direction,
+		float maxDistance = std::numeric_limits<float>::infinity()) const;
+
+private:
+	AabbTree m_tree;
+	// Per object: its proxy in the tree, its world bounds as an Aabb, and what they were
+	// computed from.
+	std::vector<int32_t> m_proxies;
+	std::vector<Aabb> m_bounds;
+	std::vector<uint64_t> m_transformVersions;
+	std::vector<BoundingVolume> m_meshBounds;
+	// Scratch space for the parallel update and query: which objects moved, and which
+	// candidates are inside the frustum.
+	std::vector<uint8_t> m_moved;
+	mutable std::vector<uint8_t> m_inside;
+	// Per object: the graph node it is attached to, and the version of the node's world
+	// transformation it was last given.
+	std::vector<SceneGraph::NodeId> m_objectNodes;
+	std::vector<uint64_t> m_nodeVersions;
+
+	Aabb worldBounds(size_t object) const;
+	// Updates the graph and gives the attached objects whose node moved its world transformation.
+	void applyGraph();
+	// Drops the proxies of objects removed from the end of the list.
+	void removeDeleted();
+	// Recomputes an object's bounds if its transformation or mesh bounds changed, and returns
+	// whether they did. Touches nothing but the object and its own entries.
+	bool refreshBounds(size_t object);
+	// Adds proxies for the objects added since the last update.
+	void addNew();
+	// Counts the objects a frustum query found, and the others, towards the profiler.
+	void countVisible(size_t visibleCount) const;
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+ * @brief A hierarchy of transformation nodes, each placed relative to its parent, whose world
+ * transformations are brought up to date by one sweep over the nodes.
+ *
+ * The nodes are stored in flat arrays in depth-first order, so every parent comes before its
+ * children and every subtree is one contiguous range. Changing a node's local transformation
+ * only marks it dirty, along with a "has a dirty descendant" mark on its ancestors; update()
+ * then walks the arrays front to back, jumping over the subtrees with nothing dirty in them,
+ * and recomputes the world transformation of the dirty nodes and everything below them. Moving
+ * the root of a 500-part model is one setLocalTransform() call.
+ *
+ * Nodes are identified by ids that stay the same while the arrays are reordered. Adding a node
+ * anywhere but at the end of the last subtree, reparenting and destroying nodes shift the
+ * arrays, so they cost time linear in the number of nodes.
+ */
+class SceneGraph {
+public:
+	using NodeId = uint32_t;
+	static constexpr NodeId NO_NODE = UINT32_MAX;
+
+	/**
+	 * @brief Adds a node as the last child of the given parent, or as a new root.
+	 */
+	NodeId createNode(NodeId parent = NO_NODE, const glm::mat4& localTransform = glm::mat4(1));
+	/**
+	 * @brief Destroys a node and every node below it.
+	 */
+	void destroyNode(NodeId node);
+	bool contains(NodeId node) const;
+
+	/**
+	 * @brief Moves a node, with its subtree, to be the last child of the given parent, or a
+	 * root. Throws std::runtime_error if the parent is in the node's own subtree.
+	 */
+	void setParent(NodeId node, NodeId parent);
+	NodeId getParent(NodeId node) const;
+
+	void setLocalTransform(NodeId node, const glm::mat4& localTransform);
+	const glm::mat4& getLocalTransform(NodeId node) const;
+	/**
+	 * @brief The node's local->world transformation as of the last update(): its parent's
+	 * world transformation times its own local one.
+	 */
+	const glm::mat4& getWorldTransform(NodeId node) const;
+	/**
+	 * @brief A number that changes whenever update() gives the node a new world transformation.
+	 */
+	uint64_t getWorldVersion(NodeId node) const;
+
+	/**
+	 * @brief Recomputes the world transformations of the dirty nodes and their descendants.
+	 */
+	void update();
+
+	size_t getNodeCount() const;
+
+private:
+	static constexpr uint32_t NO_INDEX = UINT32_MAX;
+	// A node's own local transformation changed.
+	static constexpr uint8_t DIRTY = 1;
+	// Some node below it is dirty.
+	static constexpr uint8_t DIRTY_BELOW = 2;
+
+	// Per node, in depth-first order.
+	std::vector<NodeId> m_ids;
+	std::vector<NodeId> m_parents;
+	// The parent's index in these arrays, or NO_INDEX for roots.
+	std::vector<uint32_t> m_parentIndices;
+	// The number of nodes in the node's subtree, itself included.
+	std::vector<uint32_t> m_subtreeSizes;
+	std::vector<glm::mat4> m_localTransforms;
+	std::vector<glm::mat4> m_worldTransforms;
+	std::vector<uint64_t> m_worldVersions;
+	std::vector<uint8_t> m_dirty;
+	// Scratch space for update(): whether each node's world transformation was recomputed.
+	std::vector<uint8_t> m_changed;
+
+	// Each id's index in the arrays, or NO_INDEX if it is free.
+	std::vector<uint32_t> m_indices;
+	std::vector<NodeId> m_freeIds;
+	uint64_t m_nextVersion = 1;
+
+	uint32_t indexOf(NodeId node) const;
+	// Marks the node's ancestors as having a dirty node below them.
+	void markAncestors(uint32_t index);
+	// Adds count to the subtree sizes of the node at the index and its ancestors.
+	void growAncestors(uint32_t index, int64_t count);
+	// Refreshes the id -> index table and the parent indices, from the given index on.
+	void reindex(size_t from);
+};
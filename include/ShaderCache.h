@@ -0,0 +1,94 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "ShaderProgram.h"
+
+/**
+ * @brief Builds shader programs once per set of sources, keeps their linked binaries on disk
+ * between runs, and reloads them when their source files change.
+ *
+ * Programs are keyed by a hash of their stages' sources, so loading the same shaders twice
+ * returns copies of one ShaderProgram instead of compiling them again. A newly linked program's
+ * binary is saved with glGetProgramBinary in the binary directory, named by its source hash and
+ * stamped with the driver that built it, and the next run links it from there with
+ * glProgramBinary. A binary from another driver, or one the driver rejects, is rebuilt from
+ * source.
+ *
+ * With hot reload on, update() watches the source files. A changed program is rebuilt in the
+ * background where GL_KHR_parallel_shader_compile is supported, or right away where it isn't,
+ * while the old program stays in use; once it links, it replaces the old one in every copy
+ * of the ShaderProgram, keeping its uniform values (see ShaderProgram::replaceProgram). A
+ * program that fails to build is reported, and the old one kept.
+ *
+ * All methods must be called on the thread that owns the OpenGL context.
+ */
+class ShaderCache {
+public:
+	/**
+	 * @brief Creates a cache that keeps linked binaries in the given directory, which is
+	 * created when the first binary is saved.
+	 */
+	explicit ShaderCache(std::filesystem::path binaryDirectory = "shader_cache");
+	~ShaderCache();
+
+	ShaderCache(const ShaderCache&) = delete;
+	ShaderCache& operator=(const ShaderCache&) = delete;
+
+	/**
+	 * @brief Returns the program of the given vertex and fragment shaders, building it unless
+	 * the same sources were loaded before. Throws std::runtime_error if a file can't be read or
+	 * the program doesn't build.
+	 */
+	ShaderProgram load(const std::string& vertexShaderPath, const std::string& fragmentShaderPath);
+	/**
+	 * @brief Returns the program of the given compute shader, like load(). Needs OpenGL 4.3.
+	 */
+	ShaderProgram loadCompute(const std::string& computeShaderPath);
+
+	void setHotReload(bool hotReload);
+	bool getHotReload() const;
+
+	/**
+	 * @brief With hot reload on, starts rebuilding the programs whose source files changed,
+	 * and swaps in the ones that finished. Call once per frame; the files are checked a few
+	 * times per second.
+	 */
+	void update();
+
+	/**
+	 * @brief The number of distinct programs built.
+	 */
+	size_t getProgramCount() const;
+
+private:
+	struct Entry {
+		// The shader stages' types and source files, and when the files were last written.
+		std::vector<uint32_t> types;
+		std::vector<std::string> paths;
+		std::vector<std::filesystem::file_time_type> writeTimes;
+		uint64_t sourceHash;
+		ShaderProgram program;
+		// A rebuild in progress, if pendingProgram isn't 0, of the sources with pendingHash.
+		uint32_t pendingProgram;
+		std::vector<uint32_t> pendingShaders;
+		uint64_t pendingHash;
+	};
+
+	std::filesystem::path m_binaryDirectory;
+	std::vector<Entry> m_entries;
+	bool m_hotReload;
+	std::chrono::steady_clock::time_point m_lastCheck;
+
+	ShaderProgram loadStages(std::vector<uint32_t> types, std::vector<std::string> paths);
+	// Links the program from its saved binary, or returns 0 if there is none the driver takes.
+	uint32_t loadBinary(uint64_t sourceHash) const;
+	void saveBinary(uint64_t sourceHash, uint32_t program) const;
+	std::filesystem::path binaryPath(uint64_t sourceHash) const;
+	// Starts rebuilding the entry from the given sources.
+	void startRebuild(Entry& entry, const std::vector<std::string>& sources, uint64_t sourceHash);
+	// Swaps in the entry's rebuilt program if it is done, or drops it if it failed.
+	void finishRebuild(Entry& entry);
+};
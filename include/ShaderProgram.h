@@ -1,15 +1,76 @@
 #pragma once
 #include <glm/ext.hpp>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief A uniform location resolved once from a ShaderProgram, so per-draw uniform
+ * uploads can skip the name lookup.
+ */
+struct UniformHandle {
+	int32_t location = -1;
+
+	bool isValid() const { return location >= 0; }
+};
+
 class ShaderProgram {
-	uint32_t m_programId;
+	// The linked program, shared by every copy of this ShaderProgram, so a program swapped in
+	// with replaceProgram() is used through all of them.
+	struct Linked {
+		uint32_t programId;
+		// Every active uniform's location, keyed by name. Built once when the program is linked.
+		std::unordered_map<std::string, int32_t> uniformLocations;
+		// The names of the active uniform blocks.
+		std::vector<std::string> uniformBlocks;
+	};
+	std::shared_ptr<Linked> m_linked;
+
+	// Queries the linked program's active uniforms and fills the location table, and binds its
+	// uniform blocks to their binding points (see UniformBuffer::bindingPoint).
+	void cacheUniformLocations();
 
 public:
 	ShaderProgram();
+	/**
+	 * @brief Wraps a program that is already linked, such as one built by a ShaderCache.
+	 */
+	explicit ShaderProgram(uint32_t programId);
 	void load(const std::string& vertexShaderPath, const std::string& fragmentShaderPath);
+	/**
+	 * @brief Builds the program from a single compute shader, to be run with glDispatchCompute
+	 * rather than drawn with. Needs OpenGL 4.3.
+	 */
+	void loadCompute(const std::string& computeShaderPath);
 
 	void activate();
 
+	/**
+	 * @brief The OpenGL name of the program this and every copy of it currently use.
+	 */
+	uint32_t getId() const;
+
+	/**
+	 * @brief Swaps in another linked program for this one and all of its copies, carrying over
+	 * the values of the uniforms the two have in common, and deletes the old program. Uniform
+	 * handles resolved from the old program must be resolved again.
+	 */
+	void replaceProgram(uint32_t programId);
+
+	/**
+	 * @brief Looks up a uniform's location in the cached table. The handle is invalid
+	 * if the program has no active uniform with that name; setting an invalid handle
+	 * is a no-op, just like an unknown uniform name.
+	 */
+	UniformHandle getUniformHandle(const std::string& uniformName) const;
+
+	/**
+	 * @brief Whether the program declares a uniform block with the given name, which reads from
+	 * the buffer bound to UniformBuffer::bindingPoint of that name.
+	 */
+	bool hasUniformBlock(const std::string& blockName) const;
+
 	void setUniform(const std::string& uniformName, bool value);
 	void setUniform(const std::string& uniformName, int32_t value);
 	void setUniform(const std::string& uniformName, float value);
@@ -19,4 +80,14 @@ public:
 	void setUniform(const std::string& uniformName, const glm::mat2& value);
 	void setUniform(const std::string& uniformName, const glm::mat3& value);
 	void setUniform(const std::string& uniformName, const glm::mat4& value);
+
+	void setUniform(UniformHandle uniform, bool value);
+	void setUniform(UniformHandle uniform, int32_t value);
+	void setUniform(UniformHandle uniform, float value);
+	void setUniform(UniformHandle uniform, const glm::vec2& value);
+	void setUniform(UniformHandle uniform, const glm::vec3& value);
+	void setUniform(UniformHandle uniform, const glm::vec4& value);
+	void setUniform(UniformHandle uniform, const glm::mat2& value);
+	void setUniform(UniformHandle uniform, const glm::mat3& value);
+	void setUniform(UniformHandle uniform, const glm::mat4& value);
 };
\ No newline at end of file
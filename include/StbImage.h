@@ -2,17 +2,24 @@
 #ifndef __STBIMAGE_H
 #define __STBIMAGE_H
 #include "stb_image.h"
+#include <cstddef>
 #include <memory>
 #include <string>
 class StbImage
 {
     int m_width, m_height, m_bpp;
-    std::unique_ptr<unsigned char[]> m_data = nullptr;
+    // Allocated by stb_image, so it must be freed by stb_image too.
+    std::unique_ptr<unsigned char, void (*)(void*)> m_data{ nullptr, stbi_image_free };
 
 public:
     StbImage();
 
+    // Maps the file into memory and decodes it from there, without reading it into a buffer first.
     void loadFromFile(const std::string& filepath);
+    // Decodes an image file's contents that are already in memory, e.g. a mapped file.
+    void loadFromMemory(const unsigned char* data, size_t size);
+    // Frees the decoded pixels, e.g. once they are uploaded. The size stays known.
+    void release();
 
     int getWidth() const;
     int getHeight() const;
@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "GlFence.h"
+
+/**
+ * @brief A GPU buffer for data that is rewritten every frame, such as instance transforms or
+ * animated vertices, that never makes the CPU wait for the driver.
+ *
+ * The buffer is split into one region per frame in flight. Each frame writes only to its own
+ * region, and a fence placed at the end of the frame tells a later frame when the GPU is done
+ * reading that region, so it can be reused without stalling or orphaning the buffer. When the
+ * context supports it (OpenGL 4.4), the whole buffer is mapped once with glBufferStorage and
+ * stays mapped; otherwise each write maps its range with glMapBufferRange, unsynchronized,
+ * since the fences already guarantee the GPU is not using it.
+ */
+class StreamBuffer {
+private:
+	uint32_t m_buffer;
+	uint32_t m_target;
+	size_t m_regionSize;
+	std::vector<GLsync> m_fences;
+	// The region being written this frame, and how much of it is used.
+	size_t m_region;
+	size_t m_regionUsed;
+	// The persistent mapping of the whole buffer, or null when mapping per write.
+	unsigned char* m_persistentData;
+	bool m_mapped;
+
+	// Creates the buffer, with room for every region.
+	void createStorage();
+
+public:
+	/**
+	 * @brief Creates a buffer for the given target (e.g. GL_ARRAY_BUFFER) with room for
+	 * regionSize bytes per frame, and the given number of frames in flight.
+	 */
+	StreamBuffer(uint32_t target, size_t regionSize, size_t framesInFlight = 3);
+	~StreamBuffer();
+
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+	/**
+	 * @brief Moves on to the next frame's region, waiting if the GPU is still reading it
+	 * (which only happens when the CPU is more than framesInFlight frames ahead).
+	 */
+	void beginFrame();
+
+	/**
+	 * @brief Marks the end of the frame's draws that read from this buffer.
+	 */
+	void endFrame();
+
+	/**
+	 * @brief Reserves size bytes of this frame's region, aligned to the given alignment, and
+	 * returns a pointer to write them through. The byte offset of the reservation within the
+	 * buffer is stored in offset. Call unmap() when done writing, before drawing from it.
+	 * Throws std::runtime_error if the frame's region is full, and returns null, reserving
+	 * nothing, if the driver fails to map the range; the caller should upload some other way.
+	 */
+	void* map(size_t size, size_t alignment, size_t& offset);
+
+	/**
+	 * @brief Whether map() can still reserve size bytes with the given alignment this frame.
+	 */
+	bool hasRoom(size_t size, size_t alignment) const;
+
+	/**
+	 * @brief Finishes writing the most recent map() reservation.
+	 */
+	void unmap();
+
+	/**
+	 * @brief Replaces the buffer with one whose regions hold at least regionSize bytes, at least
+	 * doubling them, for a frame that needs more room than it has. The rest of the frame is
+	 * written to the new buffer, starting from an empty region, so look getBuffer() up again
+	 * for the draws that read it; draws already issued keep reading the old one, which is
+	 * deleted once the GPU is done with them (see GpuResources).
+	 */
+	void grow(size_t regionSize);
+
+	uint32_t getBuffer() const;
+	size_t getRegionSize() const;
+	bool isPersistent() const;
+};
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "CompressedImage.h"
+#include "MipChain.h"
+#include "StbImage.h"
+
+class StreamBuffer;
+
+/**
+ * @brief A 2D texture that lives on the GPU, with a full mipmap chain. It is either an RGBA
+ * image whose mipmaps are generated at upload, or a block-compressed image that brings its
+ * own precomputed mipmaps.
+ *
+ * A streamed texture only has some of its levels on the GPU: every level from its base level
+ * down to the smallest. Finer levels are added by uploading a MipChain that starts at them,
+ * and dropped again by evictLevels(); sampling never reads past the base level.
+ *
+ * A Texture owns its OpenGL texture name, which is deleted along with the object. Textures
+ * cannot be copied; meshes share them through std::shared_ptr handles instead, usually
+ * handed out by a TextureManager.
+ */
+class Texture {
+private:
+	uint32_t m_textureId;
+	int m_width;
+	int m_height;
+	// GL_RGBA8, or the compressed format of the levels.
+	uint32_t m_format;
+	// The size in bytes of every level of the full chain, and the first one on the GPU.
+	std::vector<size_t> m_levelSizes;
+	int m_baseLevel;
+	uint64_t m_version;
+
+	void setLevelRange();
+
+public:
+	/**
+	 * @brief Creates a 1x1 mid-grey placeholder texture, to be replaced later by upload().
+	 */
+	Texture();
+	/**
+	 * @brief Uploads a decoded image to a new GPU texture and generates its mipmaps.
+	 */
+	explicit Texture(const StbImage& image);
+	/**
+	 * @brief Uploads a block-compressed image and its mipmap chain to a new GPU texture.
+	 */
+	explicit Texture(const CompressedImage& image);
+	~Texture();
+
+	Texture(const Texture&) = delete;
+	Texture& operator=(const Texture&) = delete;
+
+	/**
+	 * @brief Replaces the texture's contents with a decoded image, keeping its OpenGL name, so
+	 * every mesh holding this texture sees the new image.
+	 *
+	 * Every upload can go through a staging buffer for GL_PIXEL_UNPACK_BUFFER: the pixels are
+	 * copied into its mapped region and the texture is filled from there, so the driver can
+	 * transfer them to the GPU in the background and the image can be freed right away. Pixels
+	 * that don't fit in the frame's region are uploaded directly.
+	 */
+	void upload(const StbImage& image, StreamBuffer* staging = nullptr);
+	void upload(const CompressedImage& image, StreamBuffer* staging = nullptr);
+
+	/**
+	 * @brief Uploads the levels of the chain from its first level up to the texture's base
+	 * level, and makes its first level the new base level. If the chain is of a different
+	 * image than the texture holds, it replaces the texture's contents instead, like the other
+	 * uploads.
+	 */
+	void upload(const MipChain& chain, StreamBuffer* staging = nullptr);
+
+	/**
+	 * @brief Frees the levels before the given one, which becomes the base level. The last
+	 * level always stays.
+	 */
+	void evictLevels(int baseLevel);
+
+	uint32_t getId() const;
+	// The full-size image's size, whether or not its level 0 is on the GPU.
+	int getWidth() const;
+	int getHeight() const;
+	// GL_RGBA8, or the compressed format of the levels.
+	uint32_t getFormat() const;
+
+	// A number that changes whenever the texture's contents or resident levels do, and is
+	// never reused by another texture.
+	uint64_t getVersion() const;
+	// The latest version of any texture, which changes whenever any texture does.
+	static uint64_t getLatestVersion();
+
+	int getLevelCount() const;
+	int getBaseLevel() const;
+	// The size in bytes of the given level, and of all the levels on the GPU.
+	size_t getLevelSize(int level) const;
+	size_t getResidentSize() const;
+};
@@ -0,0 +1,51 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "Texture.h"
+
+/**
+ * @brief Loads textures from image files, uploading each file to the GPU only once.
+ *
+ * Every request for the same file returns a handle to the same Texture, so GPU memory and
+ * load time grow with the number of unique images rather than the number of meshes using
+ * them. The manager only holds weak references: a texture is freed as soon as the last
+ * mesh using it is destroyed, and is reloaded if it is requested again later.
+ */
+class TextureManager {
+private:
+	// Live textures, keyed by the canonical path of their image file.
+	std::unordered_map<std::string, std::weak_ptr<Texture>> m_textures;
+
+	static std::string keyFor(const std::string& filepath);
+
+public:
+	/**
+	 * @brief Returns a shared handle to the texture for the given image file, decoding and
+	 * uploading the image only if no other handle to it is still alive. If a pre-compressed
+	 * version of the image exists (see CompressedImage::loadCompressedVersionOf), it is
+	 * uploaded instead.
+	 */
+	std::shared_ptr<Texture> load(const std::string& filepath);
+
+	/**
+	 * @brief Returns the live texture for the given image file, or null if there is none.
+	 */
+	std::shared_ptr<Texture> find(const std::string& filepath) const;
+
+	/**
+	 * @brief Registers a texture created elsewhere (for example, a placeholder that an
+	 * AssetLoader fills in later) as the texture for the given image file.
+	 */
+	void insert(const std::string& filepath, const std::shared_ptr<Texture>& texture);
+
+	/**
+	 * @brief Forgets textures whose last handle has been released.
+	 */
+	void collect();
+
+	/**
+	 * @brief The number of textures currently alive on the GPU.
+	 */
+	size_t getTextureCount() const;
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include <compare>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Texture.h"
+
+/**
+ * @brief Copies textures into the layers of a few GL_TEXTURE_2D_ARRAY textures, so draws with
+ * different textures can share one binding and be batched together, telling them apart by a
+ * layer index instead.
+ *
+ * Textures whose resident levels have the same size, format and count share an array, one
+ * texture per layer. Small RGBA textures with power-of-two sizes are instead packed side by
+ * side into atlas pages, the layers of an array of their own, and sampled through a region of
+ * their page: the shader maps the texture coordinates into the region, wrapping them itself
+ * (see texturing_layered.frag). Tiles are placed at multiples of their own size, so each
+ * mipmap level of a page holds the same level of every tile; tile edges filter into their
+ * neighbours by up to half a texel. A texture that matches no other stays where it is.
+ *
+ * The copies are made on the GPU when GL_ARB_copy_image is available, and read back through
+ * the CPU otherwise. They live alongside the textures meshes hold, so packing trades memory
+ * for fewer bindings. A texture whose contents change, as a streamed texture's do when its
+ * resident levels change, is unpacked until its group is packed again.
+ */
+class TexturePacker {
+public:
+	/**
+	 * @brief Where a texture was packed: its array, its layer, and the region of the layer it
+	 * covers, as (offset x, offset y, width, height) in texture coordinates.
+	 */
+	struct Placement {
+		uint32_t array;
+		uint32_t layer;
+		glm::vec4 region;
+	};
+
+	// Atlas pages are ATLAS_PAGE_SIZE texels square, and take textures of up to
+	// ATLAS_MAX_TILE_SIZE on each side.
+	static constexpr int ATLAS_PAGE_SIZE = 1024;
+	static constexpr int ATLAS_MAX_TILE_SIZE = 256;
+
+	TexturePacker();
+	~TexturePacker();
+
+	TexturePacker(const TexturePacker&) = delete;
+	TexturePacker& operator=(const TexturePacker&) = delete;
+
+	/**
+	 * @brief Where the texture is packed, or null if it isn't. A texture seen for the first
+	 * time, or changed since it was packed, is queued for the next flush() and unpacked until then.
+	 */
+	const Placement* place(const std::shared_ptr<Texture>& texture);
+
+	/**
+	 * @brief Packs the queued textures, repacking the groups they join or leave and dropping
+	 * the textures that were destroyed. Returns whether any placement changed.
+	 */
+	bool flush();
+
+	/**
+	 * @brief A number that changes whenever flush() changes a placement.
+	 */
+	uint64_t getGeneration() const;
+
+	size_t getArrayCount() const;
+	size_t getPackedCount() const;
+
+private:
+	// What decides which textures share an array: the size, format and count of their resident
+	// levels, or only the format for atlas tiles.
+	struct GroupKey {
+		bool atlas;
+		int width;
+		int height;
+		uint32_t format;
+		int levelCount;
+
+		auto operator<=>(const GroupKey&) const = default;
+	};
+
+	struct Entry {
+		std::weak_ptr<Texture> texture;
+		// The texture's version when it was placed.
+		uint64_t version;
+		bool packed;
+		Placement placement;
+	};
+
+	struct Group {
+		GroupKey key;
+		// The members and their versions, as the arrays were built from.
+		std::vector<std::pair<const Texture*, uint64_t>> members;
+		std::vector<uint32_t> arrays;
+	};
+
+	std::unordered_map<const Texture*, Entry> m_entries;
+	std::vector<Group> m_groups;
+	bool m_queued;
+	uint64_t m_generation;
+	int m_maxLayers;
+
+	static GroupKey keyFor(const Texture& texture);
+	// Rebuilds the group's arrays from its members, and places them.
+	void build(Group& group);
+	void buildLayers(Group& group);
+	void buildAtlas(Group& group);
+	void destroyArrays(Group& group);
+};
@@ -0,0 +1,103 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Object3D.h"
+#include "Texture.h"
+
+/**
+ * @brief Decides which mipmap levels of streamed textures should be on the GPU, keeping the
+ * total under a memory budget.
+ *
+ * Textures start out with only their small levels (see AssetLoader::enableTextureStreaming).
+ * Each frame, the objects on screen report how many pixels tall they are drawn with
+ * noteUse(), and update() asks for the finer levels that size calls for, blurriest textures
+ * first. When a request doesn't fit in the budget, it evicts the finest levels of the textures
+ * that were used longest ago, never going below what the current frame uses; requests that
+ * still don't fit are made for a coarser level, or wait.
+ *
+ * The streamer only does the bookkeeping. The loads it asks for are carried out by an
+ * AssetLoader, which reports back with finished(). All methods must be called on the thread
+ * that owns the OpenGL context.
+ */
+class TextureStreamer {
+public:
+	/**
+	 * @brief A load of a texture's levels from firstLevel on, which fits in the budget.
+	 */
+	struct Request {
+		std::shared_ptr<Texture> texture;
+		std::string path;
+		int firstLevel;
+	};
+
+	/**
+	 * @brief Streams textures under a budget, in bytes of GPU memory. A texture never drops
+	 * below the first level that is at most initialSize on either side.
+	 */
+	TextureStreamer(size_t budget, int initialSize);
+
+	/**
+	 * @brief Starts streaming a texture loaded from the given image file.
+	 */
+	void add(const std::shared_ptr<Texture>& texture, const std::string& path);
+
+	/**
+	 * @brief Notes that the texture is drawn over the given number of pixels this frame. Does
+	 * nothing for textures that aren't streamed.
+	 */
+	void noteUse(const Texture& texture, float screenSize);
+	/**
+	 * @brief Notes every texture of an object, drawn as tall as its bounding sphere appears
+	 * with the given view and projection matrices and viewport height in pixels.
+	 */
+	void noteUse(const Object3D& object, const glm::mat4& view, const glm::mat4& projection, float viewportHeight);
+
+	/**
+	 * @brief Evicts levels as needed, and returns the loads to start, at the end of a frame.
+	 */
+	std::vector<Request> update();
+
+	/**
+	 * @brief Reports that a requested load was uploaded, or failed; a texture that fails is
+	 * not requested again.
+	 */
+	void finished(const Texture& texture, bool loaded);
+
+	void setBudget(size_t budget);
+	size_t getBudget() const;
+	int getInitialSize() const;
+	/**
+	 * @brief The GPU memory used by the streamed textures, as of the last update.
+	 */
+	size_t getResidentSize() const;
+
+private:
+	struct Entry {
+		std::weak_ptr<Texture> texture;
+		std::string path;
+		// The finest level the texture's users asked for in the last frame it was used in.
+		int wantedLevel;
+		uint64_t lastUsedFrame;
+		// The level a load in flight brings the texture to, or -1, and the bytes it adds.
+		int loadingLevel;
+		size_t loadingSize;
+		bool failed;
+	};
+
+	std::unordered_map<const Texture*, Entry> m_entries;
+	size_t m_budget;
+	int m_initialSize;
+	uint64_t m_frame;
+	size_t m_residentSize;
+	size_t m_loadingSize;
+
+	// The coarsest level eviction may leave the texture at.
+	int keepLevel(const Entry& entry, const Texture& texture) const;
+	// Evicts levels until the given number of bytes fits in the budget, without touching the
+	// given texture. Returns false if that's not possible.
+	bool makeRoom(size_t size, const Texture* keep);
+};
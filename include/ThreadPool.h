@@ -0,0 +1,41 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A fixed set of worker threads that run queued tasks in submission order.
+ *
+ * Destroying the pool lets the workers finish the task they are running, discards the tasks
+ * that have not started yet, and joins the threads.
+ */
+class ThreadPool {
+private:
+	std::vector<std::thread> m_workers;
+	std::queue<std::function<void()>> m_tasks;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	bool m_stopping;
+
+	void workerLoop();
+
+public:
+	/**
+	 * @brief Starts the given number of workers; 0 means one per hardware thread.
+	 */
+	explicit ThreadPool(size_t threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/**
+	 * @brief Queues a task to run on one of the workers.
+	 */
+	void submit(std::function<void()> task);
+
+	size_t getThreadCount() const;
+};
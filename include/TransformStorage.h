@@ -0,0 +1,102 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "JobSystem.h"
+
+/**
+ * @brief The positions, orientations and scales of every Object3D, in structure-of-arrays
+ * form, with their model matrices.
+ *
+ * Each object owns one slot. Every component of the transformations is an array of its own,
+ * indexed by slot, so rebuilding the model matrices streams through a few dense arrays instead
+ * of visiting each object, and does it several slots at a time with SIMD: SSE2, AVX2 where the
+ * compiler targets it, or NEON. Changing a transformation only marks its matrix dirty;
+ * updateMatrices() rebuilds all the dirty ones, and a matrix that is asked for while still
+ * dirty is rebuilt on its own with the same arithmetic.
+ *
+ * Slots are allocated and released on one thread, but jobs may change and read the
+ * transformations of different slots in parallel.
+ */
+class TransformStorage {
+public:
+	/**
+	 * @brief The storage every Object3D keeps its transformation in.
+	 */
+	static TransformStorage& shared();
+
+	/**
+	 * @brief Allocates a slot with the identity transformation.
+	 */
+	uint32_t allocate();
+	/**
+	 * @brief Allocates a slot with the same transformation, version and all, as another.
+	 */
+	uint32_t allocateCopy(uint32_t slot);
+	/**
+	 * @brief Gives the transformation of one slot to another.
+	 */
+	void copy(uint32_t from, uint32_t to);
+	void release(uint32_t slot);
+
+	glm::vec3 getPosition(uint32_t slot) const;
+	glm::vec3 getOrientation(uint32_t slot) const;
+	glm::vec3 getScale(uint32_t slot) const;
+	void setPosition(uint32_t slot, const glm::vec3& position);
+	void setOrientation(uint32_t slot, const glm::vec3& orientation);
+	void setScale(uint32_t slot, const glm::vec3& scale);
+
+	/**
+	 * @brief Places the slot's transformation relative to a parent's local->world
+	 * transformation, such as a SceneGraph node's world transformation.
+	 */
+	void setParentTransform(uint32_t slot, const glm::mat4& parentTransform);
+	/**
+	 * @brief Places the slot's transformation in world space again.
+	 */
+	void clearParentTransform(uint32_t slot);
+	bool hasParentTransform(uint32_t slot) const;
+
+	/**
+	 * @brief The slot's local->world transformation matrix: the parent transformation, if any,
+	 * times translation * scale * Z, X and Y rotations by the orientation's angles, in radians.
+	 * Rebuilt first if it is dirty.
+	 */
+	const glm::mat4& getModelMatrix(uint32_t slot);
+	/**
+	 * @brief A number that changes whenever the slot's transformation does, and is never
+	 * reused by another transformation.
+	 */
+	uint64_t getVersion(uint32_t slot) const;
+
+	/**
+	 * @brief Rebuilds every dirty model matrix, a batch of slots at a time.
+	 */
+	void updateMatrices();
+	/**
+	 * @brief Rebuilds every dirty model matrix like updateMatrices(), on the job system's workers.
+	 */
+	void updateMatrices(JobSystem& jobs);
+
+	/**
+	 * @brief The number of slots, allocated or released.
+	 */
+	size_t size() const;
+
+private:
+	// One array per axis.
+	std::vector<float> m_positions[3];
+	std::vector<float> m_orientations[3];
+	std::vector<float> m_scales[3];
+	std::vector<glm::mat4> m_matrices;
+	std::vector<glm::mat4> m_parentTransforms;
+	std::vector<uint8_t> m_hasParent;
+	std::vector<uint8_t> m_dirty;
+	std::vector<uint64_t> m_versions;
+	std::vector<uint32_t> m_freeSlots;
+
+	void changed(uint32_t slot);
+	// Rebuilds the dirty matrices among the slots [begin, end).
+	void updateRange(size_t begin, size_t end);
+};
@@ -0,0 +1,129 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <glm/glm.hpp>
+
+/**
+ * @brief The std140 layout rules, for checking that a C++ struct mirrors a uniform block.
+ *
+ * Scalars align to 4 bytes, two-component vectors to 8, and three- and four-component vectors,
+ * matrix columns and array elements to 16. A struct whose members are all at offsets aligned
+ * this way, with no padding the block doesn't also have, can be copied into the block as is.
+ */
+namespace std140 {
+	constexpr size_t roundUp(size_t size, size_t alignment) {
+		return (size + alignment - 1) / alignment * alignment;
+	}
+
+	template <typename T>
+	constexpr size_t alignment = 16;
+	template <>
+	constexpr size_t alignment<float> = 4;
+	template <>
+	constexpr size_t alignment<int32_t> = 4;
+	template <>
+	constexpr size_t alignment<uint32_t> = 4;
+	template <>
+	constexpr size_t alignment<glm::vec2> = 8;
+
+	/**
+	 * @brief The distance between the elements of an array of T in a block.
+	 */
+	template <typename T>
+	constexpr size_t arrayStride = roundUp(sizeof(T), 16);
+}
+
+/**
+ * @brief The camera block every program that draws may read, updated once per frame and
+ * bound to the "Camera" block's binding point:
+ *
+ *     layout (std140) uniform Camera {
+ *         mat4 view;
+ *         mat4 projection;
+ *         mat4 viewProjection;
+ *         vec4 cameraPosition;
+ *     };
+ */
+struct CameraUniforms {
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 viewProjection;
+	// The camera's world-space position, with w = 1.
+	glm::vec4 position;
+
+	static CameraUniforms from(const glm::mat4& view, const glm::mat4& projection);
+};
+
+/**
+ * @brief One object's block, which a RenderQueue sub-allocates for each draw from a large
+ * uniform buffer and binds to the "Object" block's binding point:
+ *
+ *     layout (std140) uniform Object {
+ *         mat4 model;
+ *     };
+ */
+struct ObjectUniforms {
+	glm::mat4 model;
+};
+
+static_assert(offsetof(CameraUniforms, projection) % std140::alignment<glm::mat4> == 0);
+static_assert(offsetof(CameraUniforms, viewProjection) % std140::alignment<glm::mat4> == 0);
+static_assert(offsetof(CameraUniforms, position) % std140::alignment<glm::vec4> == 0);
+static_assert(sizeof(CameraUniforms) == 3 * sizeof(glm::mat4) + sizeof(glm::vec4));
+static_assert(sizeof(ObjectUniforms) == sizeof(glm::mat4));
+
+/**
+ * @brief A GPU buffer holding one uniform block's data, shared by every program that declares
+ * the block.
+ *
+ * Each block name has one binding point for the whole application, handed out by
+ * bindingPoint(). ShaderProgram assigns its blocks their points when it links, so binding a
+ * buffer to a block's point once makes every program that declares the block read from it.
+ */
+class UniformBuffer {
+private:
+	uint32_t m_buffer;
+	size_t m_size;
+
+public:
+	// The points of the blocks the renderers use; other blocks get the ones after them.
+	static const uint32_t CAMERA_BINDING = 0;
+	static const uint32_t OBJECT_BINDING = 1;
+
+	/**
+	 * @brief Creates a buffer of the given size in bytes, with undefined contents.
+	 */
+	explicit UniformBuffer(size_t size);
+	~UniformBuffer();
+
+	UniformBuffer(const UniformBuffer&) = delete;
+	UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+	/**
+	 * @brief Replaces the buffer's contents from the start, with at most its size in bytes.
+	 */
+	void update(const void* data, size_t size);
+	template <typename T>
+	void update(const T& block) {
+		update(&block, sizeof(T));
+	}
+
+	/**
+	 * @brief Binds the whole buffer to the given binding point.
+	 */
+	void bind(uint32_t bindingPoint) const;
+
+	uint32_t getBuffer() const;
+
+	/**
+	 * @brief The binding point of the uniform block with the given name, the same for every
+	 * program. Must be called on the thread that owns the OpenGL context.
+	 */
+	static uint32_t bindingPoint(const std::string& blockName);
+
+	/**
+	 * @brief The alignment that offsets into a buffer bound with glBindBufferRange must have.
+	 */
+	static size_t getOffsetAlignment();
+};
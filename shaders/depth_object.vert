@@ -0,0 +1,23 @@
+#version 410
+layout (location=0) in vec3 vPosition;
+
+// Shared by every program; see CameraUniforms.
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+};
+// The object being drawn, which RenderQueue binds a range of its object buffer to per draw.
+layout (std140) uniform Object {
+    mat4 model;
+};
+
+// The same position as texture_perspective_object.vert's, bit for bit, so this can draw its
+// depth pre-pass.
+invariant gl_Position;
+
+void main() {
+    // Project the position to clip space.
+    gl_Position = viewProjection * model * vec4(vPosition, 1.0);
+}
\ No newline at end of file
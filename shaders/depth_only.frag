@@ -0,0 +1,4 @@
+#version 330
+// A fragment shader for depth-only passes, which write no color.
+void main() {
+}
\ No newline at end of file
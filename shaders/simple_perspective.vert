@@ -1,10 +1,20 @@
 #version 330
 layout (location=0) in vec3 vPosition;
 
-uniform mat4 projection;
-uniform mat4 view;
+// Shared by every program; see CameraUniforms.
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+};
+
 uniform mat4 model;
 
+// The same position as texture_perspective.vert's, bit for bit, so this can draw its depth
+// pre-pass.
+invariant gl_Position;
+
 void main() {
     // Project the position to clip space.
     gl_Position = projection * view * model * vec4(vPosition, 1.0);
@@ -2,11 +2,19 @@
 layout (location=0) in vec3 vPosition;
 layout (location=1) in vec2 vTexCoord;
 
-uniform mat4 projection;
-uniform mat4 view;
+// Shared by every program; see CameraUniforms.
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+};
+
 uniform mat4 model;
 
 out vec2 TexCoord;
+// Computed exactly as the depth pre-pass's program computes it, so GL_EQUAL depth tests pass.
+invariant gl_Position;
 
 void main() {
     // Project the position to clip space.
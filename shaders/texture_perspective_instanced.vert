@@ -0,0 +1,21 @@
+#version 410
+layout (location=0) in vec3 vPosition;
+layout (location=1) in vec2 vTexCoord;
+// Per-instance: the object's model matrix, which occupies locations 2 through 5.
+layout (location=2) in mat4 vModel;
+
+// Shared by every program; see CameraUniforms.
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+};
+
+out vec2 TexCoord;
+
+void main() {
+    // Project the position to clip space.
+    gl_Position = projection * view * vModel * vec4(vPosition, 1.0);
+    TexCoord = vTexCoord;
+}
@@ -0,0 +1,29 @@
+#version 410
+layout (location=0) in vec3 vPosition;
+layout (location=1) in vec2 vTexCoord;
+// Per-instance: the object's model matrix, which occupies locations 2 through 5, and where
+// its texture was packed (see TexturePacker): the region of the layer it covers, and the
+// layer, or -1 for a texture that is bound on its own.
+layout (location=2) in mat4 vModel;
+layout (location=6) in vec4 vTextureRegion;
+layout (location=7) in float vTextureLayer;
+
+// Shared by every program; see CameraUniforms.
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+};
+
+out vec2 TexCoord;
+flat out vec4 TextureRegion;
+flat out float TextureLayer;
+
+void main() {
+    // Project the position to clip space.
+    gl_Position = projection * view * vModel * vec4(vPosition, 1.0);
+    TexCoord = vTexCoord;
+    TextureRegion = vTextureRegion;
+    TextureLayer = vTextureLayer;
+}
@@ -0,0 +1,25 @@
+#version 410
+layout (location=0) in vec3 vPosition;
+layout (location=1) in vec2 vTexCoord;
+
+// Shared by every program; see CameraUniforms.
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+};
+// The object being drawn, which RenderQueue binds a range of its object buffer to per draw.
+layout (std140) uniform Object {
+    mat4 model;
+};
+
+out vec2 TexCoord;
+// Computed exactly as the depth pre-pass's program computes it, so GL_EQUAL depth tests pass.
+invariant gl_Position;
+
+void main() {
+    // Project the position to clip space.
+    gl_Position = viewProjection * model * vec4(vPosition, 1.0);
+    TexCoord = vTexCoord;
+}
@@ -0,0 +1,34 @@
+#version 330
+// A fragment shader for rendering a mesh that has a texture, but no lighting, whose texture
+// may have been packed into a layer of a texture array, or a tile of an atlas page.
+layout (location=0) out vec4 FragColor;
+
+// Input from vertices: interpolated texture coordinate, and where the texture was packed.
+in vec2 TexCoord;
+flat in vec4 TextureRegion;
+flat in float TextureLayer;
+
+// Uniforms from application: the texture sampler for unpacked textures, and the one for the
+// texture array, on unit 1 (MultiDrawRenderer::LAYERED_TEXTURE_UNIT).
+uniform sampler2D baseTexture;
+uniform sampler2DArray layeredTexture;
+
+void main() {
+    if (TextureLayer < 0.0) {
+        FragColor = texture(baseTexture, TexCoord);
+        return;
+    }
+    // Wrap the coordinate within the region, as GL_REPEAT would within a texture of its own,
+    // and take the derivatives from the unwrapped one so the seams don't pick the smallest
+    // mipmap. The footprint is kept within the region, whose mipmaps stop at its 1x1 level.
+    vec2 dx = dFdx(TexCoord) * TextureRegion.zw;
+    vec2 dy = dFdy(TexCoord) * TextureRegion.zw;
+    float footprint = max(length(dx), length(dy));
+    float limit = min(TextureRegion.z, TextureRegion.w);
+    if (footprint > limit) {
+        dx *= limit / footprint;
+        dy *= limit / footprint;
+    }
+    vec2 coordinate = TextureRegion.xy + fract(TexCoord) * TextureRegion.zw;
+    FragColor = textureGrad(layeredTexture, vec3(coordinate, TextureLayer), dx, dy);
+}
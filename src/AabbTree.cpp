@@ -0,0 +1,352 @@
+#include "AabbTree.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+	// Leaves are enlarged by this fraction of their bounds' largest side, in every direction.
+	const float FAT_MARGIN_FRACTION = 0.1f;
+
+	Aabb combine(const Aabb& a, const Aabb& b) {
+		return { glm::min(a.min, b.min), glm::max(a.max, b.max) };
+	}
+
+	float surfaceArea(const Aabb& box) {
+		glm::vec3 size = box.max - box.min;
+		return 2 * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	bool contains(const Aabb& outer, const Aabb& inner) {
+		return glm::all(glm::lessThanEqual(outer.min, inner.min)) && glm::all(glm::lessThanEqual(inner.max, outer.max));
+	}
+
+	bool overlaps(const Aabb& a, const Aabb& b) {
+		return glm::all(glm::lessThanEqual(a.min, b.max)) && glm::all(glm::lessThanEqual(b.min, a.max));
+	}
+
+	Aabb fatten(const Aabb& bounds) {
+		glm::vec3 size = bounds.max - bounds.min;
+		float margin = FAT_MARGIN_FRACTION * std::max(size.x, std::max(size.y, size.z));
+		return { bounds.min - glm::vec3(margin), bounds.max + glm::vec3(margin) };
+	}
+}
+
+float rayEntry(const Aabb& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance) {
+	float enter = 0, leave = maxDistance;
+	for (int axis = 0; axis < 3; axis++) {
+		float t1 = (box.min[axis] - origin[axis]) * inverseDirection[axis];
+		float t2 = (box.max[axis] - origin[axis]) * inverseDirection[axis];
+		// A ray parallel to a slab gives NaN (0 * infinity) when it starts on its boundary;
+		// the comparisons below then keep enter and leave unchanged, counting it as a hit.
+		if (t1 > t2) {
+			std::swap(t1, t2);
+		}
+		enter = t1 > enter ? t1 : enter;
+		leave = t2 < leave ? t2 : leave;
+		if (enter > leave) {
+			return std::numeric_limits<float>::infinity();
+		}
+	}
+	return enter;
+}
+
+int32_t AabbTree::allocateNode() {
+	if (m_freeList == NULL_NODE) {
+		m_nodes.push_back({});
+		m_nodes.back().parent = NULL_NODE;
+		m_freeList = static_cast<int32_t>(m_nodes.size() - 1);
+	}
+	int32_t node = m_freeList;
+	m_freeList = m_nodes[node].parent;
+	m_nodes[node] = { {}, NULL_NODE, NULL_NODE, NULL_NODE, 0, 0 };
+	return node;
+}
+
+void AabbTree::freeNode(int32_t node) {
+	m_nodes[node].parent = m_freeList;
+	m_nodes[node].height = -1;
+	m_freeList = node;
+}
+
+int32_t AabbTree::createProxy(const Aabb& bounds, uint32_t userData) {
+	int32_t proxy = allocateNode();
+	m_nodes[proxy].bounds = fatten(bounds);
+	m_nodes[proxy].userData = userData;
+	insertLeaf(proxy);
+	m_proxyCount++;
+	return proxy;
+}
+
+void AabbTree::destroyProxy(int32_t proxy) {
+	if (proxy < 0 || proxy >= static_cast<int32_t>(m_nodes.size()) || !m_nodes[proxy].isLeaf() || m_nodes[proxy].height != 0) {
+		throw std::runtime_error("Destroying a proxy that is not in the tree");
+	}
+	removeLeaf(proxy);
+	freeNode(proxy);
+	m_proxyCount--;
+}
+
+bool AabbTree::moveProxy(int32_t proxy, const Aabb& bounds) {
+	if (contains(m_nodes[proxy].bounds, bounds)) {
+		return false;
+	}
+	removeLeaf(proxy);
+	m_nodes[proxy].bounds = fatten(bounds);
+	insertLeaf(proxy);
+	return true;
+}
+
+uint32_t AabbTree::getUserData(int32_t proxy) const {
+	return m_nodes[proxy].userData;
+}
+
+const Aabb& AabbTree::getFatBounds(int32_t proxy) const {
+	return m_nodes[proxy].bounds;
+}
+
+size_t AabbTree::getProxyCount() const {
+	return m_proxyCount;
+}
+
+int32_t AabbTree::getHeight() const {
+	return m_root == NULL_NODE ? 0 : m_nodes[m_root].height;
+}
+
+void AabbTree::insertLeaf(int32_t leaf) {
+	if (m_root == NULL_NODE) {
+		m_root = leaf;
+		m_nodes[leaf].parent = NULL_NODE;
+		return;
+	}
+
+	// Walk down to the sibling that makes the tree's total surface area grow the least. Every
+	// ancestor of the new leaf grows to contain it, which is the "inheritance" cost.
+	Aabb leafBounds = m_nodes[leaf].bounds;
+	int32_t index = m_root;
+	while (!m_nodes[index].isLeaf()) {
+		auto& node = m_nodes[index];
+		float area = surfaceArea(node.bounds);
+		float combinedArea = surfaceArea(combine(node.bounds, leafBounds));
+		// Making a new parent for this node and the leaf.
+		float cost = 2 * combinedArea;
+		float inheritanceCost = 2 * (combinedArea - area);
+
+		auto descendCost = [&](int32_t child) {
+			auto& childBounds = m_nodes[child].bounds;
+			float grownArea = surfaceArea(combine(childBounds, leafBounds));
+			if (m_nodes[child].isLeaf()) {
+				return grownArea + inheritanceCost;
+			}
+			return grownArea - surfaceArea(childBounds) + inheritanceCost;
+		};
+		float cost1 = descendCost(node.child1);
+		float cost2 = descendCost(node.child2);
+		if (cost < cost1 && cost < cost2) {
+			break;
+		}
+		index = cost1 < cost2 ? node.child1 : node.child2;
+	}
+
+	// Give the sibling and the leaf a new parent, in the sibling's place.
+	int32_t sibling = index;
+	int32_t oldParent = m_nodes[sibling].parent;
+	int32_t newParent = allocateNode();
+	m_nodes[newParent].parent = oldParent;
+	m_nodes[newParent].bounds = combine(leafBounds, m_nodes[sibling].bounds);
+	m_nodes[newParent].height = m_nodes[sibling].height + 1;
+	m_nodes[newParent].child1 = sibling;
+	m_nodes[newParent].child2 = leaf;
+	m_nodes[sibling].parent = newParent;
+	m_nodes[leaf].parent = newParent;
+	if (oldParent == NULL_NODE) {
+		m_root = newParent;
+	}
+	else if (m_nodes[oldParent].child1 == sibling) {
+		m_nodes[oldParent].child1 = newParent;
+	}
+	else {
+		m_nodes[oldParent].child2 = newParent;
+	}
+
+	refitUpwards(m_nodes[leaf].parent);
+}
+
+void AabbTree::removeLeaf(int32_t leaf) {
+	if (leaf == m_root) {
+		m_root = NULL_NODE;
+		return;
+	}
+
+	// The leaf's sibling takes its parent's place.
+	int32_t parent = m_nodes[leaf].parent;
+	int32_t grandParent = m_nodes[parent].parent;
+	int32_t sibling = m_nodes[parent].child1 == leaf ? m_nodes[parent].child2 : m_nodes[parent].child1;
+	m_nodes[sibling].parent = grandParent;
+	freeNode(parent);
+	if (grandParent == NULL_NODE) {
+		m_root = sibling;
+		return;
+	}
+	if (m_nodes[grandParent].child1 == parent) {
+		m_nodes[grandParent].child1 = sibling;
+	}
+	else {
+		m_nodes[grandParent].child2 = sibling;
+	}
+	refitUpwards(grandParent);
+}
+
+void AabbTree::refitUpwards(int32_t node) {
+	while (node != NULL_NODE) {
+		node = balance(node);
+		auto& current = m_nodes[node];
+		auto& child1 = m_nodes[current.child1];
+		auto& child2 = m_nodes[current.child2];
+		current.height = 1 + std::max(child1.height, child2.height);
+		current.bounds = combine(child1.bounds, child2.bounds);
+		node = current.parent;
+	}
+}
+
+int32_t AabbTree::balance(int32_t iA) {
+	auto& a = m_nodes[iA];
+	if (a.isLeaf() || a.height < 2) {
+		return iA;
+	}
+
+	int32_t iB = a.child1;
+	int32_t iC = a.child2;
+	auto& b = m_nodes[iB];
+	auto& c = m_nodes[iC];
+	int32_t difference = c.height - b.height;
+	if (difference >= -1 && difference <= 1) {
+		return iA;
+	}
+
+	// Rotate the taller child (up) into A's place; A keeps its shorter child and takes the
+	// shorter of the taller child's children, and the taller child keeps the other.
+	int32_t iUp = difference > 1 ? iC : iB;
+	auto& up = m_nodes[iUp];
+	int32_t iF = up.child1;
+	int32_t iG = up.child2;
+	auto& f = m_nodes[iF];
+	auto& g = m_nodes[iG];
+
+	up.child1 = iA;
+	up.parent = a.parent;
+	a.parent = iUp;
+	if (up.parent == NULL_NODE) {
+		m_root = iUp;
+	}
+	else if (m_nodes[up.parent].child1 == iA) {
+		m_nodes[up.parent].child1 = iUp;
+	}
+	else {
+		m_nodes[up.parent].child2 = iUp;
+	}
+
+	int32_t iKept = f.height > g.height ? iF : iG;
+	int32_t iMoved = f.height > g.height ? iG : iF;
+	up.child2 = iKept;
+	if (iUp == iC) {
+		a.child2 = iMoved;
+	}
+	else {
+		a.child1 = iMoved;
+	}
+	m_nodes[iMoved].parent = iA;
+
+	auto& stayed = iUp == iC ? b : c;
+	a.bounds = combine(stayed.bounds, m_nodes[iMoved].bounds);
+	a.height = 1 + std::max(stayed.height, m_nodes[iMoved].height);
+	up.bounds = combine(a.bounds, m_nodes[iKept].bounds);
+	up.height = 1 + std::max(a.height, m_nodes[iKept].height);
+	return iUp;
+}
+
+void AabbTree::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& results) const {
+	if (m_root == NULL_NODE) {
+		return;
+	}
+	// Each node to visit, and whether its parent was already found to be entirely inside, in
+	// which case so is the node, and it needs no test.
+	std::vector<std::pair<int32_t, bool>> stack = { { m_root, false } };
+	while (!stack.empty()) {
+		auto [index, inside] = stack.back();
+		stack.pop_back();
+		auto& node = m_nodes[index];
+		if (!inside) {
+			auto containment = frustum.classify((node.bounds.min + node.bounds.max) * 0.5f,
+				(node.bounds.max - node.bounds.min) * 0.5f);
+			if (containment == Frustum::Containment::Outside) {
+				continue;
+			}
+			inside = containment == Frustum::Containment::Inside;
+		}
+		if (node.isLeaf()) {
+			results.push_back(node.userData);
+		}
+		else {
+			stack.emplace_back(node.child1, inside);
+			stack.emplace_back(node.child2, inside);
+		}
+	}
+}
+
+void AabbTree::queryBox(const Aabb& box, std::vector<uint32_t>& results) const {
+	if (m_root == NULL_NODE) {
+		return;
+	}
+	std::vector<int32_t> stack = { m_root };
+	while (!stack.empty()) {
+		auto& node = m_nodes[stack.back()];
+		stack.pop_back();
+		if (!overlaps(node.bounds, box)) {
+			continue;
+		}
+		if (node.isLeaf()) {
+			results.push_back(node.userData);
+		}
+		else {
+			stack.push_back(node.child1);
+			stack.push_back(node.child2);
+		}
+	}
+}
+
+void AabbTree::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+	const std::function<float(uint32_t userData, float maxDistance)>& visitor) const {
+	if (m_root == NULL_NODE) {
+		return;
+	}
+	glm::vec3 inverseDirection = 1.0f / direction;
+	std::vector<std::pair<int32_t, float>> stack = {
+		{ m_root, rayEntry(m_nodes[m_root].bounds, origin, inverseDirection, maxDistance) }
+	};
+	while (!stack.empty()) {
+		auto [index, entry] = stack.back();
+		stack.pop_back();
+		// Missed, or the visitor has found a hit nearer than this node since it was pushed.
+		if (std::isinf(entry) || entry > maxDistance) {
+			continue;
+		}
+		auto& node = m_nodes[index];
+		if (node.isLeaf()) {
+			maxDistance = std::min(maxDistance, visitor(node.userData, maxDistance));
+			continue;
+		}
+		float entry1 = rayEntry(m_nodes[node.child1].bounds, origin, inverseDirection, maxDistance);
+		float entry2 = rayEntry(m_nodes[node.child2].bounds, origin, inverseDirection, maxDistance);
+		// Push the nearer child last, so it is visited first.
+		if (entry1 < entry2) {
+			stack.emplace_back(node.child2, entry2);
+			stack.emplace_back(node.child1, entry1);
+		}
+		else {
+			stack.emplace_back(node.child1, entry1);
+			stack.emplace_back(node.child2, entry2);
+		}
+	}
+}
@@ -0,0 +1,245 @@
+#include "AssetLoader.h"
+#include <glad/glad.h>
+#include <iostream>
+#include <stdexcept>
+#include "AssimpImport.h"
+#include "GlCapabilities.h"
+
+namespace {
+	// Textures staged per processUploads() call, in bytes; enough for a 2048x2048 RGBA image.
+	const size_t STAGING_REGION_SIZE = 16 * 1024 * 1024;
+
+	/**
+	 * @brief The promise behind an AssetHandle's future, shared by the tasks that load the
+	 * asset. If the last of them is dropped before settling it, as the tasks still queued are
+	 * when the loader is destroyed, the future fails with a cancellation error instead of
+	 * std::future_error's broken_promise.
+	 */
+	class PendingAsset {
+	private:
+		std::promise<void> m_promise;
+		bool m_settled = false;
+
+	public:
+		~PendingAsset() {
+			if (!m_settled) {
+				m_promise.set_exception(std::make_exception_ptr(
+					std::runtime_error("Loading was cancelled, since the asset loader was destroyed")));
+			}
+		}
+
+		std::shared_future<void> getFuture() {
+			return m_promise.get_future().share();
+		}
+
+		void complete() {
+			m_settled = true;
+			m_promise.set_value();
+		}
+
+		void fail(std::exception_ptr error) {
+			m_settled = true;
+			m_promise.set_exception(error);
+		}
+	};
+
+	std::shared_future<void> readyFuture() {
+		std::promise<void> promise;
+		promise.set_value();
+		return promise.get_future().share();
+	}
+}
+
+AssetLoader::AssetLoader(TextureManager& textures, size_t threadCount)
+	: m_textures(textures), m_pending(0), m_importer(ModelImporter::Auto), m_workers(threadCount) {
+	// Read the context's capabilities here, on the context thread, so workers can check which
+	// compressed texture formats are supported.
+	hasGlVersion(3, 3);
+	m_staging = std::make_unique<StreamBuffer>(GL_PIXEL_UNPACK_BUFFER, STAGING_REGION_SIZE);
+}
+
+void AssetLoader::queueUpload(std::function<void()> upload) {
+	std::lock_guard lock(m_uploadMutex);
+	m_uploads.push(std::move(upload));
+}
+
+AssetHandle<Mesh3D> AssetLoader::loadModel(const std::string& path, bool flipTextureCoords) {
+	auto mesh = std::make_shared<Mesh3D>(Mesh3D::empty());
+	auto promise = std::make_shared<PendingAsset>();
+	AssetHandle<Mesh3D> handle{ mesh, promise->getFuture() };
+	m_pending++;
+
+	m_workers.submit([this, path, flipTextureCoords, mesh, promise, importer = m_importer]() {
+		try {
+			auto model = std::make_shared<ModelData>(importModel(path, flipTextureCoords, importer));
+			queueUpload([this, mesh, promise, model]() {
+				std::vector<SubMesh> subMeshes;
+				for (auto& subMesh : model->subMeshes) {
+					if (subMesh.lod != 0) {
+						continue;
+					}
+					std::shared_ptr<Texture> texture;
+					if (!subMesh.diffuseTexture.empty()) {
+						texture = loadTexture(model->texturePath(subMesh).string()).asset;
+					}
+					subMeshes.push_back({ subMesh.indexOffset, subMesh.indexCount, std::move(texture) });
+				}
+				*mesh = Mesh3D(model->vertices, model->faces, std::move(subMeshes));
+				mesh->setLods(model->getLods());
+				promise->complete();
+				m_pending--;
+			});
+		}
+		catch (std::exception& e) {
+			std::cout << "ERROR: could not load " << path << ": " << e.what() << std::endl;
+			queueUpload([this, promise, error = std::current_exception()]() {
+				promise->fail(error);
+				m_pending--;
+			});
+		}
+	});
+	return handle;
+}
+
+void AssetLoader::setModelImporter(ModelImporter importer) {
+	m_importer = importer;
+}
+
+AssetHandle<Texture> AssetLoader::loadTexture(const std::string& path) {
+	if (auto texture = m_textures.find(path)) {
+		auto inFlight = m_inFlightTextures.find(texture.get());
+		if (inFlight != m_inFlightTextures.end()) {
+			return { texture, inFlight->second };
+		}
+		return { texture, readyFuture() };
+	}
+
+	auto texture = std::make_shared<Texture>();
+	auto promise = std::make_shared<PendingAsset>();
+	AssetHandle<Texture> handle{ texture, promise->getFuture() };
+	m_textures.insert(path, texture);
+	m_inFlightTextures[texture.get()] = handle.ready;
+	m_pending++;
+
+	if (m_streamer) {
+		// Only the small levels; the streamer asks for the rest as they are needed.
+		m_workers.submit([this, path, texture, promise, initialSize = m_streamer->getInitialSize()]() {
+			try {
+				auto chain = std::make_shared<MipChain>();
+				chain->load(path, 0, initialSize);
+				queueUpload([this, path, texture, promise, chain]() {
+					texture->upload(*chain, m_staging.get());
+					m_streamer->add(texture, path);
+					m_inFlightTextures.erase(texture.get());
+					promise->complete();
+					m_pending--;
+				});
+			}
+			catch (std::exception& e) {
+				std::cout << "ERROR: could not load " << path << ": " << e.what() << std::endl;
+				queueUpload([this, texture, promise, error = std::current_exception()]() {
+					m_inFlightTextures.erase(texture.get());
+					promise->fail(error);
+					m_pending--;
+				});
+			}
+		});
+		return handle;
+	}
+
+	m_workers.submit([this, path, texture, promise]() {
+		try {
+			// Prefer a pre-compressed version of the image, falling back to decoding the image.
+			auto compressed = std::make_shared<CompressedImage>();
+			std::shared_ptr<StbImage> image;
+			if (!compressed->loadCompressedVersionOf(path)) {
+				compressed.reset();
+				image = std::make_shared<StbImage>();
+				image->loadFromFile(path);
+			}
+			queueUpload([this, texture, promise, compressed, image]() {
+				if (compressed) {
+					texture->upload(*compressed, m_staging.get());
+				}
+				else {
+					// The pixels are staged for the GPU now; don't keep a second copy around.
+					texture->upload(*image, m_staging.get());
+					image->release();
+				}
+				m_inFlightTextures.erase(texture.get());
+				promise->complete();
+				m_pending--;
+			});
+		}
+		catch (std::exception& e) {
+			std::cout << "ERROR: could not load " << path << ": " << e.what() << std::endl;
+			queueUpload([this, texture, promise, error = std::current_exception()]() {
+				m_inFlightTextures.erase(texture.get());
+				promise->fail(error);
+				m_pending--;
+			});
+		}
+	});
+	return handle;
+}
+
+void AssetLoader::enableTextureStreaming(size_t budget, int initialSize) {
+	if (m_streamer) {
+		m_streamer->setBudget(budget);
+		return;
+	}
+	m_streamer = std::make_unique<TextureStreamer>(budget, initialSize);
+}
+
+TextureStreamer* AssetLoader::getTextureStreamer() {
+	return m_streamer.get();
+}
+
+void AssetLoader::streamTextures() {
+	if (!m_streamer) {
+		return;
+	}
+	for (auto& request : m_streamer->update()) {
+		m_workers.submit([this, request]() {
+			try {
+				auto chain = std::make_shared<MipChain>();
+				chain->load(request.path, request.firstLevel);
+				queueUpload([this, request, chain]() {
+					request.texture->upload(*chain, m_staging.get());
+					m_streamer->finished(*request.texture, true);
+				});
+			}
+			catch (std::exception& e) {
+				std::cout << "ERROR: could not stream " << request.path << ": " << e.what() << std::endl;
+				queueUpload([this, request]() {
+					m_streamer->finished(*request.texture, false);
+				});
+			}
+		});
+	}
+}
+
+void AssetLoader::processUploads(std::chrono::microseconds budget) {
+	// The default budget means no limit; converted to the clock's nanoseconds, it would overflow.
+	bool unlimited = budget == std::chrono::microseconds::max();
+	auto start = std::chrono::steady_clock::now();
+	m_staging->beginFrame();
+	while (unlimited || std::chrono::steady_clock::now() - start < budget) {
+		std::function<void()> upload;
+		{
+			std::lock_guard lock(m_uploadMutex);
+			if (m_uploads.empty()) {
+				break;
+			}
+			upload = std::move(m_uploads.front());
+			m_uploads.pop();
+		}
+		upload();
+	}
+	// The fence tells a later call when the driver is done reading this call's staged pixels.
+	m_staging->endFrame();
+}
+
+size_t AssetLoader::getPendingCount() const {
+	return m_pending;
+}
@@ -1,78 +1,363 @@
 #include "AssimpImport.h"
 #include <iostream>
 #include <assimp/Importer.hpp>
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <filesystem>
-#include "StbImage.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <map>
+#include "MappedFile.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ObjLoader.h"
 
 const size_t FLOATS_PER_VERTEX = 3;
 const size_t VERTICES_PER_FACE = 3;
+// Marks the mesh caches of models read by parseObj rather than Assimp.
+const uint32_t NATIVE_OBJ_IMPORT = 1u << 31;
 
-Mesh3D fromAssimpMesh(const aiMesh* mesh, const StbImage& texture) {
-	std::vector<Vertex3D> vertices;
+namespace {
+	/**
+	 * @brief An Assimp stream that reads straight from a memory-mapped file.
+	 */
+	class MappedStream : public Assimp::IOStream {
+	private:
+		// The mapping, if the stream owns it rather than viewing one opened by the caller.
+		MappedFile m_file;
+		const unsigned char* m_data;
+		size_t m_size;
+		size_t m_position;
 
-	// TODO: fill in this vertices list, by iterating over each element of 
-	// the mVertices field of the aiMesh pointer. Each element of mVertices
-	// has x, y, and z values that you can use to construct a Vertex3D object.
-	// To find the u and v texture coordinates of a vertex, access the 
-	// x and y fields of each element of mTextureCoords.
+	public:
+		MappedStream(const unsigned char* data, size_t size) : m_data(data), m_size(size), m_position(0) {
+		}
+		explicit MappedStream(MappedFile file) : m_file(std::move(file)), m_data(m_file.getData()),
+			m_size(m_file.getSize()), m_position(0) {
+		}
+
+		size_t Read(void* buffer, size_t size, size_t count) override {
+			if (size == 0) {
+				return 0;
+			}
+			// Only whole elements, like fread.
+			count = std::min(count, (m_size - m_position) / size);
+			if (count == 0) {
+				return 0;
+			}
+			std::memcpy(buffer, m_data + m_position, size * count);
+			m_position += size * count;
+			return count;
+		}
+
+		size_t Write(const void*, size_t, size_t) override {
+			return 0;
+		}
+
+		aiReturn Seek(size_t offset, aiOrigin origin) override {
+			// Offsets from the end count backwards, as in Assimp's own memory stream.
+			size_t base = origin == aiOrigin_CUR ? m_position : 0;
+			if (origin == aiOrigin_END) {
+				if (offset > m_size) {
+					return aiReturn_FAILURE;
+				}
+				m_position = m_size - offset;
+				return aiReturn_SUCCESS;
+			}
+			if (offset > m_size - base) {
+				return aiReturn_FAILURE;
+			}
+			m_position = base + offset;
+			return aiReturn_SUCCESS;
+		}
+
+		size_t Tell() const override {
+			return m_position;
+		}
+
+		size_t FileSize() const override {
+			return m_size;
+		}
+
+		void Flush() override {
+		}
+	};
+
+	/**
+	 * @brief Opens the files an import reads as memory mappings instead of through stdio: the
+	 * model file itself, which the caller has already mapped, and any it refers to, such as an
+	 * OBJ file's material library.
+	 */
+	class MappedIOSystem : public Assimp::IOSystem {
+	private:
+		std::filesystem::path m_sourcePath;
+		const MappedFile& m_source;
+
+	public:
+		MappedIOSystem(const std::string& sourcePath, const MappedFile& source)
+			: m_sourcePath(std::filesystem::path(sourcePath).lexically_normal()), m_source(source) {
+		}
+
+		bool Exists(const char* path) const override {
+			std::error_code error;
+			return std::filesystem::is_regular_file(path, error);
+		}
+
+		char getOsSeparator() const override {
+			return static_cast<char>(std::filesystem::path::preferred_separator);
+		}
+
+		Assimp::IOStream* Open(const char* path, const char* mode) override {
+			if (std::strchr(mode, 'w') != nullptr || std::strchr(mode, 'a') != nullptr) {
+				return nullptr;
+			}
+			if (std::filesystem::path(path).lexically_normal() == m_sourcePath) {
+				return new MappedStream(m_source.getData(), m_source.getSize());
+			}
+			MappedFile file;
+			try {
+				file.open(path);
+			}
+			catch (std::exception&) {
+				return nullptr;
+			}
+			return new MappedStream(std::move(file));
+		}
+
+		void Close(Assimp::IOStream* stream) override {
+			delete stream;
+		}
+	};
+}
+
+/**
+ * @brief Appends an aiMesh's vertices to the packed vertex list, positioned by the given
+ * node transformation, and its faces to the packed face list, rebased to the new vertices.
+ */
+void fromAssimpMesh(const aiMesh* mesh, const aiMatrix4x4& transform,
+	std::vector<Vertex3D>& vertices, std::vector<uint32_t>& faces) {
+	auto baseVertex = static_cast<uint32_t>(vertices.size());
+
+	vertices.reserve(vertices.size() + mesh->mNumVertices);
 	for (size_t i = 0; i < mesh->mNumVertices; i++) {
-		auto& meshVertex = mesh->mVertices[i];
-		auto& texCoord = mesh->mTextureCoords[0][i];
+		auto meshVertex = transform * mesh->mVertices[i];
+		// Meshes without texture coordinates get (0, 0) for every vertex.
+		aiVector3D texCoord = mesh->HasTextureCoords(0) ? mesh->mTextureCoords[0][i] : aiVector3D();
 		
-		// See above.
-
+		vertices.push_back({ meshVertex.x, meshVertex.y, meshVertex.z, texCoord.x, texCoord.y });
 	}
 
-	std::vector<uint32_t> faces;
-	// TODO: fill in the faces list, by iterating over each element of
-	// the mFaces field of the aiMesh pointer. Each element of mFaces
-	// has an mIndices list, which will have three elements of its own at 
-	// [0], [1], and [2]. Each of those should be pushed individually onto 
-	// the faces list.
+	faces.reserve(faces.size() + mesh->mNumFaces * VERTICES_PER_FACE);
 	for (size_t i = 0; i < mesh->mNumFaces; i++) {
 		auto& meshFace = mesh->mFaces[i];
-		// See above.
+		// Triangulation leaves behind point and line primitives in some files; they can't be drawn as triangles.
+		if (meshFace.mNumIndices != VERTICES_PER_FACE) {
+			continue;
+		}
+		faces.push_back(baseVertex + meshFace.mIndices[0]);
+		faces.push_back(baseVertex + meshFace.mIndices[1]);
+		faces.push_back(baseVertex + meshFace.mIndices[2]);
+	}
+}
+
+/**
+ * @brief Collects every mesh referenced by a node and its descendants, along with the node's
+ * local->model transformation.
+ */
+void collectMeshInstances(const aiNode* node, const aiMatrix4x4& parentTransform,
+	std::vector<std::pair<unsigned int, aiMatrix4x4>>& instances) {
+	auto transform = parentTransform * node->mTransformation;
+	for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+		instances.emplace_back(node->mMeshes[i], transform);
+	}
+	for (unsigned int i = 0; i < node->mNumChildren; i++) {
+		collectMeshInstances(node->mChildren[i], transform, instances);
+	}
+}
 
+/**
+ * @brief Imports the model through Assimp into the model's import buffers, reading it from the
+ * given mapping of its file.
+ */
+void importWithAssimp(const std::string& path, const MappedFile& source, uint32_t options, ModelData& model) {
+	// Import from the mapping that was just hashed, rather than reading the file a second time.
+	// The importer takes ownership of the IO system.
+	Assimp::Importer importer;
+	importer.SetIOHandler(new MappedIOSystem(path, source));
+	const aiScene* scene = importer.ReadFile(path, options);
 
+	// If the import failed, report it
+	if (nullptr == scene || nullptr == scene->mRootNode) {
+		throw std::runtime_error("Error loading assimp file " + path + ": " + importer.GetErrorString());
 	}
 
-	return Mesh3D(vertices, faces, texture);
+	// Pack every mesh in the scene into one pair of buffers, grouped by material so that
+	// each material's faces form one contiguous range that can be drawn with a single call.
+	std::vector<std::pair<unsigned int, aiMatrix4x4>> instances;
+	collectMeshInstances(scene->mRootNode, aiMatrix4x4(), instances);
+	std::map<unsigned int, std::vector<size_t>> instancesByMaterial;
+	for (size_t i = 0; i < instances.size(); i++) {
+		instancesByMaterial[scene->mMeshes[instances[i].first]->mMaterialIndex].push_back(i);
+	}
+
+	// Reserved up front, because the sub-mesh table holds views into these names.
+	model.importedTextures.reserve(instancesByMaterial.size());
+	for (auto& [materialIndex, materialInstances] : instancesByMaterial) {
+		auto indexOffset = static_cast<uint32_t>(model.importedFaces.size());
+		for (auto instance : materialInstances) {
+			auto& [meshIndex, transform] = instances[instance];
+			fromAssimpMesh(scene->mMeshes[meshIndex], transform, model.importedVertices, model.importedFaces);
+		}
+
+		// Locate the "diffuse map" of the material, which is the primary texture of its meshes.
+		std::string& textureName = model.importedTextures.emplace_back();
+		if (scene->HasMaterials()) {
+			auto* material = scene->mMaterials[materialIndex];
+			aiString name;
+			if (material->GetTexture(aiTextureType_DIFFUSE, 0, &name) == aiReturn_SUCCESS) {
+				textureName = name.C_Str();
+			}
+		}
+		model.importedSubMeshes.push_back({ indexOffset,
+			static_cast<uint32_t>(model.importedFaces.size()) - indexOffset, textureName });
+	}
 }
 
-Object3D assimpLoad(const std::string& path, bool flipTextureCoords) {
-	Assimp::Importer importer;
+/**
+ * @brief Parses an OBJ file with parseObj into the model's import buffers.
+ */
+void importObj(const MappedFile& source, bool flipTextureCoords, ModelData& model) {
+	auto obj = parseObj(std::string_view(reinterpret_cast<const char*>(source.getData()), source.getSize()),
+		model.path.parent_path(), flipTextureCoords);
+	model.importedVertices = std::move(obj.vertices);
+	model.importedFaces = std::move(obj.faces);
+	model.importedTextures.reserve(obj.groups.size());
+	for (auto& group : obj.groups) {
+		auto& textureName = model.importedTextures.emplace_back(std::move(group.diffuseTexture));
+		model.importedSubMeshes.push_back({ group.indexOffset, group.indexCount, textureName });
+	}
+}
 
-	auto options = aiProcessPreset_TargetRealtime_MaxQuality;
+ModelData importModel(const std::string& path, bool flipTextureCoords, ModelImporter importer) {
+	uint32_t options = aiProcessPreset_TargetRealtime_MaxQuality;
 	if (flipTextureCoords) {
 		options |= aiProcess_FlipUVs;
 	}
-	const aiScene* scene = importer.ReadFile(path, options);
+	ModelData model;
+	model.path = path;
 
-	// If the import failed, report it
-	if (nullptr == scene) {
-		throw std::runtime_error("Error loading assimp file ");
-		
+	auto extension = model.path.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+	bool native = importer == ModelImporter::Auto && extension == ".obj";
+	// The OBJ parser only honors the UV flip, and its output differs from Assimp's, so its
+	// caches are told apart by a bit none of Assimp's steps used here has.
+	uint32_t nativeOptions = NATIVE_OBJ_IMPORT | (options & aiProcess_FlipUVs);
+
+	// Reuse the binary cache of this model if it was built from the same file with the same options.
+	MappedFile source;
+	source.open(path);
+	auto sourceHash = MeshCache::hash(source.getData(), source.getSize());
+	auto cachePath = MeshCache::pathFor(model.path);
+	auto readCache = [&](uint32_t cacheOptions) {
+		if (!model.cache.open(cachePath, sourceHash, cacheOptions)) {
+			return false;
+		}
+		model.vertices = model.cache.getVertices();
+		model.faces = model.cache.getFaces();
+		model.subMeshes = model.cache.getSubMeshes();
+		return true;
+	};
+
+	if (readCache(native ? nativeOptions : options)) {
+		return model;
 	}
-	else {
+	if (native) {
+		try {
+			importObj(source, flipTextureCoords, model);
+		}
+		catch (std::exception& e) {
+			std::cout << "WARNING: could not parse " << path << ", importing it with Assimp instead: " << e.what() << std::endl;
+			native = false;
+			model.importedVertices.clear();
+			model.importedFaces.clear();
+			model.importedTextures.clear();
+			model.importedSubMeshes.clear();
+			if (readCache(options)) {
+				return model;
+			}
+		}
+	}
+	if (!native) {
+		importWithAssimp(path, source, options, model);
+	}
+
+	// Reorder the faces for the vertex cache and overdraw, and the vertices for fetching. The
+	// cache stores the result, so this only runs when the model changes.
+	optimizeMesh(model.importedVertices, model.importedFaces, model.importedSubMeshes);
+	// Then append simplified levels of detail, which share the optimized vertices.
+	generateLods(model.importedVertices, model.importedFaces, model.importedSubMeshes);
+
+	try {
+		MeshCache::write(cachePath, sourceHash, native ? nativeOptions : options, model.importedVertices,
+			model.importedFaces, model.importedSubMeshes);
+	}
+	catch (std::exception& e) {
+		std::cout << "WARNING: could not write mesh cache " << cachePath << ": " << e.what() << std::endl;
+	}
+	model.vertices = model.importedVertices;
+	model.faces = model.importedFaces;
+	model.subMeshes = model.importedSubMeshes;
+	return model;
+}
 
+std::filesystem::path ModelData::texturePath(const MeshCacheSubMesh& subMesh) const {
+	if (subMesh.diffuseTexture.empty()) {
+		return {};
 	}
-	auto* mesh = scene->mMeshes[0];
-	StbImage texture;
+	return path.parent_path() / subMesh.diffuseTexture;
+}
 
-	if (scene->HasMaterials()) {
-		// Locate the "diffuse map" of the mesh, which is the mesh's primary texture.
-		auto* material = scene->mMaterials[mesh->mMaterialIndex];
-		aiString name;
-		material->Get(AI_MATKEY_NAME, name);
-		material->GetTexture(aiTextureType_DIFFUSE, 0, &name);
+std::vector<MeshLod> ModelData::getLods() const {
+	std::vector<MeshLod> lods;
+	for (auto& subMesh : subMeshes) {
+		if (subMesh.lod == 0) {
+			continue;
+		}
+		if (lods.size() < subMesh.lod) {
+			lods.resize(subMesh.lod, MeshLod{ 0, {} });
+		}
+		auto& lod = lods[subMesh.lod - 1];
+		lod.error = std::max(lod.error, subMesh.lodError);
+		lod.ranges.push_back({ subMesh.indexOffset, subMesh.indexCount });
+	}
+	return lods;
+}
 
-		// Locate and load the texture image into RAM.
-		std::filesystem::path modelPath = path;
-		std::filesystem::path texPath = modelPath.parent_path() / name.C_Str();
-		texture.loadFromFile(texPath.string());
+Mesh3D createMesh(const ModelData& model, TextureManager& textures, PositionFormat positionFormat) {
+	std::vector<SubMesh> meshSubMeshes;
+	for (auto& subMesh : model.subMeshes) {
+		if (subMesh.lod != 0) {
+			continue;
+		}
+		std::shared_ptr<Texture> texture;
+		if (!subMesh.diffuseTexture.empty()) {
+			// Load the texture image, unless another mesh already uses it.
+			texture = textures.load(model.texturePath(subMesh).string());
+		}
+		meshSubMeshes.push_back({ subMesh.indexOffset, subMesh.indexCount, std::move(texture) });
 	}
-	auto ret = Object3D(std::make_shared<Mesh3D>(fromAssimpMesh(scene->mMeshes[0], texture)));
+	Mesh3D mesh(model.vertices, model.faces, std::move(meshSubMeshes), positionFormat);
+	mesh.setLods(model.getLods());
+	return mesh;
+}
+
+Object3D assimpLoad(const std::string& path, bool flipTextureCoords, TextureManager& textures,
+	ModelImporter importer) {
+	auto model = importModel(path, flipTextureCoords, importer);
+	auto ret = Object3D(std::make_shared<Mesh3D>(createMesh(model, textures)));
 	return ret;
 }
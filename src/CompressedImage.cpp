@@ -0,0 +1,357 @@
+#include "CompressedImage.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include "GlCapabilities.h"
+
+// Compressed formats that come from extensions, which the OpenGL headers may not define.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT 0x83F2
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT 0x8C4E
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+#ifndef GL_COMPRESSED_RED_RGTC1
+#define GL_COMPRESSED_RED_RGTC1 0x8DBB
+#define GL_COMPRESSED_RG_RGTC2 0x8DBD
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM 0x8E8D
+#endif
+#ifndef GL_COMPRESSED_RGB8_ETC2
+#define GL_COMPRESSED_RGB8_ETC2 0x9274
+#define GL_COMPRESSED_SRGB8_ETC2 0x9275
+#define GL_COMPRESSED_RGBA8_ETC2_EAC 0x9278
+#define GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC 0x9279
+#endif
+#ifndef GL_COMPRESSED_RGBA_ASTC_4x4_KHR
+#define GL_COMPRESSED_RGBA_ASTC_4x4_KHR 0x93B0
+#define GL_COMPRESSED_RGBA_ASTC_12x12_KHR 0x93BD
+#define GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR 0x93D0
+#define GL_COMPRESSED_SRGB8_ALPHA8_ASTC_12x12_KHR 0x93DD
+#endif
+
+namespace {
+	struct BlockFormat {
+		int blockWidth;
+		int blockHeight;
+		int blockBytes;
+	};
+
+	// The block dimensions of a compressed format, or a zero-sized block if it is not one we know.
+	BlockFormat blockFormat(uint32_t format) {
+		switch (format) {
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RED_RGTC1:
+		case GL_COMPRESSED_RGB8_ETC2:
+		case GL_COMPRESSED_SRGB8_ETC2:
+			return { 4, 4, 8 };
+		case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_RG_RGTC2:
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:
+		case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+		case GL_COMPRESSED_RGBA8_ETC2_EAC:
+		case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+			return { 4, 4, 16 };
+		}
+		// ASTC formats are numbered in order of block size, for linear and sRGB alike.
+		static const BlockFormat astcBlocks[] = {
+			{ 4, 4, 16 }, { 5, 4, 16 }, { 5, 5, 16 }, { 6, 5, 16 }, { 6, 6, 16 }, { 8, 5, 16 }, { 8, 6, 16 },
+			{ 8, 8, 16 }, { 10, 5, 16 }, { 10, 6, 16 }, { 10, 8, 16 }, { 10, 10, 16 }, { 12, 10, 16 }, { 12, 12, 16 },
+		};
+		if (format >= GL_COMPRESSED_RGBA_ASTC_4x4_KHR && format <= GL_COMPRESSED_RGBA_ASTC_12x12_KHR) {
+			return astcBlocks[format - GL_COMPRESSED_RGBA_ASTC_4x4_KHR];
+		}
+		if (format >= GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR && format <= GL_COMPRESSED_SRGB8_ALPHA8_ASTC_12x12_KHR) {
+			return astcBlocks[format - GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR];
+		}
+		return { 0, 0, 0 };
+	}
+
+	size_t levelSize(const BlockFormat& block, int width, int height) {
+		size_t blocksWide = (width + block.blockWidth - 1) / block.blockWidth;
+		size_t blocksHigh = (height + block.blockHeight - 1) / block.blockHeight;
+		return blocksWide * blocksHigh * block.blockBytes;
+	}
+
+	// Rejects a width or height of zero, or one the GPU can't hold, which could also overflow
+	// the level size maths.
+	void checkDimensions(uint32_t width, uint32_t height, const std::string& filepath) {
+		auto maxSize = static_cast<uint32_t>(std::max(getGlMaxTextureSize(), 1));
+		if (width == 0 || height == 0 || width > maxSize || height > maxSize) {
+			throw std::runtime_error("Unsupported image size " + std::to_string(width) + "x" + std::to_string(height)
+				+ ": " + filepath);
+		}
+	}
+
+	// The number of levels in a full mipmap chain, down to 1x1.
+	uint32_t fullLevelCount(uint32_t width, uint32_t height) {
+		uint32_t count = 1;
+		for (auto size = std::max(width, height); size > 1; size /= 2) {
+			count++;
+		}
+		return count;
+	}
+
+	uint32_t readUint32(const unsigned char* data) {
+		uint32_t value;
+		std::memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	uint32_t fourCC(const char code[4]) {
+		return uint32_t(uint8_t(code[0])) | (uint32_t(uint8_t(code[1])) << 8)
+			| (uint32_t(uint8_t(code[2])) << 16) | (uint32_t(uint8_t(code[3])) << 24);
+	}
+}
+
+CompressedImage::CompressedImage() : m_format(0) {
+}
+
+void CompressedImage::loadFromFile(const std::string& filepath) {
+	auto extension = std::filesystem::path(filepath).extension().string();
+	m_file.open(filepath);
+	m_levels.clear();
+	if (extension == ".ktx") {
+		loadKtx(filepath);
+	}
+	else if (extension == ".dds") {
+		loadDds(filepath);
+	}
+	else {
+		throw std::runtime_error("Unknown compressed image type " + filepath);
+	}
+}
+
+void CompressedImage::loadKtx(const std::string& filepath) {
+	static const unsigned char identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+	const size_t headerSize = 64;
+	auto* data = m_file.getData();
+	auto size = m_file.getSize();
+	if (size < headerSize || std::memcmp(data, identifier, sizeof(identifier)) != 0
+		|| readUint32(data + 12) != 0x04030201) {
+		throw std::runtime_error("Not a little-endian KTX file: " + filepath);
+	}
+
+	auto glType = readUint32(data + 16);
+	m_format = readUint32(data + 28);
+	auto fileWidth = readUint32(data + 36);
+	auto fileHeight = readUint32(data + 40);
+	auto depth = readUint32(data + 44);
+	auto arrayElements = readUint32(data + 48);
+	auto faces = readUint32(data + 52);
+	auto levelCount = std::max(1u, readUint32(data + 56));
+	auto keyValueBytes = readUint32(data + 60);
+	auto block = blockFormat(m_format);
+	if (glType != 0 || block.blockBytes == 0 || depth > 1 || arrayElements > 0 || faces != 1) {
+		throw std::runtime_error("Only compressed 2D textures are supported: " + filepath);
+	}
+	checkDimensions(fileWidth, fileHeight, filepath);
+	levelCount = std::min(levelCount, fullLevelCount(fileWidth, fileHeight));
+	int width = static_cast<int>(fileWidth);
+	int height = static_cast<int>(fileHeight);
+
+	// Each level is its size, followed by its data padded to a multiple of 4 bytes.
+	if (keyValueBytes > size - headerSize) {
+		throw std::runtime_error("Truncated KTX file: " + filepath);
+	}
+	size_t offset = headerSize + keyValueBytes;
+	for (uint32_t level = 0; level < levelCount; level++) {
+		if (4 > size - offset) {
+			throw std::runtime_error("Truncated KTX file: " + filepath);
+		}
+		size_t imageSize = readUint32(data + offset);
+		offset += 4;
+		if (imageSize > size - offset || imageSize != levelSize(block, width, height)) {
+			throw std::runtime_error("Malformed KTX file: " + filepath);
+		}
+		m_levels.push_back({ width, height, data + offset, imageSize });
+		// The last level's padding may run past the end of the file.
+		offset = std::min(size, offset + ((imageSize + 3) & ~size_t(3)));
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+}
+
+void CompressedImage::loadDds(const std::string& filepath) {
+	const size_t headerSize = 4 + 124;
+	const size_t dx10HeaderSize = 20;
+	auto* data = m_file.getData();
+	auto size = m_file.getSize();
+	if (size < headerSize || readUint32(data) != fourCC("DDS ")) {
+		throw std::runtime_error("Not a DDS file: " + filepath);
+	}
+
+	auto fileHeight = readUint32(data + 12);
+	auto fileWidth = readUint32(data + 16);
+	auto levelCount = std::max(1u, readUint32(data + 28));
+	auto pixelFormatFlags = readUint32(data + 80);
+	auto pixelFourCC = readUint32(data + 84);
+	auto caps2 = readUint32(data + 112);
+	const uint32_t DDPF_FOURCC = 0x4;
+	const uint32_t DDSCAPS2_CUBEMAP = 0x200, DDSCAPS2_VOLUME = 0x200000;
+	if (!(pixelFormatFlags & DDPF_FOURCC) || (caps2 & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME))) {
+		throw std::runtime_error("Only compressed 2D textures are supported: " + filepath);
+	}
+
+	size_t offset = headerSize;
+	if (pixelFourCC == fourCC("DX10")) {
+		if (size < headerSize + dx10HeaderSize) {
+			throw std::runtime_error("Truncated DDS file: " + filepath);
+		}
+		auto dxgiFormat = readUint32(data + headerSize);
+		auto arraySize = readUint32(data + headerSize + 12);
+		offset += dx10HeaderSize;
+		if (arraySize > 1) {
+			throw std::runtime_error("Texture arrays are not supported: " + filepath);
+		}
+		switch (dxgiFormat) {
+		case 71: m_format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; break;        // BC1_UNORM
+		case 72: m_format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT; break;  // BC1_UNORM_SRGB
+		case 74: m_format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; break;        // BC2_UNORM
+		case 75: m_format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT; break;  // BC2_UNORM_SRGB
+		case 77: m_format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;        // BC3_UNORM
+		case 78: m_format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT; break;  // BC3_UNORM_SRGB
+		case 80: m_format = GL_COMPRESSED_RED_RGTC1; break;                 // BC4_UNORM
+		case 83: m_format = GL_COMPRESSED_RG_RGTC2; break;                  // BC5_UNORM
+		case 98: m_format = GL_COMPRESSED_RGBA_BPTC_UNORM; break;           // BC7_UNORM
+		case 99: m_format = GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM; break;     // BC7_UNORM_SRGB
+		default:
+			throw std::runtime_error("Unsupported DXGI format " + std::to_string(dxgiFormat) + ": " + filepath);
+		}
+	}
+	else if (pixelFourCC == fourCC("DXT1")) {
+		m_format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+	}
+	else if (pixelFourCC == fourCC("DXT3")) {
+		m_format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+	}
+	else if (pixelFourCC == fourCC("DXT5")) {
+		m_format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	}
+	else if (pixelFourCC == fourCC("ATI1") || pixelFourCC == fourCC("BC4U")) {
+		m_format = GL_COMPRESSED_RED_RGTC1;
+	}
+	else if (pixelFourCC == fourCC("ATI2") || pixelFourCC == fourCC("BC5U")) {
+		m_format = GL_COMPRESSED_RG_RGTC2;
+	}
+	else {
+		throw std::runtime_error("Unsupported DDS pixel format: " + filepath);
+	}
+
+	checkDimensions(fileWidth, fileHeight, filepath);
+	levelCount = std::min(levelCount, fullLevelCount(fileWidth, fileHeight));
+	int width = static_cast<int>(fileWidth);
+	int height = static_cast<int>(fileHeight);
+
+	// DDS levels follow one another with no padding.
+	auto block = blockFormat(m_format);
+	for (uint32_t level = 0; level < levelCount; level++) {
+		size_t imageSize = levelSize(block, width, height);
+		if (imageSize > size - offset) {
+			throw std::runtime_error("Truncated DDS file: " + filepath);
+		}
+		m_levels.push_back({ width, height, data + offset, imageSize });
+		offset += imageSize;
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+}
+
+bool CompressedImage::loadCompressedVersionOf(const std::string& imagePath) {
+	for (auto* extension : { ".ktx", ".dds" }) {
+		auto compressedPath = std::filesystem::path(imagePath).replace_extension(extension);
+		std::error_code error;
+		if (!std::filesystem::is_regular_file(compressedPath, error)) {
+			continue;
+		}
+		try {
+			loadFromFile(compressedPath.string());
+		}
+		catch (std::runtime_error& e) {
+			// A broken compressed copy shouldn't cost the texture; the original image may be fine.
+			std::cout << "WARNING: ignoring " << compressedPath.string() << ": " << e.what() << std::endl;
+			m_levels.clear();
+			m_file = MappedFile();
+			continue;
+		}
+		if (isFormatSupported(m_format)) {
+			return true;
+		}
+	}
+	m_levels.clear();
+	m_file = MappedFile();
+	return false;
+}
+
+bool CompressedImage::isFormatSupported(uint32_t format) {
+	switch (format) {
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		return hasGlExtension("GL_EXT_texture_compression_s3tc");
+	case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+		return hasGlExtension("GL_EXT_texture_compression_s3tc")
+			&& (hasGlExtension("GL_EXT_texture_sRGB") || hasGlExtension("GL_EXT_texture_compression_s3tc_srgb"));
+	case GL_COMPRESSED_RED_RGTC1:
+	case GL_COMPRESSED_RG_RGTC2:
+		return hasGlVersion(3, 0);
+	case GL_COMPRESSED_RGBA_BPTC_UNORM:
+	case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+		return hasGlVersion(4, 2) || hasGlExtension("GL_ARB_texture_compression_bptc");
+	case GL_COMPRESSED_RGB8_ETC2:
+	case GL_COMPRESSED_SRGB8_ETC2:
+	case GL_COMPRESSED_RGBA8_ETC2_EAC:
+	case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+		return hasGlVersion(4, 3) || hasGlExtension("GL_ARB_ES3_compatibility");
+	}
+	if (blockFormat(format).blockBytes != 0) {
+		// Everything else we recognize is ASTC.
+		return hasGlExtension("GL_KHR_texture_compression_astc_ldr");
+	}
+	return false;
+}
+
+uint32_t CompressedImage::getFormat() const {
+	return m_format;
+}
+
+int CompressedImage::getWidth() const {
+	return m_levels.empty() ? 0 : m_levels[0].width;
+}
+
+int CompressedImage::getHeight() const {
+	return m_levels.empty() ? 0 : m_levels[0].height;
+}
+
+const std::vector<CompressedImage::Level>& CompressedImage::getLevels() const {
+	return m_levels;
+}
+
+size_t CompressedImage::getSize() const {
+	size_t size = 0;
+	for (auto& level : m_levels) {
+		size += level.size;
+	}
+	return size;
+}
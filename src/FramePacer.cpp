@@ -0,0 +1,70 @@
+#include "FramePacer.h"
+#include <glad/glad.h>
+#include <algorithm>
+
+namespace {
+	// With vsync on, a frame that missed its refresh takes about two intervals; this is the
+	// longest a frame may take before adaptive mode takes it for a miss.
+	const double MISSED_FRAME_FACTOR = 1.5;
+	// With vsync off, adaptive mode turns it back on after this many frames in a row that each
+	// took less than FAST_FRAME_FACTOR refresh intervals.
+	const size_t RESYNC_FRAMES = 30;
+	const double FAST_FRAME_FACTOR = 0.9;
+}
+
+FramePacer::FramePacer(size_t framesInFlight)
+	: m_framesInFlight(std::max<size_t>(framesInFlight, 1)), m_mode(VsyncMode::Off), m_refreshInterval(1.0 / 60),
+	m_vsync(false), m_fastFrames(0), m_timed(false) {
+}
+
+FramePacer::~FramePacer() {
+	for (auto fence : m_fences) {
+		glDeleteSync(fence);
+	}
+}
+
+void FramePacer::beginFrame() {
+	while (m_fences.size() >= m_framesInFlight) {
+		auto fence = m_fences.front();
+		waitForFence(fence);
+		glDeleteSync(fence);
+		m_fences.pop_front();
+	}
+}
+
+void FramePacer::endFrame() {
+	m_fences.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+
+	auto now = std::chrono::steady_clock::now();
+	double frameTime = std::chrono::duration<double>(now - m_lastFrameEnd).count();
+	if (m_timed && m_mode == VsyncMode::Adaptive) {
+		if (m_vsync && frameTime > m_refreshInterval * MISSED_FRAME_FACTOR) {
+			m_vsync = false;
+			m_fastFrames = 0;
+		}
+		else if (!m_vsync) {
+			m_fastFrames = frameTime < m_refreshInterval * FAST_FRAME_FACTOR ? m_fastFrames + 1 : 0;
+			m_vsync = m_fastFrames >= RESYNC_FRAMES;
+		}
+	}
+	m_lastFrameEnd = now;
+	m_timed = true;
+}
+
+void FramePacer::setVsyncMode(VsyncMode mode) {
+	m_mode = mode;
+	m_vsync = mode != VsyncMode::Off;
+	m_fastFrames = 0;
+}
+
+VsyncMode FramePacer::getVsyncMode() const {
+	return m_mode;
+}
+
+void FramePacer::setRefreshInterval(double seconds) {
+	m_refreshInterval = seconds;
+}
+
+bool FramePacer::wantsVsync() const {
+	return m_vsync;
+}
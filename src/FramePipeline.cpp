@@ -0,0 +1,91 @@
+#include "FramePipeline.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+	// How far behind real time the simulation may fall, e.g. while paused in a debugger, before
+	// it skips ahead instead of catching up with a burst of steps.
+	const std::chrono::milliseconds MAX_LAG(250);
+}
+
+FrameSnapshot FrameSnapshot::from(std::span<const Object3D> objects) {
+	FrameSnapshot snapshot = { 0, 0, {} };
+	snapshot.objects.reserve(objects.size());
+	for (auto& object : objects) {
+		snapshot.objects.push_back({ object.getPosition(), object.getOrientation(), object.getScale() });
+	}
+	return snapshot;
+}
+
+void FrameSnapshot::applyTo(std::span<Object3D> objects) const {
+	size_t count = std::min(objects.size(), this->objects.size());
+	for (size_t i = 0; i < count; i++) {
+		auto& transform = this->objects[i];
+		auto& object = objects[i];
+		if (object.getPosition() != transform.position) {
+			object.setPosition(transform.position);
+		}
+		if (object.getOrientation() != transform.orientation) {
+			object.setOrientation(transform.orientation);
+		}
+		if (object.getScale() != transform.scale) {
+			object.setScale(transform.scale);
+		}
+	}
+}
+
+FramePipeline::FramePipeline(FrameSnapshot world, Step step, double stepSeconds)
+	: m_simulate(std::move(step)), m_stepSeconds(stepSeconds), m_world(std::move(world)),
+	m_snapshots{ m_world, m_world, m_world }, m_writing(&m_snapshots[0]), m_published(&m_snapshots[1]),
+	m_rendering(&m_snapshots[2]), m_fresh(false), m_stopping(false) {
+	m_thread = std::thread(&FramePipeline::simulationLoop, this);
+}
+
+FramePipeline::~FramePipeline() {
+	{
+		std::lock_guard lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	m_thread.join();
+}
+
+const FrameSnapshot& FramePipeline::acquire() {
+	std::lock_guard lock(m_mutex);
+	if (m_fresh) {
+		std::swap(m_published, m_rendering);
+		m_fresh = false;
+	}
+	return *m_rendering;
+}
+
+void FramePipeline::simulationLoop() {
+	using Clock = std::chrono::steady_clock;
+	auto stepDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(m_stepSeconds));
+	auto nextStep = Clock::now() + stepDuration;
+	while (true) {
+		{
+			std::unique_lock lock(m_mutex);
+			if (m_wake.wait_until(lock, nextStep, [this] { return m_stopping; })) {
+				return;
+			}
+		}
+
+		m_simulate(m_world, m_stepSeconds);
+		m_world.step++;
+		m_world.time += m_stepSeconds;
+		// The snapshot being written is the simulation's alone; copying into it reuses its memory.
+		*m_writing = m_world;
+		{
+			std::lock_guard lock(m_mutex);
+			std::swap(m_writing, m_published);
+			m_fresh = true;
+		}
+
+		nextStep += stepDuration;
+		auto now = Clock::now();
+		if (nextStep < now - MAX_LAG) {
+			nextStep = now;
+		}
+	}
+}
@@ -0,0 +1,33 @@
+#include "Frustum.h"
+#include <cmath>
+
+Frustum Frustum::fromMatrix(const glm::mat4& viewProjection) {
+	auto row = [&](int i) {
+		return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	};
+	Frustum frustum;
+	frustum.planes = {
+		row(3) + row(0), row(3) - row(0),
+		row(3) + row(1), row(3) - row(1),
+		row(3) + row(2), row(3) - row(2)
+	};
+	for (auto& plane : frustum.planes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return frustum;
+}
+
+Frustum::Containment Frustum::classify(const glm::vec3& center, const glm::vec3& extent) const {
+	auto containment = Containment::Inside;
+	for (auto& plane : planes) {
+		float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+		float reach = std::abs(plane.x) * extent.x + std::abs(plane.y) * extent.y + std::abs(plane.z) * extent.z;
+		if (distance + reach < 0) {
+			return Containment::Outside;
+		}
+		if (distance - reach < 0) {
+			containment = Containment::Intersects;
+		}
+	}
+	return containment;
+}
@@ -0,0 +1,72 @@
+#include "FrustumCuller.h"
+#include <algorithm>
+#include <cmath>
+#include "Frustum.h"
+#include "Profiler.h"
+
+void FrustumCuller::updateObject(const Object3D& object, size_t index) {
+	auto bounds = object.getWorldBounds();
+	m_centerX[index] = bounds.center.x;
+	m_centerY[index] = bounds.center.y;
+	m_centerZ[index] = bounds.center.z;
+	m_extentX[index] = bounds.extent.x;
+	m_extentY[index] = bounds.extent.y;
+	m_extentZ[index] = bounds.extent.z;
+	m_radius[index] = bounds.radius;
+	m_transformVersions[index] = object.getTransformVersion();
+	m_meshBounds[index] = object.getMesh()->getBounds();
+}
+
+void FrustumCuller::update(std::span<const Object3D> objects) {
+	size_t previousCount = m_transformVersions.size();
+	for (auto* component : { &m_centerX, &m_centerY, &m_centerZ, &m_extentX, &m_extentY, &m_extentZ, &m_radius }) {
+		component->resize(objects.size());
+	}
+	m_transformVersions.resize(objects.size());
+	m_meshBounds.resize(objects.size());
+	m_inside.resize(objects.size());
+
+	for (size_t i = 0; i < objects.size(); i++) {
+		// A mesh that finishes loading in place changes its bounds without the object moving.
+		if (i >= previousCount || objects[i].getTransformVersion() != m_transformVersions[i]
+			|| objects[i].getMesh()->getBounds() != m_meshBounds[i]) {
+			updateObject(objects[i], i);
+		}
+	}
+}
+
+std::span<const uint32_t> FrustumCuller::cull(const glm::mat4& viewProjection) {
+	auto planes = Frustum::fromMatrix(viewProjection).planes;
+	size_t count = m_inside.size();
+	const float* centerX = m_centerX.data();
+	const float* centerY = m_centerY.data();
+	const float* centerZ = m_centerZ.data();
+	const float* extentX = m_extentX.data();
+	const float* extentY = m_extentY.data();
+	const float* extentZ = m_extentZ.data();
+	const float* radius = m_radius.data();
+	uint8_t* inside = m_inside.data();
+
+	// Branch-free, so the loop vectorizes: an object is outside if it is entirely behind any
+	// plane, judged by the smaller of its box's and its sphere's reach towards that plane.
+	for (size_t i = 0; i < count; i++) {
+		uint8_t visible = 1;
+		for (auto& plane : planes) {
+			float distance = plane.x * centerX[i] + plane.y * centerY[i] + plane.z * centerZ[i] + plane.w;
+			float reach = std::abs(plane.x) * extentX[i] + std::abs(plane.y) * extentY[i] + std::abs(plane.z) * extentZ[i];
+			reach = std::min(reach, radius[i]);
+			visible &= static_cast<uint8_t>(distance + reach >= 0);
+		}
+		inside[i] = visible;
+	}
+
+	m_visible.clear();
+	for (size_t i = 0; i < count; i++) {
+		if (inside[i]) {
+			m_visible.push_back(static_cast<uint32_t>(i));
+		}
+	}
+	Profiler::count(Profiler::Counter::ObjectsVisible, static_cast<uint32_t>(m_visible.size()));
+	Profiler::count(Profiler::Counter::ObjectsCulled, static_cast<uint32_t>(count - m_visible.size()));
+	return m_visible;
+}
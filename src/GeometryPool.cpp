@@ -0,0 +1,173 @@
+#include "GeometryPool.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include "GpuResources.h"
+
+namespace {
+	// The smallest the buffers grow to, in vertices and indices, so small meshes don't cause
+	// a string of reallocations.
+	const uint32_t MIN_VERTEX_CAPACITY = 1 << 16;
+	const uint32_t MIN_INDEX_CAPACITY = 3 << 16;
+}
+
+bool GeometryPool::RangeAllocator::allocate(uint32_t size, uint32_t& offset) {
+	if (size == 0) {
+		offset = 0;
+		return true;
+	}
+	for (auto it = m_free.begin(); it != m_free.end(); it++) {
+		if (it->size >= size) {
+			offset = it->offset;
+			it->offset += size;
+			it->size -= size;
+			if (it->size == 0) {
+				m_free.erase(it);
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+void GeometryPool::RangeAllocator::free(uint32_t offset, uint32_t size) {
+	if (size == 0) {
+		return;
+	}
+	// Insert in offset order, merging with the neighboring free ranges it touches.
+	auto next = std::lower_bound(m_free.begin(), m_free.end(), offset,
+		[](const Range& range, uint32_t value) { return range.offset < value; });
+	if (next != m_free.begin() && std::prev(next)->offset + std::prev(next)->size == offset) {
+		auto previous = std::prev(next);
+		previous->size += size;
+		if (next != m_free.end() && previous->offset + previous->size == next->offset) {
+			previous->size += next->size;
+			m_free.erase(next);
+		}
+	}
+	else if (next != m_free.end() && offset + size == next->offset) {
+		next->offset = offset;
+		next->size += size;
+	}
+	else {
+		m_free.insert(next, { offset, size });
+	}
+}
+
+void GeometryPool::RangeAllocator::grow(uint32_t capacity) {
+	free(m_capacity, capacity - m_capacity);
+	m_capacity = capacity;
+}
+
+uint32_t GeometryPool::RangeAllocator::getCapacity() const {
+	return m_capacity;
+}
+
+GeometryPool::GeometryPool(const Mesh3D::VertexLayout& layout, uint32_t indexType)
+	: m_layout(layout), m_indexType(indexType) {
+	auto& resources = GpuResources::shared();
+	m_vao = resources.createVertexArray();
+	m_vbo = resources.createBuffer();
+	m_ebo = resources.createBuffer();
+	bindBuffers();
+}
+
+GeometryPool::~GeometryPool() {
+	auto& resources = GpuResources::shared();
+	resources.destroyVertexArray(m_vao);
+	resources.destroyBuffer(m_vbo);
+	resources.destroyBuffer(m_ebo);
+}
+
+void GeometryPool::bindBuffers() {
+	glBindVertexArray(m_vao);
+	Mesh3D::setVertexAttributes(m_layout, m_vbo, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+	glBindVertexArray(0);
+}
+
+void GeometryPool::growBuffer(uint32_t& buffer, size_t oldBytes, size_t newBytes) {
+	uint32_t grown = GpuResources::shared().createBuffer();
+	glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+	glBufferData(GL_COPY_WRITE_BUFFER, newBytes, nullptr, GL_STATIC_DRAW);
+	if (oldBytes > 0) {
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldBytes);
+	}
+	GpuResources::shared().destroyBuffer(buffer);
+	buffer = grown;
+}
+
+bool GeometryPool::accepts(const Mesh3D& mesh) const {
+	return mesh.getLayout() == m_layout && mesh.getIndexType() == m_indexType;
+}
+
+GeometryPool::Allocation GeometryPool::add(const Mesh3D& mesh) {
+	Allocation allocation = { 0, static_cast<uint32_t>(mesh.getVertexCount()), 0,
+		static_cast<uint32_t>(mesh.getIndexCount()) };
+
+	reclaim();
+	bool grew = false;
+	while (!m_vertices.allocate(allocation.vertexCount, allocation.baseVertex)) {
+		uint32_t capacity = m_vertices.getCapacity();
+		uint32_t grown = std::max({ capacity * 2, capacity + allocation.vertexCount, MIN_VERTEX_CAPACITY });
+		growBuffer(m_vbo, static_cast<size_t>(capacity) * m_layout.stride, static_cast<size_t>(grown) * m_layout.stride);
+		m_vertices.grow(grown);
+		grew = true;
+	}
+	while (!m_indices.allocate(allocation.indexCount, allocation.firstIndex)) {
+		uint32_t capacity = m_indices.getCapacity();
+		uint32_t grown = std::max({ capacity * 2, capacity + allocation.indexCount, MIN_INDEX_CAPACITY });
+		growBuffer(m_ebo, capacity * getIndexSize(), grown * getIndexSize());
+		m_indices.grow(grown);
+		grew = true;
+	}
+	if (grew) {
+		bindBuffers();
+	}
+
+	// Copy the mesh's buffers in, without a round trip through the CPU.
+	if (allocation.vertexCount > 0) {
+		glBindBuffer(GL_COPY_READ_BUFFER, mesh.getVertexBuffer());
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_vbo);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+			static_cast<size_t>(allocation.baseVertex) * m_layout.stride,
+			static_cast<size_t>(allocation.vertexCount) * m_layout.stride);
+	}
+	if (allocation.indexCount > 0) {
+		glBindBuffer(GL_COPY_READ_BUFFER, mesh.getIndexBuffer());
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_ebo);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+			allocation.firstIndex * getIndexSize(), allocation.indexCount * getIndexSize());
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return allocation;
+}
+
+void GeometryPool::remove(const Allocation& allocation) {
+	m_removed.push_back({ GpuResources::shared().getFrame(), allocation });
+}
+
+void GeometryPool::reclaim() {
+	auto& resources = GpuResources::shared();
+	size_t count = 0;
+	while (count < m_removed.size() && resources.isFrameComplete(m_removed[count].first)) {
+		auto& allocation = m_removed[count].second;
+		m_vertices.free(allocation.baseVertex, allocation.vertexCount);
+		m_indices.free(allocation.firstIndex, allocation.indexCount);
+		count++;
+	}
+	m_removed.erase(m_removed.begin(), m_removed.begin() + count);
+}
+
+uint32_t GeometryPool::getVertexArray() const {
+	return m_vao;
+}
+
+uint32_t GeometryPool::getIndexType() const {
+	return m_indexType;
+}
+
+size_t GeometryPool::getIndexSize() const {
+	return m_indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+}
@@ -0,0 +1,47 @@
+#include "GlCapabilities.h"
+#include <glad/glad.h>
+#include <set>
+#include <string>
+
+namespace {
+	struct GlCapabilities {
+		int major = 0;
+		int minor = 0;
+		int maxTextureSize = 0;
+		std::set<std::string, std::less<>> extensions;
+
+		GlCapabilities() {
+			glGetIntegerv(GL_MAJOR_VERSION, &major);
+			glGetIntegerv(GL_MINOR_VERSION, &minor);
+			glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+
+			int extensionCount = 0;
+			glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+			for (int i = 0; i < extensionCount; i++) {
+				auto* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+				if (name != nullptr) {
+					extensions.emplace(name);
+				}
+			}
+		}
+	};
+
+	const GlCapabilities& capabilities() {
+		static const GlCapabilities instance;
+		return instance;
+	}
+}
+
+bool hasGlExtension(std::string_view name) {
+	auto& extensions = capabilities().extensions;
+	return extensions.find(name) != extensions.end();
+}
+
+bool hasGlVersion(int major, int minor) {
+	auto& caps = capabilities();
+	return caps.major > major || (caps.major == major && caps.minor >= minor);
+}
+
+int getGlMaxTextureSize() {
+	return capabilities().maxTextureSize;
+}
@@ -0,0 +1,14 @@
+#include "GlFence.h"
+#include <glad/glad.h>
+
+void waitForFence(GLsync fence) {
+	// Flush on the first wait, so the fence is sure to reach the GPU and eventually signal.
+	GLbitfield waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	while (true) {
+		auto status = glClientWaitSync(fence, waitFlags, 1'000'000'000);
+		if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED || status == GL_WAIT_FAILED) {
+			return;
+		}
+		waitFlags = 0;
+	}
+}
@@ -0,0 +1,199 @@
+#include "GpuCuller.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <string>
+#include "Frustum.h"
+#include "GlCapabilities.h"
+#include "Object3D.h"
+
+namespace {
+	// Must match the shaders' local sizes.
+	const uint32_t CULL_GROUP_SIZE = 64;
+	const uint32_t PYRAMID_GROUP_SIZE = 8;
+
+	uint32_t groupCount(uint32_t invocations, uint32_t groupSize) {
+		return (invocations + groupSize - 1) / groupSize;
+	}
+}
+
+bool GpuCuller::isSupported() {
+	static bool supported = hasGlVersion(4, 3);
+	return supported;
+}
+
+GpuCuller::GpuCuller()
+	: m_objectCount(0), m_occlusionCulling(false), m_depthTexture(0), m_depthFramebuffer(0),
+	m_pyramidTexture(0), m_pyramidWidth(0), m_pyramidHeight(0), m_pyramidLevels(0), m_pyramidValid(false),
+	m_pyramidViewProjection(1) {
+	m_cullProgram.loadCompute("shaders/cull.comp");
+	m_pyramidProgram.loadCompute("shaders/depth_pyramid.comp");
+	m_cullProgram.activate();
+	m_cullProgram.setUniform("pyramid", 0);
+	m_pyramidProgram.activate();
+	m_pyramidProgram.setUniform("source", 0);
+
+	glGenBuffers(1, &m_objectBuffer);
+	glGenBuffers(1, &m_drawBuffer);
+	glGenBuffers(1, &m_rangeBuffer);
+	glGenBuffers(1, &m_lodBuffer);
+}
+
+GpuCuller::~GpuCuller() {
+	glDeleteBuffers(1, &m_objectBuffer);
+	glDeleteBuffers(1, &m_drawBuffer);
+	glDeleteBuffers(1, &m_rangeBuffer);
+	glDeleteBuffers(1, &m_lodBuffer);
+	deletePyramid();
+}
+
+void GpuCuller::setDraws(std::span<const DrawRecord> draws, std::span<const RangeRecord> ranges,
+	std::span<const uint32_t> lodLevels) {
+	m_objectCount = lodLevels.size();
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_drawBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, draws.size_bytes(), draws.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_rangeBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, ranges.size_bytes(), ranges.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_lodBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, lodLevels.size_bytes(), lodLevels.data(), GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_objectBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, m_objectCount * sizeof(ObjectRecord), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GpuCuller::setObjects(size_t firstObject, std::span<const ObjectRecord> objects) {
+	if (objects.empty()) {
+		return;
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_objectBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, firstObject * sizeof(ObjectRecord), objects.size_bytes(), objects.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GpuCuller::cull(uint32_t commandBuffer, const glm::mat4& view, const glm::mat4& projection,
+	float viewportHeight, float pixelError) {
+	if (m_objectCount == 0) {
+		return;
+	}
+
+	m_cullProgram.activate();
+	auto frustum = Frustum::fromMatrix(projection * view);
+	for (size_t i = 0; i < frustum.planes.size(); i++) {
+		m_cullProgram.setUniform("planes[" + std::to_string(i) + "]", frustum.planes[i]);
+	}
+	m_cullProgram.setUniform("objectCount", static_cast<int32_t>(m_objectCount));
+	m_cullProgram.setUniform("view", view);
+	m_cullProgram.setUniform("lodScale", projection[1][1] * viewportHeight * 0.5f / pixelError);
+	m_cullProgram.setUniform("lodHysteresis", Object3D::LOD_HYSTERESIS);
+	bool occlusion = m_occlusionCulling && m_pyramidValid;
+	m_cullProgram.setUniform("occlusion", occlusion);
+	if (occlusion) {
+		m_cullProgram.setUniform("pyramidViewProjection", m_pyramidViewProjection);
+		m_cullProgram.setUniform("pyramidLevels", m_pyramidLevels);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, m_pyramidTexture);
+	}
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_objectBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_drawBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_rangeBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_lodBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, commandBuffer);
+	glDispatchCompute(groupCount(static_cast<uint32_t>(m_objectCount), CULL_GROUP_SIZE), 1, 1);
+	// The draws that follow read the commands as their indirect arguments.
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+
+	for (uint32_t binding = 0; binding <= 4; binding++) {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+	}
+	if (occlusion) {
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+}
+
+void GpuCuller::setOcclusionCulling(bool occlusionCulling) {
+	m_occlusionCulling = occlusionCulling;
+	if (!occlusionCulling) {
+		m_pyramidValid = false;
+	}
+}
+
+bool GpuCuller::getOcclusionCulling() const {
+	return m_occlusionCulling;
+}
+
+void GpuCuller::deletePyramid() {
+	if (m_depthFramebuffer != 0) {
+		glDeleteFramebuffers(1, &m_depthFramebuffer);
+		glDeleteTextures(1, &m_depthTexture);
+		glDeleteTextures(1, &m_pyramidTexture);
+	}
+	m_depthFramebuffer = m_depthTexture = m_pyramidTexture = 0;
+	m_pyramidValid = false;
+}
+
+void GpuCuller::resizePyramid(uint32_t width, uint32_t height) {
+	deletePyramid();
+	m_pyramidWidth = width;
+	m_pyramidHeight = height;
+	m_pyramidLevels = 1;
+	while ((std::max(width, height) >> m_pyramidLevels) > 0) {
+		m_pyramidLevels++;
+	}
+
+	// The texture the depth buffer is resolved into. Its format must match the depth buffer's
+	// for the blit.
+	glGenTextures(1, &m_depthTexture);
+	glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenFramebuffers(1, &m_depthFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_depthFramebuffer);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_depthTexture, 0);
+	glDrawBuffer(GL_NONE);
+
+	glGenTextures(1, &m_pyramidTexture);
+	glBindTexture(GL_TEXTURE_2D, m_pyramidTexture);
+	glTexStorage2D(GL_TEXTURE_2D, m_pyramidLevels, GL_R32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void GpuCuller::updateDepthPyramid(const glm::mat4& viewProjection, uint32_t width, uint32_t height) {
+	if (!m_occlusionCulling || width == 0 || height == 0) {
+		return;
+	}
+
+	// Resolving a multisampled depth buffer takes a blit; compute shaders can't read one, or
+	// the default framebuffer's, directly.
+	int32_t drawFramebuffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+	if (width != m_pyramidWidth || height != m_pyramidHeight || m_depthFramebuffer == 0) {
+		resizePyramid(width, height);
+	}
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_depthFramebuffer);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+
+	// Each level is reduced from the one before it, which must be written first.
+	m_pyramidProgram.activate();
+	glActiveTexture(GL_TEXTURE0);
+	for (int32_t level = 0; level < m_pyramidLevels; level++) {
+		glBindTexture(GL_TEXTURE_2D, level == 0 ? m_depthTexture : m_pyramidTexture);
+		m_pyramidProgram.setUniform("sourceLevel", level - 1);
+		glBindImageTexture(0, m_pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		uint32_t levelWidth = std::max(width >> level, 1u);
+		uint32_t levelHeight = std::max(height >> level, 1u);
+		glDispatchCompute(groupCount(levelWidth, PYRAMID_GROUP_SIZE), groupCount(levelHeight, PYRAMID_GROUP_SIZE), 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+	glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	m_pyramidViewProjection = viewProjection;
+	m_pyramidValid = true;
+}
@@ -0,0 +1,133 @@
+#include "GpuResources.h"
+#include <glad/glad.h>
+
+namespace {
+	// How many names of a kind are generated at once.
+	const GLsizei NAME_BATCH_SIZE = 64;
+}
+
+GpuResources& GpuResources::shared() {
+	// Never destroyed: meshes and textures destroyed during static destruction still release
+	// their names here, and by then the context is gone along with everything in it.
+	static GpuResources* resources = new GpuResources();
+	return *resources;
+}
+
+GpuResources::GpuResources() : m_frame(1), m_completedFrame(0), m_pendingCount(0) {
+}
+
+uint32_t GpuResources::createBuffer() {
+	return create(BUFFER);
+}
+
+uint32_t GpuResources::createVertexArray() {
+	return create(VERTEX_ARRAY);
+}
+
+uint32_t GpuResources::createTexture() {
+	return create(TEXTURE);
+}
+
+uint32_t GpuResources::create(Kind kind) {
+	auto& free = m_free[kind];
+	if (free.empty()) {
+		// Names stay free of any object until first bound, so generating them early costs nothing.
+		free.resize(NAME_BATCH_SIZE);
+		switch (kind) {
+		case BUFFER:
+			glGenBuffers(NAME_BATCH_SIZE, free.data());
+			break;
+		case VERTEX_ARRAY:
+			glGenVertexArrays(NAME_BATCH_SIZE, free.data());
+			break;
+		default:
+			glGenTextures(NAME_BATCH_SIZE, free.data());
+			break;
+		}
+	}
+	uint32_t name = free.back();
+	free.pop_back();
+	return name;
+}
+
+void GpuResources::destroyBuffer(uint32_t buffer) {
+	destroy(BUFFER, buffer);
+}
+
+void GpuResources::destroyVertexArray(uint32_t vertexArray) {
+	destroy(VERTEX_ARRAY, vertexArray);
+}
+
+void GpuResources::destroyTexture(uint32_t texture) {
+	destroy(TEXTURE, texture);
+}
+
+void GpuResources::destroy(Kind kind, uint32_t name) {
+	if (name == 0) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_retired.empty() || m_retired.back().frame != m_frame) {
+		m_retired.push_back({ m_frame });
+	}
+	m_retired.back().names[kind].push_back(name);
+	m_pendingCount++;
+}
+
+void GpuResources::endFrame() {
+	auto fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	std::deque<Retired> finished;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_fences.push_back({ m_frame, fence });
+		m_frame++;
+
+		// Poll without waiting; a fence that hasn't signaled is looked at again next frame.
+		while (!m_fences.empty()) {
+			auto status = glClientWaitSync(m_fences.front().second, 0, 0);
+			if (status == GL_TIMEOUT_EXPIRED) {
+				break;
+			}
+			m_completedFrame = m_fences.front().first;
+			glDeleteSync(m_fences.front().second);
+			m_fences.pop_front();
+		}
+		while (!m_retired.empty() && m_retired.front().frame <= m_completedFrame) {
+			for (auto& names : m_retired.front().names) {
+				m_pendingCount -= names.size();
+			}
+			finished.push_back(std::move(m_retired.front()));
+			m_retired.pop_front();
+		}
+	}
+
+	for (auto& retired : finished) {
+		auto& buffers = retired.names[BUFFER];
+		auto& vertexArrays = retired.names[VERTEX_ARRAY];
+		auto& textures = retired.names[TEXTURE];
+		if (!buffers.empty()) {
+			glDeleteBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
+		}
+		if (!vertexArrays.empty()) {
+			glDeleteVertexArrays(static_cast<GLsizei>(vertexArrays.size()), vertexArrays.data());
+		}
+		if (!textures.empty()) {
+			glDeleteTextures(static_cast<GLsizei>(textures.size()), textures.data());
+		}
+	}
+}
+
+uint64_t GpuResources::getFrame() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_frame;
+}
+
+bool GpuResources::isFrameComplete(uint64_t frame) const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return frame <= m_completedFrame;
+}
+
+size_t GpuResources::getPendingCount() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pendingCount;
+}
@@ -0,0 +1,238 @@
+#include "InstancedRenderer.h"
+#include <glad/glad.h>
+
+InstancedRenderer::InstancedRenderer() : m_capacity(0), m_objects(nullptr), m_stream(nullptr) {
+	glGenBuffers(1, &m_instanceBuffer);
+	glGenBuffers(1, &m_visibleBuffer);
+}
+
+InstancedRenderer::~InstancedRenderer() {
+	glDeleteBuffers(1, &m_instanceBuffer);
+	glDeleteBuffers(1, &m_visibleBuffer);
+}
+
+bool InstancedRenderer::layoutMatches(std::span<const Object3D> objects) const {
+	if (objects.data() != m_objects || objects.size() != m_objectMeshes.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < objects.size(); i++) {
+		if (objects[i].getMesh().get() != m_objectMeshes[i].first || objects[i].getLod() != m_objectMeshes[i].second) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void InstancedRenderer::buildLayout(std::span<const Object3D> objects) {
+	m_objects = objects.data();
+	m_objectMeshes.clear();
+	m_batches.clear();
+
+	// Count the objects of each mesh and level of detail, then give each a contiguous range of slots.
+	std::map<std::pair<const Mesh3D*, size_t>, size_t> batchIndices;
+	for (auto& object : objects) {
+		auto* mesh = object.getMesh().get();
+		m_objectMeshes.emplace_back(mesh, object.getLod());
+		auto [it, inserted] = batchIndices.try_emplace(m_objectMeshes.back(), m_batches.size());
+		if (inserted) {
+			m_batches.push_back({ mesh, object.getLod(), 0, 0, mesh->getPositionTransform() });
+		}
+		m_batches[it->second].instanceCount++;
+	}
+	size_t firstInstance = 0;
+	for (auto& batch : m_batches) {
+		batch.firstInstance = firstInstance;
+		firstInstance += batch.instanceCount;
+	}
+
+	std::vector<size_t> nextSlot(m_batches.size());
+	for (size_t i = 0; i < m_batches.size(); i++) {
+		nextSlot[i] = m_batches[i].firstInstance;
+	}
+	m_slots.resize(objects.size());
+	m_objectBatches.resize(objects.size());
+	for (size_t i = 0; i < objects.size(); i++) {
+		m_objectBatches[i] = batchIndices[m_objectMeshes[i]];
+		m_slots[i] = nextSlot[m_objectBatches[i]]++;
+	}
+
+	// Every slot needs uploading into the new layout.
+	m_matrices.resize(objects.size());
+	m_uploadedVersions.assign(objects.size(), 0);
+	m_dirtySlots.assign(objects.size(), true);
+	for (size_t i = 0; i < objects.size(); i++) {
+		m_matrices[m_slots[i]] = instanceMatrix(objects[i], i);
+		m_uploadedVersions[i] = objects[i].getTransformVersion();
+	}
+
+	if (objects.size() > m_capacity) {
+		m_capacity = objects.size();
+		glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+		glBufferData(GL_ARRAY_BUFFER, m_capacity * sizeof(glm::mat4), nullptr, GL_DYNAMIC_DRAW);
+	}
+}
+
+glm::mat4 InstancedRenderer::instanceMatrix(const Object3D& object, size_t objectIndex) const {
+	auto* mesh = m_batches[m_objectBatches[objectIndex]].mesh;
+	if (mesh->hasQuantizedPositions()) {
+		return object.getModelMatrix() * mesh->getPositionTransform();
+	}
+	return object.getModelMatrix();
+}
+
+void InstancedRenderer::uploadDirtySlots() {
+	glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+	// Upload each contiguous run of changed slots with one call.
+	size_t slot = 0;
+	while (slot < m_dirtySlots.size()) {
+		if (!m_dirtySlots[slot]) {
+			slot++;
+			continue;
+		}
+		size_t runStart = slot;
+		while (slot < m_dirtySlots.size() && m_dirtySlots[slot]) {
+			m_dirtySlots[slot] = false;
+			slot++;
+		}
+		glBufferSubData(GL_ARRAY_BUFFER, runStart * sizeof(glm::mat4), (slot - runStart) * sizeof(glm::mat4),
+			&m_matrices[runStart]);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+bool InstancedRenderer::streamMatrices(std::span<const Object3D> objects) {
+	if (objects.empty()) {
+		return true;
+	}
+	if (!m_stream->hasRoom(objects.size() * sizeof(glm::mat4), alignof(glm::mat4))) {
+		return false;
+	}
+	size_t offset;
+	auto* data = static_cast<glm::mat4*>(m_stream->map(objects.size() * sizeof(glm::mat4), alignof(glm::mat4), offset));
+	if (data == nullptr) {
+		return false;
+	}
+	for (size_t i = 0; i < objects.size(); i++) {
+		data[m_slots[i]] = instanceMatrix(objects[i], i);
+	}
+	m_stream->unmap();
+
+	for (auto& batch : m_batches) {
+		batch.mesh->renderInstanced(m_stream->getBuffer(), offset + batch.firstInstance * sizeof(glm::mat4),
+			batch.instanceCount, batch.lod);
+	}
+	return true;
+}
+
+void InstancedRenderer::setStreamBuffer(StreamBuffer* stream) {
+	m_stream = stream;
+	// The instance buffer went stale while streaming; rebuild it from scratch on the next render.
+	m_objects = nullptr;
+	m_objectMeshes.clear();
+}
+
+void InstancedRenderer::render(std::span<const Object3D> objects) {
+	if (!layoutMatches(objects)) {
+		buildLayout(objects);
+	}
+	else if (m_stream == nullptr) {
+		// A mesh whose position transform changed needs every one of its objects re-uploaded.
+		std::vector<bool> batchChanged(m_batches.size(), false);
+		for (size_t b = 0; b < m_batches.size(); b++) {
+			auto& batch = m_batches[b];
+			if (batch.mesh->getPositionTransform() != batch.positionTransform) {
+				batch.positionTransform = batch.mesh->getPositionTransform();
+				batchChanged[b] = true;
+			}
+		}
+		// Otherwise, only objects that moved since their matrix was uploaded need a new one.
+		for (size_t i = 0; i < objects.size(); i++) {
+			auto version = objects[i].getTransformVersion();
+			if (version != m_uploadedVersions[i] || batchChanged[m_objectBatches[i]]) {
+				m_uploadedVersions[i] = version;
+				m_matrices[m_slots[i]] = instanceMatrix(objects[i], i);
+				m_dirtySlots[m_slots[i]] = true;
+			}
+		}
+	}
+	if (m_stream != nullptr) {
+		if (streamMatrices(objects)) {
+			return;
+		}
+		// The stream has no room left for this frame's matrices. The instance buffer went stale
+		// while streaming, so bring every slot up to date and draw from it instead.
+		for (auto& batch : m_batches) {
+			batch.positionTransform = batch.mesh->getPositionTransform();
+		}
+		for (size_t i = 0; i < objects.size(); i++) {
+			m_uploadedVersions[i] = objects[i].getTransformVersion();
+			m_matrices[m_slots[i]] = instanceMatrix(objects[i], i);
+			m_dirtySlots[m_slots[i]] = true;
+		}
+	}
+	uploadDirtySlots();
+
+	for (auto& batch : m_batches) {
+		batch.mesh->renderInstanced(m_instanceBuffer, batch.firstInstance * sizeof(glm::mat4), batch.instanceCount,
+			batch.lod);
+	}
+}
+
+void InstancedRenderer::render(std::span<const Object3D> objects, std::span<const uint32_t> visible) {
+	if (!layoutMatches(objects)) {
+		buildLayout(objects);
+	}
+
+	// Give each batch's visible objects consecutive instances.
+	m_visibleCounts.assign(m_batches.size(), 0);
+	for (auto i : visible) {
+		m_visibleCounts[m_objectBatches[i]]++;
+	}
+	m_visibleStarts.resize(m_batches.size());
+	size_t firstInstance = 0;
+	for (size_t b = 0; b < m_batches.size(); b++) {
+		m_visibleStarts[b] = firstInstance;
+		firstInstance += m_visibleCounts[b];
+	}
+	if (visible.empty()) {
+		return;
+	}
+
+	uint32_t buffer;
+	size_t offset = 0;
+	glm::mat4* data = nullptr;
+	// Without room left in the stream for this frame, or if it fails to map, fall back to the
+	// orphaned visible buffer.
+	bool streaming = m_stream != nullptr && m_stream->hasRoom(visible.size() * sizeof(glm::mat4), alignof(glm::mat4));
+	if (streaming) {
+		buffer = m_stream->getBuffer();
+		data = static_cast<glm::mat4*>(m_stream->map(visible.size() * sizeof(glm::mat4), alignof(glm::mat4), offset));
+		streaming = data != nullptr;
+	}
+	if (!streaming) {
+		buffer = m_visibleBuffer;
+		offset = 0;
+		m_visibleMatrices.resize(visible.size());
+		data = m_visibleMatrices.data();
+	}
+	std::vector<size_t> nextInstance(m_visibleStarts);
+	for (auto i : visible) {
+		data[nextInstance[m_objectBatches[i]]++] = instanceMatrix(objects[i], i);
+	}
+	if (streaming) {
+		m_stream->unmap();
+	}
+	else {
+		// Orphan last frame's storage rather than wait for the GPU to finish reading it.
+		glBindBuffer(GL_ARRAY_BUFFER, m_visibleBuffer);
+		glBufferData(GL_ARRAY_BUFFER, visible.size() * sizeof(glm::mat4), m_visibleMatrices.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	for (size_t b = 0; b < m_batches.size(); b++) {
+		if (m_visibleCounts[b] > 0) {
+			m_batches[b].mesh->renderInstanced(buffer, offset + m_visibleStarts[b] * sizeof(glm::mat4),
+				m_visibleCounts[b], m_batches[b].lod);
+		}
+	}
+}
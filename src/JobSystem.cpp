@@ -0,0 +1,131 @@
+#include "JobSystem.h"
+#include <algorithm>
+#include <iterator>
+
+namespace {
+	// Which system's worker the current thread is, if any, and its index there.
+	thread_local const JobSystem* t_system = nullptr;
+	thread_local size_t t_worker = 0;
+}
+
+JobSystem::JobSystem(size_t workerCount) : m_queued(0), m_stopping(false) {
+	if (workerCount == 0) {
+		workerCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for (size_t i = 0; i < workerCount; i++) {
+		m_queues.push_back(std::make_unique<Queue>());
+	}
+	// Worker 0 is whichever thread calls parallelFor().
+	for (size_t i = 1; i < workerCount; i++) {
+		m_threads.emplace_back(&JobSystem::workerLoop, this, i);
+	}
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard lock(m_sleepMutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	for (auto& thread : m_threads) {
+		thread.join();
+	}
+}
+
+size_t JobSystem::getWorkerCount() const {
+	return m_queues.size();
+}
+
+size_t JobSystem::currentWorker() const {
+	return t_system == this ? t_worker : 0;
+}
+
+void JobSystem::parallelFor(size_t count, size_t grainSize, const RangeJob& job) {
+	if (count == 0) {
+		return;
+	}
+	size_t worker = currentWorker();
+	grainSize = std::max<size_t>(grainSize, 1);
+	size_t chunkCount = (count + grainSize - 1) / grainSize;
+	if (chunkCount == 1 || m_queues.size() == 1) {
+		job(0, count, worker);
+		return;
+	}
+
+	// Deal the chunks out starting with this thread's queue, so every worker starts on its
+	// own share and only steals once that runs out. They are counted first, so none is run
+	// before it is counted.
+	std::atomic<size_t> remaining(chunkCount);
+	m_queued += chunkCount;
+	for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+		auto& queue = *m_queues[(worker + chunk) % m_queues.size()];
+		size_t begin = chunk * grainSize;
+		std::lock_guard lock(queue.mutex);
+		queue.chunks.push_back({ &job, begin, std::min(begin + grainSize, count), &remaining });
+	}
+	{
+		// Taking the lock orders this with a worker that is about to sleep, so it can't miss the
+		// wakeup.
+		std::lock_guard lock(m_sleepMutex);
+	}
+	m_wake.notify_all();
+
+	// Help until the last chunk is done, with this call's chunks only. When this is a job's own
+	// parallelFor(), another call's chunk could be one of the suspended job's siblings, which
+	// would then share its worker index while it is halfway through using it.
+	while (remaining.load(std::memory_order_acquire) > 0) {
+		if (!runChunk(worker, &remaining)) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+bool JobSystem::runChunk(size_t worker, const std::atomic<size_t>* call) {
+	auto isWanted = [call](const Chunk& chunk) { return call == nullptr || chunk.remaining == call; };
+	Chunk chunk;
+	bool found = false;
+	{
+		// The newest chunk of the worker's own queue is the likeliest to still be in its cache.
+		auto& queue = *m_queues[worker];
+		std::lock_guard lock(queue.mutex);
+		auto it = std::find_if(queue.chunks.rbegin(), queue.chunks.rend(), isWanted);
+		if (it != queue.chunks.rend()) {
+			chunk = *it;
+			queue.chunks.erase(std::next(it).base());
+			found = true;
+		}
+	}
+	for (size_t i = 1; i < m_queues.size() && !found; i++) {
+		auto& queue = *m_queues[(worker + i) % m_queues.size()];
+		std::lock_guard lock(queue.mutex);
+		auto it = std::find_if(queue.chunks.begin(), queue.chunks.end(), isWanted);
+		if (it != queue.chunks.end()) {
+			chunk = *it;
+			queue.chunks.erase(it);
+			found = true;
+		}
+	}
+	if (!found) {
+		return false;
+	}
+
+	m_queued.fetch_sub(1);
+	(*chunk.job)(chunk.begin, chunk.end, worker);
+	chunk.remaining->fetch_sub(1, std::memory_order_release);
+	return true;
+}
+
+void JobSystem::workerLoop(size_t worker) {
+	t_system = this;
+	t_worker = worker;
+	while (true) {
+		if (runChunk(worker)) {
+			continue;
+		}
+		std::unique_lock lock(m_sleepMutex);
+		m_wake.wait(lock, [this] { return m_stopping || m_queued.load() > 0; });
+		if (m_stopping) {
+			return;
+		}
+	}
+}
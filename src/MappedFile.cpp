@@ -0,0 +1,138 @@
+#include "MappedFile.h"
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile() : m_data(nullptr), m_size(0), m_file(nullptr), m_mapping(nullptr) {
+}
+#else
+MappedFile::MappedFile() : m_data(nullptr), m_size(0), m_file(-1) {
+}
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept : MappedFile() {
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	std::swap(m_data, other.m_data);
+	std::swap(m_size, other.m_size);
+	std::swap(m_file, other.m_file);
+#ifdef _WIN32
+	std::swap(m_mapping, other.m_mapping);
+#endif
+	return *this;
+}
+
+#ifdef _WIN32
+void MappedFile::open(const std::string& filepath) {
+	close();
+
+	m_file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE) {
+		m_file = nullptr;
+		throw std::runtime_error("Could not open file " + filepath);
+	}
+
+	LARGE_INTEGER size;
+	GetFileSizeEx(m_file, &size);
+	m_size = static_cast<size_t>(size.QuadPart);
+	// Empty files cannot be mapped, but are still valid files.
+	if (m_size == 0) {
+		return;
+	}
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping != nullptr) {
+		m_data = static_cast<const unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+	if (m_data == nullptr) {
+		close();
+		throw std::runtime_error("Could not map file " + filepath);
+	}
+}
+
+void MappedFile::close() {
+	if (m_data != nullptr) {
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping != nullptr) {
+		CloseHandle(m_mapping);
+	}
+	if (m_file != nullptr) {
+		CloseHandle(m_file);
+	}
+	m_data = nullptr;
+	m_mapping = nullptr;
+	m_file = nullptr;
+	m_size = 0;
+}
+#else
+void MappedFile::open(const std::string& filepath) {
+	close();
+
+	m_file = ::open(filepath.c_str(), O_RDONLY);
+	if (m_file < 0) {
+		throw std::runtime_error("Could not open file " + filepath);
+	}
+
+	struct stat info;
+	fstat(m_file, &info);
+	m_size = static_cast<size_t>(info.st_size);
+	// Empty files cannot be mapped, but are still valid files.
+	if (m_size == 0) {
+		return;
+	}
+
+	void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+	if (data == MAP_FAILED) {
+		close();
+		throw std::runtime_error("Could not map file " + filepath);
+	}
+	m_data = static_cast<const unsigned char*>(data);
+}
+
+void MappedFile::close() {
+	if (m_data != nullptr) {
+		munmap(const_cast<unsigned char*>(m_data), m_size);
+	}
+	if (m_file >= 0) {
+		::close(m_file);
+	}
+	m_data = nullptr;
+	m_file = -1;
+	m_size = 0;
+}
+#endif
+
+bool MappedFile::isOpen() const {
+#ifdef _WIN32
+	return m_file != nullptr;
+#else
+	return m_file >= 0;
+#endif
+}
+
+const unsigned char* MappedFile::getData() const {
+	return m_data;
+}
+
+size_t MappedFile::getSize() const {
+	return m_size;
+}
@@ -1,73 +1,353 @@
 #include <iostream>
 #include "Mesh3D.h"
+#include "Profiler.h"
 #include <glad/glad.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include "GpuResources.h"
+#include "MeshOptimizer.h"
 
 Mesh3D::Mesh3D(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& faces,
-	const StbImage& texture)
-	: m_vertexCount(vertices.size()), m_faceCount(faces.size()) {
+	std::shared_ptr<Texture> texture)
+	: Mesh3D(std::span<const Vertex3D>(vertices), std::span<const uint32_t>(faces), std::move(texture)) {
+}
+
+Mesh3D::Mesh3D(std::span<const Vertex3D> vertices, std::span<const uint32_t> faces,
+	std::shared_ptr<Texture> texture)
+	: Mesh3D(vertices, faces, { SubMesh{ 0, static_cast<uint32_t>(faces.size()), std::move(texture) } }) {
+}
+
+namespace {
+	// The layout of full-precision Vertex3D data, such as vertices streamed in each frame.
+	const uint32_t VERTEX3D_TEXCOORD_OFFSET = offsetof(Vertex3D, u);
+}
+
+Mesh3D::Mesh3D(std::span<const Vertex3D> vertices, std::span<const uint32_t> faces,
+	std::vector<SubMesh> subMeshes, PositionFormat positionFormat)
+	: m_subMeshes(std::move(subMeshes)), m_vertexCount(vertices.size()), m_faceCount(faces.size()),
+	m_positionTransform(1), m_quantizedPositions(positionFormat == PositionFormat::Unorm16),
+	m_bounds{ glm::vec3(0), glm::vec3(0), 0 } {
+
+	// Texture coordinates in [0, 1] are stored as 16-bit fractions; tiled ones need the range of half floats.
+	bool texCoordsInUnitRange = std::all_of(vertices.begin(), vertices.end(), [](const Vertex3D& vertex) {
+		return vertex.u >= 0 && vertex.u <= 1 && vertex.v >= 0 && vertex.v <= 1;
+	});
+	m_layout.texCoordType = texCoordsInUnitRange ? GL_UNSIGNED_SHORT : GL_HALF_FLOAT;
+	if (m_quantizedPositions) {
+		// x/y/z and 2 bytes of padding, to keep the texture coordinates 4-byte aligned.
+		m_layout.positionType = GL_UNSIGNED_SHORT;
+		m_layout.texCoordOffset = 4 * sizeof(uint16_t);
+	}
+	else {
+		m_layout.positionType = GL_FLOAT;
+		m_layout.texCoordOffset = 3 * sizeof(float);
+	}
+	m_layout.stride = m_layout.texCoordOffset + 2 * sizeof(uint16_t);
+
+	// The bounding box gives the culling bounds, and is what quantized positions are relative to.
+	glm::vec3 boundsMin(0), boundsMax(0);
+	if (!vertices.empty()) {
+		boundsMin = glm::vec3(vertices[0].x, vertices[0].y, vertices[0].z);
+		boundsMax = boundsMin;
+		for (auto& vertex : vertices) {
+			boundsMin = glm::min(boundsMin, glm::vec3(vertex.x, vertex.y, vertex.z));
+			boundsMax = glm::max(boundsMax, glm::vec3(vertex.x, vertex.y, vertex.z));
+		}
+	}
+	m_bounds.center = (boundsMin + boundsMax) * 0.5f;
+	m_bounds.extent = (boundsMax - boundsMin) * 0.5f;
+	for (auto& vertex : vertices) {
+		m_bounds.radius = std::max(m_bounds.radius, glm::length(glm::vec3(vertex.x, vertex.y, vertex.z) - m_bounds.center));
+	}
+
+	// The position transform maps quantized positions from the unit cube back to the box.
+	glm::vec3 boundsExtent(1);
+	if (m_quantizedPositions) {
+		boundsExtent = boundsMax - boundsMin;
+		// A flat box would divide by zero; any scale works for an axis with only one value.
+		for (int axis = 0; axis < 3; axis++) {
+			if (boundsExtent[axis] <= 0) {
+				boundsExtent[axis] = 1;
+			}
+		}
+		m_positionTransform = glm::mat4(
+			glm::vec4(boundsExtent.x, 0, 0, 0),
+			glm::vec4(0, boundsExtent.y, 0, 0),
+			glm::vec4(0, 0, boundsExtent.z, 0),
+			glm::vec4(boundsMin, 1));
+	}
+
+	// Pack the vertices into the GPU layout.
+	std::vector<unsigned char> packed(vertices.size() * m_layout.stride);
+	for (size_t i = 0; i < vertices.size(); i++) {
+		auto& vertex = vertices[i];
+		unsigned char* out = &packed[i * m_layout.stride];
+		if (m_quantizedPositions) {
+			uint16_t position[4] = {
+				toUnorm16((vertex.x - boundsMin.x) / boundsExtent.x),
+				toUnorm16((vertex.y - boundsMin.y) / boundsExtent.y),
+				toUnorm16((vertex.z - boundsMin.z) / boundsExtent.z),
+				0 };
+			std::memcpy(out, position, sizeof(position));
+		}
+		else {
+			float position[3] = { vertex.x, vertex.y, vertex.z };
+			std::memcpy(out, position, sizeof(position));
+		}
+		uint16_t texCoord[2];
+		if (texCoordsInUnitRange) {
+			texCoord[0] = toUnorm16(vertex.u);
+			texCoord[1] = toUnorm16(vertex.v);
+		}
+		else {
+			texCoord[0] = toHalfFloat(vertex.u);
+			texCoord[1] = toHalfFloat(vertex.v);
+		}
+		std::memcpy(out + m_layout.texCoordOffset, texCoord, sizeof(texCoord));
+	}
 
 	// Generate a vertex array object on the GPU.
-	glGenVertexArrays(1, &m_vao);
+	auto& resources = GpuResources::shared();
+	m_vao = resources.createVertexArray();
 	// "Bind" the newly-generated vao, which makes future functions operate on that specific object.
 	glBindVertexArray(m_vao);
 
 	// Generate a vertex buffer object on the GPU.
-	uint32_t vbo;
-	glGenBuffers(1, &vbo);
+	m_vbo = resources.createBuffer();
 
 	// "Bind" the newly-generated vbo, which makes future functions operate on that specific object.
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	// This vbo is now associated with m_vao.
-	// Copy the contents of the vertices list to the buffer that lives on the GPU.
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex3D), &vertices[0], GL_STATIC_DRAW);
-
-	// Inform OpenGL how to interpret the buffer. Each vertex now has TWO attributes; a position and a color.
-	// Atrribute 0 is position: 3 contiguous floats (x/y/z)...
-	glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(Vertex3D), 0);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	// Copy the packed vertices to the buffer that lives on the GPU.
+	glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+
+	// Inform OpenGL how to interpret the buffer; the vbo is now associated with m_vao.
+	setVertexAttributes(m_layout, m_vbo, 0);
+
+	// Generate a second buffer, to store the indices of each triangle in the mesh, in 16 bits
+	// if they all fit.
+	m_ebo = resources.createBuffer();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+	if (vertices.size() <= UINT16_MAX + 1) {
+		m_indexType = GL_UNSIGNED_SHORT;
+		std::vector<uint16_t> shortFaces(faces.begin(), faces.end());
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortFaces.size() * sizeof(uint16_t), shortFaces.data(), GL_STATIC_DRAW);
+	}
+	else {
+		m_indexType = GL_UNSIGNED_INT;
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, faces.size_bytes(), faces.data(), GL_STATIC_DRAW);
+	}
+
+	// Unbind the vertex array, so no one else can accidentally mess with it.
+	glBindVertexArray(0);
+}
+
+Mesh3D::~Mesh3D() {
+	auto& resources = GpuResources::shared();
+	resources.destroyVertexArray(m_vao);
+	resources.destroyBuffer(m_vbo);
+	resources.destroyBuffer(m_ebo);
+}
+
+Mesh3D::Mesh3D(Mesh3D&& other) noexcept
+	: m_vao(std::exchange(other.m_vao, 0)), m_vbo(std::exchange(other.m_vbo, 0)),
+	m_ebo(std::exchange(other.m_ebo, 0)), m_subMeshes(std::move(other.m_subMeshes)),
+	m_lods(std::move(other.m_lods)), m_vertexCount(std::exchange(other.m_vertexCount, 0)),
+	m_faceCount(std::exchange(other.m_faceCount, 0)), m_layout(other.m_layout),
+	m_indexType(other.m_indexType), m_positionTransform(other.m_positionTransform),
+	m_quantizedPositions(other.m_quantizedPositions), m_bounds(other.m_bounds) {
+}
+
+Mesh3D& Mesh3D::operator=(Mesh3D&& other) noexcept {
+	if (this == &other) {
+		return *this;
+	}
+	// The old objects may still be drawn from in a frame in flight; GpuResources holds on to
+	// them until it is done.
+	auto& resources = GpuResources::shared();
+	resources.destroyVertexArray(m_vao);
+	resources.destroyBuffer(m_vbo);
+	resources.destroyBuffer(m_ebo);
+
+	m_vao = std::exchange(other.m_vao, 0);
+	m_vbo = std::exchange(other.m_vbo, 0);
+	m_ebo = std::exchange(other.m_ebo, 0);
+	m_subMeshes = std::move(other.m_subMeshes);
+	other.m_subMeshes.clear();
+	m_lods = std::move(other.m_lods);
+	other.m_lods.clear();
+	m_vertexCount = std::exchange(other.m_vertexCount, 0);
+	m_faceCount = std::exchange(other.m_faceCount, 0);
+	m_layout = other.m_layout;
+	m_indexType = other.m_indexType;
+	m_positionTransform = other.m_positionTransform;
+	m_quantizedPositions = other.m_quantizedPositions;
+	m_bounds = other.m_bounds;
+	return *this;
+}
+
+void Mesh3D::setVertexAttributes(const VertexLayout& layout, uint32_t buffer, size_t bufferOffset) {
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	// Each vertex has TWO attributes; a position and a texture coordinate.
+	// Atrribute 0 is position: 3 contiguous values (x/y/z)...
+	glVertexAttribPointer(0, 3, layout.positionType, layout.positionType == GL_UNSIGNED_SHORT,
+		layout.stride, (void*)bufferOffset);
 	glEnableVertexAttribArray(0);
 
-	// Attribute 1 is texture (u,v).
-	// TODO: configure a second vertex attribute, which is two floats for u and v.
+	// Attribute 1 is texture (u,v): 2 contiguous values, following the position.
+	glVertexAttribPointer(1, 2, layout.texCoordType, layout.texCoordType == GL_UNSIGNED_SHORT,
+		layout.stride, (void*)(bufferOffset + layout.texCoordOffset));
+	glEnableVertexAttribArray(1);
+}
 
+uint32_t Mesh3D::getVertexBuffer() const {
+	return m_vbo;
+}
 
+uint32_t Mesh3D::getIndexBuffer() const {
+	return m_ebo;
+}
 
+const Mesh3D::VertexLayout& Mesh3D::getLayout() const {
+	return m_layout;
+}
 
-	// Generate a second buffer, to store the indices of each triangle in the mesh.
-	uint32_t ebo;
-	glGenBuffers(1, &ebo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, faces.size() * sizeof(uint32_t), &faces[0], GL_STATIC_DRAW);
+size_t Mesh3D::getIndexCount() const {
+	return m_faceCount;
+}
 
-	// Unbind the vertex array, so no one else can accidentally mess with it.
+uint32_t Mesh3D::getVertexArray() const {
+	return m_vao;
+}
+
+uint32_t Mesh3D::getIndexType() const {
+	return m_indexType;
+}
+
+size_t Mesh3D::getIndexSize() const {
+	return m_indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+void Mesh3D::setVertexSource(uint32_t vertexBuffer, size_t bufferOffset) {
+	glBindVertexArray(m_vao);
+	setVertexAttributes({ GL_FLOAT, GL_FLOAT, VERTEX3D_TEXCOORD_OFFSET, sizeof(Vertex3D) }, vertexBuffer, bufferOffset);
 	glBindVertexArray(0);
+}
 
+void Mesh3D::resetVertexSource() {
+	glBindVertexArray(m_vao);
+	setVertexAttributes(m_layout, m_vbo, 0);
+	glBindVertexArray(0);
+}
 
-	// Generate a texture on the GPU.
-	glGenTextures(1, &m_texture);
-	glBindTexture(GL_TEXTURE_2D, m_texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture.getWidth(), texture.getHeight(), 0, GL_RGBA,
-		GL_UNSIGNED_BYTE, texture.getData());
-	glGenerateMipmap(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, 0);
+IndexRange Mesh3D::getRange(size_t subMesh, size_t lod) const {
+	if (lod == 0 || m_lods.empty()) {
+		return { m_subMeshes[subMesh].indexOffset, m_subMeshes[subMesh].indexCount };
+	}
+	return m_lods[std::min(lod, m_lods.size()) - 1].ranges[subMesh];
 }
 
-void Mesh3D::render() {
+void Mesh3D::render(size_t lod) {
 	// Activate the mesh's vertex array.
 	glBindVertexArray(m_vao);
-	glBindTexture(GL_TEXTURE_2D, m_texture);
+	Profiler::count(Profiler::Counter::StateChanges);
 
-	// Draw the vertex array, using its "element buffer" to identify the faces.
-	glDrawElements(GL_TRIANGLES, m_faceCount, GL_UNSIGNED_INT, nullptr);
+	// Draw each sub-mesh's range of the "element buffer", switching textures only when needed.
+	const Texture* boundTexture = nullptr;
+	for (size_t i = 0; i < m_subMeshes.size(); i++) {
+		auto& subMesh = m_subMeshes[i];
+		if (i == 0 || subMesh.texture.get() != boundTexture) {
+			boundTexture = subMesh.texture.get();
+			glBindTexture(GL_TEXTURE_2D, boundTexture ? boundTexture->getId() : 0);
+			Profiler::count(Profiler::Counter::StateChanges);
+		}
+		auto range = getRange(i, lod);
+		glDrawElements(GL_TRIANGLES, range.indexCount, m_indexType,
+			(void*)(range.indexOffset * getIndexSize()));
+		Profiler::count(Profiler::Counter::DrawCalls);
+	}
 	// Deactivate the mesh's vertex array and texture.
 	glBindVertexArray(0);
 	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-Mesh3D Mesh3D::square(const StbImage& texture) {
+void Mesh3D::renderInstanced(uint32_t instanceBuffer, size_t bufferOffset, size_t instanceCount, size_t lod) {
+	glBindVertexArray(m_vao);
+	Profiler::count(Profiler::Counter::StateChanges);
+
+	// Attributes 2-5 are the columns of each instance's model matrix, advancing once per instance.
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	for (uint32_t column = 0; column < 4; column++) {
+		glVertexAttribPointer(2 + column, 4, GL_FLOAT, false, sizeof(glm::mat4),
+			(void*)(bufferOffset + column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(2 + column, 1);
+		glEnableVertexAttribArray(2 + column);
+	}
+
+	const Texture* boundTexture = nullptr;
+	for (size_t i = 0; i < m_subMeshes.size(); i++) {
+		auto& subMesh = m_subMeshes[i];
+		if (i == 0 || subMesh.texture.get() != boundTexture) {
+			boundTexture = subMesh.texture.get();
+			glBindTexture(GL_TEXTURE_2D, boundTexture ? boundTexture->getId() : 0);
+			Profiler::count(Profiler::Counter::StateChanges);
+		}
+		auto range = getRange(i, lod);
+		glDrawElementsInstanced(GL_TRIANGLES, range.indexCount, m_indexType,
+			(void*)(range.indexOffset * getIndexSize()), instanceCount);
+		Profiler::count(Profiler::Counter::DrawCalls);
+	}
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Mesh3D::setLods(std::vector<MeshLod> lods) {
+	for (auto& lod : lods) {
+		if (lod.ranges.size() != m_subMeshes.size()) {
+			throw std::runtime_error("Every level of detail needs one index range per sub-mesh");
+		}
+	}
+	m_lods = std::move(lods);
+}
+
+size_t Mesh3D::getLodCount() const {
+	return m_lods.size() + 1;
+}
+
+float Mesh3D::getLodError(size_t lod) const {
+	if (lod == 0 || m_lods.empty()) {
+		return 0;
+	}
+	return m_lods[std::min(lod, m_lods.size()) - 1].error;
+}
+
+const std::vector<SubMesh>& Mesh3D::getSubMeshes() const {
+	return m_subMeshes;
+}
+
+size_t Mesh3D::getVertexCount() const {
+	return m_vertexCount;
+}
+
+const glm::mat4& Mesh3D::getPositionTransform() const {
+	return m_positionTransform;
+}
+
+bool Mesh3D::hasQuantizedPositions() const {
+	return m_quantizedPositions;
+}
+
+const BoundingVolume& Mesh3D::getBounds() const {
+	return m_bounds;
+}
+
+Mesh3D Mesh3D::empty() {
+	return Mesh3D(std::span<const Vertex3D>(), std::span<const uint32_t>(), std::vector<SubMesh>());
+}
+
+Mesh3D Mesh3D::square(std::shared_ptr<Texture> texture) {
 	return Mesh3D(
 		{
 		  { 0.5, 0.5, 0, 1, 0 },    // TR
@@ -79,21 +359,21 @@ Mesh3D Mesh3D::square(const StbImage& texture) {
 			3, 1, 2,
 			3, 1, 0,
 		},
-		texture
+		std::move(texture)
 		);
 }
 
-Mesh3D Mesh3D::triangle(const StbImage& texture) {
+Mesh3D Mesh3D::triangle(std::shared_ptr<Texture> texture) {
 	return Mesh3D(
 		{ { -0.5, -0.5, 0., 0., 1. },
 		  { -0.5, 0.5, 0, 0., 0. },
 		  { 0.5, 0.5, 0, 1, 0 } },
 		{ 2, 1, 0 },
-		texture
+		std::move(texture)
 	);
 }
 
-Mesh3D Mesh3D::cube(const StbImage& texture) {
+Mesh3D Mesh3D::cube(std::shared_ptr<Texture> texture) {
 	std::vector<Vertex3D> verts = {
 		/*BUR*/{ 0.5, 0.5, -0.5,  0, 0},
 		/*BUL*/{ -0.5, 0.5, -0.5, 0, 0},
@@ -119,5 +399,5 @@ Mesh3D Mesh3D::cube(const StbImage& texture) {
 		2, 7, 3
 	};
 
-	return Mesh3D(verts, tris, texture);
+	return Mesh3D(verts, tris, std::move(texture));
 }
@@ -0,0 +1,177 @@
+#include "MeshCache.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+namespace {
+	// Bump this whenever the layout of the file or of Vertex3D changes, or the import
+	// pipeline starts producing different data, so stale caches are rebuilt.
+	const uint32_t MESH_CACHE_VERSION = 4;
+	const char MESH_CACHE_MAGIC[4] = { 'M', 'S', 'H', 'C' };
+
+	// The file is this header, followed by the vertex array, the face index array, the
+	// sub-mesh table, and finally the (unterminated) texture names the table points into.
+	struct MeshCacheHeader {
+		char magic[4];
+		uint32_t version;
+		uint64_t sourceHash;
+		uint32_t importOptions;
+		uint32_t vertexSize;
+		uint64_t vertexCount;
+		uint64_t faceCount;
+		uint64_t subMeshCount;
+		uint64_t textureNamesLength;
+	};
+
+	struct MeshCacheSubMeshEntry {
+		uint32_t indexOffset;
+		uint32_t indexCount;
+		uint32_t textureNameOffset;
+		uint32_t textureNameLength;
+		uint32_t lod;
+		float lodError;
+	};
+}
+
+bool MeshCache::open(const std::filesystem::path& cachePath, uint64_t sourceHash, uint32_t importOptions) {
+	std::error_code error;
+	if (!std::filesystem::is_regular_file(cachePath, error)) {
+		return false;
+	}
+	try {
+		m_file.open(cachePath.string());
+	}
+	catch (std::runtime_error&) {
+		return false;
+	}
+
+	if (m_file.getSize() < sizeof(MeshCacheHeader)) {
+		return false;
+	}
+	MeshCacheHeader header;
+	std::memcpy(&header, m_file.getData(), sizeof(header));
+	if (std::memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0
+		|| header.version != MESH_CACHE_VERSION
+		|| header.vertexSize != sizeof(Vertex3D)
+		|| header.sourceHash != sourceHash
+		|| header.importOptions != importOptions) {
+		return false;
+	}
+
+	// Each count is checked against the bytes left before it is multiplied, so a corrupt header
+	// can't overflow the sizes into matching the file's.
+	size_t remaining = m_file.getSize() - sizeof(header);
+	if (header.vertexCount > remaining / sizeof(Vertex3D)) {
+		return false;
+	}
+	size_t vertexBytes = header.vertexCount * sizeof(Vertex3D);
+	remaining -= vertexBytes;
+	if (header.faceCount > remaining / sizeof(uint32_t)) {
+		return false;
+	}
+	size_t faceBytes = header.faceCount * sizeof(uint32_t);
+	remaining -= faceBytes;
+	if (header.subMeshCount > remaining / sizeof(MeshCacheSubMeshEntry)) {
+		return false;
+	}
+	size_t subMeshBytes = header.subMeshCount * sizeof(MeshCacheSubMeshEntry);
+	remaining -= subMeshBytes;
+	if (header.textureNamesLength != remaining) {
+		return false;
+	}
+
+	auto* data = m_file.getData() + sizeof(header);
+	m_vertices = { reinterpret_cast<const Vertex3D*>(data), header.vertexCount };
+	data += vertexBytes;
+	m_faces = { reinterpret_cast<const uint32_t*>(data), header.faceCount };
+	data += faceBytes;
+	// The indices go straight to the GPU and the CPU-side passes, so one past the vertices
+	// would read out of bounds there; a cache with one is rebuilt.
+	if (!m_faces.empty() && *std::max_element(m_faces.begin(), m_faces.end()) >= header.vertexCount) {
+		return false;
+	}
+	auto* entries = reinterpret_cast<const MeshCacheSubMeshEntry*>(data);
+	data += subMeshBytes;
+	auto* textureNames = reinterpret_cast<const char*>(data);
+
+	m_subMeshes.clear();
+	for (size_t i = 0; i < header.subMeshCount; i++) {
+		auto& entry = entries[i];
+		if (static_cast<uint64_t>(entry.indexOffset) + entry.indexCount > header.faceCount
+			|| static_cast<uint64_t>(entry.textureNameOffset) + entry.textureNameLength > header.textureNamesLength
+			|| entry.lod > MESH_CACHE_MAX_LOD) {
+			return false;
+		}
+		m_subMeshes.push_back({ entry.indexOffset, entry.indexCount,
+			std::string_view(textureNames + entry.textureNameOffset, entry.textureNameLength),
+			entry.lod, entry.lodError });
+	}
+	return true;
+}
+
+void MeshCache::write(const std::filesystem::path& cachePath, uint64_t sourceHash, uint32_t importOptions,
+	std::span<const Vertex3D> vertices, std::span<const uint32_t> faces,
+	std::span<const MeshCacheSubMesh> subMeshes) {
+	std::vector<MeshCacheSubMeshEntry> entries;
+	std::string textureNames;
+	for (auto& subMesh : subMeshes) {
+		entries.push_back({ subMesh.indexOffset, subMesh.indexCount,
+			static_cast<uint32_t>(textureNames.size()), static_cast<uint32_t>(subMesh.diffuseTexture.size()),
+			subMesh.lod, subMesh.lodError });
+		textureNames += subMesh.diffuseTexture;
+	}
+
+	MeshCacheHeader header = {};
+	std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+	header.version = MESH_CACHE_VERSION;
+	header.sourceHash = sourceHash;
+	header.importOptions = importOptions;
+	header.vertexSize = sizeof(Vertex3D);
+	header.vertexCount = vertices.size();
+	header.faceCount = faces.size();
+	header.subMeshCount = entries.size();
+	header.textureNamesLength = textureNames.size();
+
+	// Write to a temporary file first, so a crash mid-write never leaves a truncated cache.
+	auto tempPath = cachePath;
+	tempPath += ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(vertices.data()), vertices.size_bytes());
+		file.write(reinterpret_cast<const char*>(faces.data()), faces.size_bytes());
+		file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(MeshCacheSubMeshEntry));
+		file.write(textureNames.data(), textureNames.size());
+	}
+	std::filesystem::rename(tempPath, cachePath);
+}
+
+std::filesystem::path MeshCache::pathFor(const std::filesystem::path& modelPath) {
+	auto cachePath = modelPath;
+	cachePath += ".meshcache";
+	return cachePath;
+}
+
+uint64_t MeshCache::hash(const unsigned char* data, size_t size) {
+	// 64-bit FNV-1a.
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+std::span<const Vertex3D> MeshCache::getVertices() const {
+	return m_vertices;
+}
+
+std::span<const uint32_t> MeshCache::getFaces() const {
+	return m_faces;
+}
+
+std::span<const MeshCacheSubMesh> MeshCache::getSubMeshes() const {
+	return m_subMeshes;
+}
@@ -0,0 +1,238 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/glm.hpp>
+
+namespace {
+	// Clusters are cut at least this often, so the overdraw pass has enough of them to sort.
+	// Each cut costs at most one cache-full of extra vertex transforms.
+	const size_t MAX_CLUSTER_FACES = 256;
+	const uint32_t NO_VERTEX = UINT32_MAX;
+
+	glm::vec3 positionOf(const Vertex3D& vertex) {
+		return glm::vec3(vertex.x, vertex.y, vertex.z);
+	}
+
+	// Reorders faces with Tipsify, and returns the face index at which each cluster starts.
+	std::vector<size_t> tipsify(std::span<uint32_t> faces, size_t vertexCount, size_t cacheSize) {
+		size_t faceCount = faces.size() / 3;
+
+		// Every vertex's faces, and how many of them are still to be emitted.
+		std::vector<uint32_t> liveFaces(vertexCount, 0);
+		for (auto index : faces) {
+			liveFaces[index]++;
+		}
+		std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0);
+		for (size_t v = 0; v < vertexCount; v++) {
+			adjacencyStart[v + 1] = adjacencyStart[v] + liveFaces[v];
+		}
+		std::vector<uint32_t> adjacency(faces.size());
+		std::vector<uint32_t> adjacencyEnd(adjacencyStart.begin(), adjacencyStart.end() - 1);
+		for (size_t f = 0; f < faceCount; f++) {
+			for (size_t corner = 0; corner < 3; corner++) {
+				adjacency[adjacencyEnd[faces[f * 3 + corner]]++] = static_cast<uint32_t>(f);
+			}
+		}
+
+		// When each vertex last entered the simulated cache; it is still there if fewer than
+		// cacheSize vertices have entered since.
+		std::vector<uint32_t> cacheTime(vertexCount, 0);
+		uint32_t time = static_cast<uint32_t>(cacheSize) + 1;
+		std::vector<bool> emitted(faceCount, false);
+		std::vector<uint32_t> deadEnds;
+		std::vector<uint32_t> candidates;
+		std::vector<uint32_t> output;
+		output.reserve(faces.size());
+		std::vector<size_t> clusterStarts = { 0 };
+		size_t clusterFaces = 0;
+		size_t cursor = 0;
+
+		uint32_t fanning = faces[0];
+		while (fanning != NO_VERTEX) {
+			// Emit every remaining face around the fanning vertex.
+			candidates.clear();
+			for (auto a = adjacencyStart[fanning]; a < adjacencyStart[fanning + 1]; a++) {
+				auto face = adjacency[a];
+				if (emitted[face]) {
+					continue;
+				}
+				emitted[face] = true;
+				clusterFaces++;
+				for (size_t corner = 0; corner < 3; corner++) {
+					auto v = faces[face * 3 + corner];
+					output.push_back(v);
+					deadEnds.push_back(v);
+					candidates.push_back(v);
+					liveFaces[v]--;
+					if (time - cacheTime[v] > cacheSize) {
+						cacheTime[v] = time++;
+					}
+				}
+			}
+
+			// Fan next around the neighbor that will be oldest in the cache but still in it
+			// after its own faces are emitted.
+			uint32_t next = NO_VERTEX;
+			int64_t bestPriority = -1;
+			for (auto v : candidates) {
+				if (liveFaces[v] == 0) {
+					continue;
+				}
+				int64_t priority = 0;
+				if (time - cacheTime[v] + 2 * liveFaces[v] <= cacheSize) {
+					priority = time - cacheTime[v];
+				}
+				if (priority > bestPriority) {
+					bestPriority = priority;
+					next = v;
+				}
+			}
+
+			bool jumped = false;
+			if (next == NO_VERTEX) {
+				// Dead end: back up to a recently used vertex, or scan for any with faces left.
+				jumped = true;
+				while (!deadEnds.empty() && next == NO_VERTEX) {
+					auto v = deadEnds.back();
+					deadEnds.pop_back();
+					if (liveFaces[v] > 0) {
+						next = v;
+					}
+				}
+				while (next == NO_VERTEX && cursor < vertexCount) {
+					if (liveFaces[cursor] > 0) {
+						next = static_cast<uint32_t>(cursor);
+					}
+					cursor++;
+				}
+			}
+			if (next != NO_VERTEX && (jumped || clusterFaces >= MAX_CLUSTER_FACES)) {
+				clusterStarts.push_back(output.size() / 3);
+				clusterFaces = 0;
+			}
+			fanning = next;
+		}
+
+		std::copy(output.begin(), output.end(), faces.begin());
+		return clusterStarts;
+	}
+}
+
+void optimizeFaceOrder(std::span<uint32_t> faces, std::span<const Vertex3D> vertices, size_t cacheSize) {
+	size_t faceCount = faces.size() / 3;
+	if (faceCount < 2) {
+		return;
+	}
+	auto clusterStarts = tipsify(faces, vertices.size(), cacheSize);
+	clusterStarts.push_back(faceCount);
+
+	// The center of the faces' vertices, which clusters are judged to face away from or towards.
+	glm::vec3 meshCenter(0);
+	for (auto index : faces) {
+		meshCenter += positionOf(vertices[index]);
+	}
+	meshCenter /= static_cast<float>(faces.size());
+
+	// Score each cluster by how directly its area-weighted normal points away from the center.
+	struct Cluster {
+		size_t firstFace;
+		size_t faceCount;
+		float score;
+	};
+	std::vector<Cluster> clusters;
+	for (size_t c = 0; c + 1 < clusterStarts.size(); c++) {
+		glm::vec3 areaNormal(0), weightedCenter(0);
+		float area = 0;
+		for (size_t f = clusterStarts[c]; f < clusterStarts[c + 1]; f++) {
+			auto a = positionOf(vertices[faces[f * 3]]);
+			auto b = positionOf(vertices[faces[f * 3 + 1]]);
+			auto d = positionOf(vertices[faces[f * 3 + 2]]);
+			auto normal = glm::cross(b - a, d - a);
+			float faceArea = glm::length(normal);
+			areaNormal += normal;
+			weightedCenter += (a + b + d) * (faceArea / 3);
+			area += faceArea;
+		}
+		float score = 0;
+		float normalLength = glm::length(areaNormal);
+		if (area > 0 && normalLength > 0) {
+			score = glm::dot(weightedCenter / area - meshCenter, areaNormal / normalLength);
+		}
+		clusters.push_back({ clusterStarts[c], clusterStarts[c + 1] - clusterStarts[c], score });
+	}
+	std::stable_sort(clusters.begin(), clusters.end(),
+		[](const Cluster& a, const Cluster& b) { return a.score > b.score; });
+
+	std::vector<uint32_t> sorted;
+	sorted.reserve(faces.size());
+	for (auto& cluster : clusters) {
+		auto first = faces.begin() + cluster.firstFace * 3;
+		sorted.insert(sorted.end(), first, first + cluster.faceCount * 3);
+	}
+	std::copy(sorted.begin(), sorted.end(), faces.begin());
+}
+
+void optimizeVertexFetch(std::vector<Vertex3D>& vertices, std::span<uint32_t> faces) {
+	std::vector<uint32_t> remap(vertices.size(), NO_VERTEX);
+	std::vector<Vertex3D> reordered;
+	reordered.reserve(vertices.size());
+	for (auto& index : faces) {
+		if (remap[index] == NO_VERTEX) {
+			remap[index] = static_cast<uint32_t>(reordered.size());
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices = std::move(reordered);
+}
+
+void optimizeMesh(std::vector<Vertex3D>& vertices, std::span<uint32_t> faces,
+	std::span<const MeshCacheSubMesh> subMeshes) {
+	for (auto& subMesh : subMeshes) {
+		optimizeFaceOrder(faces.subspan(subMesh.indexOffset, subMesh.indexCount), vertices);
+	}
+	optimizeVertexFetch(vertices, faces);
+}
+
+uint16_t toHalfFloat(float value) {
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+	int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	if (exponent >= 31) {
+		// Too large (or infinite, or NaN): clamp to infinity, keeping NaNs NaN.
+		bool isNan = ((bits >> 23) & 0xff) == 0xff && mantissa != 0;
+		return sign | 0x7c00 | (isNan ? 0x200 : 0);
+	}
+	if (exponent <= 0) {
+		// Subnormal half, or zero.
+		if (exponent < -10) {
+			return sign;
+		}
+		mantissa |= 0x800000;
+		uint32_t shift = static_cast<uint32_t>(14 - exponent);
+		uint32_t half = mantissa >> shift;
+		// Round to nearest, ties to even.
+		uint32_t remainder = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half & 1))) {
+			half++;
+		}
+		return sign | static_cast<uint16_t>(half);
+	}
+	uint32_t half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+	uint32_t remainder = mantissa & 0x1fff;
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+		// May carry into the exponent, which correctly rounds up to the next power of two
+		// (or to infinity).
+		half++;
+	}
+	return sign | static_cast<uint16_t>(half);
+}
+
+uint16_t toUnorm16(float value) {
+	return static_cast<uint16_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
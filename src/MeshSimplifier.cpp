@@ -0,0 +1,199 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <unordered_map>
+#include <unordered_set>
+#include "MeshOptimizer.h"
+
+namespace {
+	// A level is kept only if it has at most this fraction of the previous level's faces.
+	const double MIN_LEVEL_REDUCTION = 0.8;
+	const uint32_t MAX_GRID_CELLS = 1024;
+
+	// The symmetric 4x4 matrix of a sum of squared distances to planes, stored as its upper
+	// triangle: a2, ab, ac, ad, b2, bc, bd, c2, cd, d2.
+	using Quadric = std::array<double, 10>;
+
+	void addPlane(Quadric& q, double a, double b, double c, double d, double weight) {
+		q[0] += weight * a * a; q[1] += weight * a * b; q[2] += weight * a * c; q[3] += weight * a * d;
+		q[4] += weight * b * b; q[5] += weight * b * c; q[6] += weight * b * d;
+		q[7] += weight * c * c; q[8] += weight * c * d;
+		q[9] += weight * d * d;
+	}
+
+	double quadricError(const Quadric& q, const Vertex3D& v) {
+		double x = v.x, y = v.y, z = v.z;
+		return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+			+ q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+			+ q[7] * z * z + 2 * q[8] * z
+			+ q[9];
+	}
+
+	struct Bounds {
+		float min[3];
+		float extent;
+	};
+
+	// Clusters the faces' vertices on a grid with the given number of cells along the longest
+	// axis of the bounds, and returns the faces that survive.
+	std::vector<uint32_t> cluster(std::span<const uint32_t> faces, std::span<const Vertex3D> vertices,
+		const Bounds& bounds, uint32_t gridCells) {
+		float cellSize = bounds.extent / gridCells;
+		auto cellOf = [&](const Vertex3D& v) {
+			uint64_t cell = 0;
+			const float position[3] = { v.x, v.y, v.z };
+			for (int axis = 0; axis < 3; axis++) {
+				auto coordinate = static_cast<uint64_t>((position[axis] - bounds.min[axis]) / cellSize);
+				cell = (cell << 21) | std::min<uint64_t>(coordinate, gridCells - 1);
+			}
+			return cell;
+		};
+
+		// Number the occupied cells, and sum the plane quadrics of every face touching each.
+		std::unordered_map<uint64_t, uint32_t> cellIndices;
+		std::unordered_map<uint32_t, uint32_t> vertexCells;
+		for (auto index : faces) {
+			if (vertexCells.count(index) == 0) {
+				auto [it, inserted] = cellIndices.try_emplace(cellOf(vertices[index]),
+					static_cast<uint32_t>(cellIndices.size()));
+				vertexCells[index] = it->second;
+			}
+		}
+		std::vector<Quadric> quadrics(cellIndices.size(), Quadric{});
+		for (size_t f = 0; f + 2 < faces.size(); f += 3) {
+			auto& p0 = vertices[faces[f]];
+			auto& p1 = vertices[faces[f + 1]];
+			auto& p2 = vertices[faces[f + 2]];
+			double e1[3] = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+			double e2[3] = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+			double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			if (length == 0) {
+				continue;
+			}
+			double a = n[0] / length, b = n[1] / length, c = n[2] / length;
+			double d = -(a * p0.x + b * p0.y + c * p0.z);
+			// Weighted by area, so large faces keep their shape over small ones.
+			for (int corner = 0; corner < 3; corner++) {
+				addPlane(quadrics[vertexCells[faces[f + corner]]], a, b, c, d, length / 2);
+			}
+		}
+
+		// Each cell is represented by its vertex that fits the cell's planes best.
+		std::vector<uint32_t> representatives(cellIndices.size(), UINT32_MAX);
+		std::vector<double> bestErrors(cellIndices.size());
+		for (auto [index, cell] : vertexCells) {
+			double error = quadricError(quadrics[cell], vertices[index]);
+			if (representatives[cell] == UINT32_MAX || error < bestErrors[cell]
+				|| (error == bestErrors[cell] && index < representatives[cell])) {
+				representatives[cell] = index;
+				bestErrors[cell] = error;
+			}
+		}
+
+		// Keep the faces whose corners land in three different cells, once each.
+		std::vector<uint32_t> simplified;
+		std::unordered_set<uint64_t> seen;
+		for (size_t f = 0; f + 2 < faces.size(); f += 3) {
+			uint32_t a = vertexCells[faces[f]], b = vertexCells[faces[f + 1]], c = vertexCells[faces[f + 2]];
+			if (a == b || b == c || a == c) {
+				continue;
+			}
+			// Faces are the same if they have the same cells in the same winding.
+			uint32_t rotated[3] = { a, b, c };
+			std::rotate(rotated, std::min_element(rotated, rotated + 3), rotated + 3);
+			uint64_t key = (static_cast<uint64_t>(rotated[0]) << 42) | (static_cast<uint64_t>(rotated[1]) << 21) | rotated[2];
+			if (!seen.insert(key).second) {
+				continue;
+			}
+			simplified.push_back(representatives[a]);
+			simplified.push_back(representatives[b]);
+			simplified.push_back(representatives[c]);
+		}
+		return simplified;
+	}
+}
+
+std::vector<uint32_t> simplifyByClustering(std::span<const uint32_t> faces, std::span<const Vertex3D> vertices,
+	size_t targetFaceCount, float& error) {
+	error = 0;
+	if (faces.empty()) {
+		return {};
+	}
+
+	float boundsMax[3] = { vertices[faces[0]].x, vertices[faces[0]].y, vertices[faces[0]].z };
+	Bounds bounds = { { boundsMax[0], boundsMax[1], boundsMax[2] }, 0 };
+	for (auto index : faces) {
+		const float position[3] = { vertices[index].x, vertices[index].y, vertices[index].z };
+		for (int axis = 0; axis < 3; axis++) {
+			bounds.min[axis] = std::min(bounds.min[axis], position[axis]);
+			boundsMax[axis] = std::max(boundsMax[axis], position[axis]);
+		}
+	}
+	for (int axis = 0; axis < 3; axis++) {
+		bounds.extent = std::max(bounds.extent, boundsMax[axis] - bounds.min[axis]);
+	}
+	if (bounds.extent <= 0) {
+		return {};
+	}
+
+	// Finer grids keep more faces; find the finest one that meets the target.
+	uint32_t low = 1, high = MAX_GRID_CELLS;
+	std::vector<uint32_t> best = cluster(faces, vertices, bounds, low);
+	uint32_t bestCells = low;
+	while (low < high) {
+		uint32_t middle = low + (high - low + 1) / 2;
+		auto candidate = cluster(faces, vertices, bounds, middle);
+		if (candidate.size() / 3 <= targetFaceCount) {
+			best = std::move(candidate);
+			bestCells = middle;
+			low = middle;
+		}
+		else {
+			high = middle - 1;
+		}
+	}
+	error = bounds.extent / bestCells;
+	return best;
+}
+
+void generateLods(std::span<const Vertex3D> vertices, std::vector<uint32_t>& faces,
+	std::vector<MeshCacheSubMesh>& subMeshes, size_t maxLevels) {
+	std::vector<MeshCacheSubMesh> baseLevel;
+	for (auto& subMesh : subMeshes) {
+		if (subMesh.lod == 0) {
+			baseLevel.push_back(subMesh);
+		}
+	}
+
+	size_t previousFaces = faces.size() / 3;
+	for (uint32_t level = 1; level <= maxLevels; level++) {
+		std::vector<uint32_t> levelFaces;
+		std::vector<MeshCacheSubMesh> levelSubMeshes;
+		float levelError = 0;
+		for (auto& subMesh : baseLevel) {
+			auto range = std::span<const uint32_t>(faces).subspan(subMesh.indexOffset, subMesh.indexCount);
+			float error;
+			auto simplified = simplifyByClustering(range, vertices, (subMesh.indexCount / 3) >> level, error);
+			optimizeFaceOrder(simplified, vertices);
+
+			auto indexOffset = static_cast<uint32_t>(faces.size() + levelFaces.size());
+			levelFaces.insert(levelFaces.end(), simplified.begin(), simplified.end());
+			levelSubMeshes.push_back({ indexOffset, static_cast<uint32_t>(simplified.size()),
+				subMesh.diffuseTexture, level, 0 });
+			levelError = std::max(levelError, error);
+		}
+
+		size_t levelFaceCount = levelFaces.size() / 3;
+		if (levelFaceCount == 0 || levelFaceCount > previousFaces * MIN_LEVEL_REDUCTION) {
+			break;
+		}
+		for (auto& subMesh : levelSubMeshes) {
+			subMesh.lodError = levelError;
+		}
+		faces.insert(faces.end(), levelFaces.begin(), levelFaces.end());
+		subMeshes.insert(subMeshes.end(), levelSubMeshes.begin(), levelSubMeshes.end());
+		previousFaces = levelFaceCount;
+	}
+}
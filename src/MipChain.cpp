@@ -0,0 +1,105 @@
+#include "MipChain.h"
+#include <glad/glad.h>
+#include <algorithm>
+
+namespace {
+	// Averages each 2x2 block of RGBA pixels into one. The last row or column of an odd-sized
+	// image is reused for the missing neighbors.
+	std::vector<unsigned char> halve(const unsigned char* pixels, int width, int height) {
+		int halfWidth = std::max(width / 2, 1);
+		int halfHeight = std::max(height / 2, 1);
+		std::vector<unsigned char> half(static_cast<size_t>(halfWidth) * halfHeight * 4);
+		for (int y = 0; y < halfHeight; y++) {
+			const unsigned char* row0 = pixels + static_cast<size_t>(std::min(2 * y, height - 1)) * width * 4;
+			const unsigned char* row1 = pixels + static_cast<size_t>(std::min(2 * y + 1, height - 1)) * width * 4;
+			for (int x = 0; x < halfWidth; x++) {
+				size_t x0 = static_cast<size_t>(std::min(2 * x, width - 1)) * 4;
+				size_t x1 = static_cast<size_t>(std::min(2 * x + 1, width - 1)) * 4;
+				for (int channel = 0; channel < 4; channel++) {
+					int sum = row0[x0 + channel] + row0[x1 + channel] + row1[x0 + channel] + row1[x1 + channel];
+					half[(static_cast<size_t>(y) * halfWidth + x) * 4 + channel] = static_cast<unsigned char>((sum + 2) / 4);
+				}
+			}
+		}
+		return half;
+	}
+}
+
+MipChain::MipChain() : m_format(GL_RGBA8), m_firstLevel(0) {
+}
+
+int MipChain::levelForSize(const std::vector<Level>& levels, int maxSize) {
+	for (size_t level = 0; level < levels.size(); level++) {
+		if (levels[level].width <= maxSize && levels[level].height <= maxSize) {
+			return static_cast<int>(level);
+		}
+	}
+	return static_cast<int>(levels.size()) - 1;
+}
+
+void MipChain::load(const std::string& imagePath, int firstLevel, int maxSize) {
+	m_levels.clear();
+	m_pixels.clear();
+
+	if (m_compressed.loadCompressedVersionOf(imagePath)) {
+		// The levels are views into the mapped file, so skipped ones are never read.
+		m_format = m_compressed.getFormat();
+		m_levels = m_compressed.getLevels();
+		m_firstLevel = std::min(std::max(firstLevel, levelForSize(m_levels, maxSize)),
+			static_cast<int>(m_levels.size()) - 1);
+		for (int level = 0; level < m_firstLevel; level++) {
+			m_levels[level].data = nullptr;
+		}
+		return;
+	}
+
+	m_format = GL_RGBA8;
+	m_image.loadFromFile(imagePath);
+	int width = m_image.getWidth();
+	int height = m_image.getHeight();
+	m_levels.push_back({ width, height, nullptr, static_cast<size_t>(width) * height * 4 });
+	while (width > 1 || height > 1) {
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+		m_levels.push_back({ width, height, nullptr, static_cast<size_t>(width) * height * 4 });
+	}
+	m_firstLevel = std::min(std::max(firstLevel, levelForSize(m_levels, maxSize)),
+		static_cast<int>(m_levels.size()) - 1);
+
+	// Every level is reduced from the one before it, but only the wanted ones are kept.
+	m_pixels.resize(m_levels.size() - 1);
+	const unsigned char* previous = m_image.getData();
+	for (size_t level = 1; level < m_levels.size(); level++) {
+		m_pixels[level - 1] = halve(previous, m_levels[level - 1].width, m_levels[level - 1].height);
+		previous = m_pixels[level - 1].data();
+		if (level >= 2 && static_cast<int>(level) - 1 < m_firstLevel) {
+			m_pixels[level - 2].clear();
+			m_pixels[level - 2].shrink_to_fit();
+		}
+		if (level == 1 && m_firstLevel > 0) {
+			m_image.release();
+		}
+	}
+	if (m_firstLevel == 0) {
+		m_levels[0].data = m_image.getData();
+	}
+	for (size_t level = std::max(m_firstLevel, 1); level < m_levels.size(); level++) {
+		m_levels[level].data = m_pixels[level - 1].data();
+	}
+}
+
+uint32_t MipChain::getFormat() const {
+	return m_format;
+}
+
+bool MipChain::isCompressed() const {
+	return m_format != GL_RGBA8;
+}
+
+int MipChain::getFirstLevel() const {
+	return m_firstLevel;
+}
+
+const std::vector<MipChain::Level>& MipChain::getLevels() const {
+	return m_levels;
+}
@@ -0,0 +1,422 @@
+#include "MultiDrawRenderer.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstddef>
+#include <numeric>
+#include "GlCapabilities.h"
+#include "Profiler.h"
+
+MultiDrawRenderer::MultiDrawRenderer() {
+	glGenBuffers(1, &m_instanceBuffer);
+	glGenBuffers(1, &m_indirectBuffer);
+	glGenBuffers(1, &m_culledCommandBuffer);
+	glGenBuffers(1, &m_culledInstanceBuffer);
+}
+
+MultiDrawRenderer::~MultiDrawRenderer() {
+	glDeleteBuffers(1, &m_instanceBuffer);
+	glDeleteBuffers(1, &m_indirectBuffer);
+	glDeleteBuffers(1, &m_culledCommandBuffer);
+	glDeleteBuffers(1, &m_culledInstanceBuffer);
+}
+
+bool MultiDrawRenderer::isIndirectSupported() {
+	// Indirect commands only honor their base instance from OpenGL 4.2 (or ARB_base_instance).
+	static bool supported = hasGlVersion(4, 3)
+		|| (hasGlExtension("GL_ARB_multi_draw_indirect")
+			&& (hasGlVersion(4, 2) || hasGlExtension("GL_ARB_base_instance")));
+	return supported;
+}
+
+void MultiDrawRenderer::setTexturePacking(bool packing) {
+	if (packing == getTexturePacking()) {
+		return;
+	}
+	m_packer = packing ? std::make_unique<TexturePacker>() : nullptr;
+	// The culled commands' instances say where their textures are.
+	m_culler = nullptr;
+}
+
+bool MultiDrawRenderer::getTexturePacking() const {
+	return m_packer != nullptr;
+}
+
+const TexturePacker* MultiDrawRenderer::getTexturePacker() const {
+	return m_packer.get();
+}
+
+void MultiDrawRenderer::setInstanceAttributes(uint32_t instanceBuffer, size_t firstInstance) {
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	size_t first = firstInstance * sizeof(InstanceData);
+	for (uint32_t column = 0; column < 4; column++) {
+		glVertexAttribPointer(2 + column, 4, GL_FLOAT, false, sizeof(InstanceData),
+			(void*)(first + offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+	}
+	glVertexAttribPointer(6, 4, GL_FLOAT, false, sizeof(InstanceData), (void*)(first + offsetof(InstanceData, textureRegion)));
+	glVertexAttribPointer(7, 1, GL_FLOAT, false, sizeof(InstanceData), (void*)(first + offsetof(InstanceData, textureLayer)));
+	for (uint32_t attribute = 2; attribute <= 7; attribute++) {
+		glEnableVertexAttribArray(attribute);
+		glVertexAttribDivisor(attribute, 1);
+	}
+}
+
+void MultiDrawRenderer::forgetDeadMeshes() {
+	for (auto it = m_meshes.begin(); it != m_meshes.end();) {
+		if (it->second.mesh.expired()) {
+			m_pools[it->second.pool]->remove(it->second.allocation);
+			it = m_meshes.erase(it);
+		}
+		else {
+			it++;
+		}
+	}
+}
+
+const MultiDrawRenderer::PooledMesh& MultiDrawRenderer::poolMesh(const std::shared_ptr<Mesh3D>& mesh) {
+	auto it = m_meshes.find(mesh.get());
+	if (it != m_meshes.end()) {
+		if (it->second.vertexBuffer == mesh->getVertexBuffer()) {
+			return it->second;
+		}
+		m_pools[it->second.pool]->remove(it->second.allocation);
+		m_meshes.erase(it);
+	}
+
+	size_t pool = 0;
+	while (pool < m_pools.size() && !m_pools[pool]->accepts(*mesh)) {
+		pool++;
+	}
+	if (pool == m_pools.size()) {
+		m_pools.push_back(std::make_unique<GeometryPool>(mesh->getLayout(), mesh->getIndexType()));
+	}
+	auto allocation = m_pools[pool]->add(*mesh);
+	return m_meshes[mesh.get()] = { mesh, mesh->getVertexBuffer(), pool, allocation };
+}
+
+uint32_t MultiDrawRenderer::textureIndex(uint32_t texture, bool layered) {
+	// An array's name may be reused by a plain texture once the packer frees it.
+	uint64_t key = (static_cast<uint64_t>(layered) << 32) | texture;
+	auto [it, inserted] = m_textureIndices.try_emplace(key, static_cast<uint32_t>(m_textures.size()));
+	if (inserted) {
+		m_textures.push_back({ texture, layered });
+	}
+	return it->second;
+}
+
+uint32_t MultiDrawRenderer::bindingFor(const std::shared_ptr<Texture>& texture, InstanceData& instance) {
+	instance.textureRegion = glm::vec4(0, 0, 1, 1);
+	instance.textureLayer = -1;
+	if (!texture) {
+		return textureIndex(0, false);
+	}
+	if (m_packer) {
+		if (auto* placement = m_packer->place(texture)) {
+			instance.textureRegion = placement->region;
+			instance.textureLayer = static_cast<float>(placement->layer);
+			return textureIndex(placement->array, true);
+		}
+	}
+	return textureIndex(texture->getId(), false);
+}
+
+void MultiDrawRenderer::bindTexture(uint32_t textureIndex) {
+	auto& binding = m_textures[textureIndex];
+	if (binding.layered) {
+		glActiveTexture(GL_TEXTURE0 + LAYERED_TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, binding.texture);
+		glActiveTexture(GL_TEXTURE0);
+	}
+	else {
+		glBindTexture(GL_TEXTURE_2D, binding.texture);
+	}
+	Profiler::count(Profiler::Counter::StateChanges);
+}
+
+void MultiDrawRenderer::unbindTextures() {
+	glBindTexture(GL_TEXTURE_2D, 0);
+	if (m_packer) {
+		glActiveTexture(GL_TEXTURE0 + LAYERED_TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		glActiveTexture(GL_TEXTURE0);
+	}
+}
+
+void MultiDrawRenderer::render(std::span<const Object3D> objects, std::span<const uint32_t> visible) {
+	forgetDeadMeshes();
+	if (m_packer) {
+		m_packer->flush();
+	}
+
+	// One instance and one command per sub-mesh, keyed by its pool and texture.
+	m_instances.clear();
+	m_draws.clear();
+	for (auto i : visible) {
+		auto& object = objects[i];
+		auto& mesh = object.getMesh();
+		auto& pooled = poolMesh(mesh);
+		auto model = mesh->hasQuantizedPositions()
+			? object.getModelMatrix() * mesh->getPositionTransform() : object.getModelMatrix();
+
+		auto& subMeshes = mesh->getSubMeshes();
+		for (size_t s = 0; s < subMeshes.size(); s++) {
+			auto range = mesh->getRange(s, object.getLod());
+			if (range.indexCount == 0) {
+				continue;
+			}
+			InstanceData instance{ model };
+			uint64_t key = (static_cast<uint64_t>(pooled.pool) << 32) | bindingFor(subMeshes[s].texture, instance);
+			m_draws.push_back({ key, { range.indexCount, 1, pooled.allocation.firstIndex + range.indexOffset,
+				static_cast<int32_t>(pooled.allocation.baseVertex), static_cast<uint32_t>(m_instances.size()) } });
+			m_instances.push_back(instance);
+		}
+	}
+	if (m_draws.empty()) {
+		return;
+	}
+	std::sort(m_draws.begin(), m_draws.end(), [](const PendingDraw& a, const PendingDraw& b) { return a.key < b.key; });
+
+	m_commands.clear();
+	for (auto& draw : m_draws) {
+		m_commands.push_back(draw.command);
+	}
+	// Orphan last frame's storage rather than wait for the GPU to finish reading it.
+	glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, m_instances.size() * sizeof(InstanceData), m_instances.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	bool indirect = isIndirectSupported();
+	if (indirect) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, m_commands.size() * sizeof(DrawCommand), m_commands.data(), GL_STREAM_DRAW);
+	}
+
+	// Each run of commands with the same pool and texture is one multi-draw.
+	size_t boundPool = SIZE_MAX;
+	size_t runStart = 0;
+	while (runStart < m_draws.size()) {
+		uint64_t key = m_draws[runStart].key;
+		size_t runEnd = runStart + 1;
+		while (runEnd < m_draws.size() && m_draws[runEnd].key == key) {
+			runEnd++;
+		}
+
+		size_t poolIndex = static_cast<size_t>(key >> 32);
+		auto& pool = *m_pools[poolIndex];
+		if (poolIndex != boundPool) {
+			glBindVertexArray(pool.getVertexArray());
+			setInstanceAttributes(m_instanceBuffer, 0);
+			Profiler::count(Profiler::Counter::StateChanges);
+			boundPool = poolIndex;
+		}
+		bindTexture(static_cast<uint32_t>(key & 0xffffffff));
+
+		if (indirect) {
+			glMultiDrawElementsIndirect(GL_TRIANGLES, pool.getIndexType(),
+				(void*)(runStart * sizeof(DrawCommand)), static_cast<GLsizei>(runEnd - runStart), 0);
+			Profiler::count(Profiler::Counter::DrawCalls);
+		}
+		else {
+			for (size_t c = runStart; c < runEnd; c++) {
+				auto& command = m_commands[c];
+				setInstanceAttributes(m_instanceBuffer, command.baseInstance);
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, pool.getIndexType(),
+					(void*)(command.firstIndex * pool.getIndexSize()), 1, command.baseVertex);
+				Profiler::count(Profiler::Counter::DrawCalls);
+			}
+		}
+		runStart = runEnd;
+	}
+
+	glBindVertexArray(0);
+	unbindTextures();
+	if (indirect) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+}
+
+bool MultiDrawRenderer::culledCommandsOutdated(std::span<const Object3D> objects, const GpuCuller& culler) const {
+	if (&culler != m_culler || objects.size() != m_culledObjects.size()
+		|| (m_packer && m_packer->getGeneration() != m_culledPackGeneration)) {
+		return true;
+	}
+	for (size_t i = 0; i < objects.size(); i++) {
+		auto& mesh = *objects[i].getMesh();
+		if (&mesh != m_culledObjects[i].mesh || mesh.getVertexBuffer() != m_culledObjects[i].vertexBuffer) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void MultiDrawRenderer::buildCulledCommands(std::span<const Object3D> objects, GpuCuller& culler) {
+	forgetDeadMeshes();
+	m_culler = &culler;
+	m_culledObjects.clear();
+	m_objectRecords.clear();
+	m_draws.clear();
+	m_culledInstances.clear();
+	m_culledTextures.clear();
+
+	// One command per sub-mesh, which picks its index range from one range per level of detail.
+	std::vector<GpuCuller::DrawRecord> draws;
+	std::vector<GpuCuller::RangeRecord> ranges;
+	std::vector<uint32_t> lods;
+	for (size_t i = 0; i < objects.size(); i++) {
+		auto& object = objects[i];
+		auto& mesh = object.getMesh();
+		auto& pooled = poolMesh(mesh);
+		auto& subMeshes = mesh->getSubMeshes();
+		size_t lodCount = mesh->getLodCount();
+		// A transformation version of 0 is never used, so every record is uploaded below.
+		m_culledObjects.push_back({ mesh.get(), mesh->getVertexBuffer(), 0, mesh->getBounds() });
+		m_objectRecords.push_back({ glm::vec4(0), glm::vec4(0), static_cast<uint32_t>(draws.size()),
+			static_cast<uint32_t>(subMeshes.size()), static_cast<uint32_t>(lodCount), 0 });
+		lods.push_back(static_cast<uint32_t>(object.getLod()));
+
+		for (size_t s = 0; s < subMeshes.size(); s++) {
+			// Each draw has an instance of its own, whose matrix is filled in when the object moves.
+			InstanceData instance{ glm::mat4(1) };
+			uint64_t key = (static_cast<uint64_t>(pooled.pool) << 32) | bindingFor(subMeshes[s].texture, instance);
+			m_draws.push_back({ key, { 0, 0, 0, static_cast<int32_t>(pooled.allocation.baseVertex),
+				static_cast<uint32_t>(m_culledInstances.size()) } });
+			m_culledInstances.push_back(instance);
+			m_culledTextures.push_back(subMeshes[s].texture);
+			draws.push_back({ 0, static_cast<uint32_t>(ranges.size()) });
+			for (size_t lod = 0; lod < lodCount; lod++) {
+				auto range = mesh->getRange(s, lod);
+				ranges.push_back({ pooled.allocation.firstIndex + range.indexOffset, range.indexCount,
+					mesh->getLodError(lod), 0 });
+			}
+		}
+	}
+
+	// Sort the commands into runs of the same pool and texture, and point each draw at where
+	// its command ended up.
+	std::vector<uint32_t> order(m_draws.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return m_draws[a].key < m_draws[b].key; });
+	m_commands.clear();
+	m_culledRuns.clear();
+	for (size_t c = 0; c < order.size(); c++) {
+		auto& draw = m_draws[order[c]];
+		draws[order[c]].command = static_cast<uint32_t>(c);
+		m_commands.push_back(draw.command);
+		size_t pool = static_cast<size_t>(draw.key >> 32);
+		uint32_t texture = static_cast<uint32_t>(draw.key & 0xffffffff);
+		if (m_culledRuns.empty() || m_culledRuns.back().pool != pool || m_culledRuns.back().textureIndex != texture) {
+			m_culledRuns.push_back({ pool, texture, c, 0 });
+		}
+		m_culledRuns.back().commandCount++;
+	}
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_culledCommandBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, m_commands.size() * sizeof(DrawCommand), m_commands.data(), GL_DYNAMIC_COPY);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, m_culledInstanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, m_culledInstances.size() * sizeof(InstanceData), m_culledInstances.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	culler.setDraws(draws, ranges, lods);
+	if (m_packer) {
+		m_culledPackGeneration = m_packer->getGeneration();
+		m_culledTextureVersion = Texture::getLatestVersion();
+	}
+}
+
+void MultiDrawRenderer::uploadMovedObjects(std::span<const Object3D> objects, GpuCuller& culler) {
+	// Only the span from the first to the last object that moved is uploaded, which is all or
+	// nothing for most scenes, along with the instances of their draws.
+	size_t firstMoved = objects.size();
+	size_t endMoved = 0;
+	size_t firstInstance = m_culledInstances.size();
+	size_t endInstance = 0;
+	for (size_t i = 0; i < objects.size(); i++) {
+		auto& object = objects[i];
+		auto& mesh = *object.getMesh();
+		auto& culled = m_culledObjects[i];
+		if (object.getTransformVersion() == culled.transformVersion && mesh.getBounds() == culled.bounds) {
+			continue;
+		}
+		culled.transformVersion = object.getTransformVersion();
+		culled.bounds = mesh.getBounds();
+
+		auto bounds = object.getWorldBounds();
+		auto& record = m_objectRecords[i];
+		record.sphere = glm::vec4(bounds.center, bounds.radius);
+		record.extent = glm::vec4(bounds.extent, object.getWorldScale());
+		auto model = mesh.hasQuantizedPositions()
+			? object.getModelMatrix() * mesh.getPositionTransform() : object.getModelMatrix();
+		for (size_t d = record.firstDraw; d < record.firstDraw + record.drawCount; d++) {
+			m_culledInstances[d].model = model;
+		}
+		firstMoved = std::min(firstMoved, i);
+		endMoved = i + 1;
+		if (record.drawCount > 0) {
+			firstInstance = std::min(firstInstance, static_cast<size_t>(record.firstDraw));
+			endInstance = record.firstDraw + record.drawCount;
+		}
+	}
+	if (firstMoved >= endMoved) {
+		return;
+	}
+
+	size_t count = endMoved - firstMoved;
+	culler.setObjects(firstMoved, std::span(m_objectRecords).subspan(firstMoved, count));
+	if (firstInstance < endInstance) {
+		glBindBuffer(GL_ARRAY_BUFFER, m_culledInstanceBuffer);
+		glBufferSubData(GL_ARRAY_BUFFER, firstInstance * sizeof(InstanceData), (endInstance - firstInstance) * sizeof(InstanceData),
+			&m_culledInstances[firstInstance]);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+}
+
+void MultiDrawRenderer::refreshPacking() {
+	if (!m_packer) {
+		return;
+	}
+	// Textures that changed since the commands were built, such as placeholders that finished
+	// loading, are queued again; flushing them changes the packer's generation.
+	if (Texture::getLatestVersion() != m_culledTextureVersion) {
+		m_culledTextureVersion = Texture::getLatestVersion();
+		for (auto& weak : m_culledTextures) {
+			if (auto texture = weak.lock()) {
+				m_packer->place(texture);
+			}
+		}
+	}
+	m_packer->flush();
+}
+
+void MultiDrawRenderer::render(std::span<const Object3D> objects, GpuCuller& culler, ShaderProgram& program,
+	const glm::mat4& view, const glm::mat4& projection, float viewportHeight) {
+	refreshPacking();
+	if (culledCommandsOutdated(objects, culler)) {
+		buildCulledCommands(objects, culler);
+	}
+	uploadMovedObjects(objects, culler);
+	if (m_culledRuns.empty()) {
+		return;
+	}
+	culler.cull(m_culledCommandBuffer, view, projection, viewportHeight);
+
+	// Every run is drawn, whether or not the culler left any instances in it; the GPU skips
+	// the empty commands.
+	program.activate();
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_culledCommandBuffer);
+	size_t boundPool = SIZE_MAX;
+	for (auto& run : m_culledRuns) {
+		auto& pool = *m_pools[run.pool];
+		if (run.pool != boundPool) {
+			glBindVertexArray(pool.getVertexArray());
+			setInstanceAttributes(m_culledInstanceBuffer, 0);
+			Profiler::count(Profiler::Counter::StateChanges);
+			boundPool = run.pool;
+		}
+		bindTexture(run.textureIndex);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, pool.getIndexType(),
+			(void*)(run.firstCommand * sizeof(DrawCommand)), static_cast<GLsizei>(run.commandCount), 0);
+		Profiler::count(Profiler::Counter::DrawCalls);
+	}
+
+	glBindVertexArray(0);
+	unbindTextures();
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
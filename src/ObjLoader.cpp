@@ -0,0 +1,371 @@
+#include "ObjLoader.h"
+#include <algorithm>
+#include <charconv>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include "MappedFile.h"
+
+namespace {
+	// Files are only split into chunks of at least this many bytes, so small ones aren't spread
+	// over threads that would each parse a handful of lines.
+	const size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+	// How a corner's indices are stored.
+	const uint8_t POSITION_RELATIVE = 1;
+	const uint8_t TEX_COORD_RELATIVE = 2;
+	const uint8_t NO_TEX_COORD = 4;
+
+	/**
+	 * @brief A face corner's zero-based position and texture coordinate indices. A negative
+	 * index in the file counts back from the last vertex before the face, which a chunk can
+	 * only know relative to its own start, so those are stored relative and resolved once every
+	 * chunk's vertex count is known.
+	 */
+	struct Corner {
+		int64_t position;
+		int64_t texCoord;
+		uint8_t flags;
+	};
+
+	struct ParsedChunk {
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec2> texCoords;
+		// Three corners per triangle.
+		std::vector<Corner> corners;
+		// Each usemtl in the chunk: the first corner it applies to, and the material's name.
+		std::vector<std::pair<size_t, std::string>> materials;
+		std::vector<std::string> libraries;
+		size_t line = 0;
+		std::exception_ptr error;
+	};
+
+	bool isSpace(char c) {
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	const char* skipSpace(const char* p, const char* end) {
+		while (p < end && isSpace(*p)) {
+			p++;
+		}
+		return p;
+	}
+
+	// The next whitespace-separated token, moving p past it; empty at the end of the line.
+	std::string_view nextToken(const char*& p, const char* end) {
+		p = skipSpace(p, end);
+		auto* start = p;
+		while (p < end && !isSpace(*p)) {
+			p++;
+		}
+		return std::string_view(start, p - start);
+	}
+
+	// The rest of the line, without surrounding whitespace.
+	std::string_view restOfLine(const char* p, const char* end) {
+		p = skipSpace(p, end);
+		while (end > p && isSpace(end[-1])) {
+			end--;
+		}
+		return std::string_view(p, end - p);
+	}
+
+	template <typename T>
+	bool parseNumber(const char*& p, const char* end, T& value) {
+		p = skipSpace(p, end);
+		// from_chars doesn't take an explicit plus sign.
+		if (p < end && *p == '+') {
+			p++;
+		}
+		auto [next, error] = std::from_chars(p, end, value);
+		if (error != std::errc()) {
+			return false;
+		}
+		p = next;
+		return true;
+	}
+
+	// Parses one index of a face corner into its zero-based form.
+	bool parseIndex(const char*& p, const char* end, size_t count, int64_t& index, bool& relative) {
+		int64_t value;
+		auto [next, error] = std::from_chars(p, end, value);
+		if (error != std::errc() || value == 0) {
+			return false;
+		}
+		p = next;
+		relative = value < 0;
+		index = relative ? static_cast<int64_t>(count) + value : value - 1;
+		return true;
+	}
+
+	void parseFace(const char* p, const char* end, ParsedChunk& chunk, std::vector<Corner>& polygon) {
+		polygon.clear();
+		while (true) {
+			p = skipSpace(p, end);
+			if (p == end) {
+				break;
+			}
+			// v, v/vt, v//vn or v/vt/vn.
+			Corner corner{ 0, 0, NO_TEX_COORD };
+			bool relative;
+			if (!parseIndex(p, end, chunk.positions.size(), corner.position, relative)) {
+				throw std::runtime_error("Malformed face");
+			}
+			if (relative) {
+				corner.flags |= POSITION_RELATIVE;
+			}
+			if (p < end && *p == '/') {
+				p++;
+				if (p < end && *p != '/') {
+					if (!parseIndex(p, end, chunk.texCoords.size(), corner.texCoord, relative)) {
+						throw std::runtime_error("Malformed face");
+					}
+					corner.flags &= ~NO_TEX_COORD;
+					if (relative) {
+						corner.flags |= TEX_COORD_RELATIVE;
+					}
+				}
+				// The normal isn't needed.
+				while (p < end && !isSpace(*p)) {
+					p++;
+				}
+			}
+			polygon.push_back(corner);
+		}
+		// Lines and points can't be drawn as triangles, which Assimp drops too.
+		for (size_t i = 2; i < polygon.size(); i++) {
+			chunk.corners.push_back(polygon[0]);
+			chunk.corners.push_back(polygon[i - 1]);
+			chunk.corners.push_back(polygon[i]);
+		}
+	}
+
+	void parseChunk(const char* p, const char* end, ParsedChunk& chunk) {
+		std::vector<Corner> polygon;
+		while (p < end) {
+			auto* lineEnd = std::find(p, end, '\n');
+			auto* cursor = p;
+			auto keyword = nextToken(cursor, lineEnd);
+			if (keyword == "v") {
+				glm::vec3 position;
+				if (!parseNumber(cursor, lineEnd, position.x) || !parseNumber(cursor, lineEnd, position.y)
+					|| !parseNumber(cursor, lineEnd, position.z)) {
+					throw std::runtime_error("Malformed vertex position");
+				}
+				chunk.positions.push_back(position);
+			}
+			else if (keyword == "vt") {
+				glm::vec2 texCoord(0.0f);
+				if (!parseNumber(cursor, lineEnd, texCoord.x)) {
+					throw std::runtime_error("Malformed texture coordinate");
+				}
+				// The second coordinate is optional.
+				parseNumber(cursor, lineEnd, texCoord.y);
+				chunk.texCoords.push_back(texCoord);
+			}
+			else if (keyword == "f") {
+				parseFace(cursor, lineEnd, chunk, polygon);
+			}
+			else if (keyword == "usemtl") {
+				chunk.materials.emplace_back(chunk.corners.size(), std::string(restOfLine(cursor, lineEnd)));
+			}
+			else if (keyword == "mtllib") {
+				for (auto name = nextToken(cursor, lineEnd); !name.empty(); name = nextToken(cursor, lineEnd)) {
+					chunk.libraries.emplace_back(name);
+				}
+			}
+			chunk.line++;
+			p = lineEnd + 1;
+		}
+	}
+
+	/**
+	 * @brief Reads the diffuse maps of the materials in an MTL file.
+	 */
+	void parseMaterialLibrary(const std::filesystem::path& path,
+		std::unordered_map<std::string, std::string>& diffuseTextures) {
+		MappedFile file;
+		file.open(path.string());
+		auto* p = reinterpret_cast<const char*>(file.getData());
+		auto* end = p + file.getSize();
+		std::string* material = nullptr;
+		while (p < end) {
+			auto* lineEnd = std::find(p, end, '\n');
+			auto* cursor = p;
+			auto keyword = nextToken(cursor, lineEnd);
+			if (keyword == "newmtl") {
+				material = &diffuseTextures[std::string(restOfLine(cursor, lineEnd))];
+			}
+			else if (keyword == "map_Kd" && material != nullptr) {
+				// The file name ends the line, after any options; names may contain spaces, but
+				// then there are no options.
+				auto name = restOfLine(cursor, lineEnd);
+				if (!name.empty() && name[0] == '-') {
+					name = name.substr(name.find_last_of(" \t") + 1);
+				}
+				*material = name;
+			}
+			p = lineEnd + 1;
+		}
+	}
+}
+
+ObjModel parseObj(std::string_view source, const std::filesystem::path& directory, bool flipTextureCoords,
+	size_t threadCount) {
+	if (threadCount == 0) {
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	size_t chunkCount = std::clamp<size_t>(source.size() / MIN_CHUNK_SIZE, 1, threadCount);
+
+	// Cut the file at the line breaks after evenly spaced offsets.
+	std::vector<size_t> bounds{ 0 };
+	for (size_t i = 1; i < chunkCount; i++) {
+		size_t bound = source.find('\n', std::max(source.size() * i / chunkCount, bounds.back()));
+		bounds.push_back(bound == std::string_view::npos ? source.size() : bound + 1);
+	}
+	bounds.push_back(source.size());
+
+	std::vector<ParsedChunk> chunks(chunkCount);
+	auto parse = [&](size_t i) {
+		try {
+			parseChunk(source.data() + bounds[i], source.data() + bounds[i + 1], chunks[i]);
+		}
+		catch (...) {
+			chunks[i].error = std::current_exception();
+		}
+	};
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < chunkCount; i++) {
+		threads.emplace_back(parse, i);
+	}
+	parse(0);
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	size_t line = 1;
+	for (auto& chunk : chunks) {
+		if (chunk.error) {
+			try {
+				std::rethrow_exception(chunk.error);
+			}
+			catch (std::exception& e) {
+				throw std::runtime_error(std::string(e.what()) + " on line " + std::to_string(line + chunk.line));
+			}
+		}
+		line += chunk.line;
+	}
+
+	std::unordered_map<std::string, std::string> diffuseTextures;
+	for (auto& chunk : chunks) {
+		for (auto& library : chunk.libraries) {
+			try {
+				parseMaterialLibrary(directory / library, diffuseTextures);
+			}
+			catch (std::exception& e) {
+				std::cout << "WARNING: could not read material library " << library << ": " << e.what() << std::endl;
+			}
+		}
+	}
+
+	// Where each chunk's vertices start in the whole file's numbering.
+	std::vector<size_t> positionStarts, texCoordStarts;
+	size_t cornerCount = 0, positionCount = 0, texCoordCount = 0;
+	for (auto& chunk : chunks) {
+		positionStarts.push_back(positionCount);
+		texCoordStarts.push_back(texCoordCount);
+		cornerCount += chunk.corners.size();
+		positionCount += chunk.positions.size();
+		texCoordCount += chunk.texCoords.size();
+	}
+	auto chunkOf = [](const std::vector<size_t>& starts, size_t index) {
+		return static_cast<size_t>(std::upper_bound(starts.begin(), starts.end(), index) - starts.begin() - 1);
+	};
+
+	// Merge the corners into vertices, one per distinct pair of indices, and sort the triangles
+	// by material. Faces before the first usemtl have no material, so no texture.
+	ObjModel model;
+	std::unordered_map<std::string, size_t> materialIndices;
+	std::vector<std::string> materialNames{ "" };
+	std::vector<std::vector<uint32_t>> materialFaces(1);
+	std::unordered_map<uint64_t, uint32_t> vertexIndices;
+	vertexIndices.reserve(positionCount);
+	model.vertices.reserve(positionCount);
+	size_t material = 0;
+	auto useMaterial = [&](const std::string& name) {
+		auto [entry, added] = materialIndices.emplace(name, materialNames.size());
+		if (added) {
+			materialNames.push_back(name);
+			materialFaces.emplace_back();
+		}
+		material = entry->second;
+	};
+	for (size_t chunkIndex = 0; chunkIndex < chunks.size(); chunkIndex++) {
+		auto& chunk = chunks[chunkIndex];
+		auto nextMaterial = chunk.materials.begin();
+		for (size_t corner = 0; corner < chunk.corners.size(); corner += 3) {
+			for (; nextMaterial != chunk.materials.end() && nextMaterial->first <= corner; ++nextMaterial) {
+				useMaterial(nextMaterial->second);
+			}
+
+			int64_t positions[3], texCoords[3];
+			for (size_t i = 0; i < 3; i++) {
+				auto& c = chunk.corners[corner + i];
+				positions[i] = c.position;
+				if (c.flags & POSITION_RELATIVE) {
+					positions[i] += positionStarts[chunkIndex];
+				}
+				texCoords[i] = -1;
+				if (!(c.flags & NO_TEX_COORD)) {
+					texCoords[i] = c.texCoord;
+					if (c.flags & TEX_COORD_RELATIVE) {
+						texCoords[i] += texCoordStarts[chunkIndex];
+					}
+				}
+				if (positions[i] < 0 || positions[i] >= static_cast<int64_t>(positionCount)
+					|| texCoords[i] < -1 || texCoords[i] >= static_cast<int64_t>(texCoordCount)) {
+					throw std::runtime_error("A face refers to a vertex that doesn't exist");
+				}
+			}
+			if (positions[0] == positions[1] || positions[1] == positions[2] || positions[0] == positions[2]) {
+				continue;
+			}
+
+			for (size_t i = 0; i < 3; i++) {
+				uint64_t key = (static_cast<uint64_t>(positions[i]) << 32) | static_cast<uint32_t>(texCoords[i] + 1);
+				auto [entry, added] = vertexIndices.emplace(key, static_cast<uint32_t>(model.vertices.size()));
+				if (added) {
+					size_t p = chunkOf(positionStarts, positions[i]);
+					auto& position = chunks[p].positions[positions[i] - positionStarts[p]];
+					Vertex3D vertex{ position.x, position.y, position.z, 0, 0 };
+					if (texCoords[i] >= 0) {
+						size_t t = chunkOf(texCoordStarts, texCoords[i]);
+						auto& texCoord = chunks[t].texCoords[texCoords[i] - texCoordStarts[t]];
+						vertex.u = texCoord.x;
+						vertex.v = flipTextureCoords ? 1.0f - texCoord.y : texCoord.y;
+					}
+					model.vertices.push_back(vertex);
+				}
+				materialFaces[material].push_back(entry->second);
+			}
+		}
+		// A usemtl after the chunk's last face applies to the next chunk's.
+		for (; nextMaterial != chunk.materials.end(); ++nextMaterial) {
+			useMaterial(nextMaterial->second);
+		}
+	}
+
+	model.faces.reserve(cornerCount);
+	for (size_t i = 0; i < materialFaces.size(); i++) {
+		if (materialFaces[i].empty()) {
+			continue;
+		}
+		auto texture = diffuseTextures.find(materialNames[i]);
+		model.groups.push_back({ static_cast<uint32_t>(model.faces.size()), static_cast<uint32_t>(materialFaces[i].size()),
+			i != 0 && texture != diffuseTextures.end() ? texture->second : std::string() });
+		model.faces.insert(model.faces.end(), materialFaces[i].begin(), materialFaces[i].end());
+	}
+	return model;
+}
@@ -1,57 +1,165 @@
 #include "Object3D.h"
 #include "ShaderProgram.h"
+#include <algorithm>
+#include <cmath>
 
-glm::mat4 Object3D::buildModelMatrix() const {
-	auto m = glm::translate(glm::mat4(1), m_position);
-	m = glm::scale(m, m_scale);
-	m = glm::rotate(m, m_orientation[2], glm::vec3(0, 0, 1));
-	m = glm::rotate(m, m_orientation[0], glm::vec3(1, 0, 0));
-	m = glm::rotate(m, m_orientation[1], glm::vec3(0, 1, 0));
-	return m;
+Object3D::Object3D(std::shared_ptr<Mesh3D>&& mesh) : m_mesh(mesh),
+	m_transform(TransformStorage::shared().allocate()), m_lod(0) {
 }
 
-Object3D::Object3D(std::shared_ptr<Mesh3D>&& mesh) : m_mesh(mesh), m_position(), m_orientation(), m_scale(1.0) {
+Object3D::~Object3D() {
+	if (m_transform != NO_TRANSFORM) {
+		TransformStorage::shared().release(m_transform);
+	}
 }
 
-const glm::vec3& Object3D::getPosition() const {
-	return m_position;
+Object3D::Object3D(const Object3D& other) : m_mesh(other.m_mesh),
+	m_transform(TransformStorage::shared().allocateCopy(other.m_transform)), m_lod(other.m_lod) {
 }
 
-const glm::vec3& Object3D::getOrientation() const {
-	return m_orientation;
+Object3D::Object3D(Object3D&& other) noexcept : m_mesh(std::move(other.m_mesh)),
+	m_transform(other.m_transform), m_lod(other.m_lod) {
+	other.m_transform = NO_TRANSFORM;
 }
 
-const glm::vec3& Object3D::getScale() const {
-	return m_scale;
+Object3D& Object3D::operator=(const Object3D& other) {
+	m_mesh = other.m_mesh;
+	if (m_transform == NO_TRANSFORM) {
+		m_transform = TransformStorage::shared().allocateCopy(other.m_transform);
+	}
+	else {
+		TransformStorage::shared().copy(other.m_transform, m_transform);
+	}
+	m_lod = other.m_lod;
+	return *this;
+}
+
+Object3D& Object3D::operator=(Object3D&& other) noexcept {
+	m_mesh = std::move(other.m_mesh);
+	std::swap(m_transform, other.m_transform);
+	m_lod = other.m_lod;
+	return *this;
+}
+
+const std::shared_ptr<Mesh3D>& Object3D::getMesh() const {
+	return m_mesh;
+}
+
+glm::vec3 Object3D::getPosition() const {
+	return TransformStorage::shared().getPosition(m_transform);
+}
+
+glm::vec3 Object3D::getOrientation() const {
+	return TransformStorage::shared().getOrientation(m_transform);
+}
+
+glm::vec3 Object3D::getScale() const {
+	return TransformStorage::shared().getScale(m_transform);
 }
 
 void Object3D::setPosition(const glm::vec3& position) {
-	m_position = position;
+	TransformStorage::shared().setPosition(m_transform, position);
 }
 
 void Object3D::setOrientation(const glm::vec3& orientation) {
-	m_orientation = orientation;
+	TransformStorage::shared().setOrientation(m_transform, orientation);
 }
 
 void Object3D::setScale(const glm::vec3& scale) {
-	m_scale = scale;
+	TransformStorage::shared().setScale(m_transform, scale);
+}
+
+void Object3D::setParentTransform(const glm::mat4& parentTransform) {
+	TransformStorage::shared().setParentTransform(m_transform, parentTransform);
+}
+
+void Object3D::clearParentTransform() {
+	TransformStorage::shared().clearParentTransform(m_transform);
 }
 
 void Object3D::move(const glm::vec3& offset) {
-	m_position = m_position + offset;
+	setPosition(getPosition() + offset);
 }
 
 void Object3D::rotate(const glm::vec3& rotation) {
-	m_orientation = m_orientation + rotation;
+	setOrientation(getOrientation() + rotation);
 }
 
 void Object3D::grow(const glm::vec3& growth) {
-	m_scale = m_scale * growth;
+	setScale(getScale() * growth);
+}
+
+const glm::mat4& Object3D::getModelMatrix() const {
+	return TransformStorage::shared().getModelMatrix(m_transform);
+}
+
+uint64_t Object3D::getTransformVersion() const {
+	return TransformStorage::shared().getVersion(m_transform);
+}
+
+float Object3D::getWorldScale() const {
+	auto& model = getModelMatrix();
+	return std::max(glm::length(glm::vec3(model[0])),
+		std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+}
+
+BoundingVolume Object3D::getWorldBounds() const {
+	auto& bounds = m_mesh->getBounds();
+	auto& model = getModelMatrix();
+	BoundingVolume world;
+	world.center = glm::vec3(model * glm::vec4(bounds.center, 1));
+	// Each world axis's extent is the sum of the model axes' extents projected onto it.
+	for (int axis = 0; axis < 3; axis++) {
+		world.extent[axis] = std::abs(model[0][axis]) * bounds.extent.x + std::abs(model[1][axis]) * bounds.extent.y
+			+ std::abs(model[2][axis]) * bounds.extent.z;
+	}
+	world.radius = bounds.radius * getWorldScale();
+	return world;
+}
+
+void Object3D::selectLod(const glm::mat4& view, const glm::mat4& projection, float viewportHeight, float pixelError) {
+	size_t lodCount = m_mesh->getLodCount();
+	if (lodCount == 1) {
+		m_lod = 0;
+		return;
+	}
+
+	// How many pixels one model unit covers at the nearest point of the mesh's bounding sphere.
+	float scale = getWorldScale();
+	auto bounds = getWorldBounds();
+	glm::vec4 center = view * glm::vec4(bounds.center, 1);
+	float distance = glm::length(glm::vec3(center)) - bounds.radius;
+	if (distance <= 0) {
+		// The camera is inside the bounds.
+		m_lod = 0;
+		return;
+	}
+	float pixelsPerUnit = scale * projection[1][1] * viewportHeight * 0.5f / distance;
+
+	size_t lod = std::min(m_lod, lodCount - 1);
+	while (lod > 0 && m_mesh->getLodError(lod) * pixelsPerUnit > pixelError) {
+		lod--;
+	}
+	while (lod + 1 < lodCount && m_mesh->getLodError(lod + 1) * pixelsPerUnit <= pixelError * LOD_HYSTERESIS) {
+		lod++;
+	}
+	m_lod = lod;
+}
+
+size_t Object3D::getLod() const {
+	return m_lod;
 }
 
 void Object3D::render(ShaderProgram& shaderProgram) const {
-	auto modelMatrix = buildModelMatrix();
-	
-	shaderProgram.setUniform("model", modelMatrix);
-	m_mesh->render();
+	render(shaderProgram, shaderProgram.getUniformHandle("model"));
+}
+
+void Object3D::render(ShaderProgram& shaderProgram, UniformHandle modelUniform) const {
+	if (m_mesh->hasQuantizedPositions()) {
+		shaderProgram.setUniform(modelUniform, getModelMatrix() * m_mesh->getPositionTransform());
+	}
+	else {
+		shaderProgram.setUniform(modelUniform, getModelMatrix());
+	}
+	m_mesh->render(m_lod);
 }
@@ -0,0 +1,381 @@
+#include "Profiler.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+namespace {
+	// The frame-time histogram has buckets this many milliseconds wide, up to the last,
+	// which collects every slower frame.
+	const double HISTOGRAM_BUCKET_MS = 1.0;
+	const size_t HISTOGRAM_BUCKETS = 34;
+	const size_t HISTOGRAM_BAR_WIDTH = 50;
+
+	const char* const COUNTER_NAMES[] = { "draw calls", "state changes", "uniform uploads",
+		"objects visible", "objects culled" };
+	const char* const COUNTER_COLUMNS[] = { "draw_calls", "state_changes", "uniform_uploads",
+		"objects_visible", "objects_culled" };
+
+	// The nearest-rank percentile of sorted values.
+	double percentile(const std::vector<double>& sorted, double p) {
+		if (sorted.empty()) {
+			return 0;
+		}
+		size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+		return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+	}
+
+	double mean(const std::vector<double>& values) {
+		if (values.empty()) {
+			return 0;
+		}
+		double sum = 0;
+		for (auto value : values) {
+			sum += value;
+		}
+		return sum / values.size();
+	}
+}
+
+Profiler::Scope::Scope(Profiler& profiler, const char* name, bool gpu) : m_profiler(profiler) {
+	m_profiler.beginSection(name, gpu);
+}
+
+Profiler::Scope::~Scope() {
+	m_profiler.endSection();
+}
+
+Profiler::Profiler(size_t historyFrames)
+	: m_epoch(std::chrono::steady_clock::now()), m_historyFrames(historyFrames), m_recording(false),
+	m_frame(-1), m_gpuQueryOpen(false) {
+}
+
+Profiler::~Profiler() {
+	for (auto& section : m_sections) {
+		if (section.gpu) {
+			glDeleteQueries(QueryLatency, section.queries.data());
+		}
+	}
+}
+
+double Profiler::now() const {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_epoch).count();
+}
+
+size_t Profiler::sectionIndex(const char* name, bool gpu) {
+	for (size_t i = 0; i < m_sections.size(); i++) {
+		if (m_sections[i].name == name) {
+			return i;
+		}
+	}
+	Section section{ name, gpu, {}, {} };
+	section.queryFrames.fill(-1);
+	if (gpu) {
+		glGenQueries(QueryLatency, section.queries.data());
+	}
+	m_sections.push_back(std::move(section));
+	return m_sections.size() - 1;
+}
+
+void Profiler::beginFrame() {
+	m_frame++;
+	if (!m_recording) {
+		while (!m_frames.empty() && m_frames.size() >= m_historyFrames) {
+			m_frames.pop_front();
+		}
+	}
+	s_counters.fill(0);
+	m_frames.push_back({ m_frame, now(), -1, {}, {} });
+}
+
+void Profiler::endFrame() {
+	auto& record = m_frames.back();
+	record.frameTime = now() - record.start;
+	record.counters = s_counters;
+	collectGpuResults();
+}
+
+void Profiler::beginSection(const char* name, bool gpu) {
+	size_t index = sectionIndex(name, gpu);
+	auto& section = m_sections[index];
+	auto& record = m_frames.back();
+
+	bool timeGpu = section.gpu && !m_gpuQueryOpen;
+	size_t slot = m_frame % QueryLatency;
+	if (timeGpu && section.queryFrames[slot] == m_frame) {
+		// The section already ran this frame, and its query is taken.
+		timeGpu = false;
+	}
+	if (timeGpu) {
+		// If the result from QueryLatency frames ago still isn't available, it is dropped
+		// rather than waited for.
+		glBeginQuery(GL_TIME_ELAPSED, section.queries[slot]);
+		section.queryFrames[slot] = m_frame;
+		m_gpuQueryOpen = true;
+	}
+	m_openSections.push_back({ record.sections.size(), timeGpu });
+	record.sections.push_back({ index, now(), 0, -1, timeGpu });
+}
+
+void Profiler::endSection() {
+	auto [timingIndex, heldGpuQuery] = m_openSections.back();
+	m_openSections.pop_back();
+
+	auto& timing = m_frames.back().sections[timingIndex];
+	timing.cpuTime = now() - timing.cpuStart;
+	if (heldGpuQuery) {
+		glEndQuery(GL_TIME_ELAPSED);
+		m_gpuQueryOpen = false;
+	}
+}
+
+void Profiler::collectGpuResults() {
+	if (m_frames.empty()) {
+		return;
+	}
+	int64_t firstFrame = m_frames.front().frame;
+	for (size_t index = 0; index < m_sections.size(); index++) {
+		auto& section = m_sections[index];
+		if (!section.gpu) {
+			continue;
+		}
+		for (size_t slot = 0; slot < QueryLatency; slot++) {
+			if (section.queryFrames[slot] < 0) {
+				continue;
+			}
+			int32_t available = 0;
+			glGetQueryObjectiv(section.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) {
+				continue;
+			}
+			uint64_t elapsed = 0;
+			glGetQueryObjectui64v(section.queries[slot], GL_QUERY_RESULT, &elapsed);
+
+			// The frame may have left the history while its result was in flight.
+			int64_t frame = section.queryFrames[slot];
+			section.queryFrames[slot] = -1;
+			if (frame < firstFrame) {
+				continue;
+			}
+			for (auto& timing : m_frames[frame - firstFrame].sections) {
+				if (timing.section == index && timing.gpuTimed) {
+					timing.gpuTime = elapsed / 1e6;
+					break;
+				}
+			}
+		}
+	}
+}
+
+void Profiler::setRecording(bool recording) {
+	m_recording = recording;
+}
+
+size_t Profiler::firstRecentFrame() const {
+	return m_frames.size() > m_historyFrames ? m_frames.size() - m_historyFrames : 0;
+}
+
+Profiler::Stats Profiler::statsOf(std::vector<double> values) {
+	Stats stats;
+	if (values.empty()) {
+		return stats;
+	}
+	std::sort(values.begin(), values.end());
+	stats.samples = values.size();
+	stats.mean = mean(values);
+	stats.p50 = percentile(values, 0.5);
+	stats.p99 = percentile(values, 0.99);
+	stats.max = values.back();
+	return stats;
+}
+
+Profiler::Stats Profiler::getFrameTimeStats() const {
+	std::vector<double> frameTimes;
+	for (size_t i = firstRecentFrame(); i < m_frames.size(); i++) {
+		if (m_frames[i].frameTime >= 0) {
+			frameTimes.push_back(m_frames[i].frameTime);
+		}
+	}
+	return statsOf(std::move(frameTimes));
+}
+
+Profiler::Stats Profiler::getSectionStats(const std::string& section, bool gpu) const {
+	std::vector<double> times;
+	for (size_t i = firstRecentFrame(); i < m_frames.size(); i++) {
+		if (m_frames[i].frameTime < 0) {
+			continue;
+		}
+		for (auto& timing : m_frames[i].sections) {
+			if (m_sections[timing.section].name != section) {
+				continue;
+			}
+			if (!gpu) {
+				times.push_back(timing.cpuTime);
+			}
+			else if (timing.gpuTime >= 0) {
+				times.push_back(timing.gpuTime);
+			}
+		}
+	}
+	return statsOf(std::move(times));
+}
+
+double Profiler::getCounterAverage(Counter counter) const {
+	double total = 0;
+	size_t frames = 0;
+	for (size_t i = firstRecentFrame(); i < m_frames.size(); i++) {
+		if (m_frames[i].frameTime >= 0) {
+			total += m_frames[i].counters[static_cast<size_t>(counter)];
+			frames++;
+		}
+	}
+	return frames > 0 ? total / frames : 0;
+}
+
+void Profiler::writeReport(std::ostream& out) const {
+	auto frameStats = getFrameTimeStats();
+	if (frameStats.samples == 0) {
+		out << "No frames profiled." << std::endl;
+		return;
+	}
+
+	out << std::fixed << std::setprecision(2);
+	out << "Profile of the last " << frameStats.samples << " frames:" << std::endl;
+	out << "  frame time: mean " << frameStats.mean << " ms (" << 1000 / frameStats.mean << " fps), p50 "
+		<< frameStats.p50 << " ms, p99 " << frameStats.p99 << " ms, max " << frameStats.max << " ms" << std::endl;
+
+	for (auto& section : m_sections) {
+		auto cpu = getSectionStats(section.name, false);
+		if (cpu.samples == 0) {
+			continue;
+		}
+		out << "  " << std::left << std::setw(12) << section.name << std::right
+			<< " cpu: mean " << cpu.mean << " ms, p99 " << cpu.p99 << " ms";
+		auto gpu = getSectionStats(section.name, true);
+		if (gpu.samples > 0) {
+			out << "   gpu: mean " << gpu.mean << " ms, p99 " << gpu.p99 << " ms";
+		}
+		out << std::endl;
+	}
+
+	out << "  per frame:";
+	for (size_t c = 0; c < static_cast<size_t>(Counter::Count); c++) {
+		out << (c == 0 ? " " : ", ") << getCounterAverage(static_cast<Counter>(c)) << " " << COUNTER_NAMES[c];
+	}
+	out << std::endl;
+
+	std::array<size_t, HISTOGRAM_BUCKETS> buckets{};
+	for (size_t i = firstRecentFrame(); i < m_frames.size(); i++) {
+		if (m_frames[i].frameTime >= 0) {
+			auto bucket = static_cast<size_t>(m_frames[i].frameTime / HISTOGRAM_BUCKET_MS);
+			buckets[std::min(bucket, HISTOGRAM_BUCKETS - 1)]++;
+		}
+	}
+	size_t firstBucket = 0, lastBucket = HISTOGRAM_BUCKETS - 1, largestBucket = 0;
+	while (buckets[firstBucket] == 0) {
+		firstBucket++;
+	}
+	while (buckets[lastBucket] == 0) {
+		lastBucket--;
+	}
+	for (auto count : buckets) {
+		largestBucket = std::max(largestBucket, count);
+	}
+	out << "  frame-time histogram:" << std::endl;
+	out << std::setprecision(0);
+	for (size_t b = firstBucket; b <= lastBucket; b++) {
+		out << "    " << std::setw(3) << b * HISTOGRAM_BUCKET_MS;
+		if (b == HISTOGRAM_BUCKETS - 1) {
+			out << "+     ms |";
+		}
+		else {
+			out << "-" << std::setw(3) << (b + 1) * HISTOGRAM_BUCKET_MS << " ms |";
+		}
+		out << std::string(buckets[b] * HISTOGRAM_BAR_WIDTH / largestBucket, '#') << " " << buckets[b] << std::endl;
+	}
+	out << std::defaultfloat << std::setprecision(6);
+}
+
+void Profiler::writeCsv(const std::string& path) const {
+	std::ofstream out(path);
+	if (!out) {
+		throw std::runtime_error("Could not open " + path + " for writing");
+	}
+
+	out << "frame,frame_ms";
+	for (auto& section : m_sections) {
+		out << "," << section.name << "_cpu_ms";
+		if (section.gpu) {
+			out << "," << section.name << "_gpu_ms";
+		}
+	}
+	for (auto column : COUNTER_COLUMNS) {
+		out << "," << column;
+	}
+	out << "\n";
+
+	for (auto& record : m_frames) {
+		if (record.frameTime < 0) {
+			continue;
+		}
+		// Sections that ran several times in a frame are summed; GPU times not read are blank.
+		std::vector<double> cpuTimes(m_sections.size(), 0), gpuTimes(m_sections.size(), -1);
+		for (auto& timing : record.sections) {
+			cpuTimes[timing.section] += timing.cpuTime;
+			if (timing.gpuTime >= 0) {
+				gpuTimes[timing.section] = std::max(gpuTimes[timing.section], 0.0) + timing.gpuTime;
+			}
+		}
+
+		out << record.frame << "," << record.frameTime;
+		for (size_t i = 0; i < m_sections.size(); i++) {
+			out << "," << cpuTimes[i];
+			if (m_sections[i].gpu) {
+				out << ",";
+				if (gpuTimes[i] >= 0) {
+					out << gpuTimes[i];
+				}
+			}
+		}
+		for (auto count : record.counters) {
+			out << "," << count;
+		}
+		out << "\n";
+	}
+}
+
+void Profiler::writeChromeTrace(const std::string& path) const {
+	std::ofstream out(path);
+	if (!out) {
+		throw std::runtime_error("Could not open " + path + " for writing");
+	}
+
+	// Trace timestamps and durations are in microseconds.
+	out << std::fixed << std::setprecision(3);
+	out << "{\"traceEvents\":[\n";
+	out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+	out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+	for (auto& record : m_frames) {
+		if (record.frameTime < 0) {
+			continue;
+		}
+		out << ",\n{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":" << record.start * 1000
+			<< ",\"dur\":" << record.frameTime * 1000 << ",\"args\":{\"frame\":" << record.frame;
+		for (size_t c = 0; c < record.counters.size(); c++) {
+			out << ",\"" << COUNTER_COLUMNS[c] << "\":" << record.counters[c];
+		}
+		out << "}}";
+		for (auto& timing : record.sections) {
+			auto& name = m_sections[timing.section].name;
+			out << ",\n{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":"
+				<< timing.cpuStart * 1000 << ",\"dur\":" << timing.cpuTime * 1000 << "}";
+			if (timing.gpuTime >= 0) {
+				out << ",\n{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":"
+					<< timing.cpuStart * 1000 << ",\"dur\":" << timing.gpuTime * 1000 << "}";
+			}
+		}
+	}
+	out << "\n]}\n";
+}
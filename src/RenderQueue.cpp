@@ -0,0 +1,325 @@
+#include "RenderQueue.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include "Profiler.h"
+#include "UniformBuffer.h"
+
+namespace {
+	const uint32_t NO_BINDING = UINT32_MAX;
+	// Objects per job when packets are built on a job system.
+	const size_t SUBMIT_GRAIN_SIZE = 128;
+
+	// Sorts the entries by key with a least-significant-digit radix sort, one byte per pass.
+	// Passes in which every key has the same byte are skipped, which is most of them when the
+	// keys only use a few distinct programs and textures.
+	template <typename Entry>
+	void radixSort(std::vector<Entry>& entries, std::vector<Entry>& scratch) {
+		// Every pass's histogram, counted in one read of the keys.
+		std::array<std::array<size_t, 256>, 8> counts{};
+		for (auto& entry : entries) {
+			for (int digit = 0; digit < 8; digit++) {
+				counts[digit][(entry.key >> (digit * 8)) & 0xff]++;
+			}
+		}
+
+		scratch.resize(entries.size());
+		for (int digit = 0; digit < 8; digit++) {
+			auto& digitCounts = counts[digit];
+			if (std::find(digitCounts.begin(), digitCounts.end(), entries.size()) != digitCounts.end()) {
+				continue;
+			}
+			size_t offset = 0;
+			for (auto& count : digitCounts) {
+				size_t bucketSize = count;
+				count = offset;
+				offset += bucketSize;
+			}
+			for (auto& entry : entries) {
+				scratch[digitCounts[(entry.key >> (digit * 8)) & 0xff]++] = entry;
+			}
+			entries.swap(scratch);
+		}
+	}
+
+	// The top 24 bits of a non-negative float, which order the same way as the float does.
+	uint64_t depthBits(float depth) {
+		depth = std::max(depth, 0.0f);
+		uint32_t bits;
+		std::memcpy(&bits, &depth, sizeof(bits));
+		return bits >> 8;
+	}
+}
+
+RenderQueue::~RenderQueue() {
+	glDeleteBuffers(1, &m_fallbackObjectBuffer);
+}
+
+void RenderQueue::begin(const glm::mat4& view) {
+	m_view = view;
+	// A program may have been reloaded since the last frame, moving its uniforms.
+	for (auto& program : m_programs) {
+		program.modelUniform = program.program->getUniformHandle("model");
+		program.objectBlock = program.program->hasUniformBlock("Object");
+		if (program.depthProgram != nullptr) {
+			program.depthModelUniform = program.depthProgram->getUniformHandle("model");
+		}
+	}
+	m_packets.clear();
+	m_entries.clear();
+}
+
+uint32_t RenderQueue::programIndex(ShaderProgram& program) {
+	for (size_t i = 0; i < m_programs.size(); i++) {
+		if (m_programs[i].program == &program) {
+			return static_cast<uint32_t>(i);
+		}
+	}
+	m_programs.push_back({ &program, program.getUniformHandle("model"), program.hasUniformBlock("Object"), nullptr, {} });
+	return static_cast<uint32_t>(m_programs.size() - 1);
+}
+
+uint64_t RenderQueue::makeKey(const Packet& packet, float depth) const {
+	// Only the low bits of the state fit; names that share them just sort together.
+	uint64_t program = packet.program & 0xff;
+	uint64_t texture = packet.texture & 0xffff;
+	uint64_t vertexArray = packet.vertexArray & 0xffff;
+	if (m_depthFirst) {
+		return (depthBits(depth) << 40) | (program << 32) | (texture << 16) | vertexArray;
+	}
+	return (program << 56) | (texture << 40) | (vertexArray << 24) | depthBits(depth);
+}
+
+void RenderQueue::buildPackets(uint32_t programId, const Object3D& object, std::vector<Packet>& packets,
+	std::vector<SortEntry>& entries) const {
+	auto& mesh = *object.getMesh();
+	glm::mat4 model = object.getModelMatrix();
+	if (mesh.hasQuantizedPositions()) {
+		model = model * mesh.getPositionTransform();
+	}
+	// The distance in front of the camera of the object's center.
+	float depth = -(m_view * glm::vec4(object.getWorldBounds().center, 1)).z;
+
+	auto& subMeshes = mesh.getSubMeshes();
+	for (size_t i = 0; i < subMeshes.size(); i++) {
+		auto range = mesh.getRange(i, object.getLod());
+		if (range.indexCount == 0) {
+			continue;
+		}
+		Packet packet = {
+			programId,
+			mesh.getVertexArray(),
+			subMeshes[i].texture ? subMeshes[i].texture->getId() : 0,
+			mesh.getIndexType(),
+			range.indexCount,
+			range.indexOffset * mesh.getIndexSize(),
+			model
+		};
+		entries.push_back({ makeKey(packet, depth), static_cast<uint32_t>(packets.size()) });
+		packets.push_back(packet);
+	}
+}
+
+void RenderQueue::submit(ShaderProgram& program, const Object3D& object) {
+	buildPackets(programIndex(program), object, m_packets, m_entries);
+}
+
+void RenderQueue::submit(JobSystem& jobs, ShaderProgram& program, std::span<const Object3D> objects,
+	std::span<const uint32_t> indices) {
+	// The program is looked up once, here, since that may add it to the queue.
+	uint32_t programId = programIndex(program);
+	m_workerLists.resize(jobs.getWorkerCount());
+	jobs.parallelFor(indices.size(), SUBMIT_GRAIN_SIZE, [&](size_t begin, size_t end, size_t worker) {
+		auto& list = m_workerLists[worker];
+		for (size_t i = begin; i < end; i++) {
+			buildPackets(programId, objects[indices[i]], list.packets, list.entries);
+		}
+	});
+
+	// The entries' packet indices move along with their packets. Their order doesn't matter,
+	// since flush() sorts them.
+	for (auto& list : m_workerLists) {
+		uint32_t offset = static_cast<uint32_t>(m_packets.size());
+		for (auto& entry : list.entries) {
+			m_entries.push_back({ entry.key, entry.packet + offset });
+		}
+		m_packets.insert(m_packets.end(), list.packets.begin(), list.packets.end());
+		list.packets.clear();
+		list.entries.clear();
+	}
+}
+
+void RenderQueue::flush() {
+	radixSort(m_entries, m_scratch);
+
+	// The object blocks' slots, in draw order, all written with one map of the buffer.
+	size_t slotSize = std140::roundUp(sizeof(ObjectUniforms), UniformBuffer::getOffsetAlignment());
+	size_t firstSlotOffset = 0;
+	uint32_t slotBuffer = 0;
+	if (m_objectBuffer != nullptr) {
+		size_t slotCount = 0;
+		for (auto& entry : m_entries) {
+			slotCount += m_programs[m_packets[entry.packet].program].objectBlock;
+		}
+		if (slotCount > 0) {
+			// A frame with more draws than the buffer has slots for gets a bigger buffer, rather
+			// than failing to map.
+			if (!m_objectBuffer->hasRoom(slotCount * slotSize, UniformBuffer::getOffsetAlignment())) {
+				m_objectBuffer->grow(slotCount * slotSize);
+			}
+			auto* slots = static_cast<unsigned char*>(m_objectBuffer->map(slotCount * slotSize,
+				UniformBuffer::getOffsetAlignment(), firstSlotOffset));
+			bool mapped = slots != nullptr;
+			if (mapped) {
+				slotBuffer = m_objectBuffer->getBuffer();
+			}
+			else {
+				// The driver couldn't map the buffer; upload the slots to one of the queue's own.
+				if (m_fallbackObjectBuffer == 0) {
+					glGenBuffers(1, &m_fallbackObjectBuffer);
+				}
+				slotBuffer = m_fallbackObjectBuffer;
+				firstSlotOffset = 0;
+				m_fallbackSlots.resize(slotCount * slotSize);
+				slots = m_fallbackSlots.data();
+			}
+			for (auto& entry : m_entries) {
+				auto& packet = m_packets[entry.packet];
+				if (m_programs[packet.program].objectBlock) {
+					ObjectUniforms object = { packet.model };
+					std::memcpy(slots, &object, sizeof(object));
+					slots += slotSize;
+				}
+			}
+			if (mapped) {
+				m_objectBuffer->unmap();
+			}
+			else {
+				// Orphan last frame's storage rather than wait for the GPU to finish reading it.
+				glBindBuffer(GL_UNIFORM_BUFFER, m_fallbackObjectBuffer);
+				glBufferData(GL_UNIFORM_BUFFER, m_fallbackSlots.size(), m_fallbackSlots.data(), GL_STREAM_DRAW);
+				glBindBuffer(GL_UNIFORM_BUFFER, 0);
+			}
+		}
+	}
+	size_t slotOffset = firstSlotOffset;
+	if (m_depthPrepass) {
+		drawDepthPrepass(slotBuffer, firstSlotOffset, slotSize);
+	}
+
+	uint32_t boundProgram = NO_BINDING;
+	uint32_t boundVertexArray = NO_BINDING;
+	uint32_t boundTexture = NO_BINDING;
+	// Whether the depth test is set up for shading surfaces the pre-pass left.
+	bool depthEqual = false;
+	for (auto& entry : m_entries) {
+		auto& packet = m_packets[entry.packet];
+		auto& program = m_programs[packet.program];
+		if (packet.program != boundProgram) {
+			program.program->activate();
+			boundProgram = packet.program;
+		}
+		bool prepassed = m_depthPrepass && program.depthProgram != nullptr;
+		if (prepassed != depthEqual) {
+			glDepthFunc(prepassed ? GL_EQUAL : GL_LESS);
+			glDepthMask(prepassed ? GL_FALSE : GL_TRUE);
+			Profiler::count(Profiler::Counter::StateChanges);
+			depthEqual = prepassed;
+		}
+		if (packet.vertexArray != boundVertexArray) {
+			glBindVertexArray(packet.vertexArray);
+			Profiler::count(Profiler::Counter::StateChanges);
+			boundVertexArray = packet.vertexArray;
+		}
+		if (packet.texture != boundTexture) {
+			glBindTexture(GL_TEXTURE_2D, packet.texture);
+			Profiler::count(Profiler::Counter::StateChanges);
+			boundTexture = packet.texture;
+		}
+		if (program.objectBlock && slotBuffer != 0) {
+			glBindBufferRange(GL_UNIFORM_BUFFER, UniformBuffer::OBJECT_BINDING, slotBuffer, slotOffset,
+				sizeof(ObjectUniforms));
+			slotOffset += slotSize;
+		}
+		else {
+			program.program->setUniform(program.modelUniform, packet.model);
+		}
+		glDrawElements(GL_TRIANGLES, packet.indexCount, packet.indexType, (void*)packet.indexByteOffset);
+		Profiler::count(Profiler::Counter::DrawCalls);
+	}
+	// Leave no vertex array bound, as Mesh3D::render does, so no one else can accidentally
+	// mess with it.
+	if (boundVertexArray != NO_BINDING) {
+		glBindVertexArray(0);
+	}
+	if (depthEqual) {
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
+	}
+
+	m_packets.clear();
+	m_entries.clear();
+}
+
+void RenderQueue::drawDepthPrepass(uint32_t slotBuffer, size_t firstSlotOffset, size_t slotSize) {
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	ShaderProgram* boundProgram = nullptr;
+	uint32_t boundVertexArray = NO_BINDING;
+	size_t slotOffset = firstSlotOffset;
+	for (auto& entry : m_entries) {
+		auto& packet = m_packets[entry.packet];
+		auto& program = m_programs[packet.program];
+		// Step over the slot even if the packet is skipped, to stay in line with the shading pass.
+		size_t slot = slotOffset;
+		bool hasSlot = program.objectBlock && slotBuffer != 0;
+		if (hasSlot) {
+			slotOffset += slotSize;
+		}
+		if (program.depthProgram == nullptr) {
+			continue;
+		}
+
+		if (program.depthProgram != boundProgram) {
+			program.depthProgram->activate();
+			boundProgram = program.depthProgram;
+		}
+		if (packet.vertexArray != boundVertexArray) {
+			glBindVertexArray(packet.vertexArray);
+			Profiler::count(Profiler::Counter::StateChanges);
+			boundVertexArray = packet.vertexArray;
+		}
+		if (hasSlot) {
+			glBindBufferRange(GL_UNIFORM_BUFFER, UniformBuffer::OBJECT_BINDING, slotBuffer, slot,
+				sizeof(ObjectUniforms));
+		}
+		else {
+			program.depthProgram->setUniform(program.depthModelUniform, packet.model);
+		}
+		glDrawElements(GL_TRIANGLES, packet.indexCount, packet.indexType, (void*)packet.indexByteOffset);
+		Profiler::count(Profiler::Counter::DrawCalls);
+	}
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+void RenderQueue::setDepthFirst(bool depthFirst) {
+	m_depthFirst = depthFirst;
+}
+
+void RenderQueue::setDepthProgram(ShaderProgram& program, ShaderProgram* depthProgram) {
+	auto& entry = m_programs[programIndex(program)];
+	entry.depthProgram = depthProgram;
+	entry.depthModelUniform = depthProgram != nullptr ? depthProgram->getUniformHandle("model") : UniformHandle{};
+}
+
+void RenderQueue::setDepthPrepass(bool depthPrepass) {
+	m_depthPrepass = depthPrepass;
+}
+
+void RenderQueue::setObjectBuffer(StreamBuffer* objectBuffer) {
+	m_objectBuffer = objectBuffer;
+}
+
+size_t RenderQueue::getPacketCount() const {
+	return m_packets.size();
+}
@@ -0,0 +1,203 @@
+#include "Scene.h"
+#include <cmath>
+#include "Frustum.h"
+#include "Profiler.h"
+
+namespace {
+	// Objects per job; each one's test is short, so the chunks must be long enough to be
+	// worth handing to another thread.
+	const size_t UPDATE_GRAIN_SIZE = 256;
+	const size_t QUERY_GRAIN_SIZE = 512;
+
+	bool isInside(const Frustum& frustum, const Aabb& bounds) {
+		return frustum.classify((bounds.min + bounds.max) * 0.5f, (bounds.max - bounds.min) * 0.5f)
+			!= Frustum::Containment::Outside;
+	}
+}
+
+Scene::Scene(std::vector<Object3D> objects, ShaderProgram program)
+	: objects(std::move(objects)), program(std::move(program)) {
+	update();
+}
+
+size_t Scene::addObject(Object3D object) {
+	objects.push_back(std::move(object));
+	return objects.size() - 1;
+}
+
+void Scene::attach(size_t object, SceneGraph::NodeId node) {
+	m_objectNodes.resize(objects.size(), SceneGraph::NO_NODE);
+	m_nodeVersions.resize(objects.size(), 0);
+	m_objectNodes[object] = node;
+	// No world version is 0, so the node's transformation is handed over at the next update.
+	m_nodeVersions[object] = 0;
+	if (node == SceneGraph::NO_NODE) {
+		objects[object].clearParentTransform();
+	}
+}
+
+SceneGraph::NodeId Scene::getNode(size_t object) const {
+	return object < m_objectNodes.size() ? m_objectNodes[object] : SceneGraph::NO_NODE;
+}
+
+void Scene::applyGraph() {
+	graph.update();
+	m_objectNodes.resize(objects.size(), SceneGraph::NO_NODE);
+	m_nodeVersions.resize(objects.size(), 0);
+	for (size_t i = 0; i < objects.size(); i++) {
+		auto node = m_objectNodes[i];
+		if (node == SceneGraph::NO_NODE) {
+			continue;
+		}
+		if (!graph.contains(node)) {
+			objects[i].clearParentTransform();
+			m_objectNodes[i] = SceneGraph::NO_NODE;
+			continue;
+		}
+		auto version = graph.getWorldVersion(node);
+		if (version != m_nodeVersions[i]) {
+			objects[i].setParentTransform(graph.getWorldTransform(node));
+			m_nodeVersions[i] = version;
+		}
+	}
+}
+
+Aabb Scene::worldBounds(size_t object) const {
+	auto bounds = objects[object].getWorldBounds();
+	return { bounds.center - bounds.extent, bounds.center + bounds.extent };
+}
+
+void Scene::removeDeleted() {
+	// Objects removed from the end of the list leave the tree.
+	while (m_proxies.size() > objects.size()) {
+		m_tree.destroyProxy(m_proxies.back());
+		m_proxies.pop_back();
+		m_bounds.pop_back();
+		m_transformVersions.pop_back();
+		m_meshBounds.pop_back();
+	}
+}
+
+bool Scene::refreshBounds(size_t object) {
+	// A mesh that finishes loading in place changes its bounds without the object moving.
+	auto& current = objects[object];
+	if (current.getTransformVersion() == m_transformVersions[object]
+		&& current.getMesh()->getBounds() == m_meshBounds[object]) {
+		return false;
+	}
+	m_bounds[object] = worldBounds(object);
+	m_transformVersions[object] = current.getTransformVersion();
+	m_meshBounds[object] = current.getMesh()->getBounds();
+	return true;
+}
+
+void Scene::addNew() {
+	for (size_t i = m_proxies.size(); i < objects.size(); i++) {
+		m_bounds.push_back(worldBounds(i));
+		m_proxies.push_back(m_tree.createProxy(m_bounds.back(), static_cast<uint32_t>(i)));
+		m_transformVersions.push_back(objects[i].getTransformVersion());
+		m_meshBounds.push_back(objects[i].getMesh()->getBounds());
+	}
+}
+
+void Scene::update() {
+	applyGraph();
+	TransformStorage::shared().updateMatrices();
+	removeDeleted();
+	for (size_t i = 0; i < m_proxies.size(); i++) {
+		if (refreshBounds(i)) {
+			m_tree.moveProxy(m_proxies[i], m_bounds[i]);
+		}
+	}
+	addNew();
+}
+
+void Scene::update(JobSystem& jobs) {
+	applyGraph();
+	TransformStorage::shared().updateMatrices(jobs);
+	removeDeleted();
+	m_moved.resize(m_proxies.size());
+	jobs.parallelFor(m_proxies.size(), UPDATE_GRAIN_SIZE, [this](size_t begin, size_t end, size_t) {
+		for (size_t i = begin; i < end; i++) {
+			m_moved[i] = refreshBounds(i);
+		}
+	});
+	for (size_t i = 0; i < m_proxies.size(); i++) {
+		if (m_moved[i]) {
+			m_tree.moveProxy(m_proxies[i], m_bounds[i]);
+		}
+	}
+	addNew();
+}
+
+void Scene::queryFrustum(const glm::mat4& viewProjection, std::vector<uint32_t>& visible) const {
+	visible.clear();
+	auto frustum = Frustum::fromMatrix(viewProjection);
+	m_tree.queryFrustum(frustum, visible);
+
+	// The tree only knows the enlarged boxes; drop the objects whose own boxes are outside.
+	size_t kept = 0;
+	for (auto i : visible) {
+		if (isInside(frustum, m_bounds[i])) {
+			visible[kept++] = i;
+		}
+	}
+	visible.resize(kept);
+	countVisible(kept);
+}
+
+void Scene::queryFrustum(const glm::mat4& viewProjection, std::vector<uint32_t>& visible, JobSystem& jobs) const {
+	visible.clear();
+	auto frustum = Frustum::fromMatrix(viewProjection);
+	m_tree.queryFrustum(frustum, visible);
+
+	// The candidates are tested in parallel, then compacted in order.
+	m_inside.resize(visible.size());
+	jobs.parallelFor(visible.size(), QUERY_GRAIN_SIZE, [&](size_t begin, size_t end, size_t) {
+		for (size_t i = begin; i < end; i++) {
+			m_inside[i] = isInside(frustum, m_bounds[visible[i]]);
+		}
+	});
+	size_t kept = 0;
+	for (size_t i = 0; i < visible.size(); i++) {
+		if (m_inside[i]) {
+			visible[kept++] = visible[i];
+		}
+	}
+	visible.resize(kept);
+	countVisible(kept);
+}
+
+void Scene::countVisible(size_t visibleCount) const {
+	Profiler::count(Profiler::Counter::ObjectsVisible, static_cast<uint32_t>(visibleCount));
+	Profiler::count(Profiler::Counter::ObjectsCulled, static_cast<uint32_t>(m_proxies.size() - visibleCount));
+}
+
+void Scene::queryBox(const Aabb& box, std::vector<uint32_t>& results) const {
+	results.clear();
+	m_tree.queryBox(box, results);
+
+	size_t kept = 0;
+	for (auto i : results) {
+		auto& bounds = m_bounds[i];
+		if (glm::all(glm::lessThanEqual(bounds.min, box.max)) && glm::all(glm::lessThanEqual(box.min, bounds.max))) {
+			results[kept++] = i;
+		}
+	}
+	results.resize(kept);
+}
+
+std::optional<Scene::RayHit> Scene::raycast(const glm::vec3& origin, const glm::vec3& direction,
+	float maxDistance) const {
+	glm::vec3 inverseDirection = 1.0f / direction;
+	std::optional<RayHit> nearest;
+	m_tree.raycast(origin, direction, maxDistance, [&](uint32_t object, float limit) {
+		float distance = rayEntry(m_bounds[object], origin, inverseDirection, limit);
+		if (std::isfinite(distance) && (!nearest || distance < nearest->distance)) {
+			nearest = RayHit{ object, distance };
+			return distance;
+		}
+		return limit;
+	});
+	return nearest;
+}
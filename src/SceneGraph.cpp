@@ -0,0 +1,198 @@
+#include "SceneGraph.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace {
+	// Moves the count elements from the given index so they start at the index "to" of the
+	// array as it would be without them.
+	template <typename T>
+	void moveBlock(std::vector<T>& items, size_t from, size_t count, size_t to) {
+		if (to < from) {
+			std::rotate(items.begin() + to, items.begin() + from, items.begin() + from + count);
+		}
+		else {
+			std::rotate(items.begin() + from, items.begin() + from + count, items.begin() + to + count);
+		}
+	}
+}
+
+SceneGraph::NodeId SceneGraph::createNode(NodeId parent, const glm::mat4& localTransform) {
+	NodeId id;
+	if (!m_freeIds.empty()) {
+		id = m_freeIds.back();
+		m_freeIds.pop_back();
+	}
+	else {
+		id = static_cast<NodeId>(m_indices.size());
+		m_indices.push_back(NO_INDEX);
+	}
+
+	// The last child goes right after its parent's subtree.
+	size_t at = m_ids.size();
+	uint32_t parentIndex = NO_INDEX;
+	if (parent != NO_NODE) {
+		parentIndex = indexOf(parent);
+		at = parentIndex + m_subtreeSizes[parentIndex];
+	}
+	m_ids.insert(m_ids.begin() + at, id);
+	m_parents.insert(m_parents.begin() + at, parent);
+	m_parentIndices.insert(m_parentIndices.begin() + at, parentIndex);
+	m_subtreeSizes.insert(m_subtreeSizes.begin() + at, 1);
+	m_localTransforms.insert(m_localTransforms.begin() + at, localTransform);
+	m_worldTransforms.insert(m_worldTransforms.begin() + at, glm::mat4(1));
+	m_worldVersions.insert(m_worldVersions.begin() + at, m_nextVersion++);
+	m_dirty.insert(m_dirty.begin() + at, DIRTY);
+	m_changed.insert(m_changed.begin() + at, 0);
+	if (parentIndex != NO_INDEX) {
+		growAncestors(parentIndex, 1);
+	}
+	reindex(at);
+	markAncestors(static_cast<uint32_t>(at));
+	return id;
+}
+
+void SceneGraph::destroyNode(NodeId node) {
+	uint32_t index = indexOf(node);
+	uint32_t count = m_subtreeSizes[index];
+	if (m_parentIndices[index] != NO_INDEX) {
+		growAncestors(m_parentIndices[index], -static_cast<int64_t>(count));
+	}
+	for (size_t i = index; i < index + count; i++) {
+		m_indices[m_ids[i]] = NO_INDEX;
+		m_freeIds.push_back(m_ids[i]);
+	}
+
+	auto erase = [index, count](auto& items) {
+		items.erase(items.begin() + index, items.begin() + index + count);
+	};
+	erase(m_ids);
+	erase(m_parents);
+	erase(m_parentIndices);
+	erase(m_subtreeSizes);
+	erase(m_localTransforms);
+	erase(m_worldTransforms);
+	erase(m_worldVersions);
+	erase(m_dirty);
+	erase(m_changed);
+	reindex(index);
+}
+
+bool SceneGraph::contains(NodeId node) const {
+	return node < m_indices.size() && m_indices[node] != NO_INDEX;
+}
+
+void SceneGraph::setParent(NodeId node, NodeId parent) {
+	uint32_t index = indexOf(node);
+	uint32_t count = m_subtreeSizes[index];
+	uint32_t parentIndex = NO_INDEX;
+	if (parent != NO_NODE) {
+		parentIndex = indexOf(parent);
+		if (parentIndex >= index && parentIndex < index + count) {
+			throw std::runtime_error("A scene graph node can't be moved below itself");
+		}
+	}
+
+	if (m_parentIndices[index] != NO_INDEX) {
+		growAncestors(m_parentIndices[index], -static_cast<int64_t>(count));
+	}
+	// Where the subtree starts once it is taken out and put back after the new parent's.
+	size_t to = m_ids.size() - count;
+	if (parentIndex != NO_INDEX) {
+		to = (parentIndex < index ? parentIndex : parentIndex - count) + m_subtreeSizes[parentIndex];
+		growAncestors(parentIndex, count);
+	}
+	m_parents[index] = parent;
+
+	moveBlock(m_ids, index, count, to);
+	moveBlock(m_parents, index, count, to);
+	moveBlock(m_parentIndices, index, count, to);
+	moveBlock(m_subtreeSizes, index, count, to);
+	moveBlock(m_localTransforms, index, count, to);
+	moveBlock(m_worldTransforms, index, count, to);
+	moveBlock(m_worldVersions, index, count, to);
+	moveBlock(m_dirty, index, count, to);
+	moveBlock(m_changed, index, count, to);
+	reindex(std::min<size_t>(index, to));
+
+	m_dirty[to] |= DIRTY;
+	markAncestors(static_cast<uint32_t>(to));
+}
+
+SceneGraph::NodeId SceneGraph::getParent(NodeId node) const {
+	return m_parents[indexOf(node)];
+}
+
+void SceneGraph::setLocalTransform(NodeId node, const glm::mat4& localTransform) {
+	uint32_t index = indexOf(node);
+	m_localTransforms[index] = localTransform;
+	if (!(m_dirty[index] & DIRTY)) {
+		m_dirty[index] |= DIRTY;
+		markAncestors(index);
+	}
+}
+
+const glm::mat4& SceneGraph::getLocalTransform(NodeId node) const {
+	return m_localTransforms[indexOf(node)];
+}
+
+const glm::mat4& SceneGraph::getWorldTransform(NodeId node) const {
+	return m_worldTransforms[indexOf(node)];
+}
+
+uint64_t SceneGraph::getWorldVersion(NodeId node) const {
+	return m_worldVersions[indexOf(node)];
+}
+
+void SceneGraph::update() {
+	for (size_t i = 0; i < m_ids.size();) {
+		uint32_t parent = m_parentIndices[i];
+		bool changed = (m_dirty[i] & DIRTY) || (parent != NO_INDEX && m_changed[parent]);
+		if (!changed && !(m_dirty[i] & DIRTY_BELOW)) {
+			// Nothing in this subtree moved.
+			i += m_subtreeSizes[i];
+			continue;
+		}
+		if (changed) {
+			m_worldTransforms[i] = parent == NO_INDEX ? m_localTransforms[i] : m_worldTransforms[parent] * m_localTransforms[i];
+			m_worldVersions[i] = m_nextVersion++;
+		}
+		m_changed[i] = changed;
+		m_dirty[i] = 0;
+		i++;
+	}
+}
+
+size_t SceneGraph::getNodeCount() const {
+	return m_ids.size();
+}
+
+uint32_t SceneGraph::indexOf(NodeId node) const {
+	if (!contains(node)) {
+		throw std::runtime_error("No scene graph node " + std::to_string(node));
+	}
+	return m_indices[node];
+}
+
+void SceneGraph::markAncestors(uint32_t index) {
+	// Once an ancestor is marked, so are all of its own.
+	for (uint32_t parent = m_parentIndices[index]; parent != NO_INDEX && !(m_dirty[parent] & DIRTY_BELOW);
+		parent = m_parentIndices[parent]) {
+		m_dirty[parent] |= DIRTY_BELOW;
+	}
+}
+
+void SceneGraph::growAncestors(uint32_t index, int64_t count) {
+	for (uint32_t node = index; node != NO_INDEX; node = m_parentIndices[node]) {
+		m_subtreeSizes[node] = static_cast<uint32_t>(m_subtreeSizes[node] + count);
+	}
+}
+
+void SceneGraph::reindex(size_t from) {
+	for (size_t i = from; i < m_ids.size(); i++) {
+		m_indices[m_ids[i]] = static_cast<uint32_t>(i);
+	}
+	for (size_t i = from; i < m_ids.size(); i++) {
+		m_parentIndices[i] = m_parents[i] == NO_NODE ? NO_INDEX : m_indices[m_parents[i]];
+	}
+}
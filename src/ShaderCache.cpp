@@ -0,0 +1,377 @@
+#include "ShaderCache.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include "GlCapabilities.h"
+#include "MeshCache.h"
+
+// From GL_KHR_parallel_shader_compile, in case the loader was generated without it.
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+namespace {
+	// Bump this whenever the layout of the binary files changes.
+	const uint32_t BINARY_VERSION = 1;
+	const char BINARY_MAGIC[4] = { 'S', 'H', 'D', 'B' };
+
+	// A binary file is this header, followed by the program binary.
+	struct BinaryHeader {
+		char magic[4];
+		uint32_t version;
+		uint64_t key;
+		uint32_t format;
+		uint32_t length;
+	};
+
+	// How often hot reload looks at the source files.
+	const auto CHECK_INTERVAL = std::chrono::milliseconds(500);
+
+	bool binariesSupported() {
+		static bool supported = [] {
+			if (!hasGlVersion(4, 1) && !hasGlExtension("GL_ARB_get_program_binary")) {
+				return false;
+			}
+			int32_t formatCount = 0;
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+			return formatCount > 0;
+		}();
+		return supported;
+	}
+
+	bool parallelCompileSupported() {
+		static bool supported = hasGlExtension("GL_KHR_parallel_shader_compile")
+			|| hasGlExtension("GL_ARB_parallel_shader_compile");
+		return supported;
+	}
+
+	// Identifies the driver, whose binaries no other driver (or version of it) can read.
+	uint64_t driverHash() {
+		static uint64_t hash = [] {
+			std::string driver;
+			for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+				auto* value = reinterpret_cast<const char*>(glGetString(name));
+				driver += value != nullptr ? value : "";
+				driver += '\n';
+			}
+			return MeshCache::hash(reinterpret_cast<const unsigned char*>(driver.data()), driver.size());
+		}();
+		return hash;
+	}
+
+	std::string readSource(const std::string& path) {
+		std::ifstream file(path, std::ios::binary);
+		std::stringstream stream;
+		stream << file.rdbuf();
+		if (!file) {
+			throw std::runtime_error("Failed to read shader file " + path);
+		}
+		return stream.str();
+	}
+
+	uint64_t hashSources(const std::vector<uint32_t>& types, const std::vector<std::string>& sources) {
+		std::string all;
+		for (size_t i = 0; i < types.size(); i++) {
+			all += std::to_string(types[i]) + '\n' + sources[i] + '\0';
+		}
+		return MeshCache::hash(reinterpret_cast<const unsigned char*>(all.data()), all.size());
+	}
+
+	// Compiles the stages and links them into a new program, without waiting for the driver
+	// to finish; the shaders stay attached until finishBuild().
+	uint32_t startBuild(const std::vector<uint32_t>& types, const std::vector<std::string>& sources,
+		std::vector<uint32_t>& shaders) {
+		uint32_t program = glCreateProgram();
+		shaders.clear();
+		for (size_t i = 0; i < types.size(); i++) {
+			uint32_t shader = glCreateShader(types[i]);
+			const char* source = sources[i].c_str();
+			glShaderSource(shader, 1, &source, nullptr);
+			glCompileShader(shader);
+			glAttachShader(program, shader);
+			shaders.push_back(shader);
+		}
+		if (binariesSupported()) {
+			glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+		glLinkProgram(program);
+		return program;
+	}
+
+	// Waits for the build, deletes its shaders, and returns its error log, or an empty string
+	// if it linked. A program that didn't link is deleted too.
+	std::string finishBuild(uint32_t program, std::vector<uint32_t>& shaders) {
+		std::string log;
+		for (auto shader : shaders) {
+			int32_t success = 0;
+			glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+			if (!success && log.empty()) {
+				int32_t length = 0;
+				glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+				log.resize(std::max(length, 1));
+				glGetShaderInfoLog(shader, length, nullptr, log.data());
+				log.resize(std::strlen(log.c_str()));
+			}
+		}
+		int32_t success = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success && log.empty()) {
+			int32_t length = 0;
+			glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+			log.resize(std::max(length, 1));
+			glGetProgramInfoLog(program, length, nullptr, log.data());
+			log.resize(std::strlen(log.c_str()));
+		}
+
+		for (auto shader : shaders) {
+			glDetachShader(program, shader);
+			glDeleteShader(shader);
+		}
+		shaders.clear();
+		if (!success) {
+			glDeleteProgram(program);
+			if (log.empty()) {
+				log = "Failed to link shader program";
+			}
+		}
+		return success ? std::string() : log;
+	}
+
+	// Deletes a build that is no longer wanted, whether or not it is done.
+	void discardBuild(uint32_t program, std::vector<uint32_t>& shaders) {
+		for (auto shader : shaders) {
+			glDeleteShader(shader);
+		}
+		shaders.clear();
+		glDeleteProgram(program);
+	}
+
+	std::string describe(const std::vector<std::string>& paths) {
+		std::string description;
+		for (auto& path : paths) {
+			description += (description.empty() ? "" : " and ") + path;
+		}
+		return description;
+	}
+}
+
+ShaderCache::ShaderCache(std::filesystem::path binaryDirectory)
+	: m_binaryDirectory(std::move(binaryDirectory)), m_hotReload(false), m_lastCheck(std::chrono::steady_clock::now()) {
+}
+
+ShaderCache::~ShaderCache() {
+	for (auto& entry : m_entries) {
+		if (entry.pendingProgram != 0) {
+			discardBuild(entry.pendingProgram, entry.pendingShaders);
+		}
+	}
+}
+
+ShaderProgram ShaderCache::load(const std::string& vertexShaderPath, const std::string& fragmentShaderPath) {
+	return loadStages({ GL_VERTEX_SHADER, GL_FRAGMENT_SHADER }, { vertexShaderPath, fragmentShaderPath });
+}
+
+ShaderProgram ShaderCache::loadCompute(const std::string& computeShaderPath) {
+	return loadStages({ GL_COMPUTE_SHADER }, { computeShaderPath });
+}
+
+ShaderProgram ShaderCache::loadStages(std::vector<uint32_t> types, std::vector<std::string> paths) {
+	std::vector<std::string> sources;
+	std::vector<std::filesystem::file_time_type> writeTimes;
+	for (auto& path : paths) {
+		sources.push_back(readSource(path));
+		std::error_code error;
+		writeTimes.push_back(std::filesystem::last_write_time(path, error));
+	}
+	uint64_t sourceHash = hashSources(types, sources);
+	for (auto& entry : m_entries) {
+		if (entry.sourceHash == sourceHash) {
+			return entry.program;
+		}
+	}
+
+	uint32_t program = loadBinary(sourceHash);
+	if (program == 0) {
+		std::vector<uint32_t> shaders;
+		program = startBuild(types, sources, shaders);
+		auto log = finishBuild(program, shaders);
+		if (!log.empty()) {
+			throw std::runtime_error(log);
+		}
+		saveBinary(sourceHash, program);
+	}
+	m_entries.push_back({ std::move(types), std::move(paths), std::move(writeTimes), sourceHash,
+		ShaderProgram(program), 0, {}, 0 });
+	return m_entries.back().program;
+}
+
+std::filesystem::path ShaderCache::binaryPath(uint64_t sourceHash) const {
+	std::ostringstream name;
+	name << std::hex << std::setw(16) << std::setfill('0') << sourceHash << ".bin";
+	return m_binaryDirectory / name.str();
+}
+
+uint32_t ShaderCache::loadBinary(uint64_t sourceHash) const {
+	if (!binariesSupported()) {
+		return 0;
+	}
+	std::ifstream file(binaryPath(sourceHash), std::ios::binary);
+	BinaryHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+		|| std::memcmp(header.magic, BINARY_MAGIC, sizeof(header.magic)) != 0
+		|| header.version != BINARY_VERSION
+		|| header.key != (sourceHash ^ driverHash())) {
+		return 0;
+	}
+	std::vector<char> binary(header.length);
+	if (!file.read(binary.data(), binary.size())) {
+		return 0;
+	}
+
+	uint32_t program = glCreateProgram();
+	glProgramBinary(program, header.format, binary.data(), header.length);
+	int32_t success = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success) {
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+void ShaderCache::saveBinary(uint64_t sourceHash, uint32_t program) const {
+	if (!binariesSupported()) {
+		return;
+	}
+	int32_t length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+
+	// A binary that can't be saved only costs a rebuild next run.
+	std::error_code error;
+	std::filesystem::create_directories(m_binaryDirectory, error);
+	std::ofstream file(binaryPath(sourceHash), std::ios::binary | std::ios::trunc);
+	BinaryHeader header = {};
+	std::memcpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+	header.version = BINARY_VERSION;
+	header.key = sourceHash ^ driverHash();
+	header.format = format;
+	header.length = static_cast<uint32_t>(length);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(binary.data(), length);
+	if (!file) {
+		std::cout << "WARNING: could not save a shader binary in " << m_binaryDirectory << std::endl;
+	}
+}
+
+void ShaderCache::setHotReload(bool hotReload) {
+	m_hotReload = hotReload;
+}
+
+bool ShaderCache::getHotReload() const {
+	return m_hotReload;
+}
+
+void ShaderCache::update() {
+	if (!m_hotReload) {
+		return;
+	}
+	for (auto& entry : m_entries) {
+		if (entry.pendingProgram != 0) {
+			finishRebuild(entry);
+		}
+	}
+
+	auto now = std::chrono::steady_clock::now();
+	if (now - m_lastCheck < CHECK_INTERVAL) {
+		return;
+	}
+	m_lastCheck = now;
+	for (auto& entry : m_entries) {
+		bool changed = false;
+		for (size_t i = 0; i < entry.paths.size(); i++) {
+			std::error_code error;
+			auto writeTime = std::filesystem::last_write_time(entry.paths[i], error);
+			if (!error && writeTime != entry.writeTimes[i]) {
+				entry.writeTimes[i] = writeTime;
+				changed = true;
+			}
+		}
+		if (!changed) {
+			continue;
+		}
+
+		std::vector<std::string> sources;
+		try {
+			for (auto& path : entry.paths) {
+				sources.push_back(readSource(path));
+			}
+		}
+		catch (std::runtime_error& e) {
+			std::cout << "WARNING: " << e.what() << std::endl;
+			continue;
+		}
+		// Saving a file without changing it, or back to what is being built, needs no rebuild.
+		uint64_t sourceHash = hashSources(entry.types, sources);
+		if (sourceHash == entry.sourceHash && entry.pendingProgram == 0) {
+			continue;
+		}
+		if (entry.pendingProgram != 0 && sourceHash == entry.pendingHash) {
+			continue;
+		}
+		startRebuild(entry, sources, sourceHash);
+	}
+}
+
+void ShaderCache::startRebuild(Entry& entry, const std::vector<std::string>& sources, uint64_t sourceHash) {
+	// A rebuild of an older edit is dropped.
+	if (entry.pendingProgram != 0) {
+		discardBuild(entry.pendingProgram, entry.pendingShaders);
+		entry.pendingProgram = 0;
+	}
+	if (sourceHash == entry.sourceHash) {
+		return;
+	}
+	entry.pendingProgram = startBuild(entry.types, sources, entry.pendingShaders);
+	entry.pendingHash = sourceHash;
+	// Without parallel compilation, the build is already done, or blocks until it is.
+	if (!parallelCompileSupported()) {
+		finishRebuild(entry);
+	}
+}
+
+void ShaderCache::finishRebuild(Entry& entry) {
+	if (parallelCompileSupported()) {
+		int32_t done = 0;
+		glGetProgramiv(entry.pendingProgram, GL_COMPLETION_STATUS_KHR, &done);
+		if (!done) {
+			return;
+		}
+	}
+
+	uint32_t program = entry.pendingProgram;
+	entry.pendingProgram = 0;
+	auto log = finishBuild(program, entry.pendingShaders);
+	if (!log.empty()) {
+		std::cout << "ERROR: reloading " << describe(entry.paths) << ": " << log << std::endl;
+		return;
+	}
+	entry.program.replaceProgram(program);
+	entry.sourceHash = entry.pendingHash;
+	saveBinary(entry.sourceHash, program);
+	std::cout << "Reloaded " << describe(entry.paths) << std::endl;
+}
+
+size_t ShaderCache::getProgramCount() const {
+	return m_entries.size();
+}
@@ -1,14 +1,97 @@
 #include "ShaderProgram.h"
 #include <glad/glad.h>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include "Profiler.h"
+#include "UniformBuffer.h"
+
+namespace {
+    // Sets every uniform of the target program to its value in the source program, where the
+    // two have a uniform of the same name and type. Samplers are copied as the texture units
+    // they read from.
+    void copyUniformValues(uint32_t source, uint32_t target)
+    {
+        int32_t previousProgram = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+        glUseProgram(target);
+
+        int32_t maxNameLength = 0, uniformCount = 0;
+        glGetProgramiv(target, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+        glGetProgramiv(target, GL_ACTIVE_UNIFORMS, &uniformCount);
+        std::unordered_map<std::string, GLenum> targetTypes;
+        std::string name(std::max(maxNameLength, 1), '\0');
+        for (int32_t i = 0; i < uniformCount; i++) {
+            int32_t nameLength = 0, arraySize = 0;
+            GLenum type;
+            glGetActiveUniform(target, i, maxNameLength, &nameLength, &arraySize, &type, name.data());
+            targetTypes[name.substr(0, nameLength)] = type;
+        }
+
+        glGetProgramiv(source, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+        glGetProgramiv(source, GL_ACTIVE_UNIFORMS, &uniformCount);
+        name.assign(std::max(maxNameLength, 1), '\0');
+        for (int32_t i = 0; i < uniformCount; i++) {
+            int32_t nameLength = 0, arraySize = 0;
+            GLenum type;
+            glGetActiveUniform(source, i, maxNameLength, &nameLength, &arraySize, &type, name.data());
+            std::string uniformName = name.substr(0, nameLength);
+            auto targetType = targetTypes.find(uniformName);
+            if (targetType == targetTypes.end() || targetType->second != type) {
+                continue;
+            }
+
+            // Arrays are copied element by element, as "name[0]", "name[1]" and so on.
+            auto bracket = uniformName.find('[');
+            std::string baseName = uniformName.substr(0, bracket);
+            for (int32_t element = 0; element < arraySize; element++) {
+                std::string elementName = bracket == std::string::npos ? baseName
+                    : baseName + "[" + std::to_string(element) + "]";
+                int32_t from = glGetUniformLocation(source, elementName.c_str());
+                int32_t to = glGetUniformLocation(target, elementName.c_str());
+                if (from < 0 || to < 0) {
+                    continue;
+                }
+                float floats[16];
+                int32_t ints[4];
+                switch (type) {
+                case GL_FLOAT: glGetUniformfv(source, from, floats); glUniform1fv(to, 1, floats); break;
+                case GL_FLOAT_VEC2: glGetUniformfv(source, from, floats); glUniform2fv(to, 1, floats); break;
+                case GL_FLOAT_VEC3: glGetUniformfv(source, from, floats); glUniform3fv(to, 1, floats); break;
+                case GL_FLOAT_VEC4: glGetUniformfv(source, from, floats); glUniform4fv(to, 1, floats); break;
+                case GL_FLOAT_MAT2: glGetUniformfv(source, from, floats); glUniformMatrix2fv(to, 1, false, floats); break;
+                case GL_FLOAT_MAT3: glGetUniformfv(source, from, floats); glUniformMatrix3fv(to, 1, false, floats); break;
+                case GL_FLOAT_MAT4: glGetUniformfv(source, from, floats); glUniformMatrix4fv(to, 1, false, floats); break;
+                case GL_INT:
+                case GL_BOOL:
+                case GL_SAMPLER_2D:
+                case GL_SAMPLER_2D_ARRAY:
+                case GL_SAMPLER_CUBE:
+                    glGetUniformiv(source, from, ints);
+                    glUniform1iv(to, 1, ints);
+                    break;
+                default:
+                    // Vectors of integers and the rarer types aren't used by this project's shaders.
+                    break;
+                }
+            }
+        }
+        glUseProgram(previousProgram);
+    }
+}
 
 ShaderProgram::ShaderProgram()
-    : m_programId(-1) {
+    : m_linked(std::make_shared<Linked>(Linked{ static_cast<uint32_t>(-1) })) {
 
 }
 
+ShaderProgram::ShaderProgram(uint32_t programId)
+    : m_linked(std::make_shared<Linked>(Linked{ programId }))
+{
+    cacheUniformLocations();
+}
+
 
 
 void ShaderProgram::load(const std::string& vertexShaderPath, const std::string& fragmentShaderPath)
@@ -72,70 +155,254 @@ void ShaderProgram::load(const std::string& vertexShaderPath, const std::string&
         throw std::runtime_error(infoLog);
     };
 
-    // shader Program
-    m_programId = glCreateProgram();
-    glAttachShader(m_programId, vertex);
-    glAttachShader(m_programId, fragment);
-    glLinkProgram(m_programId);
+    // shader Program, not shared with copies made before this load
+    m_linked = std::make_shared<Linked>();
+    m_linked->programId = glCreateProgram();
+    glAttachShader(m_linked->programId, vertex);
+    glAttachShader(m_linked->programId, fragment);
+    glLinkProgram(m_linked->programId);
     // print linking errors if any
-    glGetProgramiv(m_programId, GL_LINK_STATUS, &success);
+    glGetProgramiv(m_linked->programId, GL_LINK_STATUS, &success);
     if (!success)
     {
-        glGetProgramInfoLog(m_programId, 512, NULL, infoLog);
+        glGetProgramInfoLog(m_linked->programId, 512, NULL, infoLog);
         throw std::runtime_error(infoLog);
     }
 
     // delete the shaders as they're linked into our program now and no longer necessary
     glDeleteShader(vertex);
     glDeleteShader(fragment);
+
+    cacheUniformLocations();
+}
+
+void ShaderProgram::loadCompute(const std::string& computeShaderPath)
+{
+    std::string computeCode;
+    std::ifstream cShaderFile;
+    cShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    try
+    {
+        cShaderFile.open(computeShaderPath);
+        std::stringstream cShaderStream;
+        cShaderStream << cShaderFile.rdbuf();
+        cShaderFile.close();
+        computeCode = cShaderStream.str();
+    }
+    catch (std::ifstream::failure& e)
+    {
+        throw std::runtime_error("Failed to locate compute shader file " + computeShaderPath);
+    }
+
+    const char* cShaderCode = computeCode.c_str();
+    int success;
+    char infoLog[512];
+
+    unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(compute, 1, &cShaderCode, NULL);
+    glCompileShader(compute);
+    glGetShaderiv(compute, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(compute, 512, NULL, infoLog);
+        throw std::runtime_error(infoLog);
+    }
+
+    m_linked = std::make_shared<Linked>();
+    m_linked->programId = glCreateProgram();
+    glAttachShader(m_linked->programId, compute);
+    glLinkProgram(m_linked->programId);
+    glGetProgramiv(m_linked->programId, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(m_linked->programId, 512, NULL, infoLog);
+        throw std::runtime_error(infoLog);
+    }
+    glDeleteShader(compute);
+
+    cacheUniformLocations();
+}
+
+void ShaderProgram::cacheUniformLocations()
+{
+    m_linked->uniformLocations.clear();
+
+    int32_t uniformCount = 0, maxNameLength = 0;
+    glGetProgramiv(m_linked->programId, GL_ACTIVE_UNIFORMS, &uniformCount);
+    glGetProgramiv(m_linked->programId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+    std::string name(maxNameLength, '\0');
+    for (int32_t i = 0; i < uniformCount; i++) {
+        int32_t nameLength = 0, arraySize = 0;
+        GLenum type;
+        glGetActiveUniform(m_linked->programId, i, maxNameLength, &nameLength, &arraySize, &type, name.data());
+        std::string uniformName = name.substr(0, nameLength);
+
+        // Members of uniform blocks have no location of their own.
+        int32_t location = glGetUniformLocation(m_linked->programId, uniformName.c_str());
+        if (location < 0) {
+            continue;
+        }
+        m_linked->uniformLocations[uniformName] = location;
+
+        // Arrays are reported as "name[0]"; also register the bare name and every element.
+        auto bracket = uniformName.find('[');
+        if (bracket != std::string::npos) {
+            auto baseName = uniformName.substr(0, bracket);
+            m_linked->uniformLocations[baseName] = location;
+            for (int32_t element = 1; element < arraySize; element++) {
+                auto elementName = baseName + "[" + std::to_string(element) + "]";
+                m_linked->uniformLocations[elementName] = glGetUniformLocation(m_linked->programId, elementName.c_str());
+            }
+        }
+    }
+
+    // Each block reads from its name's binding point, the same one in every program.
+    m_linked->uniformBlocks.clear();
+    int32_t blockCount = 0, maxBlockNameLength = 0;
+    glGetProgramiv(m_linked->programId, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+    glGetProgramiv(m_linked->programId, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxBlockNameLength);
+    std::string blockName(maxBlockNameLength, '\0');
+    for (int32_t i = 0; i < blockCount; i++) {
+        int32_t nameLength = 0;
+        glGetActiveUniformBlockName(m_linked->programId, i, maxBlockNameLength, &nameLength, blockName.data());
+        m_linked->uniformBlocks.push_back(blockName.substr(0, nameLength));
+        glUniformBlockBinding(m_linked->programId, i, UniformBuffer::bindingPoint(m_linked->uniformBlocks.back()));
+    }
 }
 
 void ShaderProgram::activate()
 {
-    glUseProgram(m_programId);
+    glUseProgram(m_linked->programId);
+    Profiler::count(Profiler::Counter::StateChanges);
+}
+
+uint32_t ShaderProgram::getId() const
+{
+    return m_linked->programId;
+}
+
+void ShaderProgram::replaceProgram(uint32_t programId)
+{
+    uint32_t oldProgramId = m_linked->programId;
+    m_linked->programId = programId;
+    cacheUniformLocations();
+    if (oldProgramId != static_cast<uint32_t>(-1)) {
+        copyUniformValues(oldProgramId, programId);
+        glDeleteProgram(oldProgramId);
+    }
+}
+
+UniformHandle ShaderProgram::getUniformHandle(const std::string& uniformName) const
+{
+    auto it = m_linked->uniformLocations.find(uniformName);
+    if (it == m_linked->uniformLocations.end()) {
+        return UniformHandle{};
+    }
+    return UniformHandle{ it->second };
+}
+
+bool ShaderProgram::hasUniformBlock(const std::string& blockName) const
+{
+    auto& blocks = m_linked->uniformBlocks;
+    return std::find(blocks.begin(), blocks.end(), blockName) != blocks.end();
 }
 
 void ShaderProgram::setUniform(const std::string& uniformName, bool value)
 {
-    glUniform1i(glGetUniformLocation(m_programId, uniformName.c_str()), (int32_t)value);
+    setUniform(getUniformHandle(uniformName), value);
 }
 
 void ShaderProgram::setUniform(const std::string& uniformName, int32_t value)
 {
-    glUniform1i(glGetUniformLocation(m_programId, uniformName.c_str()), value);
+    setUniform(getUniformHandle(uniformName), value);
 }
 
 void ShaderProgram::setUniform(const std::string& uniformName, float value)
 {
-    glUniform1f(glGetUniformLocation(m_programId, uniformName.c_str()), (int)value);
+    setUniform(getUniformHandle(uniformName), value);
 }
 
 void ShaderProgram::setUniform(const std::string& uniformName, const glm::vec2& value)
 {
-    glUniform2fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, &value[0]);
+    setUniform(getUniformHandle(uniformName), value);
 }
 
 void ShaderProgram::setUniform(const std::string& uniformName, const glm::vec3& value)
 {
-    glUniform3fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, &value[0]);
+    setUniform(getUniformHandle(uniformName), value);
 }
 
 void ShaderProgram::setUniform(const std::string& uniformName, const glm::vec4& value)
 {
-    glUniform4fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, &value[0]);
+    setUniform(getUniformHandle(uniformName), value);
 }
 
 void ShaderProgram::setUniform(const std::string& uniformName, const glm::mat2& value)
 {
-    glUniformMatrix2fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, false, &value[0][0]);
+    setUniform(getUniformHandle(uniformName), value);
 }
 
 void ShaderProgram::setUniform(const std::string& uniformName, const glm::mat3& value)
 {
-    glUniformMatrix3fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, false, &value[0][0]);
+    setUniform(getUniformHandle(uniformName), value);
 }
 
 void ShaderProgram::setUniform(const std::string& uniformName, const glm::mat4& value)
 {
-    glUniformMatrix4fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, false, &value[0][0]);
+    setUniform(getUniformHandle(uniformName), value);
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, bool value)
+{
+    glUniform1i(uniform.location, (int32_t)value);
+    Profiler::count(Profiler::Counter::UniformUploads);
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, int32_t value)
+{
+    glUniform1i(uniform.location, value);
+    Profiler::count(Profiler::Counter::UniformUploads);
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, float value)
+{
+    glUniform1f(uniform.location, value);
+    Profiler::count(Profiler::Counter::UniformUploads);
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::vec2& value)
+{
+    glUniform2fv(uniform.location, 1, &value[0]);
+    Profiler::count(Profiler::Counter::UniformUploads);
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::vec3& value)
+{
+    glUniform3fv(uniform.location, 1, &value[0]);
+    Profiler::count(Profiler::Counter::UniformUploads);
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::vec4& value)
+{
+    glUniform4fv(uniform.location, 1, &value[0]);
+    Profiler::count(Profiler::Counter::UniformUploads);
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::mat2& value)
+{
+    glUniformMatrix2fv(uniform.location, 1, false, &value[0][0]);
+    Profiler::count(Profiler::Counter::UniformUploads);
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::mat3& value)
+{
+    glUniformMatrix3fv(uniform.location, 1, false, &value[0][0]);
+    Profiler::count(Profiler::Counter::UniformUploads);
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::mat4& value)
+{
+    glUniformMatrix4fv(uniform.location, 1, false, &value[0][0]);
+    Profiler::count(Profiler::Counter::UniformUploads);
 }
@@ -1,19 +1,38 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "StbImage.h"
 
+#include <climits>
 #include <string>
 #include <iostream>
+#include "MappedFile.h"
 
 StbImage::StbImage() : m_width(0), m_height(0), m_bpp(0) {
 }
 
 void StbImage::loadFromFile(const std::string& filepath) {
-    unsigned char* data = stbi_load(filepath.c_str(), &m_width, &m_height, &m_bpp, 4);
-
-    if (data == nullptr)
+    MappedFile file;
+    file.open(filepath);
+    try {
+        loadFromMemory(file.getData(), file.getSize());
+    }
+    catch (std::exception&) {
         throw std::runtime_error("Could not load file " + filepath);
+    }
+}
+
+void StbImage::loadFromMemory(const unsigned char* data, size_t size) {
+    unsigned char* pixels = nullptr;
+    if (data != nullptr && size <= INT_MAX)
+        pixels = stbi_load_from_memory(data, static_cast<int>(size), &m_width, &m_height, &m_bpp, 4);
+
+    if (pixels == nullptr)
+        throw std::runtime_error("Could not decode image");
+
+    m_data.reset(pixels);
+}
 
-    m_data = std::unique_ptr<unsigned char[]>(data);
+void StbImage::release() {
+    m_data.reset();
 }
 
 int StbImage::getWidth() const { return m_width; }
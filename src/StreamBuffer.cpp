@@ -0,0 +1,136 @@
+#include "StreamBuffer.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <stdexcept>
+#include "GlCapabilities.h"
+#include "GpuResources.h"
+
+StreamBuffer::StreamBuffer(uint32_t target, size_t regionSize, size_t framesInFlight)
+	: m_target(target), m_regionSize(regionSize), m_fences(framesInFlight, nullptr),
+	m_region(framesInFlight - 1), m_regionUsed(0), m_persistentData(nullptr), m_mapped(false) {
+	createStorage();
+}
+
+void StreamBuffer::createStorage() {
+	size_t size = m_regionSize * m_fences.size();
+	m_persistentData = nullptr;
+
+	glGenBuffers(1, &m_buffer);
+	glBindBuffer(m_target, m_buffer);
+	if (hasGlVersion(4, 4)) {
+		// Immutable storage, mapped for the buffer's whole life. Coherent, so writes become
+		// visible to the GPU without explicit flushes.
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(m_target, size, nullptr, flags);
+		m_persistentData = static_cast<unsigned char*>(glMapBufferRange(m_target, 0, size, flags));
+	}
+	else {
+		glBufferData(m_target, size, nullptr, GL_STREAM_DRAW);
+	}
+	glBindBuffer(m_target, 0);
+}
+
+StreamBuffer::~StreamBuffer() {
+	for (auto fence : m_fences) {
+		if (fence != nullptr) {
+			glDeleteSync(fence);
+		}
+	}
+	if (m_persistentData != nullptr) {
+		glBindBuffer(m_target, m_buffer);
+		glUnmapBuffer(m_target);
+		glBindBuffer(m_target, 0);
+	}
+	glDeleteBuffers(1, &m_buffer);
+}
+
+void StreamBuffer::grow(size_t regionSize) {
+	if (regionSize <= m_regionSize) {
+		return;
+	}
+	unmap();
+	if (m_persistentData != nullptr) {
+		glBindBuffer(m_target, m_buffer);
+		glUnmapBuffer(m_target);
+		glBindBuffer(m_target, 0);
+	}
+	// Draws already issued this frame still read the old buffer; it goes once they are done.
+	GpuResources::shared().destroyBuffer(m_buffer);
+	// Nothing has been drawn from the new buffer yet, so none of its regions need waiting for.
+	for (auto& fence : m_fences) {
+		if (fence != nullptr) {
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+	m_regionSize = std::max(regionSize, m_regionSize * 2);
+	m_regionUsed = 0;
+	createStorage();
+}
+
+void StreamBuffer::beginFrame() {
+	m_region = (m_region + 1) % m_fences.size();
+	m_regionUsed = 0;
+
+	auto& fence = m_fences[m_region];
+	if (fence != nullptr) {
+		waitForFence(fence);
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+}
+
+void StreamBuffer::endFrame() {
+	m_fences[m_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool StreamBuffer::hasRoom(size_t size, size_t alignment) const {
+	size_t alignedUsed = (m_regionUsed + alignment - 1) / alignment * alignment;
+	return alignedUsed + size <= m_regionSize;
+}
+
+void* StreamBuffer::map(size_t size, size_t alignment, size_t& offset) {
+	if (!hasRoom(size, alignment)) {
+		throw std::runtime_error("StreamBuffer region is full");
+	}
+	size_t previousUsed = m_regionUsed;
+	size_t alignedUsed = (m_regionUsed + alignment - 1) / alignment * alignment;
+	m_regionUsed = alignedUsed + size;
+	offset = m_region * m_regionSize + alignedUsed;
+
+	if (m_persistentData != nullptr) {
+		return m_persistentData + offset;
+	}
+	glBindBuffer(m_target, m_buffer);
+	auto* data = glMapBufferRange(m_target, offset, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (data == nullptr) {
+		// Out of memory, or the context was lost: give the reservation back.
+		glBindBuffer(m_target, 0);
+		m_regionUsed = previousUsed;
+		return nullptr;
+	}
+	m_mapped = true;
+	return data;
+}
+
+void StreamBuffer::unmap() {
+	if (m_mapped) {
+		glBindBuffer(m_target, m_buffer);
+		glUnmapBuffer(m_target);
+		glBindBuffer(m_target, 0);
+		m_mapped = false;
+	}
+}
+
+uint32_t StreamBuffer::getBuffer() const {
+	return m_buffer;
+}
+
+size_t StreamBuffer::getRegionSize() const {
+	return m_regionSize;
+}
+
+bool StreamBuffer::isPersistent() const {
+	return m_persistentData != nullptr;
+}
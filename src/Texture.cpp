@@ -0,0 +1,234 @@
+#include "Texture.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstring>
+#include "GpuResources.h"
+#include "StreamBuffer.h"
+
+namespace {
+	// Shared by all textures, so that a version number identifies one texture's contents.
+	uint64_t latestVersion = 0;
+
+	// Staged pixels start at offsets aligned for any format's rows.
+	const size_t STAGING_ALIGNMENT = 16;
+
+	/**
+	 * @brief Copies pixels into the staging buffer, if there is one with room left this frame,
+	 * and binds it as the unpack buffer. Returns what to pass to glTexImage2D for them: their
+	 * offset in the staging buffer, or the pixels themselves if they weren't staged.
+	 */
+	const void* stagePixels(StreamBuffer* staging, const void* data, size_t size) {
+		if (staging == nullptr || data == nullptr || !staging->hasRoom(size, STAGING_ALIGNMENT)) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			return data;
+		}
+		size_t offset;
+		auto* staged = staging->map(size, STAGING_ALIGNMENT, offset);
+		if (staged == nullptr) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			return data;
+		}
+		std::memcpy(staged, data, size);
+		staging->unmap();
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging->getBuffer());
+		return reinterpret_cast<const void*>(offset);
+	}
+}
+
+Texture::Texture() : m_width(1), m_height(1), m_format(GL_RGBA8), m_levelSizes{ 4 }, m_baseLevel(0),
+	m_version(++latestVersion) {
+	const unsigned char grey[4] = { 128, 128, 128, 255 };
+
+	m_textureId = GpuResources::shared().createTexture();
+	glBindTexture(GL_TEXTURE_2D, m_textureId);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+Texture::Texture(const StbImage& image) : m_baseLevel(0), m_version(0) {
+	// Generate a texture on the GPU.
+	m_textureId = GpuResources::shared().createTexture();
+	upload(image);
+}
+
+Texture::~Texture() {
+	GpuResources::shared().destroyTexture(m_textureId);
+}
+
+void Texture::upload(const StbImage& image, StreamBuffer* staging) {
+	m_version = ++latestVersion;
+	m_width = image.getWidth();
+	m_height = image.getHeight();
+	m_format = GL_RGBA8;
+	m_baseLevel = 0;
+	m_levelSizes.clear();
+	for (int width = m_width, height = m_height;; width = std::max(width / 2, 1), height = std::max(height / 2, 1)) {
+		m_levelSizes.push_back(static_cast<size_t>(width) * height * 4);
+		if (width == 1 && height == 1) {
+			break;
+		}
+	}
+
+	glBindTexture(GL_TEXTURE_2D, m_textureId);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+	auto* pixels = stagePixels(staging, image.getData(), m_levelSizes[0]);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.getWidth(), image.getHeight(), 0, GL_RGBA,
+		GL_UNSIGNED_BYTE, pixels);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+Texture::Texture(const CompressedImage& image) : m_baseLevel(0), m_version(0) {
+	m_textureId = GpuResources::shared().createTexture();
+	upload(image);
+}
+
+void Texture::upload(const CompressedImage& image, StreamBuffer* staging) {
+	m_version = ++latestVersion;
+	m_width = image.getWidth();
+	m_height = image.getHeight();
+	auto& levels = image.getLevels();
+	m_format = image.getFormat();
+	m_baseLevel = 0;
+	m_levelSizes.clear();
+	for (auto& level : levels) {
+		m_levelSizes.push_back(level.size);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, m_textureId);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	// The file's mipmap chain may stop short of 1x1; tell OpenGL not to look for more levels.
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<int>(levels.size()) - 1);
+	for (size_t level = 0; level < levels.size(); level++) {
+		auto* data = stagePixels(staging, levels[level].data, levels[level].size);
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, image.getFormat(), levels[level].width, levels[level].height,
+			0, levels[level].size, data);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Texture::setLevelRange() {
+	int last = getLevelCount() - 1;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, last > m_baseLevel ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, m_baseLevel);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, last);
+}
+
+void Texture::upload(const MipChain& chain, StreamBuffer* staging) {
+	auto& levels = chain.getLevels();
+	m_version = ++latestVersion;
+	glBindTexture(GL_TEXTURE_2D, m_textureId);
+
+	bool sameImage = chain.getFormat() == m_format && levels.size() == m_levelSizes.size()
+		&& levels[0].width == m_width && levels[0].height == m_height;
+	if (!sameImage) {
+		// None of the new image's levels are on the GPU yet; free the old image's, except for
+		// those about to be replaced.
+		for (int level = m_baseLevel; level < getLevelCount(); level++) {
+			if (level < chain.getFirstLevel() || level >= static_cast<int>(levels.size())) {
+				glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			}
+		}
+		m_width = levels[0].width;
+		m_height = levels[0].height;
+		m_format = chain.getFormat();
+		m_levelSizes.clear();
+		for (auto& level : levels) {
+			m_levelSizes.push_back(level.size);
+		}
+		m_baseLevel = getLevelCount();
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+
+	for (int level = chain.getFirstLevel(); level < m_baseLevel; level++) {
+		auto& data = levels[level];
+		auto* pixels = stagePixels(staging, data.data, data.size);
+		if (chain.isCompressed()) {
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, m_format, data.width, data.height, 0, data.size, pixels);
+		}
+		else {
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, data.width, data.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		}
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	m_baseLevel = std::min(m_baseLevel, chain.getFirstLevel());
+	setLevelRange();
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Texture::evictLevels(int baseLevel) {
+	baseLevel = std::min(baseLevel, getLevelCount() - 1);
+	if (baseLevel <= m_baseLevel) {
+		return;
+	}
+	m_version = ++latestVersion;
+	glBindTexture(GL_TEXTURE_2D, m_textureId);
+	// Redefining a level as empty frees its memory; it is outside the sampled range anyway.
+	for (int level = m_baseLevel; level < baseLevel; level++) {
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	}
+	m_baseLevel = baseLevel;
+	setLevelRange();
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+uint32_t Texture::getId() const {
+	return m_textureId;
+}
+
+int Texture::getWidth() const {
+	return m_width;
+}
+
+int Texture::getHeight() const {
+	return m_height;
+}
+
+uint32_t Texture::getFormat() const {
+	return m_format;
+}
+
+uint64_t Texture::getVersion() const {
+	return m_version;
+}
+
+uint64_t Texture::getLatestVersion() {
+	return latestVersion;
+}
+
+int Texture::getLevelCount() const {
+	return static_cast<int>(m_levelSizes.size());
+}
+
+int Texture::getBaseLevel() const {
+	return m_baseLevel;
+}
+
+size_t Texture::getLevelSize(int level) const {
+	return m_levelSizes[level];
+}
+
+size_t Texture::getResidentSize() const {
+	size_t size = 0;
+	for (int level = m_baseLevel; level < getLevelCount(); level++) {
+		size += m_levelSizes[level];
+	}
+	return size;
+}
@@ -0,0 +1,57 @@
+#include "TextureManager.h"
+#include <filesystem>
+
+std::string TextureManager::keyFor(const std::string& filepath) {
+	// Different spellings of the same path ("models/../models/wall.jpg") share one texture.
+	std::error_code error;
+	auto canonical = std::filesystem::weakly_canonical(filepath, error);
+	return error ? filepath : canonical.string();
+}
+
+std::shared_ptr<Texture> TextureManager::load(const std::string& filepath) {
+	auto& entry = m_textures[keyFor(filepath)];
+	if (auto texture = entry.lock()) {
+		return texture;
+	}
+
+	// Prefer a pre-compressed version of the image, which is smaller on the GPU and comes with
+	// its mipmaps; fall back to decoding the image itself.
+	std::shared_ptr<Texture> texture;
+	CompressedImage compressed;
+	if (compressed.loadCompressedVersionOf(filepath)) {
+		texture = std::make_shared<Texture>(compressed);
+	}
+	else {
+		StbImage image;
+		image.loadFromFile(filepath);
+		texture = std::make_shared<Texture>(image);
+	}
+	entry = texture;
+	return texture;
+}
+
+std::shared_ptr<Texture> TextureManager::find(const std::string& filepath) const {
+	auto it = m_textures.find(keyFor(filepath));
+	if (it == m_textures.end()) {
+		return nullptr;
+	}
+	return it->second.lock();
+}
+
+void TextureManager::insert(const std::string& filepath, const std::shared_ptr<Texture>& texture) {
+	m_textures[keyFor(filepath)] = texture;
+}
+
+void TextureManager::collect() {
+	std::erase_if(m_textures, [](const auto& entry) { return entry.second.expired(); });
+}
+
+size_t TextureManager::getTextureCount() const {
+	size_t count = 0;
+	for (auto& [path, texture] : m_textures) {
+		if (!texture.expired()) {
+			count++;
+		}
+	}
+	return count;
+}
@@ -0,0 +1,302 @@
+#include "TexturePacker.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <map>
+#include "GlCapabilities.h"
+#include "GpuResources.h"
+
+namespace {
+	bool canCopyImages() {
+		static bool supported = hasGlVersion(4, 3) || hasGlExtension("GL_ARB_copy_image");
+		return supported;
+	}
+
+	int levelSize(int size, int level) {
+		return std::max(size >> level, 1);
+	}
+
+	bool isPowerOfTwo(int size) {
+		return (size & (size - 1)) == 0;
+	}
+
+	/**
+	 * @brief Copies one level of a texture into a level of an array's layer, at the given
+	 * texel offset, on the GPU if the context can, and through the CPU if not.
+	 */
+	void copyLevel(const Texture& texture, int level, uint32_t array, int arrayLevel, int layer, int x, int y) {
+		int width = levelSize(texture.getWidth(), level);
+		int height = levelSize(texture.getHeight(), level);
+		if (canCopyImages()) {
+			glCopyImageSubData(texture.getId(), GL_TEXTURE_2D, level, 0, 0, 0,
+				array, GL_TEXTURE_2D_ARRAY, arrayLevel, x, y, layer, width, height, 1);
+			return;
+		}
+
+		bool compressed = texture.getFormat() != GL_RGBA8;
+		std::vector<unsigned char> pixels(texture.getLevelSize(level));
+		glBindTexture(GL_TEXTURE_2D, texture.getId());
+		if (compressed) {
+			glGetCompressedTexImage(GL_TEXTURE_2D, level, pixels.data());
+		}
+		else {
+			glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+		if (compressed) {
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, arrayLevel, x, y, layer, width, height, 1,
+				texture.getFormat(), static_cast<GLsizei>(pixels.size()), pixels.data());
+		}
+		else {
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, arrayLevel, x, y, layer, width, height, 1, GL_RGBA,
+				GL_UNSIGNED_BYTE, pixels.data());
+		}
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	}
+}
+
+TexturePacker::TexturePacker() : m_queued(false), m_generation(0), m_maxLayers(0) {
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &m_maxLayers);
+}
+
+TexturePacker::~TexturePacker() {
+	for (auto& group : m_groups) {
+		destroyArrays(group);
+	}
+}
+
+const TexturePacker::Placement* TexturePacker::place(const std::shared_ptr<Texture>& texture) {
+	auto it = m_entries.find(texture.get());
+	if (it != m_entries.end() && it->second.version == texture->getVersion()) {
+		return it->second.packed ? &it->second.placement : nullptr;
+	}
+	// Version numbers are never reused, so this also catches a new texture at a dead one's address.
+	auto& entry = m_entries[texture.get()];
+	entry.texture = texture;
+	entry.version = texture->getVersion();
+	entry.packed = false;
+	m_queued = true;
+	return nullptr;
+}
+
+bool TexturePacker::flush() {
+	bool changed = m_queued;
+	for (auto it = m_entries.begin(); it != m_entries.end();) {
+		if (it->second.texture.expired()) {
+			it = m_entries.erase(it);
+			changed = true;
+		}
+		else {
+			it++;
+		}
+	}
+	if (!changed) {
+		return false;
+	}
+	m_queued = false;
+
+	// Regroup every texture as it is now, and only rebuild the groups whose members changed.
+	std::map<GroupKey, std::vector<std::pair<const Texture*, uint64_t>>> members;
+	for (auto& [texture, entry] : m_entries) {
+		entry.version = texture->getVersion();
+		members[keyFor(*texture)].push_back({ texture, entry.version });
+	}
+	for (auto& [key, list] : members) {
+		std::sort(list.begin(), list.end());
+	}
+
+	bool placementsChanged = false;
+	std::vector<Group> groups;
+	for (auto& group : m_groups) {
+		auto it = members.find(group.key);
+		if (it != members.end() && it->second == group.members) {
+			members.erase(it);
+			groups.push_back(std::move(group));
+			continue;
+		}
+		for (auto& [texture, version] : group.members) {
+			auto entry = m_entries.find(texture);
+			if (entry != m_entries.end()) {
+				entry->second.packed = false;
+			}
+		}
+		destroyArrays(group);
+		placementsChanged = true;
+	}
+	for (auto& [key, list] : members) {
+		// A texture with nothing to share a binding with is best left where it is.
+		if (list.size() < 2) {
+			m_entries[list[0].first].packed = false;
+			continue;
+		}
+		groups.push_back({ key, std::move(list), {} });
+		build(groups.back());
+		placementsChanged = true;
+	}
+	m_groups = std::move(groups);
+	if (placementsChanged) {
+		m_generation++;
+	}
+	return placementsChanged;
+}
+
+uint64_t TexturePacker::getGeneration() const {
+	return m_generation;
+}
+
+size_t TexturePacker::getArrayCount() const {
+	size_t count = 0;
+	for (auto& group : m_groups) {
+		count += group.arrays.size();
+	}
+	return count;
+}
+
+size_t TexturePacker::getPackedCount() const {
+	return std::count_if(m_entries.begin(), m_entries.end(), [](auto& entry) { return entry.second.packed; });
+}
+
+TexturePacker::GroupKey TexturePacker::keyFor(const Texture& texture) {
+	int base = texture.getBaseLevel();
+	int width = levelSize(texture.getWidth(), base);
+	int height = levelSize(texture.getHeight(), base);
+	if (texture.getFormat() == GL_RGBA8 && isPowerOfTwo(width) && isPowerOfTwo(height)
+		&& width <= ATLAS_MAX_TILE_SIZE && height <= ATLAS_MAX_TILE_SIZE) {
+		return { true, 0, 0, GL_RGBA8, 0 };
+	}
+	return { false, width, height, texture.getFormat(), texture.getLevelCount() - base };
+}
+
+void TexturePacker::build(Group& group) {
+	if (group.key.atlas) {
+		buildAtlas(group);
+	}
+	else {
+		buildLayers(group);
+	}
+}
+
+void TexturePacker::buildLayers(Group& group) {
+	auto& key = group.key;
+	bool compressed = key.format != GL_RGBA8;
+	for (size_t first = 0; first < group.members.size(); first += m_maxLayers) {
+		size_t layerCount = std::min(group.members.size() - first, static_cast<size_t>(m_maxLayers));
+		auto sample = m_entries[group.members[first].first].texture.lock();
+		int base = sample->getBaseLevel();
+
+		uint32_t array = GpuResources::shared().createTexture();
+		glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, key.levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, key.levelCount - 1);
+		for (int level = 0; level < key.levelCount; level++) {
+			int width = levelSize(key.width, level);
+			int height = levelSize(key.height, level);
+			auto layers = static_cast<GLsizei>(layerCount);
+			if (compressed) {
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, key.format, width, height, layers, 0,
+					static_cast<GLsizei>(sample->getLevelSize(base + level) * layerCount), nullptr);
+			}
+			else {
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, width, height, layers, 0, GL_RGBA,
+					GL_UNSIGNED_BYTE, nullptr);
+			}
+		}
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		group.arrays.push_back(array);
+
+		for (size_t layer = 0; layer < layerCount; layer++) {
+			auto& entry = m_entries[group.members[first + layer].first];
+			auto texture = entry.texture.lock();
+			for (int level = 0; level < key.levelCount; level++) {
+				copyLevel(*texture, texture->getBaseLevel() + level, array, level, static_cast<int>(layer), 0, 0);
+			}
+			entry.packed = true;
+			entry.placement = { array, static_cast<uint32_t>(layer), glm::vec4(0, 0, 1, 1) };
+		}
+	}
+}
+
+void TexturePacker::buildAtlas(Group& group) {
+	struct Tile {
+		Entry* entry;
+		std::shared_ptr<Texture> texture;
+		int width;
+		int height;
+		int page;
+		int x;
+		int y;
+	};
+	std::vector<Tile> tiles;
+	for (auto& [pointer, version] : group.members) {
+		auto& entry = m_entries[pointer];
+		auto texture = entry.texture.lock();
+		int base = texture->getBaseLevel();
+		tiles.push_back({ &entry, texture, levelSize(texture->getWidth(), base), levelSize(texture->getHeight(), base), 0, 0, 0 });
+	}
+
+	// Shelves of tiles, tallest first. Every size is a power of two, so rounding x up to a
+	// multiple of the tile's width, and starting shelves below taller ones, keeps every tile
+	// at a multiple of its own size.
+	std::sort(tiles.begin(), tiles.end(), [](const Tile& a, const Tile& b) {
+		return a.height != b.height ? a.height > b.height : a.width > b.width;
+	});
+	int page = 0, x = 0, y = 0, shelfHeight = 0;
+	for (auto& tile : tiles) {
+		x = (x + tile.width - 1) / tile.width * tile.width;
+		if (x + tile.width > ATLAS_PAGE_SIZE) {
+			x = 0;
+			y += shelfHeight;
+			shelfHeight = 0;
+		}
+		if (y + tile.height > ATLAS_PAGE_SIZE) {
+			page++;
+			x = y = shelfHeight = 0;
+		}
+		tile.page = page;
+		tile.x = x;
+		tile.y = y;
+		x += tile.width;
+		shelfHeight = std::max(shelfHeight, tile.height);
+	}
+	int pageCount = std::min(page + 1, m_maxLayers);
+
+	uint32_t array = GpuResources::shared().createTexture();
+	glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+	// The shader wraps the coordinates within each tile itself.
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, pageCount, 0, GL_RGBA,
+		GL_UNSIGNED_BYTE, nullptr);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	group.arrays.push_back(array);
+
+	for (auto& tile : tiles) {
+		if (tile.page >= pageCount) {
+			tile.entry->packed = false;
+			continue;
+		}
+		copyLevel(*tile.texture, tile.texture->getBaseLevel(), array, 0, tile.page, tile.x, tile.y);
+		tile.entry->packed = true;
+		tile.entry->placement = { array, static_cast<uint32_t>(tile.page),
+			glm::vec4(tile.x, tile.y, tile.width, tile.height) / static_cast<float>(ATLAS_PAGE_SIZE) };
+	}
+	// Below a tile's 1x1 level its texels blend with its neighbours', which the shader keeps
+	// the tile's sampling from reaching.
+	glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void TexturePacker::destroyArrays(Group& group) {
+	// Draws in flight may still sample the old arrays.
+	for (auto array : group.arrays) {
+		GpuResources::shared().destroyTexture(array);
+	}
+	group.arrays.clear();
+}
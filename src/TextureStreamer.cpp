@@ -0,0 +1,176 @@
+#include "TextureStreamer.h"
+#include <algorithm>
+#include <utility>
+
+namespace {
+	// The most loads in flight at once, so a camera cut doesn't queue a load for every texture
+	// in view ahead of the ones it needs most.
+	const size_t MAX_LOADS = 4;
+}
+
+TextureStreamer::TextureStreamer(size_t budget, int initialSize)
+	: m_budget(budget), m_initialSize(initialSize), m_frame(1), m_residentSize(0), m_loadingSize(0) {
+}
+
+void TextureStreamer::add(const std::shared_ptr<Texture>& texture, const std::string& path) {
+	m_entries[texture.get()] = { texture, path, texture->getBaseLevel(), 0, -1, 0, false };
+}
+
+void TextureStreamer::noteUse(const Texture& texture, float screenSize) {
+	auto it = m_entries.find(&texture);
+	if (it == m_entries.end()) {
+		return;
+	}
+	// The smallest level that still has a texel for every pixel.
+	int size = std::max(texture.getWidth(), texture.getHeight());
+	int level = 0;
+	while (level + 1 < texture.getLevelCount() && (size >> (level + 1)) >= screenSize) {
+		level++;
+	}
+
+	auto& entry = it->second;
+	entry.wantedLevel = entry.lastUsedFrame == m_frame ? std::min(entry.wantedLevel, level) : level;
+	entry.lastUsedFrame = m_frame;
+}
+
+void TextureStreamer::noteUse(const Object3D& object, const glm::mat4& view, const glm::mat4& projection,
+	float viewportHeight) {
+	auto bounds = object.getWorldBounds();
+	float distance = glm::length(glm::vec3(view * glm::vec4(bounds.center, 1))) - bounds.radius;
+	float screenSize = distance > 0 ? bounds.radius * projection[1][1] * viewportHeight / distance : viewportHeight;
+	for (auto& subMesh : object.getMesh()->getSubMeshes()) {
+		if (subMesh.texture) {
+			noteUse(*subMesh.texture, screenSize);
+		}
+	}
+}
+
+int TextureStreamer::keepLevel(const Entry& entry, const Texture& texture) const {
+	int initialLevel = 0;
+	while (initialLevel + 1 < texture.getLevelCount()
+		&& std::max(texture.getWidth() >> initialLevel, texture.getHeight() >> initialLevel) > m_initialSize) {
+		initialLevel++;
+	}
+	return entry.lastUsedFrame == m_frame ? std::min(entry.wantedLevel, initialLevel) : initialLevel;
+}
+
+bool TextureStreamer::makeRoom(size_t size, const Texture* keep) {
+	if (m_residentSize + m_loadingSize + size <= m_budget) {
+		return true;
+	}
+	// Evict nothing unless enough can be evicted; a load that won't fit anyway is no reason to
+	// drop other textures' levels.
+	size_t evictable = 0;
+	for (auto& [key, entry] : m_entries) {
+		if (key == keep || entry.loadingLevel >= 0) {
+			continue;
+		}
+		for (int level = key->getBaseLevel(); level < keepLevel(entry, *key); level++) {
+			evictable += key->getLevelSize(level);
+		}
+	}
+	if (m_residentSize + m_loadingSize + size > m_budget + evictable) {
+		return false;
+	}
+
+	while (m_residentSize + m_loadingSize + size > m_budget) {
+		// The finest level of the texture used longest ago, or the biggest of those.
+		std::shared_ptr<Texture> victim;
+		uint64_t victimLastUsed = 0;
+		for (auto& [key, entry] : m_entries) {
+			auto texture = entry.texture.lock();
+			if (!texture || texture.get() == keep || entry.loadingLevel >= 0
+				|| texture->getBaseLevel() >= keepLevel(entry, *texture)) {
+				continue;
+			}
+			if (!victim || entry.lastUsedFrame < victimLastUsed || (entry.lastUsedFrame == victimLastUsed
+				&& texture->getLevelSize(texture->getBaseLevel()) > victim->getLevelSize(victim->getBaseLevel()))) {
+				victim = std::move(texture);
+				victimLastUsed = entry.lastUsedFrame;
+			}
+		}
+		if (!victim) {
+			return false;
+		}
+		m_residentSize -= victim->getLevelSize(victim->getBaseLevel());
+		victim->evictLevels(victim->getBaseLevel() + 1);
+	}
+	return true;
+}
+
+std::vector<TextureStreamer::Request> TextureStreamer::update() {
+	std::erase_if(m_entries, [](const auto& entry) { return entry.second.texture.expired(); });
+	m_residentSize = 0;
+	size_t loads = 0;
+	for (auto& [key, entry] : m_entries) {
+		m_residentSize += key->getResidentSize();
+		loads += entry.loadingLevel >= 0 ? 1 : 0;
+	}
+	// The budget may have shrunk, or new textures come in.
+	makeRoom(0, nullptr);
+
+	// The textures used this frame with fewer levels than they need, blurriest first.
+	std::vector<std::pair<Entry*, std::shared_ptr<Texture>>> wanting;
+	for (auto& [key, entry] : m_entries) {
+		auto texture = entry.texture.lock();
+		if (texture && !entry.failed && entry.loadingLevel < 0 && entry.lastUsedFrame == m_frame
+			&& entry.wantedLevel < texture->getBaseLevel()) {
+			wanting.emplace_back(&entry, std::move(texture));
+		}
+	}
+	std::sort(wanting.begin(), wanting.end(), [](const auto& a, const auto& b) {
+		return a.second->getBaseLevel() - a.first->wantedLevel > b.second->getBaseLevel() - b.first->wantedLevel;
+	});
+
+	std::vector<Request> requests;
+	for (auto& [entry, texture] : wanting) {
+		if (loads >= MAX_LOADS) {
+			break;
+		}
+		// Settle for a coarser level than wanted if that's all that fits.
+		for (int level = entry->wantedLevel; level < texture->getBaseLevel(); level++) {
+			size_t size = 0;
+			for (int added = level; added < texture->getBaseLevel(); added++) {
+				size += texture->getLevelSize(added);
+			}
+			if (makeRoom(size, texture.get())) {
+				entry->loadingLevel = level;
+				entry->loadingSize = size;
+				m_loadingSize += size;
+				requests.push_back({ texture, entry->path, level });
+				loads++;
+				break;
+			}
+		}
+	}
+
+	m_frame++;
+	return requests;
+}
+
+void TextureStreamer::finished(const Texture& texture, bool loaded) {
+	auto it = m_entries.find(&texture);
+	if (it == m_entries.end() || it->second.loadingLevel < 0) {
+		return;
+	}
+	m_loadingSize -= it->second.loadingSize;
+	it->second.loadingLevel = -1;
+	it->second.loadingSize = 0;
+	it->second.failed = !loaded;
+}
+
+void TextureStreamer::setBudget(size_t budget) {
+	m_budget = budget;
+}
+
+size_t TextureStreamer::getBudget() const {
+	return m_budget;
+}
+
+int TextureStreamer::getInitialSize() const {
+	return m_initialSize;
+}
+
+size_t TextureStreamer::getResidentSize() const {
+	return m_residentSize;
+}
@@ -0,0 +1,372 @@
+#include "TransformStorage.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TRANSFORM_STORAGE_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRANSFORM_STORAGE_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define TRANSFORM_STORAGE_NEON
+#endif
+
+namespace {
+	// Shared by all slots, so that a version number identifies one transformation.
+	std::atomic<uint64_t> nextVersion = 1;
+
+	// Slots per job. A multiple of every batch width, so no batch straddles two jobs.
+	const size_t UPDATE_GRAIN_SIZE = 1024;
+
+	// Sine and cosine after reducing the angle to [-pi/4, pi/4] by a multiple of pi/2, with the
+	// polynomials of Cephes' sinf and cosf. pi/2 is subtracted in three parts, the first with
+	// few enough bits that its product with the multiple is exact below 2^16, which keeps the
+	// result within a few ulp of std::sin and std::cos up to about 100000 radians.
+	const float TWO_OVER_PI = 0.636619772f;
+	const float PI_OVER_TWO_1 = 1.5703125f;
+	const float PI_OVER_TWO_2 = 4.837512969970703125e-4f;
+	const float PI_OVER_TWO_3 = 7.54978995489188216e-8f;
+	const float SIN_1 = -1.6666654611e-1f, SIN_2 = 8.3321608736e-3f, SIN_3 = -1.9515295891e-4f;
+	const float COS_1 = 4.166664568298827e-2f, COS_2 = -1.388731625493765e-3f, COS_3 = 2.443315711809948e-5f;
+
+	/**
+	 * @brief One float, standing in for a SIMD register of one lane: for rebuilding single
+	 * matrices, and the slots after the last whole batch, with the same arithmetic.
+	 */
+	struct Scalar {
+		static constexpr size_t WIDTH = 1;
+		float v;
+
+		static Scalar load(const float* p) { return { *p }; }
+		static Scalar splat(float f) { return { f }; }
+		void store(float* p) const { *p = v; }
+	};
+	Scalar operator+(Scalar a, Scalar b) { return { a.v + b.v }; }
+	Scalar operator-(Scalar a, Scalar b) { return { a.v - b.v }; }
+	Scalar operator*(Scalar a, Scalar b) { return { a.v * b.v }; }
+
+	// The angle minus j times pi/2.
+	template <typename B>
+	B reduceAngle(B x, B j) {
+		x = x - j * B::splat(PI_OVER_TWO_1);
+		x = x - j * B::splat(PI_OVER_TWO_2);
+		return x - j * B::splat(PI_OVER_TWO_3);
+	}
+
+	// The sine and cosine of an angle in [-pi/4, pi/4].
+	template <typename B>
+	void sinCosPolynomial(B y, B& sine, B& cosine) {
+		B z = y * y;
+		sine = ((B::splat(SIN_3) * z + B::splat(SIN_2)) * z + B::splat(SIN_1)) * z * y + y;
+		cosine = ((B::splat(COS_3) * z + B::splat(COS_2)) * z + B::splat(COS_1)) * z * z
+			- B::splat(0.5f) * z + B::splat(1.0f);
+	}
+
+	// Odd quadrants swap the sine and cosine; quadrants 2 and 3 negate the sine, and 1 and 2
+	// the cosine.
+	void sinCos(Scalar x, Scalar& sine, Scalar& cosine) {
+		float j = std::nearbyint(x.v * TWO_OVER_PI);
+		auto quadrant = static_cast<int32_t>(j);
+		Scalar s, c;
+		sinCosPolynomial(reduceAngle(x, Scalar{ j }), s, c);
+		if (quadrant & 1) {
+			std::swap(s, c);
+		}
+		sine.v = (quadrant & 2) ? -s.v : s.v;
+		cosine.v = ((quadrant + 1) & 2) ? -c.v : c.v;
+	}
+
+#if defined(TRANSFORM_STORAGE_AVX2)
+	struct Avx2 {
+		static constexpr size_t WIDTH = 8;
+		__m256 v;
+
+		static Avx2 load(const float* p) { return { _mm256_loadu_ps(p) }; }
+		static Avx2 splat(float f) { return { _mm256_set1_ps(f) }; }
+		void store(float* p) const { _mm256_storeu_ps(p, v); }
+	};
+	Avx2 operator+(Avx2 a, Avx2 b) { return { _mm256_add_ps(a.v, b.v) }; }
+	Avx2 operator-(Avx2 a, Avx2 b) { return { _mm256_sub_ps(a.v, b.v) }; }
+	Avx2 operator*(Avx2 a, Avx2 b) { return { _mm256_mul_ps(a.v, b.v) }; }
+
+	void sinCos(Avx2 x, Avx2& sine, Avx2& cosine) {
+		__m256i quadrant = _mm256_cvtps_epi32(_mm256_mul_ps(x.v, _mm256_set1_ps(TWO_OVER_PI)));
+		Avx2 s, c;
+		sinCosPolynomial(reduceAngle(x, Avx2{ _mm256_cvtepi32_ps(quadrant) }), s, c);
+		__m256i one = _mm256_set1_epi32(1), two = _mm256_set1_epi32(2);
+		__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, one), one));
+		__m256 sineSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant, two), 30));
+		__m256 cosineSign = _mm256_castsi256_ps(
+			_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, one), two), 30));
+		sine.v = _mm256_xor_ps(_mm256_blendv_ps(s.v, c.v, swap), sineSign);
+		cosine.v = _mm256_xor_ps(_mm256_blendv_ps(c.v, s.v, swap), cosineSign);
+	}
+
+	using Batch = Avx2;
+#elif defined(TRANSFORM_STORAGE_SSE2)
+	struct Sse2 {
+		static constexpr size_t WIDTH = 4;
+		__m128 v;
+
+		static Sse2 load(const float* p) { return { _mm_loadu_ps(p) }; }
+		static Sse2 splat(float f) { return { _mm_set1_ps(f) }; }
+		void store(float* p) const { _mm_storeu_ps(p, v); }
+	};
+	Sse2 operator+(Sse2 a, Sse2 b) { return { _mm_add_ps(a.v, b.v) }; }
+	Sse2 operator-(Sse2 a, Sse2 b) { return { _mm_sub_ps(a.v, b.v) }; }
+	Sse2 operator*(Sse2 a, Sse2 b) { return { _mm_mul_ps(a.v, b.v) }; }
+
+	void sinCos(Sse2 x, Sse2& sine, Sse2& cosine) {
+		__m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(x.v, _mm_set1_ps(TWO_OVER_PI)));
+		Sse2 s, c;
+		sinCosPolynomial(reduceAngle(x, Sse2{ _mm_cvtepi32_ps(quadrant) }), s, c);
+		__m128i one = _mm_set1_epi32(1), two = _mm_set1_epi32(2);
+		__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+		__m128 sineSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, two), 30));
+		__m128 cosineSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, one), two), 30));
+		sine.v = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, c.v), _mm_andnot_ps(swap, s.v)), sineSign);
+		cosine.v = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, s.v), _mm_andnot_ps(swap, c.v)), cosineSign);
+	}
+
+	using Batch = Sse2;
+#elif defined(TRANSFORM_STORAGE_NEON)
+	struct Neon {
+		static constexpr size_t WIDTH = 4;
+		float32x4_t v;
+
+		static Neon load(const float* p) { return { vld1q_f32(p) }; }
+		static Neon splat(float f) { return { vdupq_n_f32(f) }; }
+		void store(float* p) const { vst1q_f32(p, v); }
+	};
+	Neon operator+(Neon a, Neon b) { return { vaddq_f32(a.v, b.v) }; }
+	Neon operator-(Neon a, Neon b) { return { vsubq_f32(a.v, b.v) }; }
+	Neon operator*(Neon a, Neon b) { return { vmulq_f32(a.v, b.v) }; }
+
+	void sinCos(Neon x, Neon& sine, Neon& cosine) {
+		int32x4_t quadrant = vcvtnq_s32_f32(vmulq_f32(x.v, vdupq_n_f32(TWO_OVER_PI)));
+		Neon s, c;
+		sinCosPolynomial(reduceAngle(x, Neon{ vcvtq_f32_s32(quadrant) }), s, c);
+		int32x4_t one = vdupq_n_s32(1), two = vdupq_n_s32(2);
+		uint32x4_t swap = vceqq_s32(vandq_s32(quadrant, one), one);
+		uint32x4_t sineSign = vreinterpretq_u32_s32(vshlq_n_s32(vandq_s32(quadrant, two), 30));
+		uint32x4_t cosineSign = vreinterpretq_u32_s32(vshlq_n_s32(vandq_s32(vaddq_s32(quadrant, one), two), 30));
+		sine.v = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(vbslq_f32(swap, c.v, s.v)), sineSign));
+		cosine.v = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(vbslq_f32(swap, s.v, c.v)), cosineSign));
+	}
+
+	using Batch = Neon;
+#else
+	using Batch = Scalar;
+#endif
+
+	/**
+	 * @brief Builds the model matrices of the B::WIDTH slots from first on, the same way
+	 * Object3D always has: translate(position) * scale(scale) * rotateZ * rotateX * rotateY,
+	 * premultiplied by the parent transformation of the slots that have one.
+	 */
+	template <typename B>
+	void buildMatrices(const std::vector<float>* positions, const std::vector<float>* orientations,
+		const std::vector<float>* scales, const glm::mat4* parentTransforms, const uint8_t* hasParent,
+		size_t first, glm::mat4* matrices) {
+		B sinX, cosX, sinY, cosY, sinZ, cosZ;
+		sinCos(B::load(orientations[0].data() + first), sinX, cosX);
+		sinCos(B::load(orientations[1].data() + first), sinY, cosY);
+		sinCos(B::load(orientations[2].data() + first), sinZ, cosZ);
+		B scale[3] = { B::load(scales[0].data() + first), B::load(scales[1].data() + first),
+			B::load(scales[2].data() + first) };
+
+		// The columns of Rz * Rx * Ry, with each row then multiplied by its axis's scale.
+		B zero = B::splat(0.0f);
+		B columns[3][3] = {
+			{ (cosZ * cosY - sinZ * sinX * sinY) * scale[0], (sinZ * cosY + cosZ * sinX * sinY) * scale[1],
+				(zero - cosX * sinY) * scale[2] },
+			{ (zero - sinZ * cosX) * scale[0], cosZ * cosX * scale[1], sinX * scale[2] },
+			{ (cosZ * sinY + sinZ * sinX * cosY) * scale[0], (sinZ * sinY - cosZ * sinX * cosY) * scale[1],
+				cosX * cosY * scale[2] },
+		};
+
+		float lanes[3][3][B::WIDTH];
+		for (int column = 0; column < 3; column++) {
+			for (int row = 0; row < 3; row++) {
+				columns[column][row].store(lanes[column][row]);
+			}
+		}
+		for (size_t lane = 0; lane < B::WIDTH; lane++) {
+			auto& matrix = matrices[first + lane];
+			for (int column = 0; column < 3; column++) {
+				matrix[column] = glm::vec4(lanes[column][0][lane], lanes[column][1][lane], lanes[column][2][lane], 0);
+			}
+			matrix[3] = glm::vec4(positions[0][first + lane], positions[1][first + lane], positions[2][first + lane], 1);
+			if (hasParent[first + lane]) {
+				matrix = parentTransforms[first + lane] * matrix;
+			}
+		}
+	}
+}
+
+TransformStorage& TransformStorage::shared() {
+	static TransformStorage storage;
+	return storage;
+}
+
+uint32_t TransformStorage::allocate() {
+	uint32_t slot;
+	if (!m_freeSlots.empty()) {
+		slot = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+	else {
+		slot = static_cast<uint32_t>(m_matrices.size());
+		for (int axis = 0; axis < 3; axis++) {
+			m_positions[axis].push_back(0);
+			m_orientations[axis].push_back(0);
+			m_scales[axis].push_back(0);
+		}
+		m_matrices.emplace_back();
+		m_parentTransforms.emplace_back();
+		m_hasParent.push_back(0);
+		m_dirty.push_back(0);
+		m_versions.push_back(0);
+	}
+	for (int axis = 0; axis < 3; axis++) {
+		m_positions[axis][slot] = 0;
+		m_orientations[axis][slot] = 0;
+		m_scales[axis][slot] = 1;
+	}
+	m_matrices[slot] = glm::mat4(1);
+	m_parentTransforms[slot] = glm::mat4(1);
+	m_hasParent[slot] = 0;
+	m_dirty[slot] = 0;
+	m_versions[slot] = nextVersion++;
+	return slot;
+}
+
+uint32_t TransformStorage::allocateCopy(uint32_t slot) {
+	uint32_t copySlot = allocate();
+	copy(slot, copySlot);
+	return copySlot;
+}
+
+void TransformStorage::copy(uint32_t from, uint32_t to) {
+	for (int axis = 0; axis < 3; axis++) {
+		m_positions[axis][to] = m_positions[axis][from];
+		m_orientations[axis][to] = m_orientations[axis][from];
+		m_scales[axis][to] = m_scales[axis][from];
+	}
+	m_matrices[to] = m_matrices[from];
+	m_parentTransforms[to] = m_parentTransforms[from];
+	m_hasParent[to] = m_hasParent[from];
+	m_dirty[to] = m_dirty[from];
+	m_versions[to] = m_versions[from];
+}
+
+void TransformStorage::release(uint32_t slot) {
+	m_dirty[slot] = 0;
+	m_freeSlots.push_back(slot);
+}
+
+glm::vec3 TransformStorage::getPosition(uint32_t slot) const {
+	return { m_positions[0][slot], m_positions[1][slot], m_positions[2][slot] };
+}
+
+glm::vec3 TransformStorage::getOrientation(uint32_t slot) const {
+	return { m_orientations[0][slot], m_orientations[1][slot], m_orientations[2][slot] };
+}
+
+glm::vec3 TransformStorage::getScale(uint32_t slot) const {
+	return { m_scales[0][slot], m_scales[1][slot], m_scales[2][slot] };
+}
+
+void TransformStorage::setPosition(uint32_t slot, const glm::vec3& position) {
+	for (int axis = 0; axis < 3; axis++) {
+		m_positions[axis][slot] = position[axis];
+	}
+	changed(slot);
+}
+
+void TransformStorage::setOrientation(uint32_t slot, const glm::vec3& orientation) {
+	for (int axis = 0; axis < 3; axis++) {
+		m_orientations[axis][slot] = orientation[axis];
+	}
+	changed(slot);
+}
+
+void TransformStorage::setScale(uint32_t slot, const glm::vec3& scale) {
+	for (int axis = 0; axis < 3; axis++) {
+		m_scales[axis][slot] = scale[axis];
+	}
+	changed(slot);
+}
+
+void TransformStorage::setParentTransform(uint32_t slot, const glm::mat4& parentTransform) {
+	m_parentTransforms[slot] = parentTransform;
+	m_hasParent[slot] = 1;
+	changed(slot);
+}
+
+void TransformStorage::clearParentTransform(uint32_t slot) {
+	if (m_hasParent[slot]) {
+		m_hasParent[slot] = 0;
+		changed(slot);
+	}
+}
+
+bool TransformStorage::hasParentTransform(uint32_t slot) const {
+	return m_hasParent[slot];
+}
+
+void TransformStorage::changed(uint32_t slot) {
+	m_dirty[slot] = 1;
+	m_versions[slot] = nextVersion++;
+}
+
+const glm::mat4& TransformStorage::getModelMatrix(uint32_t slot) {
+	if (m_dirty[slot]) {
+		buildMatrices<Scalar>(m_positions, m_orientations, m_scales, m_parentTransforms.data(), m_hasParent.data(),
+			slot, m_matrices.data());
+		m_dirty[slot] = 0;
+	}
+	return m_matrices[slot];
+}
+
+uint64_t TransformStorage::getVersion(uint32_t slot) const {
+	return m_versions[slot];
+}
+
+void TransformStorage::updateRange(size_t begin, size_t end) {
+	size_t slot = begin;
+	for (; slot + Batch::WIDTH <= end; slot += Batch::WIDTH) {
+		// Rebuilding the clean slots of a batch along with the dirty ones gives them the same
+		// matrices they already have.
+		auto dirty = m_dirty.begin() + slot;
+		if (std::find(dirty, dirty + Batch::WIDTH, 1) != dirty + Batch::WIDTH) {
+			buildMatrices<Batch>(m_positions, m_orientations, m_scales, m_parentTransforms.data(), m_hasParent.data(),
+				slot, m_matrices.data());
+			std::fill(dirty, dirty + Batch::WIDTH, 0);
+		}
+	}
+	for (; slot < end; slot++) {
+		if (m_dirty[slot]) {
+			buildMatrices<Scalar>(m_positions, m_orientations, m_scales, m_parentTransforms.data(), m_hasParent.data(),
+				slot, m_matrices.data());
+			m_dirty[slot] = 0;
+		}
+	}
+}
+
+void TransformStorage::updateMatrices() {
+	updateRange(0, size());
+}
+
+void TransformStorage::updateMatrices(JobSystem& jobs) {
+	jobs.parallelFor(size(), UPDATE_GRAIN_SIZE, [this](size_t begin, size_t end, size_t) {
+		updateRange(begin, end);
+	});
+}
+
+size_t TransformStorage::size() const {
+	return m_matrices.size();
+}
@@ -0,0 +1,62 @@
+#include "UniformBuffer.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+	// Every block name's binding point, starting with the renderers' own blocks.
+	std::unordered_map<std::string, uint32_t>& bindingPoints() {
+		static std::unordered_map<std::string, uint32_t> points = {
+			{ "Camera", UniformBuffer::CAMERA_BINDING },
+			{ "Object", UniformBuffer::OBJECT_BINDING },
+		};
+		return points;
+	}
+}
+
+CameraUniforms CameraUniforms::from(const glm::mat4& view, const glm::mat4& projection) {
+	return { view, projection, projection * view, glm::inverse(view)[3] };
+}
+
+UniformBuffer::UniformBuffer(size_t size) : m_size(size) {
+	glGenBuffers(1, &m_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+	glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+UniformBuffer::~UniformBuffer() {
+	glDeleteBuffers(1, &m_buffer);
+}
+
+void UniformBuffer::update(const void* data, size_t size) {
+	glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, std::min(size, m_size), data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::bind(uint32_t bindingPoint) const {
+	glBindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, m_buffer);
+}
+
+uint32_t UniformBuffer::getBuffer() const {
+	return m_buffer;
+}
+
+uint32_t UniformBuffer::bindingPoint(const std::string& blockName) {
+	auto& points = bindingPoints();
+	auto point = points.find(blockName);
+	if (point == points.end()) {
+		point = points.emplace(blockName, static_cast<uint32_t>(points.size())).first;
+	}
+	return point->second;
+}
+
+size_t UniformBuffer::getOffsetAlignment() {
+	static size_t alignment = [] {
+		int32_t value = 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &value);
+		return static_cast<size_t>(std::max(value, 1));
+	}();
+	return alignment;
+}
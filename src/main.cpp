@@ -13,26 +13,80 @@ We now transform local space vertices to clip space using uniform matrices in th
 #include <iostream>
 #include <memory>
 #include <filesystem>
+#include <string>
 
+#include "AssetLoader.h"
 #include "AssimpImport.h"
+#include "FramePacer.h"
+#include "FramePipeline.h"
+#include "GpuCuller.h"
+#include "GpuResources.h"
+#include "InstancedRenderer.h"
+#include "JobSystem.h"
 #include "Mesh3D.h"
+#include "MultiDrawRenderer.h"
 #include "Object3D.h"
+#include "Profiler.h"
+#include "RenderQueue.h"
+#include "Scene.h"
+#include "ShaderCache.h"
 #include "ShaderProgram.h"
+#include "StreamBuffer.h"
+#include "UniformBuffer.h"
+#include "TextureManager.h"
 #include <SFML/Window/Event.hpp>
 #include <SFML/Window/Window.hpp>
 
 // You will need to add your own AssimpImport.cpp from HW 4 if you want to load
 // other meshes.
 
-struct Scene {
-	std::vector<Object3D> objects;
-	ShaderProgram program;
-};
+// The texturing shader, reading each object's model matrix from the "Object" uniform block
+// that RenderQueue fills in.
+ShaderProgram textureShader(ShaderCache& shaders) {
+	ShaderProgram shader;
+	try {
+		shader = shaders.load("shaders/texture_perspective_object.vert", "shaders/texturing.frag");
+	}
+	catch (std::runtime_error& e) {
+		std::cout << "ERROR: " << e.what() << std::endl;
+		exit(1);
+	}
+	return shader;
+}
+
+// The texturing shader, reading each object's model matrix from a per-instance attribute
+// so that InstancedRenderer can draw many objects at once.
+ShaderProgram instancedTextureShader(ShaderCache& shaders) {
+	ShaderProgram shader;
+	try {
+		shader = shaders.load("shaders/texture_perspective_instanced.vert", "shaders/texturing.frag");
+	}
+	catch (std::runtime_error& e) {
+		std::cout << "ERROR: " << e.what() << std::endl;
+		exit(1);
+	}
+	return shader;
+}
 
-ShaderProgram textureShader() {
+// The texturing shader for MultiDrawRenderer, which also reads where each draw's texture was
+// packed into a texture array, if it was.
+ShaderProgram layeredTextureShader(ShaderCache& shaders) {
 	ShaderProgram shader;
 	try {
-		shader.load("shaders/texture_perspective.vert", "shaders/texturing.frag");
+		shader = shaders.load("shaders/texture_perspective_layered.vert", "shaders/texturing_layered.frag");
+	}
+	catch (std::runtime_error& e) {
+		std::cout << "ERROR: " << e.what() << std::endl;
+		exit(1);
+	}
+	return shader;
+}
+
+// The position-only shader that draws textureShader()'s depth pre-pass.
+ShaderProgram depthShader(ShaderCache& shaders) {
+	ShaderProgram shader;
+	try {
+		shader = shaders.load("shaders/depth_object.vert", "shaders/depth_only.frag");
 	}
 	catch (std::runtime_error& e) {
 		std::cout << "ERROR: " << e.what() << std::endl;
@@ -44,33 +98,124 @@ ShaderProgram textureShader() {
 /*
 * YOU CAN USE THIS SCENE ONLY AFTER YOU HAVE FINISHED assimpLoad()
 */
-Scene bunnyTextured() {
-	auto bunny = assimpLoad("models/bunny_textured.obj", true); // will automatically load the associated texture image.
+Scene bunnyTextured(AssetLoader& loader, ShaderCache& shaders) {
+	// Loads in the background, along with the associated texture image; renders nothing until then.
+	auto bunny = Object3D(loader.loadModel("models/bunny_textured.obj", true).asset);
 	bunny.move(glm::vec3(0.2, -1, -5));
 	bunny.grow(glm::vec3(9, 9, 9));
 
 	return Scene{
 		{ bunny },
-		textureShader()
+		textureShader(shaders)
 	};
 }
 
 
+// A grid of bunnies that all share one mesh; a stress test for the instanced render path.
+Scene bunnyCrowd(AssetLoader& loader, ShaderCache& shaders, int rows = 40, int columns = 40) {
+	auto bunnyMesh = loader.loadModel("models/bunny_textured.obj", true).asset;
+
+	std::vector<Object3D> bunnies;
+	bunnies.reserve(rows * columns);
+	for (int row = 0; row < rows; row++) {
+		for (int column = 0; column < columns; column++) {
+			auto bunny = Object3D(std::shared_ptr<Mesh3D>(bunnyMesh));
+			bunny.move(glm::vec3(column - columns / 2.0, -1, -5 - row));
+			bunny.grow(glm::vec3(4, 4, 4));
+			bunnies.push_back(bunny);
+		}
+	}
+
+	return Scene{
+		bunnies,
+		textureShader(shaders)
+	};
+}
+
 // A scene of a textured triangle.
-Scene triangle() {
-	StbImage wall;
-	wall.loadFromFile("models/wall.jpg");
+Scene triangle(AssetLoader& loader, ShaderCache& shaders) {
+	auto wall = loader.loadTexture("models/wall.jpg").asset;
 
 	auto triangle = Object3D(std::make_shared<Mesh3D>(Mesh3D::triangle(wall)));
 	triangle.move(glm::vec3(0, 0, -2));
 
 	return Scene{
 		{triangle},
-		textureShader()
+		textureShader(shaders)
 	};
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+	// --profile prints a frame-time report on exit; --profile-csv and --profile-trace also keep
+	// every frame and export them to the given file when the window closes. --texture-budget
+	// sets how many MiB of GPU memory streamed textures may use, and --jobs how many threads
+	// build each frame (0 for one per hardware thread). --assimp imports OBJ models through
+	// Assimp instead of the built-in parser. --vsync picks when swaps wait for vertical blank
+	// (off, on, or adaptive, against a --refresh rate in Hz), --frames-in-flight how many frames
+	// the CPU may queue ahead of the GPU, --spin how many radians a second every object turns
+	// about its vertical axis, and --sim-rate how many steps a second the simulation thread takes.
+	bool profileReport = false;
+	auto modelImporter = ModelImporter::Auto;
+	std::string profileCsvPath, profileTracePath;
+	size_t textureBudget = 256;
+	size_t jobCount = 0;
+	auto vsyncMode = VsyncMode::Adaptive;
+	double refreshRate = 60;
+	size_t framesInFlight = 2;
+	double simulationRate = 120;
+	float spinRate = 0;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--profile") {
+			profileReport = true;
+		}
+		else if (arg == "--profile-csv" && i + 1 < argc) {
+			profileCsvPath = argv[++i];
+		}
+		else if (arg == "--profile-trace" && i + 1 < argc) {
+			profileTracePath = argv[++i];
+		}
+		else if (arg == "--texture-budget" && i + 1 < argc) {
+			textureBudget = std::stoul(argv[++i]);
+		}
+		else if (arg == "--jobs" && i + 1 < argc) {
+			jobCount = std::stoul(argv[++i]);
+		}
+		else if (arg == "--assimp") {
+			modelImporter = ModelImporter::Assimp;
+		}
+		else if (arg == "--vsync" && i + 1 < argc) {
+			std::string mode = argv[++i];
+			if (mode == "off") {
+				vsyncMode = VsyncMode::Off;
+			}
+			else if (mode == "on") {
+				vsyncMode = VsyncMode::On;
+			}
+			else if (mode == "adaptive") {
+				vsyncMode = VsyncMode::Adaptive;
+			}
+			else {
+				std::cout << "WARNING: ignoring unknown vsync mode " << mode << std::endl;
+			}
+		}
+		else if (arg == "--refresh" && i + 1 < argc) {
+			refreshRate = std::stod(argv[++i]);
+		}
+		else if (arg == "--frames-in-flight" && i + 1 < argc) {
+			framesInFlight = std::stoul(argv[++i]);
+		}
+		else if (arg == "--spin" && i + 1 < argc) {
+			spinRate = std::stof(argv[++i]);
+		}
+		else if (arg == "--sim-rate" && i + 1 < argc) {
+			simulationRate = std::stod(argv[++i]);
+		}
+		else {
+			std::cout << "WARNING: ignoring unknown argument " << arg << std::endl;
+		}
+	}
+
 	std::cout << "Current executable path: " << std::endl;
 	std::cout << std::filesystem::current_path() << std::endl;
 	std::cout << "ALL MODEL AND SHADER PATHS MUST BE RELATIVE TO THIS LOCATION" << std::endl;
@@ -88,51 +233,260 @@ int main() {
 	// Draw in wireframe mode for now.
 	glEnable(GL_DEPTH_TEST);
 
-	// Inintialize scene objects.
-	auto myScene = triangle();
+	// Inintialize scene objects. Textures are shared by every object that uses the same image,
+	// and assets are decoded on worker threads, then uploaded from the main loop.
+	TextureManager textures;
+	AssetLoader loader(textures);
+	loader.setModelImporter(modelImporter);
+	// Textures arrive at 64x64 or less, and sharpen as the objects using them come closer.
+	loader.enableTextureStreaming(textureBudget << 20);
+	// Programs are built once per set of sources, linked from the binaries saved by earlier
+	// runs when the driver takes them, and rebuilt when their files are edited.
+	ShaderCache shaders;
+	shaders.setHotReload(true);
+	auto myScene = triangle(loader, shaders);
 	auto& obj = myScene.objects[0];
 
 	// Activate the shader program.
 	myScene.program.activate();
 	myScene.program.setUniform("color", glm::vec3(1, 0.2, 0.9));
 
-	// Set up the view and projection matrices.
+	// Set up the view and projection matrices, which every program reads from the camera's
+	// uniform block, written once per frame.
 	glm::mat4 camera = glm::lookAt(glm::vec3(0, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0));
 	glm::mat4 perspective = glm::perspective(glm::radians(45.0), static_cast<double>(window.getSize().x) / window.getSize().y, 0.1, 100.0);
-	myScene.program.setUniform("view", camera);
-	myScene.program.setUniform("projection", perspective);
+	UniformBuffer cameraBuffer(sizeof(CameraUniforms));
+	cameraBuffer.bind(UniformBuffer::CAMERA_BINDING);
+
+	// Press I to toggle drawing objects that share a mesh with one instanced draw call.
+	auto instancedProgram = instancedTextureShader(shaders);
+	InstancedRenderer instancedRenderer;
+	bool instanced = false;
+
+	// Press M to toggle drawing every object from shared geometry pools, with one multi-draw
+	// call per pool and texture; and T to toggle packing the textures into texture arrays, so
+	// objects with different textures share those calls.
+	auto layeredProgram = layeredTextureShader(shaders);
+	MultiDrawRenderer multiDrawRenderer;
+	bool multiDraw = false;
+
+	// Press G to toggle culling objects and picking their levels of detail on the GPU, which
+	// then draws them from the shared pools as the multi-draw path does; and O to toggle also
+	// culling the objects hidden behind others in the previous frame. Needs OpenGL 4.3.
+	std::unique_ptr<GpuCuller> gpuCuller;
+	bool gpuCulling = false;
+
+	// Press S to toggle streaming every instance matrix each frame, for scenes where most
+	// objects move, through a buffer with room for 64K matrices per frame in flight.
+	StreamBuffer frameData(GL_ARRAY_BUFFER, 65536 * sizeof(glm::mat4));
+	bool streaming = false;
+
+	// Only objects whose bounds reach into the view frustum are drawn. Outside of the instanced
+	// path, their draws go through a queue that sorts them by state and depth, and reads their
+	// matrices from slots of one uniform buffer, with room for 16K draws per frame in flight to
+	// start with.
+	std::vector<uint32_t> visible;
+	RenderQueue renderQueue;
+	StreamBuffer objectData(GL_UNIFORM_BUFFER,
+		16384 * std140::roundUp(sizeof(ObjectUniforms), UniformBuffer::getOffsetAlignment()));
+	renderQueue.setObjectBuffer(&objectData);
+
+	// Press Z to cycle through the queue's ways of drawing less overdraw: sorted by state and
+	// then front to back, every draw front to back, or a depth-only pre-pass after which every
+	// pixel is shaded once. The last two are for fill-rate-bound scenes.
+	auto depthProgram = depthShader(shaders);
+	renderQueue.setDepthProgram(myScene.program, &depthProgram);
+	int depthMode = 0;
+
+	// Updating bounds, culling, picking levels of detail and building the queue's packets are
+	// split across cores; the OpenGL calls all stay on this thread.
+	JobSystem jobs(jobCount);
+
+	// Press V to cycle between vsync off, on, and adaptive. Either way, the CPU never gets more
+	// than framesInFlight frames ahead of the GPU.
+	FramePacer pacer(framesInFlight);
+	pacer.setRefreshInterval(1 / refreshRate);
+	pacer.setVsyncMode(vsyncMode);
+	bool vsync = pacer.wantsVsync();
+	window.setVerticalSyncEnabled(vsync);
+
+	// With --spin, the scene is simulated on a thread of its own, a fixed step at a time, while
+	// this thread renders the latest step's snapshot of the objects' transformations. A still
+	// scene has nothing to simulate, so it goes without the thread.
+	std::unique_ptr<FramePipeline> simulation;
+	if (spinRate != 0) {
+		simulation = std::make_unique<FramePipeline>(FrameSnapshot::from(myScene.objects),
+			[spinRate](FrameSnapshot& world, double seconds) {
+				for (auto& object : world.objects) {
+					object.orientation.y += spinRate * static_cast<float>(seconds);
+				}
+			}, 1 / simulationRate);
+	}
+
+	// Press P to print a profile of the recent frames.
+	Profiler profiler;
+	profiler.setRecording(!profileCsvPath.empty() || !profileTracePath.empty());
 
 	// Ready, set, go!
 	bool running = true;
-	sf::Clock c;
-	auto last = c.getElapsedTime();
 	while (running) {
-		
+		profiler.beginFrame();
+		{
+			Profiler::Scope scope(profiler, "pace", false);
+			pacer.beginFrame();
+		}
+
 		sf::Event ev;
 		while (window.pollEvent(ev)) {
 			if (ev.type == sf::Event::Closed) {
 				running = false;
 			}
+			else if (ev.type == sf::Event::KeyPressed && ev.key.code == sf::Keyboard::I) {
+				instanced = !instanced;
+			}
+			else if (ev.type == sf::Event::KeyPressed && ev.key.code == sf::Keyboard::M) {
+				multiDraw = !multiDraw;
+			}
+			else if (ev.type == sf::Event::KeyPressed && ev.key.code == sf::Keyboard::G) {
+				if (!GpuCuller::isSupported()) {
+					std::cout << "WARNING: GPU culling needs OpenGL 4.3" << std::endl;
+				}
+				else {
+					try {
+						if (!gpuCuller) {
+							gpuCuller = std::make_unique<GpuCuller>();
+						}
+						gpuCulling = !gpuCulling;
+					}
+					catch (std::runtime_error& e) {
+						std::cout << "ERROR: " << e.what() << std::endl;
+					}
+				}
+			}
+			else if (ev.type == sf::Event::KeyPressed && ev.key.code == sf::Keyboard::T) {
+				multiDrawRenderer.setTexturePacking(!multiDrawRenderer.getTexturePacking());
+			}
+			else if (ev.type == sf::Event::KeyPressed && ev.key.code == sf::Keyboard::O && gpuCuller) {
+				gpuCuller->setOcclusionCulling(!gpuCuller->getOcclusionCulling());
+			}
+			else if (ev.type == sf::Event::KeyPressed && ev.key.code == sf::Keyboard::S) {
+				streaming = !streaming;
+				instancedRenderer.setStreamBuffer(streaming ? &frameData : nullptr);
+			}
+			else if (ev.type == sf::Event::KeyPressed && ev.key.code == sf::Keyboard::Z) {
+				depthMode = (depthMode + 1) % 3;
+				renderQueue.setDepthFirst(depthMode == 1);
+				renderQueue.setDepthPrepass(depthMode == 2);
+			}
+			else if (ev.type == sf::Event::KeyPressed && ev.key.code == sf::Keyboard::V) {
+				pacer.setVsyncMode(static_cast<VsyncMode>((static_cast<int>(pacer.getVsyncMode()) + 1) % 3));
+			}
+			else if (ev.type == sf::Event::KeyPressed && ev.key.code == sf::Keyboard::P) {
+				profiler.writeReport(std::cout);
+			}
 		}
-		auto now = c.getElapsedTime();
-		auto diff = now - last;
-		//std::cout << 1 / diff.asSeconds() << " FPS " << std::endl;
-		last = now;
 
-		// Update the scene.
-		// obj.rotate(glm::vec3(0, 0.0002, 0));
+		{
+			Profiler::Scope scope(profiler, "update");
+			// Upload any assets that finished loading, without spending too long on it in one frame.
+			loader.processUploads(std::chrono::milliseconds(4));
+			shaders.update();
 
-		// Clear the OpenGL "context".
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		for (auto& o : myScene.objects) {
-			o.render(myScene.program);
+			// Take the simulation's latest state.
+			if (simulation != nullptr) {
+				simulation->acquire().applyTo(myScene.objects);
+			}
+
+			if (!gpuCulling) {
+				{
+					Profiler::Scope cullScope(profiler, "cull", false);
+					myScene.update(jobs);
+					myScene.queryFrustum(perspective * camera, visible, jobs);
+				}
+
+				// Pick each visible object's level of detail for its distance from the camera.
+				float viewportHeight = static_cast<float>(window.getSize().y);
+				jobs.parallelFor(visible.size(), 256, [&](size_t begin, size_t end, size_t) {
+					for (size_t i = begin; i < end; i++) {
+						myScene.objects[visible[i]].selectLod(camera, perspective, viewportHeight);
+					}
+				});
+			}
+
+			// Ask for the texture resolutions the visible objects need. The GPU-culled path
+			// doesn't know which objects those are, so every object counts.
+			auto* streamer = loader.getTextureStreamer();
+			float viewportHeight = static_cast<float>(window.getSize().y);
+			if (gpuCulling) {
+				for (auto& object : myScene.objects) {
+					streamer->noteUse(object, camera, perspective, viewportHeight);
+				}
+			}
+			else {
+				for (auto i : visible) {
+					streamer->noteUse(myScene.objects[i], camera, perspective, viewportHeight);
+				}
+			}
+			loader.streamTextures();
 		}
-		window.display();
 
+		{
+			Profiler::Scope scope(profiler, "render");
+			// Clear the OpenGL "context".
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			frameData.beginFrame();
+			objectData.beginFrame();
+			cameraBuffer.update(CameraUniforms::from(camera, perspective));
+			if (gpuCulling) {
+				// Set every frame, since a hot reload relinks the program.
+				layeredProgram.activate();
+				layeredProgram.setUniform("layeredTexture", MultiDrawRenderer::LAYERED_TEXTURE_UNIT);
+				multiDrawRenderer.render(myScene.objects, *gpuCuller, layeredProgram, camera, perspective,
+					static_cast<float>(window.getSize().y));
+				// Keep this frame's depth for next frame's occlusion tests.
+				gpuCuller->updateDepthPyramid(perspective * camera, window.getSize().x, window.getSize().y);
+			}
+			else if (multiDraw) {
+				layeredProgram.activate();
+				layeredProgram.setUniform("layeredTexture", MultiDrawRenderer::LAYERED_TEXTURE_UNIT);
+				multiDrawRenderer.render(myScene.objects, visible);
+			}
+			else if (instanced) {
+				instancedProgram.activate();
+				instancedRenderer.render(myScene.objects, visible);
+			}
+			else {
+				renderQueue.begin(camera);
+				renderQueue.submit(jobs, myScene.program, myScene.objects, visible);
+				renderQueue.flush();
+			}
+			frameData.endFrame();
+			objectData.endFrame();
+		}
 
-		
+		{
+			Profiler::Scope scope(profiler, "display");
+			window.display();
+		}
+		// Meshes and textures dropped this frame are deleted once the GPU is done with them.
+		GpuResources::shared().endFrame();
+		pacer.endFrame();
+		if (pacer.wantsVsync() != vsync) {
+			vsync = pacer.wantsVsync();
+			window.setVerticalSyncEnabled(vsync);
+		}
+		profiler.endFrame();
 	}
 
+	if (profileReport) {
+		profiler.writeReport(std::cout);
+	}
+	if (!profileCsvPath.empty()) {
+		profiler.writeCsv(profileCsvPath);
+	}
+	if (!profileTracePath.empty()) {
+		profiler.writeChromeTrace(profileTracePath);
+	}
 	return 0;
 }
 
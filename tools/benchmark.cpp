@@ -0,0 +1,570 @@
+/**
+This tool benchmarks the render path without a window. It builds a scene of N objects sharing
+M meshes (cycling through cubes, triangles and bunnies), renders a fixed number of frames into an
+offscreen framebuffer, and prints load, draw and frame times as JSON, so that runs from different
+builds can be compared.
+
+Usage: benchmark [--objects <N>] [--meshes <M>] [--kinds cube,triangle,bunny] [--frames <F>]
+	[--warmup <W>] [--size <width>x<height>] [--instanced] [--quantize-positions] [--cull]
+	[--spread <S>] [--queue] [--depth-first] [--depth-prepass] [--jobs <J>] [--object-buffer]
+	[--multi-draw] [--gpu-cull] [--occlusion] [--animate] [--textures <T>] [--pack-textures]
+	[-o <output file>]
+--spread spaces the grid out so that only about 1/S^2 of it is in view; with --cull, objects
+outside the view frustum are skipped before drawing. --queue draws the per-object path through a
+RenderQueue, sorted by state (or, with --depth-first, by depth) instead of in scene order;
+--depth-prepass has the queue draw a depth-only pre-pass first, then shade with a GL_EQUAL depth
+test, so overlapping objects are only shaded where they are visible; and --jobs builds the
+queue's packets on J threads (0 for one per hardware thread) instead of one.
+--object-buffer has the queue's draws read their model matrices from slots of one uniform buffer
+instead of a uniform each.
+--multi-draw draws from shared geometry pools with one multi-draw call per pool and texture.
+--gpu-cull does the same, but culls and picks levels of detail in a compute shader that writes
+the draw commands (so objects_visible and objects_culled stay 0), and --occlusion also culls
+objects hidden in the previous frame's depth buffer. Both need OpenGL 4.3.
+--animate spins every object each frame and rebuilds their model matrices in TransformStorage's
+SIMD batches (on the --jobs threads) before drawing, timed as animate_cpu.
+--textures gives the cubes and triangles T different textures (copies of one image), cycling
+through them mesh by mesh, which splits the multi-draw paths' calls by texture; with
+--pack-textures, those paths pack the textures into texture arrays and draw them together again.
+Run it from the output directory, so it finds the /shaders and /models directories.
+*/
+
+#include <glad/glad.h>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <glm/ext.hpp>
+#include <SFML/Window/Context.hpp>
+
+#include "AssimpImport.h"
+#include "FrustumCuller.h"
+#include "GpuCuller.h"
+#include "GpuResources.h"
+#include "InstancedRenderer.h"
+#include "JobSystem.h"
+#include "Mesh3D.h"
+#include "MultiDrawRenderer.h"
+#include "Object3D.h"
+#include "Profiler.h"
+#include "RenderQueue.h"
+#include "ShaderProgram.h"
+#include "StreamBuffer.h"
+#include "TextureManager.h"
+#include "TransformStorage.h"
+#include "UniformBuffer.h"
+
+struct Options {
+	size_t objects = 1000;
+	size_t meshes = 3;
+	std::vector<std::string> kinds = { "cube", "triangle", "bunny" };
+	size_t frames = 500;
+	size_t warmupFrames = 50;
+	uint32_t width = 1000;
+	uint32_t height = 1000;
+	bool instanced = false;
+	// How model (bunny) meshes store their positions.
+	PositionFormat positionFormat = PositionFormat::Float;
+	bool cull = false;
+	bool queue = false;
+	bool depthFirst = false;
+	bool depthPrepass = false;
+	// Threads building the queue's packets, or 1 to submit them on the main thread.
+	size_t jobs = 1;
+	bool objectBuffer = false;
+	bool multiDraw = false;
+	bool gpuCull = false;
+	bool occlusion = false;
+	bool animate = false;
+	size_t textures = 1;
+	bool packTextures = false;
+	float spread = 1;
+	std::string outputPath;
+};
+
+// Load times of the scene's assets, in milliseconds.
+struct LoadTimes {
+	double shaders = 0;
+	double textures = 0;
+	double models = 0;
+	size_t modelCount = 0;
+	double meshes = 0;
+};
+
+const char* const USAGE = "Usage: benchmark [--objects <N>] [--meshes <M>] [--kinds cube,triangle,bunny] "
+	"[--frames <F>] [--warmup <W>] [--size <width>x<height>] [--instanced] [--quantize-positions] [--cull] "
+	"[--spread <S>] [--queue] [--depth-first] [--depth-prepass] [--jobs <J>] [--object-buffer] [--multi-draw] "
+	"[--gpu-cull] [--occlusion] [--animate] [--textures <T>] [--pack-textures] [-o <output file>]";
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::vector<std::string> splitList(const std::string& list) {
+	std::vector<std::string> items;
+	std::stringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		if (!item.empty()) {
+			items.push_back(item);
+		}
+	}
+	return items;
+}
+
+Options parseOptions(int argc, char* argv[]) {
+	Options options;
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (argument == "--objects" && hasValue) {
+			options.objects = std::stoul(argv[++i]);
+		}
+		else if (argument == "--meshes" && hasValue) {
+			options.meshes = std::stoul(argv[++i]);
+		}
+		else if (argument == "--kinds" && hasValue) {
+			options.kinds = splitList(argv[++i]);
+		}
+		else if (argument == "--frames" && hasValue) {
+			options.frames = std::stoul(argv[++i]);
+		}
+		else if (argument == "--warmup" && hasValue) {
+			options.warmupFrames = std::stoul(argv[++i]);
+		}
+		else if (argument == "--size" && hasValue) {
+			std::string size = argv[++i];
+			auto x = size.find('x');
+			if (x == std::string::npos) {
+				throw std::runtime_error("--size must look like 1000x1000");
+			}
+			options.width = std::stoul(size.substr(0, x));
+			options.height = std::stoul(size.substr(x + 1));
+		}
+		else if (argument == "--instanced") {
+			options.instanced = true;
+		}
+		else if (argument == "--quantize-positions") {
+			options.positionFormat = PositionFormat::Unorm16;
+		}
+		else if (argument == "--cull") {
+			options.cull = true;
+		}
+		else if (argument == "--spread" && hasValue) {
+			options.spread = std::stof(argv[++i]);
+		}
+		else if (argument == "--queue") {
+			options.queue = true;
+		}
+		else if (argument == "--depth-first") {
+			options.queue = true;
+			options.depthFirst = true;
+		}
+		else if (argument == "--depth-prepass") {
+			options.queue = true;
+			options.depthPrepass = true;
+		}
+		else if (argument == "--jobs" && hasValue) {
+			options.queue = true;
+			options.jobs = std::stoul(argv[++i]);
+		}
+		else if (argument == "--object-buffer") {
+			options.queue = true;
+			options.objectBuffer = true;
+		}
+		else if (argument == "--multi-draw") {
+			options.multiDraw = true;
+		}
+		else if (argument == "--gpu-cull") {
+			options.gpuCull = true;
+		}
+		else if (argument == "--occlusion") {
+			options.gpuCull = true;
+			options.occlusion = true;
+		}
+		else if (argument == "--animate") {
+			options.animate = true;
+		}
+		else if (argument == "--textures" && hasValue) {
+			options.textures = std::stoul(argv[++i]);
+		}
+		else if (argument == "--pack-textures") {
+			options.packTextures = true;
+		}
+		else if (argument == "-o" && hasValue) {
+			options.outputPath = argv[++i];
+		}
+		else {
+			throw std::runtime_error("Unknown argument " + argument);
+		}
+	}
+	if (options.meshes == 0 || options.kinds.empty() || options.frames == 0) {
+		throw std::runtime_error("--meshes, --kinds and --frames must not be empty");
+	}
+	if (options.spread < 1) {
+		throw std::runtime_error("--spread must be at least 1");
+	}
+	if (options.textures == 0) {
+		throw std::runtime_error("--textures must be at least 1");
+	}
+	if (options.packTextures && !options.multiDraw && !options.gpuCull) {
+		throw std::runtime_error("--pack-textures needs --multi-draw or --gpu-cull");
+	}
+	for (auto& kind : options.kinds) {
+		if (kind != "cube" && kind != "triangle" && kind != "bunny") {
+			throw std::runtime_error("Unknown mesh kind " + kind);
+		}
+	}
+	return options;
+}
+
+// Builds the scene's meshes, each with its own GPU buffers, and times how long that takes.
+std::vector<std::shared_ptr<Mesh3D>> loadMeshes(const Options& options, TextureManager& textures,
+	LoadTimes& loadTimes) {
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::shared_ptr<Texture>> walls{ textures.load("models/wall.jpg") };
+	if (options.textures > 1) {
+		// The copies are textures of their own, as different images of the same size would be.
+		StbImage image;
+		image.loadFromFile("models/wall.jpg");
+		while (walls.size() < options.textures) {
+			walls.push_back(std::make_shared<Texture>(image));
+		}
+	}
+	loadTimes.textures = millisecondsSince(start);
+
+	std::vector<std::shared_ptr<Mesh3D>> meshes;
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < options.meshes; i++) {
+		auto& kind = options.kinds[i % options.kinds.size()];
+		if (kind == "bunny") {
+			auto modelStart = std::chrono::steady_clock::now();
+			auto model = importModel("models/bunny_textured.obj", true);
+			meshes.push_back(std::make_shared<Mesh3D>(createMesh(model, textures, options.positionFormat)));
+			loadTimes.models += millisecondsSince(modelStart);
+			loadTimes.modelCount++;
+		}
+		else if (kind == "cube") {
+			meshes.push_back(std::make_shared<Mesh3D>(Mesh3D::cube(walls[i % walls.size()])));
+		}
+		else {
+			meshes.push_back(std::make_shared<Mesh3D>(Mesh3D::triangle(walls[i % walls.size()])));
+		}
+	}
+	loadTimes.meshes = millisecondsSince(start);
+	return meshes;
+}
+
+// Lays the objects out in a square grid that fills the camera's view, or is spread beyond it.
+std::vector<Object3D> buildObjects(const Options& options, const std::vector<std::shared_ptr<Mesh3D>>& meshes) {
+	size_t side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(options.objects))));
+	float spacing = 1.5f;
+	float distance = side * spacing * 1.25f + 2;
+
+	std::vector<Object3D> objects;
+	objects.reserve(options.objects);
+	for (size_t i = 0; i < options.objects; i++) {
+		size_t meshIndex = i % meshes.size();
+		auto object = Object3D(std::shared_ptr<Mesh3D>(meshes[meshIndex]));
+		float x = (i % side - (side - 1) / 2.0f) * spacing * options.spread;
+		float y = (i / side - (side - 1) / 2.0f) * spacing * options.spread;
+		object.move(glm::vec3(x, y, -distance));
+		if (options.kinds[meshIndex % options.kinds.size()] == "bunny") {
+			object.grow(glm::vec3(6, 6, 6));
+		}
+		objects.push_back(std::move(object));
+	}
+	return objects;
+}
+
+void writeStats(std::ostream& out, const char* name, const Profiler::Stats& stats) {
+	out << "    \"" << name << "\": { \"mean\": " << stats.mean << ", \"p50\": " << stats.p50
+		<< ", \"p99\": " << stats.p99 << ", \"max\": " << stats.max << ", \"samples\": " << stats.samples << " }";
+}
+
+std::string jsonString(const char* text) {
+	std::string escaped = "\"";
+	for (const char* c = text; c != nullptr && *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\') {
+			escaped += '\\';
+		}
+		escaped += *c;
+	}
+	return escaped + "\"";
+}
+
+void writeResults(std::ostream& out, const Options& options, const LoadTimes& loadTimes, const Profiler& profiler) {
+	out << "{\n";
+	out << "  \"renderer\": " << jsonString(reinterpret_cast<const char*>(glGetString(GL_RENDERER))) << ",\n";
+	out << "  \"gl_version\": " << jsonString(reinterpret_cast<const char*>(glGetString(GL_VERSION))) << ",\n";
+	out << "  \"scene\": { \"objects\": " << options.objects << ", \"meshes\": " << options.meshes
+		<< ", \"kinds\": [";
+	for (size_t i = 0; i < options.kinds.size(); i++) {
+		out << (i > 0 ? ", " : "") << jsonString(options.kinds[i].c_str());
+	}
+	out << "], \"width\": " << options.width << ", \"height\": " << options.height
+		<< ", \"path\": " << (options.gpuCull ? "\"gpu-cull\"" : options.multiDraw ? "\"multi-draw\"" : options.instanced ? "\"instanced\""
+			: options.queue ? "\"queue\"" : "\"per-object\"")
+		<< ", \"indirect\": " << (options.gpuCull || (options.multiDraw && MultiDrawRenderer::isIndirectSupported()) ? "true" : "false")
+		<< ", \"occlusion\": " << (options.occlusion ? "true" : "false")
+		<< ", \"depth_first\": " << (options.depthFirst ? "true" : "false")
+		<< ", \"depth_prepass\": " << (options.depthPrepass ? "true" : "false")
+		<< ", \"jobs\": " << (options.queue ? options.jobs : 1)
+		<< ", \"object_buffer\": " << (options.objectBuffer ? "true" : "false")
+		<< ", \"animate\": " << (options.animate ? "true" : "false")
+		<< ", \"textures\": " << options.textures
+		<< ", \"pack_textures\": " << (options.packTextures ? "true" : "false")
+		<< ", \"quantized_positions\": " << (options.positionFormat == PositionFormat::Unorm16 ? "true" : "false")
+		<< ", \"cull\": " << (options.cull ? "true" : "false") << ", \"spread\": " << options.spread << " },\n";
+	out << "  \"frames\": " << options.frames << ",\n";
+	out << "  \"load_ms\": { \"shaders\": " << loadTimes.shaders << ", \"textures\": " << loadTimes.textures
+		<< ", \"models\": " << loadTimes.models << ", \"model_count\": " << loadTimes.modelCount
+		<< ", \"meshes\": " << loadTimes.meshes << " },\n";
+	out << "  \"time_ms\": {\n";
+	writeStats(out, "frame", profiler.getFrameTimeStats());
+	out << ",\n";
+	writeStats(out, "draw_cpu", profiler.getSectionStats("draw", false));
+	out << ",\n";
+	writeStats(out, "draw_gpu", profiler.getSectionStats("draw", true));
+	out << ",\n";
+	writeStats(out, "cull_cpu", profiler.getSectionStats("cull", false));
+	out << ",\n";
+	writeStats(out, "animate_cpu", profiler.getSectionStats("animate", false));
+	out << "\n  },\n";
+	out << "  \"per_frame\": { \"draw_calls\": " << profiler.getCounterAverage(Profiler::Counter::DrawCalls)
+		<< ", \"state_changes\": " << profiler.getCounterAverage(Profiler::Counter::StateChanges)
+		<< ", \"uniform_uploads\": " << profiler.getCounterAverage(Profiler::Counter::UniformUploads)
+		<< ", \"objects_visible\": " << profiler.getCounterAverage(Profiler::Counter::ObjectsVisible)
+		<< ", \"objects_culled\": " << profiler.getCounterAverage(Profiler::Counter::ObjectsCulled) << " }\n";
+	out << "}" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	Options options;
+	try {
+		options = parseOptions(argc, argv);
+	}
+	catch (std::exception& e) {
+		std::cout << "ERROR: " << e.what() << std::endl << USAGE << std::endl;
+		return 1;
+	}
+
+	// A context with no window; everything is drawn into the framebuffer below.
+	sf::ContextSettings settings;
+	settings.depthBits = 24;
+	settings.stencilBits = 8;
+	settings.majorVersion = 3;
+	settings.minorVersion = 3;
+	sf::Context context(settings, options.width, options.height);
+	gladLoadGL();
+
+	uint32_t framebuffer, colorBuffer, depthBuffer;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glGenRenderbuffers(1, &colorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, options.width, options.height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, options.width, options.height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cout << "ERROR: could not create the offscreen framebuffer" << std::endl;
+		return 1;
+	}
+	glViewport(0, 0, options.width, options.height);
+	glEnable(GL_DEPTH_TEST);
+
+	LoadTimes loadTimes;
+	TextureManager textures;
+	std::vector<Object3D> objects;
+	ShaderProgram program;
+	// Computes the same positions as the queue's program, for its depth pre-pass.
+	ShaderProgram depthProgram;
+	try {
+		auto start = std::chrono::steady_clock::now();
+		if (options.packTextures) {
+			program.load("shaders/texture_perspective_layered.vert", "shaders/texturing_layered.frag");
+		}
+		else if (options.instanced || options.multiDraw || options.gpuCull) {
+			program.load("shaders/texture_perspective_instanced.vert", "shaders/texturing.frag");
+		}
+		else if (options.objectBuffer) {
+			program.load("shaders/texture_perspective_object.vert", "shaders/texturing.frag");
+		}
+		else {
+			program.load("shaders/texture_perspective.vert", "shaders/texturing.frag");
+		}
+		if (options.depthPrepass) {
+			depthProgram.load(options.objectBuffer ? "shaders/depth_object.vert" : "shaders/simple_perspective.vert",
+				"shaders/depth_only.frag");
+		}
+		loadTimes.shaders = millisecondsSince(start);
+
+		objects = buildObjects(options, loadMeshes(options, textures, loadTimes));
+	}
+	catch (std::exception& e) {
+		std::cout << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	glm::mat4 camera = glm::lookAt(glm::vec3(0, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0));
+	glm::mat4 perspective = glm::perspective(glm::radians(45.0), static_cast<double>(options.width) / options.height, 0.1, 1000.0);
+	// The camera never moves, so its block is written once.
+	UniformBuffer cameraBuffer(sizeof(CameraUniforms));
+	cameraBuffer.update(CameraUniforms::from(camera, perspective));
+	cameraBuffer.bind(UniformBuffer::CAMERA_BINDING);
+	program.activate();
+	auto modelUniform = program.getUniformHandle("model");
+	if (options.packTextures) {
+		program.setUniform("layeredTexture", MultiDrawRenderer::LAYERED_TEXTURE_UNIT);
+	}
+	InstancedRenderer instancedRenderer;
+	RenderQueue renderQueue;
+	renderQueue.setDepthFirst(options.depthFirst);
+	if (options.depthPrepass) {
+		renderQueue.setDepthProgram(program, &depthProgram);
+		renderQueue.setDepthPrepass(true);
+	}
+	// One slot per draw, with room for each object to have a few sub-meshes.
+	std::unique_ptr<StreamBuffer> objectData;
+	if (options.objectBuffer) {
+		objectData = std::make_unique<StreamBuffer>(GL_UNIFORM_BUFFER, options.objects * 4
+			* std140::roundUp(sizeof(ObjectUniforms), UniformBuffer::getOffsetAlignment()));
+		renderQueue.setObjectBuffer(objectData.get());
+	}
+	JobSystem jobs(options.jobs);
+	MultiDrawRenderer multiDrawRenderer;
+	multiDrawRenderer.setTexturePacking(options.packTextures);
+	std::unique_ptr<GpuCuller> gpuCuller;
+	if (options.gpuCull) {
+		if (!GpuCuller::isSupported()) {
+			std::cout << "ERROR: --gpu-cull needs OpenGL 4.3" << std::endl;
+			return 1;
+		}
+		try {
+			gpuCuller = std::make_unique<GpuCuller>();
+		}
+		catch (std::exception& e) {
+			std::cout << "ERROR: " << e.what() << std::endl;
+			return 1;
+		}
+		gpuCuller->setOcclusionCulling(options.occlusion);
+	}
+	FrustumCuller culler;
+	std::vector<uint32_t> allObjects(objects.size());
+	for (size_t i = 0; i < objects.size(); i++) {
+		allObjects[i] = static_cast<uint32_t>(i);
+	}
+
+	auto drawFrame = [&](Profiler* profiler) {
+		if (options.animate) {
+			std::optional<Profiler::Scope> scope;
+			if (profiler != nullptr) {
+				scope.emplace(*profiler, "animate", false);
+			}
+			for (auto& object : objects) {
+				object.rotate(glm::vec3(0, 0.01f, 0));
+			}
+			TransformStorage::shared().updateMatrices(jobs);
+		}
+
+		std::span<const uint32_t> visible = allObjects;
+		if (options.cull) {
+			std::optional<Profiler::Scope> scope;
+			if (profiler != nullptr) {
+				scope.emplace(*profiler, "cull", false);
+			}
+			culler.update(objects);
+			visible = culler.cull(perspective * camera);
+		}
+
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		program.activate();
+		if (options.gpuCull) {
+			multiDrawRenderer.render(objects, *gpuCuller, program, camera, perspective, static_cast<float>(options.height));
+			gpuCuller->updateDepthPyramid(perspective * camera, options.width, options.height);
+		}
+		else if (options.multiDraw) {
+			multiDrawRenderer.render(objects, visible);
+		}
+		else if (options.instanced && options.cull) {
+			instancedRenderer.render(objects, visible);
+		}
+		else if (options.instanced) {
+			instancedRenderer.render(objects);
+		}
+		else if (options.queue) {
+			if (objectData) {
+				objectData->beginFrame();
+			}
+			renderQueue.begin(camera);
+			if (options.jobs == 1) {
+				for (auto i : visible) {
+					renderQueue.submit(program, objects[i]);
+				}
+			}
+			else {
+				renderQueue.submit(jobs, program, objects, visible);
+			}
+			renderQueue.flush();
+			if (objectData) {
+				objectData->endFrame();
+			}
+		}
+		else {
+			for (auto i : visible) {
+				objects[i].render(program, modelUniform);
+			}
+		}
+	};
+
+	// Warm up the driver's shader and buffer state before measuring.
+	for (size_t frame = 0; frame < options.warmupFrames; frame++) {
+		drawFrame(nullptr);
+		glFinish();
+		GpuResources::shared().endFrame();
+	}
+
+	// Each frame waits for the GPU to finish, so frames are measured one at a time rather than
+	// queued up without bound, as they would be with no display to throttle them.
+	Profiler profiler(options.frames);
+	for (size_t frame = 0; frame < options.frames; frame++) {
+		profiler.beginFrame();
+		{
+			Profiler::Scope scope(profiler, "draw");
+			drawFrame(&profiler);
+		}
+		{
+			Profiler::Scope scope(profiler, "finish", false);
+			glFinish();
+		}
+		GpuResources::shared().endFrame();
+		profiler.endFrame();
+	}
+	profiler.collectGpuResults();
+
+	if (options.outputPath.empty()) {
+		writeResults(std::cout, options, loadTimes, profiler);
+	}
+	else {
+		std::ofstream out(options.outputPath);
+		if (!out) {
+			std::cout << "ERROR: could not open " << options.outputPath << " for writing" << std::endl;
+			return 1;
+		}
+		writeResults(out, options, loadTimes, profiler);
+	}
+
+	glDeleteRenderbuffers(1, &depthBuffer);
+	glDeleteRenderbuffers(1, &colorBuffer);
+	glDeleteFramebuffers(1, &framebuffer);
+	return 0;
+}
@@ -0,0 +1,280 @@
+/**
+This tool compresses texture images offline into .dds files with a full mipmap chain, so that
+TextureManager can upload them directly with glCompressedTexImage2D instead of decoding the
+image and generating mipmaps at load time. Opaque images become BC1 (4 bits per texel); images
+with transparency become BC3 (8 bits per texel).
+
+Usage: texcompress [--bc1 | --bc3] [-o <output directory>] <image>...
+Each image is written next to the original (or into the output directory) with a .dds extension.
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "StbImage.h"
+
+struct Rgba {
+	uint8_t r, g, b, a;
+};
+
+struct MipLevel {
+	int width;
+	int height;
+	std::vector<Rgba> pixels;
+};
+
+// Halves a level with a 2x2 box filter; odd edges reuse their last row or column.
+MipLevel downsample(const MipLevel& source) {
+	MipLevel level{ std::max(1, source.width / 2), std::max(1, source.height / 2) };
+	level.pixels.resize(level.width * level.height);
+	for (int y = 0; y < level.height; y++) {
+		for (int x = 0; x < level.width; x++) {
+			int x0 = std::min(2 * x, source.width - 1), x1 = std::min(2 * x + 1, source.width - 1);
+			int y0 = std::min(2 * y, source.height - 1), y1 = std::min(2 * y + 1, source.height - 1);
+			const Rgba* texels[4] = {
+				&source.pixels[y0 * source.width + x0], &source.pixels[y0 * source.width + x1],
+				&source.pixels[y1 * source.width + x0], &source.pixels[y1 * source.width + x1],
+			};
+			int r = 0, g = 0, b = 0, a = 0;
+			for (auto* texel : texels) {
+				r += texel->r;
+				g += texel->g;
+				b += texel->b;
+				a += texel->a;
+			}
+			level.pixels[y * level.width + x] = { uint8_t((r + 2) / 4), uint8_t((g + 2) / 4),
+				uint8_t((b + 2) / 4), uint8_t((a + 2) / 4) };
+		}
+	}
+	return level;
+}
+
+uint16_t toRgb565(int r, int g, int b) {
+	return uint16_t(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+}
+
+Rgba fromRgb565(uint16_t color) {
+	int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+	return { uint8_t((r << 3) | (r >> 2)), uint8_t((g << 2) | (g >> 4)), uint8_t((b << 3) | (b >> 2)), 255 };
+}
+
+// Encodes a 4x4 block's colors as BC1: two RGB565 endpoints on the block's bounding box diagonal,
+// and a 2-bit index per texel into the 4 colors interpolated between them.
+void encodeColorBlock(const Rgba block[16], std::vector<uint8_t>& output) {
+	int minColor[3] = { 255, 255, 255 }, maxColor[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; i++) {
+		const uint8_t channels[3] = { block[i].r, block[i].g, block[i].b };
+		for (int c = 0; c < 3; c++) {
+			minColor[c] = std::min(minColor[c], int(channels[c]));
+			maxColor[c] = std::max(maxColor[c], int(channels[c]));
+		}
+	}
+	// Pull the endpoints in slightly, so the interpolated colors land closer to the texels.
+	for (int c = 0; c < 3; c++) {
+		int inset = (maxColor[c] - minColor[c]) / 16;
+		minColor[c] += inset;
+		maxColor[c] -= inset;
+	}
+
+	uint16_t color0 = toRgb565(maxColor[0], maxColor[1], maxColor[2]);
+	uint16_t color1 = toRgb565(minColor[0], minColor[1], minColor[2]);
+	// color0 > color1 selects the opaque 4-color mode.
+	if (color0 < color1) {
+		std::swap(color0, color1);
+	}
+
+	uint32_t indices = 0;
+	if (color0 != color1) {
+		Rgba c0 = fromRgb565(color0), c1 = fromRgb565(color1);
+		Rgba palette[4] = {
+			c0, c1,
+			{ uint8_t((2 * c0.r + c1.r) / 3), uint8_t((2 * c0.g + c1.g) / 3), uint8_t((2 * c0.b + c1.b) / 3), 255 },
+			{ uint8_t((c0.r + 2 * c1.r) / 3), uint8_t((c0.g + 2 * c1.g) / 3), uint8_t((c0.b + 2 * c1.b) / 3), 255 },
+		};
+		for (int i = 0; i < 16; i++) {
+			int best = 0, bestDistance = INT32_MAX;
+			for (int p = 0; p < 4; p++) {
+				int dr = block[i].r - palette[p].r, dg = block[i].g - palette[p].g, db = block[i].b - palette[p].b;
+				int distance = dr * dr + dg * dg + db * db;
+				if (distance < bestDistance) {
+					best = p;
+					bestDistance = distance;
+				}
+			}
+			indices |= uint32_t(best) << (2 * i);
+		}
+	}
+
+	output.push_back(uint8_t(color0));
+	output.push_back(uint8_t(color0 >> 8));
+	output.push_back(uint8_t(color1));
+	output.push_back(uint8_t(color1 >> 8));
+	for (int i = 0; i < 4; i++) {
+		output.push_back(uint8_t(indices >> (8 * i)));
+	}
+}
+
+// Encodes a 4x4 block's alpha as the first half of a BC3 block: two 8-bit endpoints, and a
+// 3-bit index per texel into the 8 values interpolated between them.
+void encodeAlphaBlock(const Rgba block[16], std::vector<uint8_t>& output) {
+	int alpha0 = 0, alpha1 = 255;
+	for (int i = 0; i < 16; i++) {
+		alpha0 = std::max(alpha0, int(block[i].a));
+		alpha1 = std::min(alpha1, int(block[i].a));
+	}
+
+	uint64_t indices = 0;
+	if (alpha0 != alpha1) {
+		int palette[8] = { alpha0, alpha1 };
+		for (int p = 1; p < 7; p++) {
+			palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+		}
+		for (int i = 0; i < 16; i++) {
+			int best = 0;
+			for (int p = 1; p < 8; p++) {
+				if (std::abs(block[i].a - palette[p]) < std::abs(block[i].a - palette[best])) {
+					best = p;
+				}
+			}
+			indices |= uint64_t(best) << (3 * i);
+		}
+	}
+
+	output.push_back(uint8_t(alpha0));
+	output.push_back(uint8_t(alpha1));
+	for (int i = 0; i < 6; i++) {
+		output.push_back(uint8_t(indices >> (8 * i)));
+	}
+}
+
+std::vector<uint8_t> compressLevel(const MipLevel& level, bool withAlpha) {
+	std::vector<uint8_t> output;
+	for (int blockY = 0; blockY < level.height; blockY += 4) {
+		for (int blockX = 0; blockX < level.width; blockX += 4) {
+			// Blocks that hang off the edge of the image repeat its last row and column.
+			Rgba block[16];
+			for (int y = 0; y < 4; y++) {
+				for (int x = 0; x < 4; x++) {
+					int sourceX = std::min(blockX + x, level.width - 1), sourceY = std::min(blockY + y, level.height - 1);
+					block[y * 4 + x] = level.pixels[sourceY * level.width + sourceX];
+				}
+			}
+			if (withAlpha) {
+				encodeAlphaBlock(block, output);
+			}
+			encodeColorBlock(block, output);
+		}
+	}
+	return output;
+}
+
+void writeUint32(std::ofstream& file, uint32_t value) {
+	file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void writeDds(const std::filesystem::path& path, const std::vector<MipLevel>& levels,
+	const std::vector<std::vector<uint8_t>>& data, bool withAlpha) {
+	const uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000,
+		DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+	const uint32_t DDPF_FOURCC = 0x4;
+	const uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+	file.write("DDS ", 4);
+	writeUint32(file, 124);
+	writeUint32(file, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE);
+	writeUint32(file, levels[0].height);
+	writeUint32(file, levels[0].width);
+	writeUint32(file, static_cast<uint32_t>(data[0].size()));
+	writeUint32(file, 0);
+	writeUint32(file, static_cast<uint32_t>(levels.size()));
+	for (int i = 0; i < 11; i++) {
+		writeUint32(file, 0);
+	}
+	// The pixel format: just a FourCC code.
+	writeUint32(file, 32);
+	writeUint32(file, DDPF_FOURCC);
+	file.write(withAlpha ? "DXT5" : "DXT1", 4);
+	for (int i = 0; i < 5; i++) {
+		writeUint32(file, 0);
+	}
+	writeUint32(file, DDSCAPS_COMPLEX | DDSCAPS_TEXTURE | DDSCAPS_MIPMAP);
+	for (int i = 0; i < 4; i++) {
+		writeUint32(file, 0);
+	}
+	for (auto& level : data) {
+		file.write(reinterpret_cast<const char*>(level.data()), level.size());
+	}
+}
+
+int main(int argc, char* argv[]) {
+	enum class Format { Automatic, Bc1, Bc3 } format = Format::Automatic;
+	std::filesystem::path outputDirectory;
+	std::vector<std::string> inputs;
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		if (argument == "--bc1") {
+			format = Format::Bc1;
+		}
+		else if (argument == "--bc3") {
+			format = Format::Bc3;
+		}
+		else if (argument == "-o" && i + 1 < argc) {
+			outputDirectory = argv[++i];
+		}
+		else {
+			inputs.push_back(argument);
+		}
+	}
+	if (inputs.empty()) {
+		std::cout << "Usage: texcompress [--bc1 | --bc3] [-o <output directory>] <image>..." << std::endl;
+		return 1;
+	}
+
+	for (auto& input : inputs) {
+		try {
+			StbImage image;
+			image.loadFromFile(input);
+
+			std::vector<MipLevel> levels(1);
+			levels[0] = { image.getWidth(), image.getHeight() };
+			levels[0].pixels.resize(image.getWidth() * image.getHeight());
+			std::memcpy(levels[0].pixels.data(), image.getData(), levels[0].pixels.size() * sizeof(Rgba));
+			while (levels.back().width > 1 || levels.back().height > 1) {
+				levels.push_back(downsample(levels.back()));
+			}
+
+			bool withAlpha = format == Format::Bc3;
+			if (format == Format::Automatic) {
+				withAlpha = std::any_of(levels[0].pixels.begin(), levels[0].pixels.end(),
+					[](const Rgba& pixel) { return pixel.a < 255; });
+			}
+
+			std::vector<std::vector<uint8_t>> data;
+			for (auto& level : levels) {
+				data.push_back(compressLevel(level, withAlpha));
+			}
+
+			auto output = std::filesystem::path(input).replace_extension(".dds");
+			if (!outputDirectory.empty()) {
+				output = outputDirectory / output.filename();
+			}
+			writeDds(output, levels, data, withAlpha);
+			std::cout << input << " -> " << output.string() << " (" << (withAlpha ? "BC3" : "BC1") << ", "
+				<< levels.size() << " mipmap levels)" << std::endl;
+		}
+		catch (std::exception& e) {
+			std::cout << "ERROR: " << input << ": " << e.what() << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}